@@ -181,6 +181,7 @@ unit_tests=(
 	"cq_test"
 	"mr_test"
 	"cntr_test"
+	"sep_test"
 )
 
 complex_tests=(
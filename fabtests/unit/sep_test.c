@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sched.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_cm.h>
+
+#include "unit_common.h"
+#include "shared.h"
+
+
+static char err_buf[512];
+#define MAX_SEP_CTX	4
+#define SEP_MSG_SIZE	64
+#define SEP_TIMEOUT_MS	5000
+#define MAX_ADDR	256
+
+static size_t ctx_cnt;
+static struct fid_ep *sep;
+static struct fid_ep *sep_tx[MAX_SEP_CTX], *sep_rx[MAX_SEP_CTX];
+static struct fid_cq *sep_txcq[MAX_SEP_CTX], *sep_rxcq[MAX_SEP_CTX];
+
+/*
+ * Tests:
+ * - open and close of a scalable endpoint and its contexts
+ * - messages from every tx context reach the scalable endpoint's own
+ *   address through its rx contexts
+ */
+
+static int sep_close_ctx(void)
+{
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < ctx_cnt; i++) {
+		FT_CLOSE_FID(sep_tx[i]);
+		FT_CLOSE_FID(sep_rx[i]);
+		FT_CLOSE_FID(sep_txcq[i]);
+		FT_CLOSE_FID(sep_rxcq[i]);
+	}
+	if (sep) {
+		ret = fi_close(&sep->fid);
+		sep = NULL;
+	}
+	return ret;
+}
+
+static int sep_open_ctx(void)
+{
+	struct fi_cq_attr cq_attr = {
+		.format = FI_CQ_FORMAT_CONTEXT,
+		.wait_obj = FI_WAIT_NONE,
+	};
+	size_t i;
+	int ret;
+
+	ret = fi_scalable_ep(domain, fi, &sep, NULL);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_scalable_ep failed", ret);
+		return ret;
+	}
+
+	for (i = 0; i < ctx_cnt; i++) {
+		ret = fi_tx_context(sep, (int) i, NULL, &sep_tx[i], NULL);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_tx_context failed", ret);
+			return ret;
+		}
+
+		ret = fi_rx_context(sep, (int) i, NULL, &sep_rx[i], NULL);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_rx_context failed", ret);
+			return ret;
+		}
+
+		ret = fi_cq_open(domain, &cq_attr, &sep_txcq[i], NULL);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_cq_open failed", ret);
+			return ret;
+		}
+
+		ret = fi_cq_open(domain, &cq_attr, &sep_rxcq[i], NULL);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_cq_open failed", ret);
+			return ret;
+		}
+
+		ret = fi_ep_bind(sep_tx[i], &sep_txcq[i]->fid, FI_SEND);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_ep_bind tx cq failed", ret);
+			return ret;
+		}
+
+		ret = fi_ep_bind(sep_rx[i], &sep_rxcq[i]->fid, FI_RECV);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_ep_bind rx cq failed", ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int sep_open_close(void)
+{
+	struct fid_ep *ctx;
+	int ret, testret = FAIL;
+
+	ret = sep_open_ctx();
+	if (ret)
+		goto out;
+
+	ret = fi_tx_context(sep, (int) ctx_cnt, NULL, &ctx, NULL);
+	if (!ret) {
+		sprintf(err_buf, "opened tx context %zu of %zu", ctx_cnt,
+			ctx_cnt);
+		fi_close(&ctx->fid);
+		goto out;
+	}
+
+	ret = fi_close(&sep->fid);
+	if (ret != -FI_EBUSY) {
+		FT_UNIT_STRERR(err_buf, "closing sep with open contexts", ret);
+		if (!ret)
+			sep = NULL;
+		goto out;
+	}
+	testret = PASS;
+out:
+	ret = sep_close_ctx();
+	if (ret && testret == PASS) {
+		FT_UNIT_STRERR(err_buf, "fi_close sep failed", ret);
+		testret = FAIL;
+	}
+	return TEST_RET_VAL(ret, testret);
+}
+
+static ssize_t sep_cq_read(struct fid_cq *cq, struct fi_cq_entry *entry)
+{
+	struct fi_cq_err_entry err_entry;
+	ssize_t ret;
+
+	ret = fi_cq_read(cq, entry, 1);
+	if (ret == -FI_EAVAIL) {
+		memset(&err_entry, 0, sizeof(err_entry));
+		(void) fi_cq_readerr(cq, &err_entry, 0);
+		ret = -err_entry.err;
+	}
+	if (ret < 0 && ret != -FI_EAGAIN)
+		FT_UNIT_STRERR(err_buf, "fi_cq_read failed", ret);
+	return ret;
+}
+
+/* reaps send completions and counts received messages by sender */
+static int sep_poll(size_t *recv_cnt, int *seen)
+{
+	struct fi_cq_entry entry;
+	unsigned char sender;
+	size_t i;
+	ssize_t ret;
+
+	for (i = 0; i < ctx_cnt; i++) {
+		ret = sep_cq_read(sep_txcq[i], &entry);
+		if (ret < 0 && ret != -FI_EAGAIN)
+			return (int) ret;
+
+		ret = sep_cq_read(sep_rxcq[i], &entry);
+		if (ret < 0 && ret != -FI_EAGAIN)
+			return (int) ret;
+		if (ret != 1)
+			continue;
+
+		sender = *(unsigned char *) entry.op_context;
+		if (sender >= ctx_cnt) {
+			sprintf(err_buf, "unexpected message from %u", sender);
+			return -FI_EOTHER;
+		}
+		seen[sender]++;
+		(*recv_cnt)++;
+	}
+	return 0;
+}
+
+static uint64_t sep_time_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int sep_loopback(void)
+{
+	struct fi_av_attr av_attr = {
+		.type = fi->domain_attr->av_type,
+		.count = 1,
+	};
+	static char rx_buf[MAX_SEP_CTX][MAX_SEP_CTX][SEP_MSG_SIZE];
+	static char tx_buf[MAX_SEP_CTX][SEP_MSG_SIZE];
+	char addr[MAX_ADDR];
+	int seen[MAX_SEP_CTX] = { 0 };
+	size_t addrlen = sizeof(addr), recv_cnt = 0, i, j;
+	struct fid_av *sep_av = NULL;
+	fi_addr_t self;
+	uint64_t start;
+	int ret, testret = FAIL;
+
+	ret = sep_open_ctx();
+	if (ret)
+		goto out;
+
+	ret = fi_av_open(domain, &av_attr, &sep_av, NULL);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_av_open failed", ret);
+		goto out;
+	}
+
+	ret = fi_scalable_ep_bind(sep, &sep_av->fid, 0);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_scalable_ep_bind failed", ret);
+		goto out;
+	}
+
+	ret = fi_enable(sep);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_enable sep failed", ret);
+		goto out;
+	}
+
+	for (i = 0; i < ctx_cnt; i++) {
+		ret = fi_enable(sep_tx[i]);
+		if (!ret)
+			ret = fi_enable(sep_rx[i]);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_enable failed", ret);
+			goto out;
+		}
+
+		/* every rx context can take all the messages */
+		for (j = 0; j < ctx_cnt; j++) {
+			ret = fi_recv(sep_rx[i], rx_buf[i][j], SEP_MSG_SIZE,
+				      NULL, FI_ADDR_UNSPEC, rx_buf[i][j]);
+			if (ret) {
+				FT_UNIT_STRERR(err_buf, "fi_recv failed", ret);
+				goto out;
+			}
+		}
+	}
+
+	ret = fi_getname(&sep->fid, addr, &addrlen);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_getname failed", ret);
+		goto out;
+	}
+
+	ret = fi_av_insert(sep_av, addr, 1, &self, 0, NULL);
+	if (ret != 1) {
+		FT_UNIT_STRERR(err_buf, "fi_av_insert failed", ret);
+		goto out;
+	}
+
+	for (i = 0; i < ctx_cnt; i++) {
+		tx_buf[i][0] = (char) i;
+		do {
+			ret = fi_send(sep_tx[i], tx_buf[i], SEP_MSG_SIZE,
+				      NULL, self, tx_buf[i]);
+			if (ret == -FI_EAGAIN)
+				(void) fi_cq_read(sep_txcq[i], NULL, 0);
+		} while (ret == -FI_EAGAIN);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_send failed", ret);
+			goto out;
+		}
+	}
+
+	start = sep_time_ms();
+	while (recv_cnt < ctx_cnt) {
+		ret = sep_poll(&recv_cnt, seen);
+		if (ret)
+			goto out;
+		if (sep_time_ms() - start > SEP_TIMEOUT_MS) {
+			sprintf(err_buf, "received %zu of %zu messages",
+				recv_cnt, ctx_cnt);
+			goto out;
+		}
+		sched_yield();
+	}
+
+	/* each message carries the index of the tx context sending it */
+	for (i = 0; i < ctx_cnt; i++) {
+		if (seen[i] != 1) {
+			sprintf(err_buf, "%d messages from tx context %zu",
+				seen[i], i);
+			goto out;
+		}
+	}
+	testret = PASS;
+out:
+	ret = sep_close_ctx();
+	FT_CLOSE_FID(sep_av);
+	return TEST_RET_VAL(ret, testret);
+}
+
+struct test_entry test_array[] = {
+	TEST_ENTRY(sep_open_close, "Test scalable endpoint and context open/close"),
+	TEST_ENTRY(sep_loopback, "Test sends from each tx context to the sep"),
+	{ NULL, "" }
+};
+
+static void usage(void)
+{
+	ft_unit_usage("sep_test", "Unit test for scalable endpoints");
+}
+
+int main(int argc, char **argv)
+{
+	struct fi_info *info, *cur;
+	int op, ret;
+	int failed = 0;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, INFO_OPTS "h")) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints);
+			break;
+		case '?':
+		case 'h':
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = 0;
+
+	ret = fi_getinfo(FT_FIVERSION, NULL, 0, 0, hints, &info);
+	if (ret) {
+		FT_PRINTERR("fi_getinfo", ret);
+		goto out;
+	}
+
+	/* contexts of connected endpoints would need a peer */
+	for (cur = info; cur; cur = cur->next) {
+		if (cur->ep_attr->type != FI_EP_MSG &&
+		    cur->domain_attr->max_ep_tx_ctx > 1 &&
+		    cur->domain_attr->max_ep_rx_ctx > 1)
+			break;
+	}
+	if (cur)
+		fi = fi_dupinfo(cur);
+	fi_freeinfo(info);
+	if (!cur) {
+		printf("No scalable endpoint support\n");
+		goto out;
+	}
+	if (!fi) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	ctx_cnt = MIN(MAX_SEP_CTX, MIN(fi->domain_attr->max_ep_tx_ctx,
+				       fi->domain_attr->max_ep_rx_ctx));
+	fi->ep_attr->tx_ctx_cnt = ctx_cnt;
+	fi->ep_attr->rx_ctx_cnt = ctx_cnt;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		goto out;
+
+	printf("Testing scalable endpoints on fabric %s\n",
+	       fi->fabric_attr->name);
+
+	failed = run_tests(test_array, err_buf);
+	if (failed > 0)
+		printf("Summary: %d tests failed\n", failed);
+	else
+		printf("Summary: all tests passed\n");
+
+out:
+	ft_free_res();
+	return ret ? ft_exit_code(ret) : (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
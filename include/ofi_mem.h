@@ -41,6 +41,8 @@
 #include <string.h>
 #include <ofi_list.h>
 #include <ofi_osd.h>
+#include <ofi_lock.h>
+#include <ofi_atom.h>
 
 
 #ifdef INCLUDE_VALGRIND
@@ -259,6 +261,8 @@ static inline void name ## _free(struct name *fs)		\
  */
 
 #define UTIL_BUF_POOL_REGION_CHUNK_CNT	16
+/* regions at least this large are mapped as zero filled pages */
+#define UTIL_BUF_POOL_MMAP_MIN_SIZE	(64 * 1024)
 
 struct util_buf_pool;
 typedef int (*util_buf_region_alloc_hndlr) (void *pool_ctx, void *addr, size_t len,
@@ -277,6 +281,14 @@ struct util_buf_attr {
 	void 				*ctx;
 	uint8_t				track_used;
 	uint8_t				is_mmap_region;
+	/* regions left unused for trim_idle_ms are freed by
+	 * util_buf_pool_trim, keeping at least trim_hwm free buffers */
+	uint64_t			trim_idle_ms;
+	size_t				trim_hwm;
+	/* prepare the next region in a background thread, if enabled
+	 * by FI_BUF_POOL_BG_GROW; alloc_hndlr and free_hndlr must then
+	 * be thread safe */
+	uint8_t				bg_grow;
 	struct {
 		uint8_t			used;
 		/* if the `ordered` capability is used, the buffer
@@ -295,6 +307,23 @@ struct util_buf_pool {
 	struct util_buf_region	**regions_table;
 	size_t			regions_cnt;
 	struct util_buf_attr	attr;
+	uint64_t		trim_time;
+	size_t			peak_allocated;
+	size_t			grow_cnt;
+	size_t			trim_cnt;
+	/* unordered pools hand out the uninitialized tail of this region
+	 * once the free list is empty */
+	struct util_buf_region	*lazy_region;
+	/* protected by common_locks.util_buf_bg_lock */
+	struct util_buf_region	*spare;
+	struct dlist_entry	bg_entry;
+	uint8_t			bg_busy;
+};
+
+enum util_buf_mem_type {
+	UTIL_BUF_MEM_ALIGNED,
+	UTIL_BUF_MEM_PAGES,
+	UTIL_BUF_MEM_HUGEPAGES,
 };
 
 struct util_buf_region {
@@ -304,9 +333,22 @@ struct util_buf_region {
 	size_t size;
 	void *context;
 	struct util_buf_pool *pool;
-#ifndef NDEBUG
 	size_t num_used;
-#endif
+	size_t index;		/* slot in the pool's regions_table */
+	size_t init_cnt;	/* entries handed out at least once */
+	uint8_t mem_type;	/* anything but ALIGNED starts out zeroed */
+	uint8_t active;		/* allocated from since the last trim scan */
+	uint8_t idle;		/* unused for a full trim period */
+	uint8_t trim;
+};
+
+struct util_buf_pool_stats {
+	size_t			region_cnt;
+	size_t			buf_cnt;
+	size_t			used_cnt;
+	size_t			peak_buf_cnt;
+	size_t			grow_cnt;
+	size_t			trim_cnt;
 };
 
 struct util_buf_footer {
@@ -340,6 +382,12 @@ static inline int util_buf_pool_create(struct util_buf_pool **pool,
 }
 
 int util_buf_grow(struct util_buf_pool *pool);
+struct util_buf_footer *util_buf_region_init_next(struct util_buf_pool *pool,
+						  struct util_buf_region *buf_region);
+void *util_buf_get_lazy(struct util_buf_pool *pool);
+int util_buf_pool_trim(struct util_buf_pool *pool, uint64_t now_ms);
+void util_buf_pool_get_stats(struct util_buf_pool *pool,
+			     struct util_buf_pool_stats *stats);
 
 static inline struct util_buf_footer *
 util_buf_get_ftr(struct util_buf_pool *pool, void *buf)
@@ -359,9 +407,13 @@ static inline void *util_buf_get(struct util_buf_pool *pool)
 
 	assert(!pool->attr.indexing.ordered);
 
+	if (OFI_UNLIKELY(slist_empty(&pool->list.buffers)))
+		return util_buf_get_lazy(pool);
+
 	slist_remove_head_container(&pool->list.buffers, struct util_buf_footer,
 				    buf_ftr, entry.slist);
-	assert(++buf_ftr->region->num_used);
+	buf_ftr->region->num_used++;
+	buf_ftr->region->active = 1;
 	return util_buf_get_data(pool, buf_ftr);
 }
 
@@ -369,8 +421,9 @@ static inline void util_buf_release(struct util_buf_pool *pool, void *buf)
 {
 	assert(util_buf_get_ftr(pool, buf)->region);
 	assert(util_buf_get_ftr(pool, buf)->region->pool == pool);
-	assert(util_buf_get_ftr(pool, buf)->region->num_used--);
+	assert(util_buf_get_ftr(pool, buf)->region->num_used);
 	assert(!pool->attr.indexing.ordered);
+	util_buf_get_ftr(pool, buf)->region->num_used--;
 	slist_insert_head(&util_buf_get_ftr(pool, buf)->entry.slist, &pool->list.buffers);
 }
 
@@ -383,10 +436,17 @@ static inline void *util_buf_indexed_get(struct util_buf_pool *pool)
 
 	buf_region = container_of(pool->list.regions.next,
 				  struct util_buf_region, entry);
-	dlist_pop_front(&buf_region->buf_list, struct util_buf_footer,
-			buf_ftr, entry.dlist);
-	assert(++buf_ftr->region->num_used);
-	if (dlist_empty(&buf_region->buf_list))
+	/* released entries all have lower indices than untouched ones */
+	if (!dlist_empty(&buf_region->buf_list)) {
+		dlist_pop_front(&buf_region->buf_list, struct util_buf_footer,
+				buf_ftr, entry.dlist);
+	} else {
+		buf_ftr = util_buf_region_init_next(pool, buf_region);
+	}
+	buf_region->num_used++;
+	buf_region->active = 1;
+	if (dlist_empty(&buf_region->buf_list) &&
+	    buf_region->init_cnt == pool->attr.chunk_cnt)
 		dlist_remove_init(&buf_region->entry);
 	return util_buf_get_data(pool, buf_ftr);
 }
@@ -402,7 +462,8 @@ static inline void util_buf_indexed_release(struct util_buf_pool *pool, void *bu
 
 	buf_ftr = util_buf_get_ftr(pool, buf);
 
-	assert(buf_ftr->region->num_used--);
+	assert(buf_ftr->region->num_used);
+	buf_ftr->region->num_used--;
 
 	dlist_insert_order(&buf_ftr->region->buf_list,
 			   util_buf_is_lower, &buf_ftr->entry.dlist);
@@ -438,7 +499,7 @@ static inline void *util_buf_get_ctx(struct util_buf_pool *pool, void *buf)
 
 static inline int util_buf_avail(struct util_buf_pool *pool)
 {
-	return !slist_empty(&pool->list.buffers);
+	return !slist_empty(&pool->list.buffers) || pool->lazy_region;
 }
 
 static inline int util_buf_indexed_avail(struct util_buf_pool *pool)
@@ -480,6 +541,7 @@ UTIL_BUF_DEFINE_GETTERS(_);
 UTIL_BUF_DEFINE_GETTERS(_indexed_);
 
 void util_buf_pool_destroy(struct util_buf_pool *pool);
+void util_buf_bg_cleanup(void);
 
 
 /*
@@ -44,6 +44,7 @@
 #include <ofi_atom.h>
 #include <ofi_lock.h>
 #include <ofi_list.h>
+#include <ofi_indexer.h>
 #include <rbtree.h>
 
 
@@ -105,6 +106,10 @@ struct ofi_mem_monitor {
 			 struct ofi_subscription *subscription);
 	void (*unsubscribe)(struct ofi_mem_monitor *notifier,
 			    struct ofi_subscription *subscription);
+	/* optional, called when the first queue is added and after the
+	 * last one is removed */
+	int (*start)(struct ofi_mem_monitor *notifier);
+	void (*stop)(struct ofi_mem_monitor *notifier);
 };
 
 struct ofi_notification_queue {
@@ -118,12 +123,14 @@ struct ofi_subscription {
 	struct ofi_notification_queue	*nq;
 	struct dlist_entry		entry;
 	struct iovec			iov;
+	/* used by the monitor to track the subscription */
+	struct dlist_entry		monitor_entry;
 };
 
 void ofi_monitor_init(struct ofi_mem_monitor *monitor);
 void ofi_monitor_cleanup(struct ofi_mem_monitor *monitor);
-void ofi_monitor_add_queue(struct ofi_mem_monitor *monitor,
-			   struct ofi_notification_queue *nq);
+int ofi_monitor_add_queue(struct ofi_mem_monitor *monitor,
+			  struct ofi_notification_queue *nq);
 void ofi_monitor_del_queue(struct ofi_notification_queue *nq);
 
 int ofi_monitor_subscribe(struct ofi_notification_queue *nq,
@@ -145,13 +152,63 @@ ofi_monitor_add_event_to_nq(struct ofi_subscription *subscription)
 	fastlock_release(&subscription->nq->lock);
 }
 
+/*
+ * Range monitors keep the subscribed ranges, rounded out to whole pages,
+ * in a tree of disjoint nodes.  When memory is unmapped or its pages are
+ * released, ofi_monitor_notify queues an event for every subscription
+ * whose node overlaps the affected range.
+ */
+struct ofi_range_monitor {
+	struct ofi_mem_monitor		monitor;
+	pthread_mutex_t			lock;
+	RbtHandle			ranges;
+	/* optional, called under lock before a range is tracked and
+	 * after it is dropped */
+	int (*add_range)(struct ofi_range_monitor *monitor,
+			 void *addr, size_t len);
+	void (*del_range)(struct ofi_range_monitor *monitor,
+			  void *addr, size_t len);
+};
+
+int ofi_range_monitor_init(struct ofi_range_monitor *monitor);
+void ofi_range_monitor_cleanup(struct ofi_range_monitor *monitor);
+void ofi_monitor_notify(struct ofi_range_monitor *monitor,
+			const void *addr, size_t len);
+
+/*
+ * Process wide monitors, usable by any MR cache.  memhooks intercepts
+ * munmap, mremap and madvise; uffd gets the same events from the kernel
+ * through userfaultfd.  Either is NULL if not supported on this system.
+ * memhooks is only set up when FI_MR_CACHE_MONITOR requests it, since it
+ * modifies libc.  default_monitor is the one selected, userfaultfd unless
+ * set otherwise.
+ */
+extern struct ofi_mem_monitor *memhooks_monitor;
+extern struct ofi_mem_monitor *uffd_monitor;
+extern struct ofi_mem_monitor *default_monitor;
+
+void ofi_monitors_init(void);
+void ofi_monitors_cleanup(void);
+void ofi_memhooks_init(void);
+void ofi_memhooks_cleanup(void);
+
 /*
  * MR map
  */
 
+/*
+ * Provider keys hold an indexer slot in their low bits, so they are
+ * found without a search.  The upper bits come from a counter, so stale
+ * keys don't match a later registration in the same slot.  Requested
+ * keys, and provider keys allocated once the indexer is full (slot 0),
+ * are kept in the RB tree.
+ */
+#define OFI_MR_MAP_INDEX_MASK	((uint64_t) OFI_IDX_MAX_INDEX)
+
 struct ofi_mr_map {
 	const struct fi_provider *prov;
 	void			*rbtree;
+	struct indexer		key_idx;
 	uint64_t		key;
 	enum fi_mr_mode		mode;
 };
@@ -170,9 +227,11 @@ int ofi_mr_map_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
 		      size_t len, uint64_t key, uint64_t access,
 		      void **context);
 
+/* entry is set if the registration is served by the domain's cache */
 struct ofi_mr {
 	struct fid_mr mr_fid;
 	struct util_domain *domain;
+	struct ofi_mr_entry *entry;
 	uint64_t key;
 	uint64_t flags;
 };
@@ -189,6 +248,8 @@ int ofi_mr_reg(struct fid *fid, const void *buf, size_t len,
 	       uint64_t flags, struct fid_mr **mr_fid, void *context);
 int ofi_mr_verify(struct ofi_mr_map *map, ssize_t len,
 		  uintptr_t *addr, uint64_t key, uint64_t access);
+int ofi_mr_domain_cache_init(struct util_domain *domain);
+void ofi_mr_domain_cache_cleanup(struct util_domain *domain);
 
 /*
  * Memory registration cache
@@ -196,9 +257,16 @@ int ofi_mr_verify(struct ofi_mr_map *map, ssize_t len,
 
 struct ofi_mr_entry {
 	struct iovec			iov;
-	unsigned int			cached:1;
-	unsigned int			subscribed:1;
-	int				use_cnt;
+	/* cached is changed under the cache lock, but read by lockless
+	 * searches.  referenced is set by hits and cleared by the clock
+	 * hand, so it must not share a word with the other flags. */
+	uint8_t				cached;
+	uint8_t				subscribed;
+	volatile uint8_t		referenced;
+	/* one reference per user, plus one held by the cache while the
+	 * entry is cached */
+	ofi_atomic32_t			use_cnt;
+	uint64_t			access;
 	struct dlist_entry		lru_entry;
 	struct ofi_subscription		subscription;
 	uint8_t				data[];
@@ -218,6 +286,7 @@ typedef int (*ofi_mr_erase_t)(struct ofi_mr_storage *storage,
 enum ofi_mr_storage_type {
 	OFI_MR_STORAGE_DEFAULT = 0,
 	OFI_MR_STORAGE_RBT,
+	OFI_MR_STORAGE_INTERVAL,
 	OFI_MR_STORAGE_USER,
 };
 
@@ -228,24 +297,57 @@ struct ofi_mr_storage {
 	ofi_mr_find_t find;
 	ofi_mr_insert_t insert;
 	ofi_mr_erase_t erase;
+	/* find may run concurrently with insert and erase, provided
+	 * that the result is validated by the caller */
+	int lockless_find;
+};
+
+struct ofi_mr_cache_stats {
+	size_t				search_cnt;
+	size_t				hit_cnt;
+	size_t				miss_cnt;
+	size_t				delete_cnt;
+	/* entries dropped to make room, or invalidated by the monitor */
+	size_t				evict_cnt;
+	size_t				invalidate_cnt;
+	size_t				cached_cnt;
+	size_t				cached_size;
 };
 
+/*
+ * Hits are served without taking the cache lock when the storage
+ * supports lockless finds.  Searches read the storage between two
+ * samples of seq, which writers make odd while they change it, and
+ * then take a reference on the entry found.  Entries are only freed
+ * back to their pool, so a stale entry is still readable and is
+ * rejected by checking it after the reference is taken.
+ *
+ * The LRU list is a clock: cached entries stay on it while in use,
+ * hits set entry->referenced, and eviction gives referenced entries a
+ * second pass.
+ */
 struct ofi_mr_cache {
 	struct util_domain		*domain;
 	struct ofi_notification_queue	nq;
 	size_t				max_cached_cnt;
 	size_t				max_cached_size;
 	int				merge_regions;
+	/* hits must have the access of the entry; not with merging */
+	int				match_access;
 	size_t				entry_data_size;
 
+	fastlock_t			lock;
+	ofi_atomic32_t			seq;
 	struct ofi_mr_storage		mr_storage;
 	struct dlist_entry		lru_list;
 
 	size_t				cached_cnt;
 	size_t				cached_size;
-	size_t				search_cnt;
-	size_t				delete_cnt;
-	size_t				hit_cnt;
+	ofi_atomic64_t			hit_cnt;
+	ofi_atomic64_t			delete_cnt;
+	size_t				miss_cnt;
+	size_t				evict_cnt;
+	size_t				invalidate_cnt;
 	struct util_buf_pool		*entry_pool;
 
 	int				(*add_region)(struct ofi_mr_cache *cache,
@@ -258,11 +360,13 @@ int ofi_mr_cache_init(struct util_domain *domain, struct ofi_mem_monitor *monito
 		      struct ofi_mr_cache *cache);
 void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache);
 
-/* Caller must provide locking around calls */
+/* The cache serializes calls internally */
 bool ofi_mr_cache_flush(struct ofi_mr_cache *cache);
 int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 			struct ofi_mr_entry **entry);
 void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry);
+void ofi_mr_cache_get_stats(struct ofi_mr_cache *cache,
+			    struct ofi_mr_cache_stats *stats);
 
 
 #endif /* _OFI_MR_H_ */
@@ -119,6 +119,8 @@ enum {
 struct ofi_common_locks {
 	pthread_mutex_t ini_lock;
 	pthread_mutex_t util_fabric_lock;
+	pthread_mutex_t util_buf_bg_lock;
+	pthread_mutex_t monitor_lock;
 };
 
 /*
@@ -176,6 +178,7 @@ struct util_domain {
 	uint32_t		addr_format;
 	enum fi_av_type		av_type;
 	struct ofi_mr_map	mr_map;
+	struct ofi_mr_cache	*mr_cache;
 	enum fi_threading	threading;
 	enum fi_progress	data_progress;
 };
@@ -405,6 +408,8 @@ int ofi_wait_fd_del(struct util_wait *wait, int fd);
  */
 
 typedef void (*fi_cq_read_func)(void **dst, void *src);
+typedef void (*fi_cq_read_bulk_func)(void **dst,
+				     struct fi_cq_tagged_entry *src, size_t cnt);
 
 struct util_cq_oflow_err_entry {
 	struct fi_cq_tagged_entry	*parent_comp;
@@ -433,9 +438,14 @@ struct util_cq {
 
 	struct slist		oflow_err_list;
 	fi_cq_read_func		read_entry;
+	fi_cq_read_bulk_func	read_entries;
 	int			internal_wait;
 	ofi_atomic32_t		signaled;
 	ofi_cq_progress_func	progress;
+
+	/* See ofi_cq_enable_spsc() */
+	int			spsc;
+	ofi_atomic32_t		oflow_cnt;
 };
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
@@ -459,6 +469,7 @@ int ofi_cq_signal(struct fid_cq *cq_fid);
 
 int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 			  void *buf, uint64_t data, uint64_t tag, fi_addr_t src);
+int ofi_cq_enable_spsc(struct util_cq *cq);
 
 static inline void util_cq_signal(struct util_cq *cq)
 {
@@ -477,14 +488,42 @@ ofi_cq_write_comp_entry(struct util_cq *cq, void *context, uint64_t flags,
 	comp->buf = buf;
 	comp->data = data;
 	comp->tag = tag;
+#ifdef ofi_atomic_release_fence
+	if (cq->spsc) {
+		/* publish the entry to the lockless reader */
+		ofi_atomic_release_fence();
+		*(volatile size_t *) &cq->cirq->wcnt = cq->cirq->wcnt + 1;
+		return;
+	}
+#endif
 	ofi_cirque_commit(cq->cirq);
 }
 
+/*
+ * In SPSC mode, the reader frees entries concurrently, and completions
+ * must stay behind those queued on oflow_err_list.
+ */
+static inline int ofi_cq_isfull(struct util_cq *cq)
+{
+#ifdef ofi_atomic_acquire_fence
+	size_t rcnt;
+
+	if (cq->spsc) {
+		if (ofi_atomic_get32(&cq->oflow_cnt))
+			return 1;
+		rcnt = *(volatile size_t *) &cq->cirq->rcnt;
+		ofi_atomic_acquire_fence();
+		return cq->cirq->wcnt - rcnt >= cq->cirq->size;
+	}
+#endif
+	return ofi_cirque_isfull(cq->cirq);
+}
+
 static inline int
 ofi_cq_write_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags,
 			   size_t len, void *buf, uint64_t data, uint64_t tag)
 {
-	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
+	if (OFI_UNLIKELY(ofi_cq_isfull(cq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
 		return ofi_cq_write_overflow(cq, context, flags, len,
@@ -509,7 +548,7 @@ static inline int
 ofi_cq_write_src_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 			       void *buf, uint64_t data, uint64_t tag, fi_addr_t src)
 {
-	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
+	if (OFI_UNLIKELY(ofi_cq_isfull(cq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
 		return ofi_cq_write_overflow(cq, context, flags, len,
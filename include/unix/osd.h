@@ -42,6 +42,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 
 #ifdef HAVE_GLIBC_MALLOC_HOOKS
 # include <malloc.h>
@@ -217,6 +218,23 @@ static inline int ofi_sysconf(int name)
 	return sysconf(name);
 }
 
+/* anonymous pages are zero filled by the kernel on first touch */
+static inline int ofi_alloc_page_buf(void **memptr, size_t size)
+{
+	*memptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (*memptr == MAP_FAILED)
+		return -errno;
+
+	return 0;
+}
+
+static inline int ofi_free_page_buf(void *memptr, size_t size)
+{
+	return munmap(memptr, size) ? -errno : 0;
+}
+
 /* OSX has no such definition. So, add it manually */
 #ifndef s6_addr32
 #define s6_addr32 __u6_addr.__u6_addr32
@@ -280,6 +298,9 @@ OFI_DEF_COMPLEX_OPS(long_double)
 #ifdef HAVE_BUILTIN_ATOMICS
 #define ofi_atomic_add_and_fetch(radix, ptr, val) __sync_add_and_fetch((ptr), (val))
 #define ofi_atomic_sub_and_fetch(radix, ptr, val) __sync_sub_and_fetch((ptr), (val))
+#define ofi_atomic_cas_bool(radix, ptr, expected, desired)	\
+	__sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define ofi_atomic_mb() __sync_synchronize()
 #endif /* HAVE_BUILTIN_ATOMICS */
 
 int ofi_set_thread_affinity(const char *s);
@@ -314,6 +335,8 @@ ofi_cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 
 #endif /* defined(__x86_64__) || defined(__amd64__) */
 
+#define ofi_prefetch(addr) __builtin_prefetch(addr)
+
 typedef void (*ofi_mem_free_hook)(void *, const void *);
 typedef void *(*ofi_mem_realloc_hook)(void *, size_t, const void *);
 
@@ -838,6 +838,19 @@ static inline int ofi_sysconf(int name)
 
 int ofi_shm_unmap(struct util_shm *shm);
 
+static inline int ofi_alloc_page_buf(void **memptr, size_t size)
+{
+	*memptr = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+			       PAGE_READWRITE);
+	return *memptr ? 0 : -FI_ENOMEM;
+}
+
+static inline int ofi_free_page_buf(void *memptr, size_t size)
+{
+	OFI_UNUSED(size);
+	return VirtualFree(memptr, 0, MEM_RELEASE) ? 0 : -FI_EINVAL;
+}
+
 static inline ssize_t ofi_get_hugepage_size(void)
 {
 	return -FI_ENOSYS;
@@ -938,11 +951,17 @@ OFI_DEF_COMPLEX(long_double)
 /* atomics primitives */
 #ifdef HAVE_BUILTIN_ATOMICS
 #define InterlockedAdd32 InterlockedAdd
+#define InterlockedCompareExchange32 InterlockedCompareExchange
 typedef LONG ofi_atomic_int_32_t;
 typedef LONGLONG ofi_atomic_int_64_t;
 
 #define ofi_atomic_add_and_fetch(radix, ptr, val) InterlockedAdd##radix((ofi_atomic_int_##radix##_t *)(ptr), (ofi_atomic_int_##radix##_t)(val))
 #define ofi_atomic_sub_and_fetch(radix, ptr, val) InterlockedAdd##radix((ofi_atomic_int_##radix##_t *)(ptr), -(ofi_atomic_int_##radix##_t)(val))
+#define ofi_atomic_cas_bool(radix, ptr, expected, desired)					\
+	(InterlockedCompareExchange##radix((ofi_atomic_int_##radix##_t *)(ptr),		\
+		(ofi_atomic_int_##radix##_t)(desired),					\
+		(ofi_atomic_int_##radix##_t)(expected)) == (ofi_atomic_int_##radix##_t)(expected))
+#define ofi_atomic_mb() MemoryBarrier()
 #endif /* HAVE_BUILTIN_ATOMICS */
 
 static inline int ofi_set_thread_affinity(const char *s)
@@ -966,6 +985,7 @@ ofi_cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define ofi_clflushopt(addr) do { _mm_clflush(addr); _mm_sfence(); } while (0)
 #define ofi_clflush(addr) _mm_clflush(addr)
 #define ofi_sfence() _mm_sfence()
+#define ofi_prefetch(addr) _mm_prefetch((const char *) (addr), _MM_HINT_T0)
 
 #else /* defined(_M_X64) || defined(_M_AMD64) */
 
@@ -974,6 +994,7 @@ ofi_cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define ofi_clflushopt(addr)
 #define ofi_clflush(addr)
 #define ofi_sfence()
+#define ofi_prefetch(addr)
 
 #endif /* defined(_M_X64) || defined(_M_AMD64) */
 
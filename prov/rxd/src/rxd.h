@@ -61,7 +61,7 @@
 
 #define RXD_MAJOR_VERSION 	(1)
 #define RXD_MINOR_VERSION 	(0)
-#define RXD_PROTOCOL_VERSION 	(1)
+#define RXD_PROTOCOL_VERSION 	(2)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -72,7 +72,9 @@
 #define RXD_BUF_POOL_ALIGNMENT	16
 #define RXD_TX_POOL_CHUNK_CNT	1024
 #define RXD_RX_POOL_CHUNK_CNT	1024
+#define RXD_POOL_TRIM_MS	1000
 #define RXD_MAX_PENDING		128
+#define RXD_CQ_READ_CNT		32
 #define RXD_MAX_PKT_RETRY	50
 
 #define RXD_PKT_IN_USE		(1 << 0)
@@ -92,6 +94,7 @@ struct rxd_env {
 	int retry;
 	int max_peers;
 	int max_unacked;
+	int ack_delay;
 };
 
 extern struct rxd_env rxd_env;
@@ -129,6 +132,7 @@ struct rxd_peer {
 	uint64_t rx_seq_no;
 	uint64_t last_rx_ack;
 	uint64_t last_tx_ack;
+	uint64_t ack_time;//time (us) a delayed ACK was first owed, 0 if none
 	uint16_t rx_window;//constant at MAX_UNACKED for now
 	uint16_t tx_window;//unused for now, will be used for slow start
 	int retry_cnt;
@@ -182,12 +186,15 @@ struct rxd_ep {
 	size_t tx_size;
 	size_t tx_prefix_size;
 	size_t rx_prefix_size;
+	size_t tx_iov_limit;
 	uint32_t posted_bufs;
 	size_t min_multi_recv_size;
 	int do_local_mr;
 	int next_retry;
 	int dg_cq_fd;
 	size_t pending_cnt;
+	struct rxd_pkt_entry *held_pkt;
+	int batch_tx;
 
 	struct util_buf_pool *tx_pkt_pool;
 	struct util_buf_pool *rx_pkt_pool;
@@ -280,6 +287,10 @@ struct rxd_pkt_entry {
 	struct fid_mr *mr;
 	fi_addr_t peer;
 	void *pkt;
+
+	/* payload sent in place from the user buffer, following pkt headers */
+	uint8_t iov_count;
+	struct iovec iov[RXD_IOV_LIMIT];
 };
 
 static inline int rxd_pkt_type(struct rxd_pkt_entry *pkt_entry)
@@ -292,6 +303,13 @@ static inline struct rxd_base_hdr *rxd_get_base_hdr(struct rxd_pkt_entry *pkt_en
 	return &((struct rxd_ack_pkt *) (pkt_entry->pkt))->base_hdr;
 }
 
+static inline int rxd_pkt_has_ack(struct rxd_pkt_entry *pkt_entry)
+{
+	int type = rxd_pkt_type(pkt_entry);
+
+	return type != RXD_RTS && type != RXD_CTS && type != RXD_ACK;
+}
+
 static inline uint64_t rxd_set_pkt_seq(struct rxd_peer *peer,
 				       struct rxd_pkt_entry *pkt_entry)
 {
@@ -380,6 +398,8 @@ int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 int rxd_ep_post_buf(struct rxd_ep *ep);
 void rxd_release_repost_rx(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
 void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer);
+void rxd_ep_delay_ack(struct rxd_ep *rxd_ep, fi_addr_t peer);
+void rxd_ep_flush_acks(struct rxd_ep *rxd_ep);
 struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep);
 void rxd_release_rx_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt);
 void rxd_release_tx_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt);
@@ -387,6 +407,8 @@ struct rxd_x_entry *rxd_get_tx_entry(struct rxd_ep *ep);
 struct rxd_x_entry *rxd_get_rx_entry(struct rxd_ep *ep);
 void rxd_release_rx_entry(struct rxd_ep *ep, struct rxd_x_entry *x_entry);
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+void rxd_ep_queue_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+void rxd_ep_flush_pkts(struct rxd_ep *ep);
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 			struct rxd_pkt_entry *pkt_entry);
@@ -397,6 +419,8 @@ int rxd_ep_send_op(struct rxd_ep *rxd_ep, struct rxd_x_entry *tx_entry,
 		   enum fi_datatype datatype, enum fi_op atomic_op);
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 		       struct rxd_pkt_entry *pkt_entry);
+void rxd_init_data_pkt_iov(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+			   struct rxd_pkt_entry *pkt_entry);
 void rxd_unpack_hdrs(size_t pkt_size, struct rxd_base_hdr *base_hdr,
 		     struct rxd_sar_hdr **sar_hdr, struct rxd_tag_hdr **tag_hdr,
 		     struct rxd_data_hdr **data_hdr, struct rxd_rma_hdr **rma_hdr,
@@ -68,6 +68,7 @@ static int rxd_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int time
 					fid_entry, entry) {
 			ep = container_of(fid_entry->fid, struct rxd_ep,
 					  util_ep.ep_fid.fid);
+			rxd_ep_flush_acks(ep);
 			if (ep->next_retry == -1)
 				continue;
 			ep_retry = ep_retry == -1 ? ep->next_retry :
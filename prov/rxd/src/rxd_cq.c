@@ -291,7 +291,11 @@ static void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 		return;
 	}
-	rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+
+	if (x_entry->op == RXD_WRITE)
+		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+	else
+		rxd_ep_delay_ack(ep, pkt->base_hdr.peer);
 
 	if (x_entry->cq_entry.flags & FI_READ) {
 		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
@@ -351,8 +355,8 @@ static int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 						      tx_entry->num_segs;
 	}
 	hdr->peer = ep->peers[tx_entry->peer].peer_addr;
-	rxd_ep_send_pkt(ep, tx_entry->pkt);
 	rxd_insert_unacked(ep, tx_entry->peer, tx_entry->pkt);
+	rxd_ep_queue_pkt(ep, tx_entry->pkt);
 	tx_entry->pkt = NULL;
 
 	if (tx_entry->op == RXD_READ_REQ || tx_entry->op == RXD_ATOMIC_FETCH ||
@@ -408,6 +412,9 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 			break;
 	}
 
+	if (!ep->batch_tx)
+		rxd_ep_flush_pkts(ep);
+
 	if (dlist_empty(&peer->tx_list))
 		peer->retry_cnt = 0;
 }
@@ -479,6 +486,7 @@ static void rxd_check_post_unexp(struct rxd_ep *ep, struct dlist_entry *list,
 	struct rxd_base_hdr *new_hdr = rxd_get_base_hdr(pkt_entry);
 	struct rxd_base_hdr *unexp_hdr;
 
+	rxd_remove_rx_pkt(ep, pkt_entry);
 	if (!rxd_env.retry)
 		goto insert;
 
@@ -741,7 +749,7 @@ static struct rxd_x_entry *rxd_rx_atomic_fetch(struct rxd_ep *ep,
 
 	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
 
-	rxd_ep_send_ack(ep, base_hdr->peer);
+	rxd_ep_delay_ack(ep, base_hdr->peer);
 
 	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
 
@@ -1045,10 +1053,9 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 				      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
 				      &msg, &msg_size);
 	if (!rx_entry) {
-		if (base_hdr->type == RXD_MSG || base_hdr->type == RXD_TAGGED) {
-			rxd_remove_rx_pkt(ep, pkt_entry);
+		/* queued as unexpected, or released as a duplicate of one */
+		if (base_hdr->type == RXD_MSG || base_hdr->type == RXD_TAGGED)
 			return;
-		}
 		goto release;
 	}
 
@@ -1062,6 +1069,16 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
 
+	/*
+	 * Writes and non-fetching atomics generate no response to carry the
+	 * ACK, and the initiator can't complete until it sees one.
+	 */
+	if ((base_hdr->type == RXD_WRITE || base_hdr->type == RXD_ATOMIC) &&
+	    (!sar_hdr || sar_hdr->num_segs == 1))
+		goto ack;
+
+	rxd_ep_delay_ack(ep, base_hdr->peer);
+	goto release;
 ack:
 	rxd_ep_send_ack(ep, base_hdr->peer);
 release:
@@ -1076,18 +1093,16 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
-static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
+static void rxd_process_ack(struct rxd_ep *ep, fi_addr_t peer, uint64_t seq_no)
 {
-	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
-	fi_addr_t peer = ack->base_hdr.peer;
 	struct rxd_base_hdr *hdr;
 
-	if (ep->peers[peer].last_rx_ack == ack->base_hdr.seq_no)
+	if (!ofi_before(ep->peers[peer].last_rx_ack, seq_no))
 		return;
 
 	ep->peers[peer].retry_cnt = 0;
-	ep->peers[peer].last_rx_ack = ack->base_hdr.seq_no;
+	ep->peers[peer].last_rx_ack = seq_no;
 
 	if (dlist_empty(&ep->peers[peer].unacked))
 		return;
@@ -1097,7 +1112,7 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 
 	while (&pkt_entry->d_entry != &ep->peers[peer].unacked) {
 		hdr = rxd_get_base_hdr(pkt_entry);
-		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
+		if (ofi_after_eq(hdr->seq_no, seq_no))
 			break;
 
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
@@ -1114,8 +1129,27 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 					struct rxd_pkt_entry, d_entry);
 	}
 
-	rxd_progress_tx_list(ep, &ep->peers[ack->base_hdr.peer]);
-} 
+	rxd_progress_tx_list(ep, &ep->peers[peer]);
+}
+
+static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
+{
+	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
+
+	rxd_process_ack(ep, ack->base_hdr.peer, ack->base_hdr.seq_no);
+}
+
+static void rxd_handle_piggyback_ack(struct rxd_ep *ep,
+				     struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+
+	if (pkt_entry->pkt_size < sizeof(*base_hdr) + ep->rx_prefix_size ||
+	    ep->peers[base_hdr->peer].peer_addr == FI_ADDR_UNSPEC)
+		return;
+
+	rxd_process_ack(ep, base_hdr->peer, base_hdr->ack_seq);
+}
 
 void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
@@ -1159,6 +1193,9 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	ep->posted_bufs--;
 
 	pkt_entry->pkt_size = comp->len;
+	if (rxd_pkt_has_ack(pkt_entry))
+		rxd_handle_piggyback_ack(ep, pkt_entry);
+
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
@@ -1188,16 +1225,26 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 void rxd_handle_error(struct rxd_ep *ep)
 {
 	struct fi_cq_err_entry err = {0};
+	struct fi_cq_msg_entry comp;
 	int ret;
 
 	ret = fi_cq_readerr(ep->dg_cq, &err, 0);
 	if (ret < 0) {
 		FI_WARN(&rxd_prov, FI_LOG_CQ,
 			"Error reading CQ: %s\n", fi_strerror(-ret));
-	} else {
-		FI_WARN(&rxd_prov, FI_LOG_CQ,
-			"Received %s error from core provider: %s\n",
-			err.flags & FI_SEND ? "tx" : "rx", fi_strerror(-err.err)); 
+		return;
+	}
+
+	FI_WARN(&rxd_prov, FI_LOG_CQ,
+		"Received %s error from core provider: %s\n",
+		err.flags & FI_SEND ? "tx" : "rx", fi_strerror(-err.err));
+
+	/* a failed send is released like a lost one and resent if unacked */
+	if ((err.flags & FI_SEND) && err.op_context) {
+		comp.op_context = err.op_context;
+		comp.flags = err.flags;
+		comp.len = 0;
+		rxd_handle_send_comp(ep, &comp);
 	}
 }
 
@@ -1257,6 +1304,8 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 					fid_entry, entry) {
 			ep = container_of(fid_entry->fid, struct rxd_ep,
 					  util_ep.ep_fid.fid);
+			/* nothing will piggyback on delayed ACKs while blocked */
+			rxd_ep_flush_acks(ep);
 			if (ep->next_retry == -1)
 				continue;
 			ep_retry = ep_retry == -1 ? ep->next_retry :
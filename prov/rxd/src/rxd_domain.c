@@ -147,12 +147,18 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err4;
 
+	ret = ofi_mr_domain_cache_init(&rxd_domain->util_domain);
+	if (ret)
+		goto err5;
+
 	*domain = &rxd_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &rxd_domain_fi_ops;
 	(*domain)->ops = &rxd_domain_ops;
 	(*domain)->mr = &rxd_mr_ops;
 	fi_freeinfo(dg_info);
 	return 0;
+err5:
+	ofi_mr_map_close(&rxd_domain->mr_map);
 err4:
 	if (ofi_domain_close(&rxd_domain->util_domain))
 		FI_WARN(&rxd_prov, FI_LOG_DOMAIN,
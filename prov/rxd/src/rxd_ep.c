@@ -50,6 +50,7 @@ struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep)
 
 	pkt_entry->mr = (struct fid_mr *) mr;
 	pkt_entry->flags = 0;
+	pkt_entry->iov_count = 0;
 	rxd_set_tx_pkt(ep, pkt_entry);
 
 	return pkt_entry;
@@ -318,14 +319,10 @@ uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt)
 	return start + rxd_get_timeout(retry_cnt);
 }
 
-void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
-		       struct rxd_pkt_entry *pkt_entry)
+static size_t rxd_init_data_pkt_hdr(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+				    struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
-	uint32_t seg_size;
-
-	seg_size = tx_entry->cq_entry.len - tx_entry->bytes_done;
-	seg_size = MIN(rxd_ep_domain(ep)->max_seg_sz, seg_size);
 
 	data_pkt->base_hdr.version = RXD_PROTOCOL_VERSION;
 	data_pkt->base_hdr.type = (tx_entry->cq_entry.flags &
@@ -337,17 +334,65 @@ void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 	data_pkt->ext_hdr.seg_no = tx_entry->next_seg_no++;
 	data_pkt->base_hdr.peer = ep->peers[tx_entry->peer].peer_addr;
 
+	pkt_entry->peer = tx_entry->peer;
+
+	return MIN(rxd_ep_domain(ep)->max_seg_sz,
+		   tx_entry->cq_entry.len - tx_entry->bytes_done);
+}
+
+void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+		       struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	size_t seg_size;
+
+	seg_size = rxd_init_data_pkt_hdr(ep, tx_entry, pkt_entry);
+
 	pkt_entry->pkt_size = ofi_copy_from_iov(data_pkt->msg, seg_size,
 						tx_entry->iov,
 						tx_entry->iov_count,
 						tx_entry->bytes_done);
-	pkt_entry->peer = tx_entry->peer;
 
 	tx_entry->bytes_done += pkt_entry->pkt_size;
 
 	pkt_entry->pkt_size += sizeof(*data_pkt) + ep->tx_prefix_size;
 }
 
+/*
+ * Reference the segment in the source buffer instead of copying it into the
+ * packet.  The send is not completed while any of its packets is still
+ * posted to the core provider, which may hold FI_MORE sends past the ack.
+ * Retransmissions copy the segment (see rxd_pkt_copy_iov).  Falls back to
+ * copying if the segment spans more iovs than the core provider can gather
+ * behind the header.
+ */
+void rxd_init_data_pkt_iov(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+			   struct rxd_pkt_entry *pkt_entry)
+{
+	size_t seg_size, index, offset, count;
+
+	for (index = 0, offset = tx_entry->bytes_done;
+	     index < tx_entry->iov_count &&
+	     offset >= tx_entry->iov[index].iov_len; index++)
+		offset -= tx_entry->iov[index].iov_len;
+
+	seg_size = MIN(rxd_ep_domain(ep)->max_seg_sz,
+		       tx_entry->cq_entry.len - tx_entry->bytes_done);
+
+	if (ofi_copy_iov_desc(pkt_entry->iov, NULL, &count, tx_entry->iov,
+			      NULL, tx_entry->iov_count, &index, &offset,
+			      seg_size) || count >= ep->tx_iov_limit) {
+		rxd_init_data_pkt(ep, tx_entry, pkt_entry);
+		return;
+	}
+
+	rxd_init_data_pkt_hdr(ep, tx_entry, pkt_entry);
+	pkt_entry->iov_count = (uint8_t) count;
+	tx_entry->bytes_done += seg_size;
+	pkt_entry->pkt_size = seg_size + sizeof(struct rxd_data_pkt) +
+			      ep->tx_prefix_size;
+}
+
 struct rxd_x_entry *rxd_tx_entry_init(struct rxd_ep *ep, const struct iovec *iov,
 				      size_t iov_count, const struct iovec *res_iov,
 				      size_t res_count, size_t rma_count,
@@ -439,18 +484,104 @@ void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 	ep->peers[peer].unacked_cnt++;
 }
 
+static int rxd_ep_post_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry,
+			   uint64_t flags)
+{
+	struct rxd_peer *peer;
+	struct fi_msg msg;
+	struct iovec iov[RXD_IOV_LIMIT + 1];
+	void *desc[RXD_IOV_LIMIT + 1] = { NULL };
+	int ret;
+
+	if (ep->pending_cnt >= ep->tx_size)
+		return 1;
+
+	pkt_entry->timestamp = fi_gettime_ms();
+
+	if (rxd_pkt_has_ack(pkt_entry)) {
+		peer = &ep->peers[pkt_entry->peer];
+		rxd_get_base_hdr(pkt_entry)->ack_seq = peer->rx_seq_no;
+		peer->last_tx_ack = peer->rx_seq_no;
+		peer->ack_time = 0;
+	}
+
+	iov[0].iov_base = rxd_pkt_start(pkt_entry);
+	iov[0].iov_len = pkt_entry->pkt_size;
+	desc[0] = rxd_mr_desc(pkt_entry->mr, ep);
+
+	if (pkt_entry->iov_count) {
+		memcpy(&iov[1], pkt_entry->iov,
+		       sizeof(*iov) * pkt_entry->iov_count);
+		iov[0].iov_len -= ofi_total_iov_len(pkt_entry->iov,
+						    pkt_entry->iov_count);
+	}
+
+	msg.msg_iov = iov;
+	msg.desc = desc;
+	msg.iov_count = 1 + pkt_entry->iov_count;
+	msg.addr = rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = (flags || pkt_entry->iov_count) ?
+	      fi_sendmsg(ep->dg_ep, &msg, flags) :
+	      fi_send(ep->dg_ep, iov[0].iov_base, iov[0].iov_len, desc[0],
+		      msg.addr, msg.context);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
+			ret, fi_strerror(-ret));
+	} else {
+		pkt_entry->flags |= RXD_PKT_IN_USE;
+		ep->pending_cnt++;
+	}
+
+	return ret;
+}
+
+/*
+ * Data and op packets are held back by one so that every post except the
+ * last one of a burst can be flagged FI_MORE.  While ep->batch_tx is set the
+ * burst spans all transfers started from a batch of core completions and is
+ * only ended by rxd_ep_flush_pkts().
+ */
+static void rxd_ep_post_held(struct rxd_ep *ep, uint64_t flags)
+{
+	struct rxd_pkt_entry *pkt_entry = ep->held_pkt;
+
+	if (!pkt_entry)
+		return;
+
+	ep->held_pkt = NULL;
+	rxd_ep_post_pkt(ep, pkt_entry,
+			ep->pending_cnt + 1 < ep->tx_size ? flags : 0);
+}
+
+void rxd_ep_queue_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	rxd_ep_post_held(ep, FI_MORE);
+	ep->held_pkt = pkt_entry;
+}
+
+void rxd_ep_flush_pkts(struct rxd_ep *ep)
+{
+	rxd_ep_post_held(ep, 0);
+}
+
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_data_pkt *data;
+	ssize_t ret = 0;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
 		if (ep->peers[tx_entry->peer].unacked_cnt >= rxd_env.max_unacked)
-			return 0;
+			break;
 
 		pkt_entry = rxd_get_tx_pkt(ep);
-		if (!pkt_entry)
-			return -FI_ENOMEM;
+		if (!pkt_entry) {
+			ret = -FI_ENOMEM;
+			break;
+		}
 
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
 			tx_entry->start_seq = ep->peers[tx_entry->peer].tx_seq_no;
@@ -458,7 +589,10 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 							      tx_entry->num_segs;
 		}
 
-		rxd_init_data_pkt(ep, tx_entry, pkt_entry);
+		if (ep->do_local_mr)
+			rxd_init_data_pkt(ep, tx_entry, pkt_entry);
+		else
+			rxd_init_data_pkt_iov(ep, tx_entry, pkt_entry);
 
 		data = (struct rxd_data_pkt *) (pkt_entry->pkt);
 		data->base_hdr.seq_no = tx_entry->start_seq +
@@ -466,35 +600,23 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
 
-		rxd_ep_send_pkt(ep, pkt_entry);
 		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
+		rxd_ep_queue_pkt(ep, pkt_entry);
 	}
 
+	if (!ep->batch_tx)
+		rxd_ep_flush_pkts(ep);
+
+	if (ret)
+		return ret;
+
 	return ep->peers[tx_entry->peer].unacked_cnt < rxd_env.max_unacked;
 }
 
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
-	int ret;
-
-	if (ep->pending_cnt >= ep->tx_size)
-		return 1;
-
-	pkt_entry->timestamp = fi_gettime_ms();
-
-	ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
-		      pkt_entry->pkt_size, rxd_mr_desc(pkt_entry->mr, ep),
-		      rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr,
-		      &pkt_entry->context);
-	if (ret) {
-		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
-			ret, fi_strerror(-ret));
-	} else {
-		pkt_entry->flags |= RXD_PKT_IN_USE;
-		ep->pending_cnt++;
-	}
-
-	return ret;
+	rxd_ep_post_held(ep, FI_MORE);
+	return rxd_ep_post_pkt(ep, pkt_entry, 0);
 }
 
 static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
@@ -685,10 +807,11 @@ int rxd_ep_send_op(struct rxd_ep *rxd_ep, struct rxd_x_entry *tx_entry,
 		if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1)
 			rxd_ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
 								  tx_entry->num_segs;
-		rxd_ep_send_pkt(rxd_ep, pkt_entry);
 		rxd_insert_unacked(rxd_ep, tx_entry->peer, pkt_entry);
+		rxd_ep_queue_pkt(rxd_ep, pkt_entry);
 		if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1)
 			ret = rxd_ep_post_data_pkts(rxd_ep, tx_entry);
+		rxd_ep_flush_pkts(rxd_ep);
 	} else {
 		tx_entry->pkt = pkt_entry;
 	}
@@ -715,6 +838,7 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 	ack->base_hdr.type = RXD_ACK;
 	ack->base_hdr.peer = rxd_ep->peers[peer].peer_addr;
 	ack->base_hdr.seq_no = rxd_ep->peers[peer].rx_seq_no;
+	ack->base_hdr.ack_seq = ack->base_hdr.seq_no;
 	ack->ext_hdr.tx_id = rxd_ep->peers[peer].curr_tx_id;
 	ack->ext_hdr.rx_id = rxd_ep->peers[peer].curr_rx_id;
 	rxd_ep->peers[peer].last_tx_ack = ack->base_hdr.seq_no;
@@ -723,7 +847,38 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 	if (rxd_ep_send_pkt(rxd_ep, pkt_entry)) {
 		dlist_remove(&pkt_entry->d_entry);
 		rxd_release_tx_pkt(rxd_ep, pkt_entry);
+		return;
 	}
+	rxd_ep->peers[peer].ack_time = 0;
+}
+
+/*
+ * Hold back the ACK for up to ack_delay usec.  Any data or op packet sent to
+ * the peer in the meantime carries the ACK in its base header.
+ */
+void rxd_ep_delay_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
+{
+	if (!rxd_ep->peers[peer].ack_time)
+		rxd_ep->peers[peer].ack_time = fi_gettime_us();
+}
+
+static void rxd_progress_acks(struct rxd_ep *ep, uint64_t current)
+{
+	struct rxd_peer *peer;
+
+	dlist_foreach_container(&ep->active_peers, struct rxd_peer,
+				peer, entry) {
+		if (peer->ack_time &&
+		    current >= peer->ack_time + rxd_env.ack_delay)
+			rxd_ep_send_ack(ep, peer - ep->peers);
+	}
+}
+
+void rxd_ep_flush_acks(struct rxd_ep *ep)
+{
+	fastlock_acquire(&ep->util_ep.lock);
+	rxd_progress_acks(ep, UINT64_MAX - rxd_env.ack_delay);
+	fastlock_release(&ep->util_ep.lock);
 }
 
 static void rxd_ep_free_res(struct rxd_ep *ep)
@@ -746,6 +901,12 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		peer->unacked_cnt--;
 	}
 
+	while (!dlist_empty(&peer->buf_pkts)) {
+		dlist_pop_front(&peer->buf_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		rxd_release_rx_pkt(ep, pkt_entry);
+	}
+
 	while(!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry,
 				x_entry, entry);
@@ -778,6 +939,7 @@ static int rxd_ep_close(struct fid *fid)
 
 	ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
 
+	rxd_ep_flush_acks(ep);
 	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry)
 		rxd_close_peer(ep, peer);
 
@@ -1033,6 +1195,13 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	struct rxd_x_entry *tx_entry;
 	struct rxd_pkt_entry *pkt_entry;
 
+	/* packets still posted may reference the buffers being completed */
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (pkt_entry->flags & RXD_PKT_IN_USE)
+			return;
+	}
+
 	while (!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry, tx_entry, entry);
 		memset(&err_entry, 0, sizeof(struct fi_cq_err_entry));
@@ -1054,6 +1223,24 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	dlist_remove(&peer->entry);
 }
 
+/*
+ * Move a segment sent in place into the packet buffer before resending it.
+ * The resend may still be held by the core provider when the ack for the
+ * first send arrives.
+ */
+static void rxd_pkt_copy_iov(struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+
+	if (!pkt_entry->iov_count)
+		return;
+
+	ofi_copy_from_iov(data_pkt->msg,
+			  ofi_total_iov_len(pkt_entry->iov, pkt_entry->iov_count),
+			  pkt_entry->iov, pkt_entry->iov_count, 0);
+	pkt_entry->iov_count = 0;
+}
+
 static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
@@ -1072,6 +1259,7 @@ static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
 			continue;
 		retry = 1;
+		rxd_pkt_copy_iov(pkt_entry);
 		ret = rxd_ep_send_pkt(ep, pkt_entry);
 		if (ret)
 			break;
@@ -1087,19 +1275,20 @@ static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 static void rxd_ep_progress(struct util_ep *util_ep)
 {
 	struct rxd_peer *peer;
-	struct fi_cq_msg_entry cq_entry;
+	struct fi_cq_msg_entry cq_entry[RXD_CQ_READ_CNT];
 	struct dlist_entry *tmp;
 	struct rxd_ep *ep;
+	uint64_t now;
 	ssize_t ret;
-	int i;
+	int i, j;
 
 	ep = container_of(util_ep, struct rxd_ep, util_ep);
 
 	fastlock_acquire(&ep->util_ep.lock);
 	for(ret = 1, i = 0;
 	    ret > 0 && (!rxd_env.spin_count || i < rxd_env.spin_count);
-	    i++) {
-		ret = fi_cq_read(ep->dg_cq, &cq_entry, 1);
+	    i += ret) {
+		ret = fi_cq_read(ep->dg_cq, cq_entry, RXD_CQ_READ_CNT);
 		if (ret == -FI_EAGAIN)
 			break;
 
@@ -1108,10 +1297,19 @@ static void rxd_ep_progress(struct util_ep *util_ep)
 			continue;
 		}
 
-		if (cq_entry.flags & FI_RECV)
-			rxd_handle_recv_comp(ep, &cq_entry);
-		else
-			rxd_handle_send_comp(ep, &cq_entry);
+		ep->batch_tx = 1;
+		for (j = 0; j < ret; j++) {
+			if (cq_entry[j].flags & FI_RECV)
+				rxd_handle_recv_comp(ep, &cq_entry[j]);
+			else
+				rxd_handle_send_comp(ep, &cq_entry[j]);
+		}
+		ep->batch_tx = 0;
+		rxd_ep_flush_pkts(ep);
+
+		/* A short read means the core CQ has been drained */
+		if (ret < RXD_CQ_READ_CNT)
+			break;
 	}
 
 	if (!rxd_env.retry)
@@ -1130,6 +1328,10 @@ static void rxd_ep_progress(struct util_ep *util_ep)
 	}
 
 out:
+	now = fi_gettime_us();
+	rxd_progress_acks(ep, now);
+	util_buf_pool_trim(ep->tx_pkt_pool, now / 1000);
+
 	while (ep->posted_bufs < ep->rx_size && !ret)
 		ret = rxd_ep_post_buf(ep);
 
@@ -1166,14 +1368,28 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 			.ordered	= 1,
 		},
 	};
+	/* tx packets deregister and free regions left over from bursts */
+	struct util_buf_attr tx_pool_attr = {
+		.size		= rxd_domain->max_mtu_sz +
+				  sizeof(struct rxd_pkt_entry),
+		.alignment	= RXD_BUF_POOL_ALIGNMENT,
+		.max_cnt	= 0,
+		.chunk_cnt	= RXD_TX_POOL_CHUNK_CNT,
+		.alloc_hndlr	= ep->do_local_mr ?
+				  rxd_buf_region_alloc_hndlr : NULL,
+		.free_hndlr	= ep->do_local_mr ?
+				  rxd_buf_region_free_hndlr : NULL,
+		.ctx		= rxd_domain,
+		.track_used	= 1,
+		.trim_idle_ms	= RXD_POOL_TRIM_MS,
+		.trim_hwm	= RXD_TX_POOL_CHUNK_CNT,
+		.bg_grow	= 1,
+		.indexing	= {
+			.used		= 1,
+		},
+	};
 
-	int ret = util_buf_pool_create_ex(
-		&ep->tx_pkt_pool,
-		rxd_domain->max_mtu_sz + sizeof(struct rxd_pkt_entry),
-		RXD_BUF_POOL_ALIGNMENT, 0, RXD_TX_POOL_CHUNK_CNT,
-	        ep->do_local_mr ? rxd_buf_region_alloc_hndlr : NULL,
-		ep->do_local_mr ? rxd_buf_region_free_hndlr : NULL,
-		rxd_domain);
+	int ret = util_buf_pool_create_attr(&tx_pool_attr, &ep->tx_pkt_pool);
 	if (ret)
 		return -FI_ENOMEM;
 
@@ -1231,6 +1447,7 @@ static void rxd_init_peer(struct rxd_ep *ep, uint64_t rxd_addr)
 	ep->peers[rxd_addr].rx_seq_no = 0;
 	ep->peers[rxd_addr].last_rx_ack = 0;
 	ep->peers[rxd_addr].last_tx_ack = 0;
+	ep->peers[rxd_addr].ack_time = 0;
 	ep->peers[rxd_addr].rx_window = rxd_env.max_unacked;
 	ep->peers[rxd_addr].unacked_cnt = 0;
 	ep->peers[rxd_addr].retry_cnt = 0;
@@ -1280,10 +1497,11 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 				 dg_info->ep_attr->msg_prefix_size : 0;
 	rxd_ep->rx_prefix_size = dg_info->rx_attr->mode & FI_MSG_PREFIX ?
 				 dg_info->ep_attr->msg_prefix_size : 0;
-	fi_freeinfo(dg_info);
+	rxd_ep->tx_iov_limit = dg_info->tx_attr->iov_limit;
 
 	rxd_ep->rx_size = MIN(dg_info->rx_attr->size, info->rx_attr->size);
 	rxd_ep->tx_size = MIN(dg_info->tx_attr->size, info->tx_attr->size);
+	fi_freeinfo(dg_info);
 
 	rxd_ep->next_retry = -1;
 	ret = rxd_ep_init_res(rxd_ep, info);
@@ -45,6 +45,7 @@ struct rxd_env rxd_env = {
 	.retry		= 1,
 	.max_peers	= 1024,
 	.max_unacked	= 128,
+	.ack_delay	= 100,
 };
 
 char *rxd_pkt_type_str[] = {
@@ -57,6 +58,7 @@ static void rxd_init_env(void)
 	fi_param_get_bool(&rxd_prov, "retry", &rxd_env.retry);
 	fi_param_get_int(&rxd_prov, "max_peers", &rxd_env.max_peers);
 	fi_param_get_int(&rxd_prov, "max_unacked", &rxd_env.max_unacked);
+	fi_param_get_int(&rxd_prov, "ack_delay", &rxd_env.ack_delay);
 }
 
 int rxd_info_to_core(uint32_t version, const struct fi_info *rxd_info,
@@ -126,6 +128,9 @@ RXD_INI
 			"Maximum number of peers to track (default: 1024)");
 	fi_param_define(&rxd_prov, "max_unacked", FI_PARAM_INT,
 			"Maximum number of packets to send at once (default: 128)");
+	fi_param_define(&rxd_prov, "ack_delay", FI_PARAM_INT,
+			"Time in usec to hold back an ACK waiting for outgoing "
+			"data to piggyback on (default: 100)");
 
 	rxd_init_env();
 
@@ -71,6 +71,8 @@ extern char *rxd_pkt_type_str[];
  * 		 are included in the packet
  * 	- peer: RX side peer address (exchanged during RTS-CTS process)
  * 	- seq_no: sequence number (per peer)
+ * 	- ack_seq: piggybacked ACK, next sequence number expected from the peer
+ * 		   (valid for all packets other than RTS, CTS, and ACK)
  */
 struct rxd_base_hdr {
 	uint8_t		version;
@@ -78,6 +80,7 @@ struct rxd_base_hdr {
 	uint16_t	flags;
 	uint32_t	peer;
 	uint64_t	seq_no;
+	uint64_t	ack_seq;
 };
 
 /*
@@ -140,9 +140,20 @@ static void rxm_buf_reg_set_common(struct rxm_buf *hdr, struct rxm_pkt *pkt,
 static int rxm_buf_reg(void *pool_ctx, void *addr, size_t len, void **context)
 {
 	struct rxm_buf_pool *pool = (struct rxm_buf_pool *)pool_ctx;
-	size_t i, entry_sz = pool->pool->entry_sz;
-	int ret;
-	void *mr_desc;
+
+	if ((pool->type != RXM_BUF_POOL_TX_INJECT) && pool->rxm_ep->msg_mr_local)
+		return rxm_mr_buf_reg(pool->rxm_ep, addr, len, context);
+
+	*context = NULL;
+	return FI_SUCCESS;
+}
+
+/* Called by the pool for each buffer the first time it is handed out */
+static void rxm_buf_init(void *pool_ctx, void *buf)
+{
+	struct rxm_buf_pool *pool = (struct rxm_buf_pool *)pool_ctx;
+	struct fid_mr *mr = util_buf_get_ctx(pool->pool, buf);
+	void *mr_desc = mr ? fi_mr_desc(mr) : NULL;
 	uint8_t type;
 	struct rxm_buf *hdr;
 	struct rxm_pkt *pkt;
@@ -154,100 +165,79 @@ static int rxm_buf_reg(void *pool_ctx, void *addr, size_t len, void **context)
 	struct rxm_tx_atomic_buf *tx_atomic_buf;
 	struct rxm_rma_buf *rma_buf;
 
-	if ((pool->type != RXM_BUF_POOL_TX_INJECT) && pool->rxm_ep->msg_mr_local) {
-		ret = rxm_mr_buf_reg(pool->rxm_ep, addr, len, context);
-		if (ret)
-			return ret;
-		mr_desc = fi_mr_desc((struct fid_mr *)*context);
-	} else {
-		*context = mr_desc = NULL;
-	}
+	switch (pool->type) {
+	case RXM_BUF_POOL_RX:
+		rx_buf = buf;
+		rx_buf->ep = pool->rxm_ep;
 
-	for (i = 0; i < pool->pool->attr.chunk_cnt; i++) {
-		switch (pool->type) {
-		case RXM_BUF_POOL_RX:
-			rx_buf = (struct rxm_rx_buf *)
-				((char *)addr + i * entry_sz);
-			rx_buf->ep = pool->rxm_ep;
+		hdr = &rx_buf->hdr;
+		pkt = NULL;
+		type = ofi_ctrl_data; /* This can be any value */
+		break;
+	case RXM_BUF_POOL_TX:
+		tx_eager_buf = buf;
+		tx_eager_buf->hdr.state = RXM_TX;
 
-			hdr = &rx_buf->hdr;
-			pkt = NULL;
-			type = ofi_ctrl_data; /* This can be any value */
-			break;
-		case RXM_BUF_POOL_TX:
-			tx_eager_buf = (struct rxm_tx_eager_buf *)
-				((char *)addr + i * entry_sz);
-			tx_eager_buf->hdr.state = RXM_TX;
-
-			hdr = &tx_eager_buf->hdr;
-			pkt = &tx_eager_buf->pkt;
-			type = ofi_ctrl_data;
-			break;
-		case RXM_BUF_POOL_TX_INJECT:
-			tx_base_buf = (struct rxm_tx_base_buf *)
-				((char *)addr + i * entry_sz);
-			tx_base_buf->hdr.state = RXM_INJECT_TX;
-
-			hdr = NULL;
-			pkt = &tx_base_buf->pkt;
-			type = ofi_ctrl_data;
-			break;
-		case RXM_BUF_POOL_TX_SAR:
-			tx_sar_buf = (struct rxm_tx_sar_buf *)
-				((char *)addr + i * entry_sz);
-			tx_sar_buf->hdr.state = RXM_SAR_TX;
-
-			hdr = &tx_sar_buf->hdr;
-			pkt = &tx_sar_buf->pkt;
-			type = ofi_ctrl_seg_data;
-			break;
-		case RXM_BUF_POOL_TX_RNDV:
-			tx_rndv_buf = (struct rxm_tx_rndv_buf *)
-				((char *)addr + i * entry_sz);
+		hdr = &tx_eager_buf->hdr;
+		pkt = &tx_eager_buf->pkt;
+		type = ofi_ctrl_data;
+		break;
+	case RXM_BUF_POOL_TX_INJECT:
+		tx_base_buf = buf;
+		tx_base_buf->hdr.state = RXM_INJECT_TX;
 
-			hdr = &tx_rndv_buf->hdr;
-			pkt = &tx_rndv_buf->pkt;
-			type = ofi_ctrl_large_data;
-			break;
-		case RXM_BUF_POOL_TX_ATOMIC:
-			tx_atomic_buf = (struct rxm_tx_atomic_buf *)
-				((char *)addr + i * entry_sz);
+		hdr = NULL;
+		pkt = &tx_base_buf->pkt;
+		type = ofi_ctrl_data;
+		break;
+	case RXM_BUF_POOL_TX_SAR:
+		tx_sar_buf = buf;
+		tx_sar_buf->hdr.state = RXM_SAR_TX;
 
-			hdr = &tx_atomic_buf->hdr;
-			pkt = &tx_atomic_buf->pkt;
-			type = ofi_ctrl_atomic;
-			break;
-		case RXM_BUF_POOL_TX_ACK:
-			tx_base_buf = (struct rxm_tx_base_buf *)
-				((char *)addr + i * entry_sz);
-			tx_base_buf->pkt.hdr.op = ofi_op_msg;
-
-			hdr = &tx_base_buf->hdr;
-			pkt = &tx_base_buf->pkt;
-			type = ofi_ctrl_ack;
-			break;
-		case RXM_BUF_POOL_RMA:
-			rma_buf = (struct rxm_rma_buf *)
-				((char *)addr + i * entry_sz);
-			rma_buf->pkt.hdr.op = ofi_op_msg;
-			rma_buf->hdr.state = RXM_RMA;
-
-			hdr = &rma_buf->hdr;
-			pkt = &rma_buf->pkt;
-			type = ofi_ctrl_data;
-			break;
-		default:
-			assert(0);
-			hdr = NULL;
-			pkt = NULL;
-			mr_desc = NULL;
-			type = ofi_ctrl_data;
-			break;
-		}
-		rxm_buf_reg_set_common(hdr, pkt, type, mr_desc);
-	}
+		hdr = &tx_sar_buf->hdr;
+		pkt = &tx_sar_buf->pkt;
+		type = ofi_ctrl_seg_data;
+		break;
+	case RXM_BUF_POOL_TX_RNDV:
+		tx_rndv_buf = buf;
 
-	return FI_SUCCESS;
+		hdr = &tx_rndv_buf->hdr;
+		pkt = &tx_rndv_buf->pkt;
+		type = ofi_ctrl_large_data;
+		break;
+	case RXM_BUF_POOL_TX_ATOMIC:
+		tx_atomic_buf = buf;
+
+		hdr = &tx_atomic_buf->hdr;
+		pkt = &tx_atomic_buf->pkt;
+		type = ofi_ctrl_atomic;
+		break;
+	case RXM_BUF_POOL_TX_ACK:
+		tx_base_buf = buf;
+		tx_base_buf->pkt.hdr.op = ofi_op_msg;
+
+		hdr = &tx_base_buf->hdr;
+		pkt = &tx_base_buf->pkt;
+		type = ofi_ctrl_ack;
+		break;
+	case RXM_BUF_POOL_RMA:
+		rma_buf = buf;
+		rma_buf->pkt.hdr.op = ofi_op_msg;
+		rma_buf->hdr.state = RXM_RMA;
+
+		hdr = &rma_buf->hdr;
+		pkt = &rma_buf->pkt;
+		type = ofi_ctrl_data;
+		break;
+	default:
+		assert(0);
+		hdr = NULL;
+		pkt = NULL;
+		mr_desc = NULL;
+		type = ofi_ctrl_data;
+		break;
+	}
+	rxm_buf_reg_set_common(hdr, pkt, type, mr_desc);
 }
 
 static inline void rxm_buf_close(void *pool_ctx, void *context)
@@ -282,8 +272,10 @@ static int rxm_buf_pool_create(struct rxm_ep *rxm_ep,
 		.chunk_cnt	= chunk_count,
 		.alloc_hndlr	= rxm_buf_reg,
 		.free_hndlr	= rxm_buf_close,
+		.init		= rxm_buf_init,
 		.ctx		= pool,
 		.track_used	= 0,
+		.bg_grow	= 1,
 	};
 	int ret;
 
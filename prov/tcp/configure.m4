@@ -11,5 +11,16 @@ AC_DEFUN([FI_TCP_CONFIGURE],[
        # Determine if we can support the tcp provider
        tcp_h_happy=0
        AS_IF([test x"$enable_tcp" != x"no"], [tcp_h_happy=1])
+
+       # io_uring is an optional I/O engine; raw syscalls, no liburing
+       tcp_io_uring_happy=0
+       AS_IF([test $tcp_h_happy -eq 1],
+	     [AC_CHECK_DECL([__NR_io_uring_setup],
+			    [AC_CHECK_DECL([IORING_FEAT_FAST_POLL],
+					   [tcp_io_uring_happy=1], [],
+					   [#include <linux/io_uring.h>])],
+			    [], [#include <sys/syscall.h>])])
+       AC_DEFINE_UNQUOTED([HAVE_TCP_IO_URING], [$tcp_io_uring_happy],
+			  [Whether the tcp provider can use io_uring])
        AS_IF([test $tcp_h_happy -eq 1], [$1], [$2])
 ])
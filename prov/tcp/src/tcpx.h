@@ -36,9 +36,11 @@
 #include <sys/types.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <limits.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -62,24 +64,64 @@
 #ifndef _TCP_H_
 #define _TCP_H_
 
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define TCPX_HAVE_ZEROCOPY	1
+#else
+#define TCPX_HAVE_ZEROCOPY	0
+#endif
+
 #define TCPX_MAJOR_VERSION 	0
 #define TCPX_MINOR_VERSION 	1
 
 #define TCPX_HDR_VERSION	3
-#define TCPX_CTRL_HDR_VERSION	3
+#define TCPX_CTRL_HDR_VERSION	4
 
 #define TCPX_MAX_CM_DATA_SIZE	(1<<8)
 #define TCPX_IOV_LIMIT		(4)
 #define TCPX_MAX_INJECT_SZ	(64)
+#define TCPX_MIN_MULTI_RECV	(64)
 
 #define MAX_EPOLL_EVENTS	100
+#ifdef IOV_MAX
+#define TCPX_TX_IOV_MAX		IOV_MAX
+#else
+#define TCPX_TX_IOV_MAX		_XOPEN_IOV_MAX
+#endif
 #define STAGE_BUF_SIZE		512
+#define TCPX_MAX_STAGE_BUF_SIZE	(1 << 16)
+#define TCPX_MAX_STRIPES	16
+/* FI_TCP_LATENCY default, in microseconds */
+#define TCPX_LATENCY_BUSY_POLL	50
+
+/* xfer entry pools give back regions left idle this long, keeping a chunk */
+#define TCPX_POOL_CHUNK_CNT	1024
+#define TCPX_POOL_TRIM_MS	1000
+
+struct tcpx_env {
+	size_t	zerocopy_size;
+	int	io_uring;
+	size_t	io_uring_size;
+	int	stripes;
+	size_t	stripe_size;
+	int	progress_threads;
+	char	*progress_affinity;
+	int	latency;
+	int	busy_poll;
+	int	spin_time;
+	size_t	unexp_size;
+};
 
+extern struct tcpx_env		tcpx_env;
 extern struct fi_provider	tcpx_prov;
 extern struct util_prov		tcpx_util_prov;
 extern struct fi_info		tcpx_info;
+extern struct fi_info		tcpx_rdm_info;
 struct tcpx_xfer_entry;
 struct tcpx_ep;
+struct tcpx_uring;
+struct tcpx_thread;
+struct tcpx_threads;
 
 enum tcpx_xfer_op_codes {
 	TCPX_OP_MSG_SEND,
@@ -90,6 +132,7 @@ enum tcpx_xfer_op_codes {
 	TCPX_OP_READ_REQ,
 	TCPX_OP_READ_RSP,
 	TCPX_OP_REMOTE_READ,
+	TCPX_OP_TAGGED_SEND,
 	TCPX_OP_CODE_MAX,
 };
 
@@ -99,11 +142,26 @@ enum tcpx_cm_event_type {
 	SERVER_RECV_CONNREQ,
 	SERVER_SEND_CM_ACCEPT,
 	CLIENT_RECV_CONNRESP,
+	SERVER_STRIPE_ACCEPT,
+	SERVER_STRIPE_JOIN,
+	CLIENT_STRIPE_CONNECT,
+};
+
+/*
+ * Follows the ofi_ctrl_hdr of every CM message: the stripe sockets asked
+ * for or granted and the port they connect to.  A stripe socket's own
+ * connreq names that port and the stripe's index.
+ */
+struct tcpx_cm_stripes {
+	uint32_t		cnt;
+	uint16_t		port;
+	uint16_t		index;
 };
 
 struct tcpx_cm_context {
 	fid_t			fid;
 	enum tcpx_cm_event_type	type;
+	struct tcpx_cm_stripes	stripes;
 	size_t			cm_data_sz;
 	char			cm_data[TCPX_MAX_CM_DATA_SIZE];
 };
@@ -113,6 +171,7 @@ struct tcpx_conn_handle {
 	struct tcpx_pep		*pep;
 	SOCKET			conn_fd;
 	bool			endian_match;
+	uint32_t		stripe_cnt;
 };
 
 struct tcpx_pep {
@@ -136,7 +195,8 @@ struct tcpx_base_hdr {
 	uint8_t			op_data;
 	uint8_t			rma_iov_cnt;
 	uint8_t			payload_off;
-	uint8_t			rsvd;
+	/* the payload follows on this many stripe sockets instead */
+	uint8_t			stripes;
 	uint64_t		size;
 };
 
@@ -145,6 +205,16 @@ struct tcpx_cq_data_hdr {
 	uint64_t		cq_data;
 };
 
+/* ofi_op_tagged headers carry the tag after the optional cq data */
+static inline uint64_t *tcpx_hdr_tag(struct tcpx_base_hdr *hdr)
+{
+	uint8_t *ptr = (uint8_t *)hdr + sizeof(*hdr);
+
+	if (hdr->flags & OFI_REMOTE_CQ_DATA)
+		ptr += sizeof(uint64_t);
+	return (uint64_t *)ptr;
+}
+
 #define TCPX_MAX_HDR_SZ (sizeof(struct tcpx_base_hdr) + 	\
 			 sizeof(uint64_t) +			\
 			 sizeof(struct ofi_rma_iov) *		\
@@ -163,7 +233,16 @@ struct tcpx_rx_detect {
 struct tcpx_rx_ctx {
 	struct fid_ep		rx_fid;
 	struct slist		rx_queue;
+	/* posted tagged receives, searched in order for a matching tag */
+	struct slist		tag_queue;
+	/* messages that arrived before a matching receive was posted */
+	struct slist		unexp_queue;
+	/* bytes buffered for unexp_queue, kept under tcpx_env.unexp_size */
+	size_t			unexp_size;
+	/* connections that stopped reading until there is room, by srx_entry */
+	struct dlist_entry	blocked_list;
 	struct util_buf_pool	*buf_pool;
+	size_t			min_multi_recv;
 	fastlock_t		lock;
 };
 
@@ -171,13 +250,46 @@ typedef int (*tcpx_rx_process_fn_t)(struct tcpx_xfer_entry *rx_entry);
 typedef void (*tcpx_ep_progress_func_t)(struct tcpx_ep *ep);
 typedef int (*tcpx_get_rx_func_t)(struct tcpx_ep *ep);
 
+/* Starts at STAGE_BUF_SIZE and grows while recvs keep filling it */
 struct stage_buf {
-	uint8_t			buf[STAGE_BUF_SIZE];
+	uint8_t			*buf;
 	size_t			size;
 	size_t			len;
 	size_t			off;
 };
 
+/*
+ * Large payloads can be spread over extra sockets opened alongside the
+ * connection.  The connection still carries the message header; each
+ * stripe then carries one chunk, preceded by a tcpx_stripe_hdr naming
+ * the message and where the chunk goes in it.
+ */
+struct tcpx_stripe_hdr {
+	uint64_t		seq;
+	uint64_t		offset;
+	uint64_t		len;
+};
+
+struct tcpx_stripe_xfer {
+	struct tcpx_stripe_hdr	hdr;
+	size_t			hdr_done;
+	uint64_t		offset;
+	uint64_t		len;
+	uint64_t		done;
+};
+
+struct tcpx_stripe {
+	SOCKET			fd;
+	struct tcpx_stripe_xfer	tx;
+	struct tcpx_stripe_xfer	rx;
+};
+
+/* links an endpoint into a CQ's list of endpoints needing progress */
+struct tcpx_active_entry {
+	struct dlist_entry	entry;
+	struct tcpx_ep		*ep;
+};
+
 struct tcpx_ep {
 	struct util_ep		util_ep;
 	SOCKET			conn_fd;
@@ -186,10 +298,19 @@ struct tcpx_ep {
 	tcpx_rx_process_fn_t 	cur_rx_proc_fn;
 	struct dlist_entry	ep_entry;
 	struct slist		rx_queue;
+	/* tagged receives, when there is no shared receive context */
+	struct slist		tag_queue;
+	size_t			min_multi_recv;
 	struct slist		tx_queue;
 	struct slist		tx_rsp_pend_queue;
+	/* sent with MSG_ZEROCOPY, waiting for the kernel to release them,
+	 * and the sends that finished after them, in order */
+	struct slist		tx_zc_queue;
+	uint32_t		zc_next_id;
+	bool			zc_enabled;
 	struct slist		rma_read_queue;
 	struct tcpx_rx_ctx	*srx_ctx;
+	struct dlist_entry	srx_entry;
 	enum tcpx_cm_state	cm_state;
 	/* lock for protecting tx/rx queues,rma list,cm_state*/
 	fastlock_t		lock;
@@ -198,6 +319,64 @@ struct tcpx_ep {
 	void (*hdr_bswap)(struct tcpx_base_hdr *hdr);
 	struct stage_buf	stage_buf;
 	bool			send_ready_monitor;
+	struct tcpx_active_entry rx_active;
+	struct tcpx_active_entry tx_active;
+	/* set when socket I/O goes through the domain's io_uring; the stage
+	 * buffer is then the only destination for received data */
+	struct tcpx_uring	*uring;
+	bool			uring_rx_posted;
+	bool			uring_tx_posted;
+	struct msghdr		uring_msg;
+	struct iovec		*uring_iov;
+	/* set when one of the domain's progress threads owns the endpoint;
+	 * rx_active then links it into that thread's active list, and
+	 * thread_entry into the list of endpoints it owns */
+	struct tcpx_thread	*thread;
+	struct dlist_entry	thread_entry;
+	/* the thread stopped polling the socket until a receive is posted */
+	bool			thread_muted;
+	/* stripe_cnt sockets were negotiated, stripe_ready have connected;
+	 * the accepting side listens on stripe_sock until they all have */
+	struct tcpx_stripe	stripes[TCPX_MAX_STRIPES];
+	uint32_t		stripe_cnt;
+	uint32_t		stripe_ready;
+	uint64_t		stripe_tx_seq;
+	uint64_t		stripe_rx_seq;
+	SOCKET			stripe_sock;
+	/* peer an RDM endpoint sends to over this connection, the key of
+	 * its conn_idm entry; FI_ADDR_NOTAVAIL for accepted connections
+	 * not sent to yet */
+	fi_addr_t		rdm_addr;
+	/* address an accepted RDM peer listens on, from its connect */
+	union ofi_sock_ip	rdm_peer;
+};
+
+/*
+ * FI_EP_RDM: a MSG endpoint is opened to each peer on its first send and
+ * carries only our sends; peers' connections to our listener carry only
+ * receives.  Every connection receives into the shared srx_ctx, which
+ * matches tags straight from the wire header.
+ */
+struct tcpx_rdm {
+	struct util_ep		util_ep;
+	struct fi_info		*msg_info;
+	struct fid_eq		*eq;
+	struct fid_pep		*pep;
+	/* the listener's address as reported to peers by fi_getname */
+	union ofi_sock_ip	name;
+	struct tcpx_rx_ctx	*srx_ctx;
+	/* false once the user binds an srx of their own */
+	bool			srx_owned;
+	/* fi_addr_t -> tcpx_ep used for sends */
+	struct index_map	conn_idm;
+	/* every live tcpx_ep opened by this endpoint, linked by ep_entry */
+	struct dlist_entry	conn_list;
+	/* failed connections, closed by the next send */
+	struct dlist_entry	dead_list;
+	/* connection manager wait set, polled by the CQs once enabled */
+	int			cm_fd;
+	/* protects conn_idm, both lists and the internal eq */
+	fastlock_t		lock;
 };
 
 struct tcpx_fabric {
@@ -213,14 +392,38 @@ struct tcpx_xfer_entry {
 	} hdr;
 	size_t			iov_cnt;
 	struct iovec		iov[TCPX_IOV_LIMIT+1];
+	/* striped sends: iov[1..data_iov_cnt] is the payload */
+	size_t			data_iov_cnt;
 	struct tcpx_ep		*ep;
 	uint64_t		flags;
 	void			*context;
 	uint64_t		rem_len;
+	uint32_t		zc_id;
+	bool			zc_pending;
+	/* tagged receives match on tag/ignore; set from the wire otherwise */
+	uint64_t		tag;
+	uint64_t		ignore;
+	/* srx receive buffered in unexp_buf until a posted receive claims
+	 * it; unexp_match is that receive if it came before the data did */
+	bool			unexp;
+	bool			unexp_done;
+	void			*unexp_buf;
+	struct tcpx_xfer_entry	*unexp_match;
+	/* FI_MULTI_RECV: each message takes a receive cut from the posted
+	 * buffer at mrecv_buf.  The buffer's own entry counts the receives
+	 * still using it and is retired once too little space is left. */
+	struct tcpx_xfer_entry	*mrecv;
+	void			*mrecv_buf;
+	size_t			mrecv_refs;
+	bool			mrecv_retired;
 };
 
 struct tcpx_domain {
 	struct util_domain	util_domain;
+	/* shared by the domain's endpoints when FI_TCP_IO_ENGINE=io_uring */
+	struct tcpx_uring	*uring;
+	/* progress connected endpoints when FI_TCP_PROGRESS_THREADS is set */
+	struct tcpx_threads	*threads;
 };
 
 struct tcpx_buf_pool {
@@ -232,6 +435,14 @@ struct tcpx_cq {
 	struct util_cq		util_cq;
 	/* buf_pools protected by util.cq_lock */
 	struct tcpx_buf_pool	buf_pools[TCPX_OP_CODE_MAX];
+	/* next pool trim, updated under util.cq_lock */
+	uint64_t		trim_time;
+	/* connected endpoints are progressed when their socket is ready,
+	 * or while they are on active_list (queued tx, buffered rx data) */
+	fi_epoll_t		epoll_fd;
+	ofi_atomic32_t		epoll_cnt;
+	struct dlist_entry	active_list;
+	fastlock_t		active_lock;
 };
 
 int tcpx_create_fabric(struct fi_fabric_attr *attr,
@@ -247,6 +458,9 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 
 int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep_fid, void *context);
+int tcpx_rdm_open(struct fid_domain *domain, struct fi_info *info,
+		  struct fid_ep **ep_fid, void *context);
+void tcpx_rdm_progress(struct util_ep *util_ep);
 
 
 int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
@@ -254,12 +468,44 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 void tcpx_cq_report_completion(struct util_cq *cq,
 			       struct tcpx_xfer_entry *xfer_entry,
 			       int err);
+int tcpx_cq_ep_add(struct tcpx_ep *ep);
+void tcpx_cq_ep_del(struct tcpx_ep *ep);
+void tcpx_cq_signal(struct util_cq *cq, struct tcpx_ep *ep);
+void tcpx_cq_trim(struct util_cq *cq);
+void tcpx_cq_update_active(struct tcpx_ep *ep);
+void tcpx_cq_recv_posted(struct tcpx_ep *ep);
+void tcpx_cq_ep_wake(struct tcpx_ep *ep);
+int tcpx_cq_uring_wait_try(void *arg);
+int tcpx_cq_rdm_add(struct util_cq *cq, struct tcpx_rdm *rdm, int fd);
+void tcpx_cq_rdm_del(struct util_cq *cq, int fd);
 
 int tcpx_recv_msg_data(struct tcpx_xfer_entry *recv_entry);
 int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry);
+int tcpx_send_msg_zc(struct tcpx_xfer_entry *tx_entry);
+void tcpx_stripe_tx_init(struct tcpx_xfer_entry *tx_entry);
+int tcpx_send_stripes(struct tcpx_xfer_entry *tx_entry);
+void tcpx_tx_entry_complete(struct tcpx_xfer_entry *tx_entry, int ret);
+void tcpx_zc_progress(struct tcpx_ep *ep);
 int tcpx_recv_hdr(SOCKET sock, struct stage_buf *sbuf,
 		  struct tcpx_rx_detect *rx_detect);
 int tcpx_read_to_buffer(SOCKET sock, struct stage_buf *stage_buf);
+void tcpx_stage_buf_filled(struct stage_buf *stage_buf, size_t len);
+
+int tcpx_uring_open(struct tcpx_uring **uring, size_t size);
+void tcpx_uring_close(struct tcpx_uring *uring);
+int tcpx_uring_ep_add(struct tcpx_ep *ep, struct tcpx_uring *uring);
+void tcpx_uring_ep_del(struct tcpx_ep *ep);
+int tcpx_uring_post_recv(struct tcpx_ep *ep);
+int tcpx_uring_post_send(struct tcpx_ep *ep, size_t iov_cnt);
+void tcpx_uring_progress(struct tcpx_uring *uring);
+int tcpx_uring_fd(struct tcpx_uring *uring);
+int tcpx_uring_wait_try(struct tcpx_uring *uring);
+
+int tcpx_threads_open(struct tcpx_threads **threads, int cnt);
+void tcpx_threads_close(struct tcpx_threads *threads);
+int tcpx_thread_ep_add(struct tcpx_ep *ep, struct tcpx_threads *threads);
+void tcpx_thread_ep_del(struct tcpx_ep *ep);
+void tcpx_thread_set_active(struct tcpx_ep *ep, int set);
 
 struct tcpx_xfer_entry *tcpx_xfer_entry_alloc(struct tcpx_cq *cq,
 					      enum tcpx_xfer_op_codes type);
@@ -268,8 +514,14 @@ void tcpx_xfer_entry_release(struct tcpx_cq *tcpx_cq,
 void tcpx_srx_xfer_release(struct tcpx_rx_ctx *srx_ctx,
 			   struct tcpx_xfer_entry *xfer_entry);
 void tcpx_rx_msg_release(struct tcpx_xfer_entry *rx_entry);
-struct tcpx_xfer_entry *
-tcpx_srx_dequeue(struct tcpx_rx_ctx *srx_ctx);
+ssize_t tcpx_srx_post(struct tcpx_rx_ctx *srx_ctx, const struct iovec *iov,
+		      size_t count, uint64_t tag, uint64_t ignore,
+		      uint64_t flags, void *context);
+struct tcpx_xfer_entry *tcpx_srx_match(struct tcpx_rx_ctx *srx_ctx,
+				       struct tcpx_ep *ep);
+void tcpx_srx_unexp_done(struct tcpx_rx_ctx *srx_ctx,
+			 struct tcpx_xfer_entry *unexp_entry, int err);
+void tcpx_srx_ep_del(struct tcpx_rx_ctx *srx_ctx, struct tcpx_ep *ep);
 
 
 void tcpx_progress(struct util_ep *util_ep);
@@ -283,8 +535,44 @@ int tcpx_cq_wait_ep_add(struct tcpx_ep *ep);
 void tcpx_cq_wait_ep_del(struct tcpx_ep *ep);
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry);
+int tcpx_tx_queue_sent(struct tcpx_ep *ep, ssize_t bytes_sent);
+void tcpx_tx_queue_error(struct tcpx_ep *ep, int err);
 
 void tcpx_conn_mgr_run(struct util_eq *eq);
+void tcpx_ep_stripes_close(struct tcpx_ep *ep);
+int tcpx_setup_socket(SOCKET sock);
+
+/*
+ * The sockets an endpoint receives on, polled wherever it is: index 0 is
+ * the connection, 1 to stripe_cnt its stripes.
+ */
+static inline SOCKET tcpx_ep_rx_fd(struct tcpx_ep *ep, uint32_t i)
+{
+	return i ? ep->stripes[i - 1].fd : ep->conn_fd;
+}
+
+/* The kernel drops out of quick ack mode on its own, so the latency
+ * profile re-arms it as each message arrives.
+ */
+static inline void tcpx_quickack(SOCKET sock)
+{
+#ifdef TCP_QUICKACK
+	int optval = 1;
+
+	(void) setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK,
+			  (char *) &optval, sizeof(optval));
+#endif
+}
+
+/* A header that found no matching receive waits in rx_detect, and nothing
+ * on the socket will signal it again: only posting a receive lets the
+ * endpoint continue.
+ */
+static inline bool tcpx_ep_rx_blocked(struct tcpx_ep *ep)
+{
+	return !ep->cur_rx_entry &&
+	       ep->rx_detect.done_len == ep->rx_detect.hdr_len;
+}
 int tcpx_eq_wait_try_func(void *arg);
 int tcpx_eq_create(struct fid_fabric *fabric_fid, struct fi_eq_attr *attr,
 		   struct fid_eq **eq_fid, void *context);
@@ -294,5 +582,14 @@ int tcpx_get_rx_entry_op_msg(struct tcpx_ep *tcpx_ep);
 int tcpx_get_rx_entry_op_read_req(struct tcpx_ep *tcpx_ep);
 int tcpx_get_rx_entry_op_write(struct tcpx_ep *tcpx_ep);
 int tcpx_get_rx_entry_op_read_rsp(struct tcpx_ep *tcpx_ep);
+int tcpx_get_rx_entry_op_tagged(struct tcpx_ep *tcpx_ep);
+int tcpx_get_rx_entry_op_srx(struct tcpx_ep *tcpx_ep);
+
+bool tcpx_mrecv_claim(struct tcpx_xfer_entry *mrecv,
+		      struct tcpx_xfer_entry *recv_entry, size_t len,
+		      size_t min_multi_recv);
+bool tcpx_mrecv_retire(struct tcpx_ep *ep, struct tcpx_xfer_entry *mrecv);
+void tcpx_mrecv_put(struct tcpx_xfer_entry *recv_entry);
+void tcpx_mrecv_release(struct tcpx_xfer_entry *recv_entry);
 
 #endif //_TCP_H_
@@ -34,9 +34,10 @@
 
 
 #define TCPX_DOMAIN_CAPS (FI_LOCAL_COMM | FI_REMOTE_COMM)
-#define TCPX_EP_CAPS	 (FI_MSG | FI_RMA | FI_RMA_PMEM)
+#define TCPX_EP_CAPS	 (FI_MSG | FI_TAGGED | FI_RMA | FI_RMA_PMEM)
 #define TCPX_TX_CAPS	 (FI_SEND | FI_WRITE | FI_READ)
-#define TCPX_RX_CAPS	 (FI_RECV | FI_REMOTE_READ | FI_REMOTE_WRITE)
+#define TCPX_RX_CAPS	 (FI_RECV | FI_REMOTE_READ | FI_REMOTE_WRITE | \
+			  FI_MULTI_RECV)
 
 
 #define TCPX_MSG_ORDER (FI_ORDER_RAR | FI_ORDER_RAW | FI_ORDER_RAS |	\
@@ -68,6 +69,7 @@ static struct fi_ep_attr tcpx_ep_attr = {
 	.protocol = FI_PROTO_SOCK_TCP,
 	.protocol_version = 0,
 	.max_msg_size = SIZE_MAX,
+	.mem_tag_format = FI_TAG_GENERIC,
 	.tx_ctx_cnt = 1,
 	.rx_ctx_cnt = 1,
 	.max_order_raw_size = SIZE_MAX,
@@ -99,7 +101,51 @@ static struct fi_fabric_attr tcpx_fabric_attr = {
 	.prov_version = FI_VERSION(TCPX_MAJOR_VERSION, TCPX_MINOR_VERSION),
 };
 
+#define TCPX_RDM_EP_CAPS (FI_MSG | FI_TAGGED)
+
+static struct fi_tx_attr tcpx_rdm_tx_attr = {
+	.caps = TCPX_RDM_EP_CAPS | FI_SEND,
+	.comp_order = FI_ORDER_NONE,
+	.msg_order = FI_ORDER_SAS,
+	.inject_size = 64,
+	.size = 1024,
+	.iov_limit = TCPX_IOV_LIMIT,
+};
+
+static struct fi_rx_attr tcpx_rdm_rx_attr = {
+	.caps = TCPX_RDM_EP_CAPS | FI_RECV | FI_MULTI_RECV,
+	.comp_order = FI_ORDER_NONE,
+	.msg_order = FI_ORDER_SAS,
+	.total_buffered_recv = 0,
+	.size = 1024,
+	.iov_limit = TCPX_IOV_LIMIT
+};
+
+static struct fi_ep_attr tcpx_rdm_ep_attr = {
+	.type = FI_EP_RDM,
+	.protocol = FI_PROTO_SOCK_TCP,
+	.protocol_version = 0,
+	.max_msg_size = SIZE_MAX,
+	.mem_tag_format = FI_TAG_GENERIC,
+	.tx_ctx_cnt = 1,
+	.rx_ctx_cnt = 1,
+};
+
+struct fi_info tcpx_rdm_info = {
+	.caps = TCPX_DOMAIN_CAPS | TCPX_RDM_EP_CAPS | FI_SEND | FI_RECV |
+		FI_MULTI_RECV,
+	.addr_format = FI_SOCKADDR,
+	.tx_attr = &tcpx_rdm_tx_attr,
+	.rx_attr = &tcpx_rdm_rx_attr,
+	.ep_attr = &tcpx_rdm_ep_attr,
+	.domain_attr = &tcpx_domain_attr,
+	.fabric_attr = &tcpx_fabric_attr
+};
+
 struct fi_info tcpx_info = {
+#ifdef HAVE_EPOLL
+	.next = &tcpx_rdm_info,
+#endif
 	.caps = TCPX_DOMAIN_CAPS | TCPX_EP_CAPS | TCPX_TX_CAPS | TCPX_RX_CAPS,
 	.addr_format = FI_SOCKADDR,
 	.tx_attr = &tcpx_tx_attr,
@@ -37,7 +37,7 @@
 #include <ofi_iov.h>
 #include "tcpx.h"
 
-int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
+static int tcpx_sendmsg_flags(struct tcpx_xfer_entry *tx_entry, int flags)
 {
 	ssize_t bytes_sent;
 	struct msghdr msg = {0};
@@ -46,10 +46,16 @@ int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
 	msg.msg_iovlen = tx_entry->iov_cnt;
 
 	bytes_sent = ofi_sendmsg_tcp(tx_entry->ep->conn_fd,
-	                             &msg, MSG_NOSIGNAL);
+	                             &msg, MSG_NOSIGNAL | flags);
 	if (bytes_sent < 0)
 		return ofi_sockerr() == EPIPE ? -FI_ENOTCONN : -ofi_sockerr();
 
+	if (flags) {
+		/* the kernel numbers every successful zerocopy call */
+		tx_entry->zc_id = tx_entry->ep->zc_next_id++;
+		tx_entry->zc_pending = true;
+	}
+
 	tx_entry->rem_len -= bytes_sent;
 	if (tx_entry->rem_len) {
 		ofi_consume_iov(tx_entry->iov, &tx_entry->iov_cnt, bytes_sent);
@@ -58,6 +64,79 @@ int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
 	return FI_SUCCESS;
 }
 
+int tcpx_send_msg(struct tcpx_xfer_entry *tx_entry)
+{
+	return tcpx_sendmsg_flags(tx_entry, 0);
+}
+
+#if TCPX_HAVE_ZEROCOPY
+int tcpx_send_msg_zc(struct tcpx_xfer_entry *tx_entry)
+{
+	int ret;
+
+	ret = tcpx_sendmsg_flags(tx_entry, MSG_ZEROCOPY);
+	/* out of option memory for notifications: retry once some drain */
+	return ret == -ENOBUFS ? -FI_EAGAIN : ret;
+}
+
+static void tcpx_zc_complete(struct tcpx_ep *ep, uint32_t done_id)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	while (!slist_empty(&ep->tx_zc_queue)) {
+		tx_entry = container_of(ep->tx_zc_queue.head,
+					struct tcpx_xfer_entry, entry);
+		if (tx_entry->zc_pending &&
+		    (int32_t) (tx_entry->zc_id - done_id) > 0)
+			break;
+
+		slist_remove_head(&ep->tx_zc_queue);
+		tcpx_tx_entry_complete(tx_entry, 0);
+	}
+}
+
+void tcpx_zc_progress(struct tcpx_ep *ep)
+{
+	struct sock_extended_err *serr;
+	struct msghdr msg = {0};
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(*serr))];
+
+	for (;;) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(ep->conn_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP &&
+			      cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+			if (serr->ee_errno || serr->ee_origin !=
+			    SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* ee_info..ee_data is the range of released calls */
+			tcpx_zc_complete(ep, serr->ee_data);
+		}
+	}
+}
+#else
+int tcpx_send_msg_zc(struct tcpx_xfer_entry *tx_entry)
+{
+	return tcpx_send_msg(tx_entry);
+}
+
+void tcpx_zc_progress(struct tcpx_ep *ep)
+{
+}
+#endif
+
 static ssize_t tcpx_read_from_buffer(struct stage_buf *sbuf,
 				     uint8_t *buf, size_t len)
 {
@@ -85,6 +164,8 @@ int tcpx_recv_rem_hdr(SOCKET sock, struct stage_buf *sbuf,
 
 	if (sbuf->len != sbuf->off) {
 		bytes_recvd = tcpx_read_from_buffer(sbuf, rem_buf, rem_len);
+	} else if (sock == INVALID_SOCKET) {
+		return -FI_EAGAIN;
 	} else {
 		bytes_recvd = ofi_recv_socket(sock, rem_buf, rem_len, 0);
 	}
@@ -108,6 +189,8 @@ int tcpx_recv_hdr(SOCKET sock, struct stage_buf *sbuf,
 
 	if (sbuf->len != sbuf->off) {
 		bytes_recvd = tcpx_read_from_buffer(sbuf, rem_buf, rem_len);
+	} else if (sock == INVALID_SOCKET) {
+		return -FI_EAGAIN;
 	} else {
 		bytes_recvd = ofi_recv_socket(sock, rem_buf, rem_len, 0);
 	}
@@ -150,15 +233,192 @@ static ssize_t tcpx_readv_from_buffer(struct stage_buf *sbuf,
 	return ret;
 }
 
+/* Set up each stripe's chunk once the header has gone out */
+void tcpx_stripe_tx_init(struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_ep *ep = tx_entry->ep;
+	struct tcpx_stripe_xfer *tx;
+	uint64_t data_len, chunk;
+	int i;
+
+	data_len = ofi_total_iov_len(&tx_entry->iov[1],
+				     tx_entry->data_iov_cnt);
+	chunk = (data_len + tx_entry->hdr.base_hdr.stripes - 1) /
+		tx_entry->hdr.base_hdr.stripes;
+
+	for (i = 0; i < tx_entry->hdr.base_hdr.stripes; i++) {
+		tx = &ep->stripes[i].tx;
+		tx->offset = MIN(i * chunk, data_len);
+		tx->len = MIN(chunk, data_len - tx->offset);
+		tx->done = 0;
+		tx->hdr_done = 0;
+		tx->hdr.seq = htonll(ep->stripe_tx_seq);
+		tx->hdr.offset = htonll(tx->offset);
+		tx->hdr.len = htonll(tx->len);
+	}
+	ep->stripe_tx_seq++;
+}
+
+static int tcpx_send_stripe(struct tcpx_xfer_entry *tx_entry,
+			    struct tcpx_stripe *stripe)
+{
+	struct tcpx_stripe_xfer *tx = &stripe->tx;
+	struct iovec iov[TCPX_IOV_LIMIT + 1];
+	struct msghdr msg = {0};
+	size_t data_cnt, hdr_left;
+	ssize_t bytes_sent;
+
+	hdr_left = sizeof(tx->hdr) - tx->hdr_done;
+	if (!hdr_left && tx->done == tx->len)
+		return FI_SUCCESS;
+
+	iov[0].iov_base = (uint8_t *) &tx->hdr + tx->hdr_done;
+	iov[0].iov_len = hdr_left;
+	data_cnt = tx_entry->data_iov_cnt;
+	memcpy(&iov[1], &tx_entry->iov[1], data_cnt * sizeof(*iov));
+	ofi_consume_iov(&iov[1], &data_cnt, tx->offset + tx->done);
+	ofi_truncate_iov(&iov[1], &data_cnt, tx->len - tx->done);
+
+	msg.msg_iov = hdr_left ? iov : &iov[1];
+	msg.msg_iovlen = hdr_left ? data_cnt + 1 : data_cnt;
+	bytes_sent = ofi_sendmsg_tcp(stripe->fd, &msg, MSG_NOSIGNAL);
+	if (bytes_sent < 0)
+		return ofi_sockerr() == EPIPE ? -FI_ENOTCONN : -ofi_sockerr();
+
+	if ((size_t) bytes_sent < hdr_left) {
+		tx->hdr_done += bytes_sent;
+		return -FI_EAGAIN;
+	}
+	tx->hdr_done = sizeof(tx->hdr);
+	tx->done += bytes_sent - hdr_left;
+	return tx->done == tx->len ? FI_SUCCESS : -FI_EAGAIN;
+}
+
+/* Returns -FI_EAGAIN until every stripe has sent its chunk */
+int tcpx_send_stripes(struct tcpx_xfer_entry *tx_entry)
+{
+	int i, ret, again = 0;
+
+	for (i = 0; i < tx_entry->hdr.base_hdr.stripes; i++) {
+		ret = tcpx_send_stripe(tx_entry, &tx_entry->ep->stripes[i]);
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			again = 1;
+		else if (ret)
+			return ret;
+	}
+	return again ? -FI_EAGAIN : FI_SUCCESS;
+}
+
+/*
+ * A chunk that runs past the end of a short receive buffer has its tail
+ * read and dropped, which keeps the stripe in step with the connection.
+ */
+static int tcpx_recv_stripe(struct tcpx_xfer_entry *rx_entry,
+			    struct tcpx_stripe *stripe)
+{
+	struct tcpx_stripe_xfer *rx = &stripe->rx;
+	struct iovec iov[TCPX_IOV_LIMIT + 1];
+	uint8_t discard[4096];
+	ssize_t bytes_recvd;
+	size_t iov_cnt, buf_len;
+
+	/* the peer may stripe before the last of them has joined here */
+	if (stripe->fd == INVALID_SOCKET)
+		return -FI_EAGAIN;
+
+	if (rx->hdr_done < sizeof(rx->hdr)) {
+		bytes_recvd = ofi_recv_socket(stripe->fd,
+				(uint8_t *) &rx->hdr + rx->hdr_done,
+				sizeof(rx->hdr) - rx->hdr_done, 0);
+		if (bytes_recvd <= 0)
+			return bytes_recvd ? -ofi_sockerr() : -FI_ENOTCONN;
+
+		rx->hdr_done += bytes_recvd;
+		if (rx->hdr_done < sizeof(rx->hdr))
+			return -FI_EAGAIN;
+
+		rx->offset = ntohll(rx->hdr.offset);
+		rx->len = ntohll(rx->hdr.len);
+		rx->done = 0;
+		if (ntohll(rx->hdr.seq) != rx_entry->ep->stripe_rx_seq)
+			return -FI_EIO;
+	}
+
+	if (rx->done == rx->len)
+		return FI_SUCCESS;
+
+	buf_len = ofi_total_iov_len(rx_entry->iov, rx_entry->iov_cnt);
+	if (rx->offset + rx->done < buf_len) {
+		iov_cnt = rx_entry->iov_cnt;
+		memcpy(iov, rx_entry->iov, iov_cnt * sizeof(*iov));
+		ofi_consume_iov(iov, &iov_cnt, rx->offset + rx->done);
+		ofi_truncate_iov(iov, &iov_cnt,
+				 MIN(rx->len - rx->done,
+				     buf_len - rx->offset - rx->done));
+		bytes_recvd = ofi_readv_socket(stripe->fd, iov, iov_cnt);
+	} else {
+		bytes_recvd = ofi_recv_socket(stripe->fd, discard,
+					      MIN(rx->len - rx->done,
+						  sizeof(discard)), 0);
+	}
+	if (bytes_recvd <= 0)
+		return bytes_recvd ? -ofi_sockerr() : -FI_ENOTCONN;
+
+	rx->done += bytes_recvd;
+	rx_entry->rem_len -= bytes_recvd;
+	return rx->done == rx->len ? FI_SUCCESS : -FI_EAGAIN;
+}
+
+/*
+ * The payload lands straight in the receive buffers, so their iovs are
+ * left untouched until every chunk is in.  Returns -FI_ETRUNC once a
+ * message too large for them has been received in full.
+ */
+static int tcpx_recv_stripes(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_ep *ep = rx_entry->ep;
+	struct tcpx_stripe_xfer *rx;
+	int i, ret, again = 0, trunc = 0;
+	size_t buf_len;
+
+	if (rx_entry->hdr.base_hdr.stripes > ep->stripe_cnt)
+		return -FI_EIO;
+
+	for (i = 0; i < rx_entry->hdr.base_hdr.stripes; i++) {
+		ret = tcpx_recv_stripe(rx_entry, &ep->stripes[i]);
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			again = 1;
+		else if (ret)
+			return ret;
+	}
+	if (again)
+		return -FI_EAGAIN;
+
+	buf_len = ofi_total_iov_len(rx_entry->iov, rx_entry->iov_cnt);
+	for (i = 0; i < rx_entry->hdr.base_hdr.stripes; i++) {
+		rx = &ep->stripes[i].rx;
+		if (rx->offset + rx->len > buf_len)
+			trunc = 1;
+		rx->hdr_done = 0;
+	}
+	ep->stripe_rx_seq++;
+	return trunc ? -FI_ETRUNC : FI_SUCCESS;
+}
+
 int tcpx_recv_msg_data(struct tcpx_xfer_entry *rx_entry)
 {
 	ssize_t bytes_recvd;
 
+	if (rx_entry->hdr.base_hdr.stripes)
+		return tcpx_recv_stripes(rx_entry);
+
 	if (rx_entry->ep->stage_buf.len != rx_entry->ep->stage_buf.off) {
 		bytes_recvd = tcpx_readv_from_buffer(&rx_entry->ep->stage_buf,
 						     rx_entry->iov,
 						     rx_entry->iov_cnt);
-	 }else {
+	} else if (rx_entry->ep->uring) {
+		return -FI_EAGAIN;
+	} else {
 		bytes_recvd = ofi_readv_socket(rx_entry->ep->conn_fd,
 					       rx_entry->iov,
 					       rx_entry->iov_cnt);
@@ -183,7 +443,25 @@ int tcpx_read_to_buffer(SOCKET sock, struct stage_buf *stage_buf)
 	if (bytes_recvd <= 0)
 		return (bytes_recvd)? -ofi_sockerr(): -FI_ENOTCONN;
 
-	stage_buf->len = bytes_recvd;
-	stage_buf->off = 0;
+	tcpx_stage_buf_filled(stage_buf, bytes_recvd);
 	return FI_SUCCESS;
 }
+
+void tcpx_stage_buf_filled(struct stage_buf *stage_buf, size_t len)
+{
+	uint8_t *buf;
+
+	stage_buf->len = len;
+	stage_buf->off = 0;
+
+	/* A full buffer means the peer is streaming faster than we drain
+	 * it, so pick up more messages per recv from now on. */
+	if (len == stage_buf->size &&
+	    stage_buf->size < TCPX_MAX_STAGE_BUF_SIZE) {
+		buf = realloc(stage_buf->buf, stage_buf->size * 2);
+		if (buf) {
+			stage_buf->buf = buf;
+			stage_buf->size *= 2;
+		}
+	}
+}
@@ -74,6 +74,14 @@ static int rx_cm_data(SOCKET fd, struct ofi_ctrl_hdr *hdr,
 	if (hdr->version != TCPX_CTRL_HDR_VERSION)
 		return -FI_ENOPROTOOPT;
 
+	ret = ofi_recv_socket(fd, &cm_ctx->stripes,
+			      sizeof(cm_ctx->stripes), MSG_WAITALL);
+	if (ret != sizeof(cm_ctx->stripes))
+		return -FI_EIO;
+
+	cm_ctx->stripes.cnt = ntohl(cm_ctx->stripes.cnt);
+	cm_ctx->stripes.port = ntohs(cm_ctx->stripes.port);
+	cm_ctx->stripes.index = ntohs(cm_ctx->stripes.index);
 	ret = read_cm_data(fd, cm_ctx, hdr);
 	if (hdr->type != type) {
 		ret = -FI_ECONNREFUSED;
@@ -83,17 +91,23 @@ static int rx_cm_data(SOCKET fd, struct ofi_ctrl_hdr *hdr,
 
 static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 {
-	struct ofi_ctrl_hdr hdr;
+	struct {
+		struct ofi_ctrl_hdr	hdr;
+		struct tcpx_cm_stripes	stripes;
+	} msg;
 	ssize_t ret;
 
-	memset(&hdr, 0, sizeof(hdr));
-	hdr.version = TCPX_CTRL_HDR_VERSION;
-	hdr.type = type;
-	hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
-	hdr.conn_data = 1; /* For testing endianess mismatch at peer */
-
-	ret = ofi_send_socket(fd, &hdr, sizeof(hdr), MSG_NOSIGNAL);
-	if (ret != sizeof(hdr))
+	memset(&msg, 0, sizeof(msg));
+	msg.hdr.version = TCPX_CTRL_HDR_VERSION;
+	msg.hdr.type = type;
+	msg.hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
+	msg.hdr.conn_data = 1; /* For testing endianess mismatch at peer */
+	msg.stripes.cnt = htonl(cm_ctx->stripes.cnt);
+	msg.stripes.port = htons(cm_ctx->stripes.port);
+	msg.stripes.index = htons(cm_ctx->stripes.index);
+
+	ret = ofi_send_socket(fd, &msg, sizeof(msg), MSG_NOSIGNAL);
+	if (ret != sizeof(msg))
 		return -FI_EIO;
 
 	if (cm_ctx->cm_data_sz) {
@@ -105,8 +119,224 @@ static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 	return FI_SUCCESS;
 }
 
+#if TCPX_HAVE_ZEROCOPY
+static void tcpx_ep_zerocopy_enable(struct tcpx_ep *ep)
+{
+	int optval = 1;
+
+	if (!tcpx_env.zerocopy_size)
+		return;
+
+	if (setsockopt(ep->conn_fd, SOL_SOCKET, SO_ZEROCOPY,
+		       &optval, sizeof(optval))) {
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"SO_ZEROCOPY not supported by socket\n");
+		return;
+	}
+	ep->zc_enabled = true;
+}
+#else
+#define tcpx_ep_zerocopy_enable(ep) do{ } while(0)
+#endif
+
+/*
+ * Stripe sockets: the client asks for up to FI_TCP_STRIPES of them in
+ * its connreq.  The accepting endpoint grants at most as many, listens
+ * for them on a port of its own and names it in the connresp.  The
+ * client connects each stripe there in turn, without blocking the CM
+ * progress, and sends a connreq carrying the stripe's index.  The server
+ * accepts them in the same order, one at a time.  Each side reports the
+ * connection once all of them are up.
+ */
+void tcpx_ep_stripes_close(struct tcpx_ep *ep)
+{
+	uint32_t i;
+
+	if (ep->stripe_sock != INVALID_SOCKET) {
+		ofi_wait_fd_del(ep->util_ep.eq->wait, ep->stripe_sock);
+		ofi_close_socket(ep->stripe_sock);
+		ep->stripe_sock = INVALID_SOCKET;
+	}
+
+	for (i = 0; i < TCPX_MAX_STRIPES; i++) {
+		if (ep->stripes[i].fd != INVALID_SOCKET)
+			ofi_close_socket(ep->stripes[i].fd);
+		memset(&ep->stripes[i], 0, sizeof(ep->stripes[i]));
+		ep->stripes[i].fd = INVALID_SOCKET;
+	}
+	ep->stripe_cnt = 0;
+	ep->stripe_ready = 0;
+}
+
+/* Start connecting the next stripe; its socket reports when it is done. */
+static int tcpx_stripe_connect(struct util_wait *wait, struct tcpx_ep *ep,
+			       struct tcpx_cm_context *cm_ctx)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	SOCKET sock;
+	int ret;
+
+	if (ofi_getpeername(ep->conn_fd, (struct sockaddr *) &addr, &addrlen))
+		return -ofi_sockerr();
+	ofi_addr_set_port((struct sockaddr *) &addr, cm_ctx->stripes.port);
+
+	sock = ofi_socket(addr.ss_family, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET)
+		return -ofi_sockerr();
+	ep->stripes[ep->stripe_ready].fd = sock;
+
+	ret = tcpx_setup_socket(sock);
+	if (!ret)
+		ret = fi_fd_nonblock(sock);
+	if (ret)
+		return ret;
+
+	if (connect(sock, (struct sockaddr *) &addr, addrlen) &&
+	    ofi_sockerr() != FI_EINPROGRESS)
+		return -ofi_sockerr();
+
+	cm_ctx->type = CLIENT_STRIPE_CONNECT;
+	ret = ofi_wait_fd_add(wait, sock, FI_EPOLL_OUT,
+			      tcpx_eq_wait_try_func, NULL, cm_ctx);
+	if (ret)
+		return ret;
+
+	wait->signal(wait);
+	return FI_SUCCESS;
+}
+
+/* The connected stripe identifies itself, then the next one starts. */
+static int tcpx_stripe_join(struct util_wait *wait, struct tcpx_ep *ep,
+			    struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_cm_context join_ctx = { 0 };
+	SOCKET sock = ep->stripes[ep->stripe_ready].fd;
+	socklen_t len;
+	int status, ret;
+
+	ret = ofi_wait_fd_del(wait, sock);
+	if (ret)
+		return ret;
+
+	len = sizeof(status);
+	ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *) &status, &len);
+	if (ret < 0)
+		return -ofi_sockerr();
+	if (status)
+		return -status;
+
+	join_ctx.stripes.port = cm_ctx->stripes.port;
+	join_ctx.stripes.index = (uint16_t) ep->stripe_ready;
+	ret = tx_cm_data(sock, ofi_ctrl_connreq, &join_ctx);
+	if (ret)
+		return ret;
+
+	if (++ep->stripe_ready == ep->stripe_cnt)
+		return FI_SUCCESS;
+
+	ret = tcpx_stripe_connect(wait, ep, cm_ctx);
+	return ret ? ret : -FI_EINPROGRESS;
+}
+
+static int tcpx_stripes_listen(struct tcpx_ep *ep,
+			       struct tcpx_cm_context *cm_ctx)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+
+	ep->stripe_cnt = MIN(ep->stripe_cnt, (uint32_t) tcpx_env.stripes);
+	cm_ctx->stripes.cnt = ep->stripe_cnt;
+	if (!ep->stripe_cnt)
+		return FI_SUCCESS;
+
+	if (ofi_getsockname(ep->conn_fd, (struct sockaddr *) &addr, &addrlen))
+		return -ofi_sockerr();
+	ofi_addr_set_port((struct sockaddr *) &addr, 0);
+
+	ep->stripe_sock = ofi_socket(addr.ss_family, SOCK_STREAM, 0);
+	if (ep->stripe_sock == INVALID_SOCKET)
+		return -ofi_sockerr();
+
+	if (bind(ep->stripe_sock, (struct sockaddr *) &addr, addrlen) ||
+	    listen(ep->stripe_sock, (int) ep->stripe_cnt) ||
+	    ofi_getsockname(ep->stripe_sock, (struct sockaddr *) &addr,
+			    &addrlen))
+		return -ofi_sockerr();
+
+	cm_ctx->stripes.port = ofi_addr_get_port((struct sockaddr *) &addr);
+	return FI_SUCCESS;
+}
+
+/* Take the next stripe off the listener and wait for its connreq */
+static int tcpx_stripe_accept(struct util_wait *wait, struct tcpx_ep *ep,
+			      struct tcpx_cm_context *cm_ctx)
+{
+	SOCKET sock;
+	int ret;
+
+	ret = ofi_wait_fd_del(wait, ep->stripe_sock);
+	if (ret)
+		return ret;
+
+	sock = accept(ep->stripe_sock, NULL, 0);
+	if (sock == INVALID_SOCKET)
+		return -ofi_sockerr();
+	ep->stripes[ep->stripe_ready].fd = sock;
+
+	cm_ctx->type = SERVER_STRIPE_JOIN;
+	ret = ofi_wait_fd_add(wait, sock, FI_EPOLL_IN,
+			      tcpx_eq_wait_try_func, NULL, cm_ctx);
+	if (ret)
+		return ret;
+
+	wait->signal(wait);
+	return FI_SUCCESS;
+}
+
+static int tcpx_stripe_join_accept(struct util_wait *wait,
+				   struct tcpx_ep *ep,
+				   struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_cm_context join_ctx = { 0 };
+	SOCKET sock = ep->stripes[ep->stripe_ready].fd;
+	struct ofi_ctrl_hdr hdr;
+	int ret;
+
+	ret = ofi_wait_fd_del(wait, sock);
+	if (ret)
+		return ret;
+
+	ret = rx_cm_data(sock, &hdr, ofi_ctrl_connreq, &join_ctx);
+	if (ret)
+		return ret;
+
+	if (join_ctx.stripes.index != ep->stripe_ready)
+		return -FI_EINVAL;
+
+	ret = tcpx_setup_socket(sock);
+	if (!ret)
+		ret = fi_fd_nonblock(sock);
+	if (ret)
+		return ret;
+
+	if (++ep->stripe_ready == ep->stripe_cnt)
+		return FI_SUCCESS;
+
+	cm_ctx->type = SERVER_STRIPE_ACCEPT;
+	ret = ofi_wait_fd_add(wait, ep->stripe_sock, FI_EPOLL_IN,
+			      tcpx_eq_wait_try_func, NULL, cm_ctx);
+	if (ret)
+		return ret;
+
+	wait->signal(wait);
+	return -FI_EINPROGRESS;
+}
+
 static int tcpx_ep_msg_xfer_enable(struct tcpx_ep *ep)
 {
+	struct tcpx_xfer_entry *tx_entry;
+	struct slist_entry *entry, *prev;
 	int ret;
 
 	fastlock_acquire(&ep->lock);
@@ -119,27 +349,35 @@ static int tcpx_ep_msg_xfer_enable(struct tcpx_ep *ep)
 	if (ret)
 		goto err;
 
+	tcpx_ep_zerocopy_enable(ep);
+	ret = tcpx_cq_ep_add(ep);
+	if (ret)
+		goto err;
+
 	ret = tcpx_cq_wait_ep_add(ep);
 	if (ret)
 		goto err;
 
+	/* RDM sends queued while connecting, before hdr_bswap was known */
+	(void) prev;
+	slist_foreach(&ep->tx_queue, entry, prev) {
+		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+	}
+
 	ep->cm_state = TCPX_EP_CONNECTED;
+	tcpx_cq_update_active(ep);
 err:
 	fastlock_release(&ep->lock);
 	return ret;
 }
 
-static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
-			  struct tcpx_ep *ep)
+static int tcpx_client_connected(struct tcpx_ep *ep,
+				 struct tcpx_cm_context *cm_ctx)
 {
-	struct ofi_ctrl_hdr conn_resp;
 	struct fi_eq_cm_entry *cm_entry;
 	ssize_t len;
-	int ret = FI_SUCCESS;
-
-	ret = rx_cm_data(ep->conn_fd, &conn_resp, ofi_ctrl_connresp, cm_ctx);
-	if (ret)
-		return ret;
+	int ret;
 
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
@@ -148,9 +386,6 @@ static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
 	cm_entry->fid = cm_ctx->fid;
 	memcpy(cm_entry->data, cm_ctx->cm_data, cm_ctx->cm_data_sz);
 
-	ep->hdr_bswap = (conn_resp.conn_data == 1)?
-		tcpx_hdr_none:tcpx_hdr_bswap;
-
 	ret = tcpx_ep_msg_xfer_enable(ep);
 	if (ret)
 		goto err;
@@ -166,17 +401,69 @@ err:
 	return ret;
 }
 
+static int proc_conn_resp(struct util_wait *wait,
+			  struct tcpx_cm_context *cm_ctx,
+			  struct tcpx_ep *ep)
+{
+	struct ofi_ctrl_hdr conn_resp;
+	int ret;
+
+	ret = rx_cm_data(ep->conn_fd, &conn_resp, ofi_ctrl_connresp, cm_ctx);
+	if (ret)
+		return ret;
+
+	ep->hdr_bswap = (conn_resp.conn_data == 1)?
+		tcpx_hdr_none:tcpx_hdr_bswap;
+
+	if (!cm_ctx->stripes.cnt)
+		return tcpx_client_connected(ep, cm_ctx);
+
+	if (cm_ctx->stripes.cnt > (uint32_t) tcpx_env.stripes)
+		return -FI_EINVAL;
+
+	ep->stripe_cnt = cm_ctx->stripes.cnt;
+	ret = tcpx_stripe_connect(wait, ep, cm_ctx);
+	return ret ? ret : -FI_EINPROGRESS;
+}
+
 int tcpx_eq_wait_try_func(void *arg)
 {
 	return FI_SUCCESS;
 }
 
+static void client_connect_err(struct tcpx_ep *ep,
+			       struct tcpx_cm_context *cm_ctx, int ret)
+{
+	struct fi_eq_err_entry err_entry = { 0 };
+
+	tcpx_ep_stripes_close(ep);
+	err_entry.fid = cm_ctx->fid;
+	err_entry.context = cm_ctx->fid->context;
+	err_entry.err = -ret;
+	if (cm_ctx->cm_data_sz) {
+		err_entry.err_data = calloc(1, cm_ctx->cm_data_sz);
+		if (OFI_LIKELY(err_entry.err_data != NULL)) {
+			memcpy(err_entry.err_data, cm_ctx->cm_data,
+			       cm_ctx->cm_data_sz);
+			err_entry.err_data_size = cm_ctx->cm_data_sz;
+		}
+	}
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL,
+	       "fi_eq_write the conn refused %d\n", ret);
+	free(cm_ctx);
+	/* `err_entry.err_data` must live until it is passed to user */
+	if (OFI_UNLIKELY(fi_eq_write(&ep->util_ep.eq->eq_fid, FI_NOTIFY,
+				     &err_entry, sizeof(err_entry),
+				     UTIL_FLAG_ERROR) < 0)) {
+		free(err_entry.err_data);
+	}
+}
+
 static void client_recv_connresp(struct util_wait *wait,
 				 struct tcpx_cm_context *cm_ctx)
 {
-	struct fi_eq_err_entry err_entry = { 0 };
 	struct tcpx_ep *ep;
-	ssize_t ret;
+	int ret;
 
 	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
 	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
@@ -188,7 +475,9 @@ static void client_recv_connresp(struct util_wait *wait,
 		goto err;
 	}
 
-	ret = proc_conn_resp(cm_ctx, ep);
+	ret = proc_conn_resp(wait, cm_ctx, ep);
+	if (ret == -FI_EINPROGRESS)
+		return;
 	if (ret)
 		goto err;
 
@@ -196,40 +485,45 @@ static void client_recv_connresp(struct util_wait *wait,
 	free(cm_ctx);
 	return;
 err:
-	err_entry.fid = cm_ctx->fid;
-	err_entry.context = cm_ctx->fid->context;
-	err_entry.err = -ret;
-	if (cm_ctx->cm_data_sz) {
-		err_entry.err_data = calloc(1, cm_ctx->cm_data_sz);
-		if (OFI_LIKELY(err_entry.err_data != NULL)) {
-			memcpy(err_entry.err_data, cm_ctx->cm_data,
-			       cm_ctx->cm_data_sz);
-			err_entry.err_data_size = cm_ctx->cm_data_sz;
-		}
-	}
-	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL,
-	       "fi_eq_write the conn refused %"PRId64"\n", ret);
-	free(cm_ctx);
-	/* `err_entry.err_data` must live until it is passed to user */
-	ret = fi_eq_write(&ep->util_ep.eq->eq_fid, FI_NOTIFY,
-			  &err_entry, sizeof(err_entry), UTIL_FLAG_ERROR);
-	if (OFI_UNLIKELY(ret < 0)) {
-		free(err_entry.err_data);
-	}
+	client_connect_err(ep, cm_ctx, ret);
 }
 
-static void server_send_cm_accept(struct util_wait *wait,
+static void client_stripe_connect(struct util_wait *wait,
 				  struct tcpx_cm_context *cm_ctx)
 {
-	struct fi_eq_cm_entry cm_entry = {0};
-	struct fi_eq_err_entry err_entry;
 	struct tcpx_ep *ep;
 	int ret;
 
 	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
 	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
 
-	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connresp, cm_ctx);
+	ret = tcpx_stripe_join(wait, ep, cm_ctx);
+	if (ret == -FI_EINPROGRESS)
+		return;
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to connect stripe socket: %d\n", ret);
+		goto err;
+	}
+
+	ret = tcpx_client_connected(ep, cm_ctx);
+	if (ret)
+		goto err;
+
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Received Accept from server\n");
+	free(cm_ctx);
+	return;
+err:
+	client_connect_err(ep, cm_ctx, ret);
+}
+
+static void server_accept_done(struct tcpx_cm_context *cm_ctx, int ret)
+{
+	struct fi_eq_cm_entry cm_entry = {0};
+	struct fi_eq_err_entry err_entry;
+	struct tcpx_ep *ep;
+
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
 	if (ret)
 		goto err;
 
@@ -240,13 +534,6 @@ static void server_send_cm_accept(struct util_wait *wait,
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "Error writing to EQ\n");
 	}
 
-	ret = ofi_wait_fd_del(wait, ep->conn_fd);
-	if (ret) {
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"Could not remove fd from wait\n");
-		goto err;
-	}
-
 	ret = tcpx_ep_msg_xfer_enable(ep);
 	if (ret)
 		goto err;
@@ -265,6 +552,93 @@ err:
 		    &err_entry, sizeof(err_entry), UTIL_FLAG_ERROR);
 }
 
+static void server_stripe_accept(struct util_wait *wait,
+				 struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_ep *ep;
+	int ret;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+
+	ret = tcpx_stripe_accept(wait, ep, cm_ctx);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to accept stripe socket: %d\n", ret);
+		tcpx_ep_stripes_close(ep);
+		server_accept_done(cm_ctx, ret);
+	}
+}
+
+static void server_stripe_join(struct util_wait *wait,
+			       struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_ep *ep;
+	int ret;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+
+	ret = tcpx_stripe_join_accept(wait, ep, cm_ctx);
+	if (ret == -FI_EINPROGRESS)
+		return;
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to accept stripe socket: %d\n", ret);
+		tcpx_ep_stripes_close(ep);
+		server_accept_done(cm_ctx, ret);
+		return;
+	}
+
+	ofi_close_socket(ep->stripe_sock);
+	ep->stripe_sock = INVALID_SOCKET;
+	server_accept_done(cm_ctx, FI_SUCCESS);
+}
+
+static void server_send_cm_accept(struct util_wait *wait,
+				  struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_ep *ep;
+	int ret;
+
+	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
+	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
+
+	ret = tcpx_stripes_listen(ep, cm_ctx);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to listen for stripe sockets: %d\n", ret);
+		tcpx_ep_stripes_close(ep);
+		cm_ctx->stripes.cnt = 0;
+	}
+
+	ret = tx_cm_data(ep->conn_fd, ofi_ctrl_connresp, cm_ctx);
+	if (ret)
+		goto err;
+
+	ret = ofi_wait_fd_del(wait, ep->conn_fd);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Could not remove fd from wait\n");
+		goto err;
+	}
+
+	/* The connection is reported once every stripe socket has
+	 * arrived.  A peer that fails to open them is never reported.
+	 */
+	if (ep->stripe_cnt) {
+		cm_ctx->type = SERVER_STRIPE_ACCEPT;
+		ret = ofi_wait_fd_add(wait, ep->stripe_sock, FI_EPOLL_IN,
+				      tcpx_eq_wait_try_func, NULL, cm_ctx);
+		if (ret)
+			goto err;
+		wait->signal(wait);
+		return;
+	}
+err:
+	server_accept_done(cm_ctx, ret);
+}
+
 static void server_recv_connreq(struct util_wait *wait,
 				struct tcpx_cm_context *cm_ctx)
 {
@@ -283,6 +657,8 @@ static void server_recv_connreq(struct util_wait *wait,
 	if (ret)
 		goto err1;
 
+	handle->stripe_cnt = cm_ctx->stripes.cnt;
+
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
 		goto err1;
@@ -440,6 +816,15 @@ static void process_cm_ctx(struct util_wait *wait,
 	case CLIENT_RECV_CONNRESP:
 		client_recv_connresp(wait, cm_ctx);
 		break;
+	case SERVER_STRIPE_ACCEPT:
+		server_stripe_accept(wait, cm_ctx);
+		break;
+	case SERVER_STRIPE_JOIN:
+		server_stripe_join(wait, cm_ctx);
+		break;
+	case CLIENT_STRIPE_CONNECT:
+		client_stripe_connect(wait, cm_ctx);
+		break;
 	default:
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"should never end up here\n");
@@ -45,6 +45,275 @@ static void tcpx_buf_pools_destroy(struct tcpx_buf_pool *buf_pools)
 		util_buf_pool_destroy(buf_pools[i].pool);
 }
 
+/* Called from CQ progress, and by progress threads when they go idle */
+void tcpx_cq_trim(struct util_cq *cq)
+{
+	struct tcpx_cq *tcpx_cq;
+	uint64_t now;
+	int i;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	now = fi_gettime_ms();
+	if (now < tcpx_cq->trim_time)
+		return;
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	if (now >= tcpx_cq->trim_time) {
+		tcpx_cq->trim_time = now + TCPX_POOL_TRIM_MS;
+		for (i = 0; i < TCPX_OP_CODE_MAX; i++)
+			util_buf_pool_trim(tcpx_cq->buf_pools[i].pool, now);
+	}
+	cq->cq_fastlock_release(&cq->cq_lock);
+}
+
+static void tcpx_cq_progress(struct util_cq *cq)
+{
+	void *contexts[MAX_EPOLL_EVENTS];
+	struct tcpx_active_entry *active;
+	struct dlist_entry active_list;
+	struct tcpx_domain *domain;
+	struct util_ep *util_ep;
+	struct tcpx_cq *tcpx_cq;
+	int nfds, i;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	domain = container_of(cq->domain, struct tcpx_domain, util_domain);
+	cq->cq_fastlock_acquire(&cq->ep_list_lock);
+	if (domain->uring)
+		tcpx_uring_progress(domain->uring);
+
+	/* Endpoints requeue themselves if they still need progress */
+	dlist_init(&active_list);
+	fastlock_acquire(&tcpx_cq->active_lock);
+	dlist_splice_tail(&active_list, &tcpx_cq->active_list);
+	while (!dlist_empty(&active_list)) {
+		dlist_pop_front(&active_list, struct tcpx_active_entry,
+				active, entry);
+		dlist_init(&active->entry);
+		fastlock_release(&tcpx_cq->active_lock);
+
+		tcpx_progress(&active->ep->util_ep);
+
+		fastlock_acquire(&tcpx_cq->active_lock);
+	}
+	fastlock_release(&tcpx_cq->active_lock);
+
+	if (ofi_atomic_get32(&tcpx_cq->epoll_cnt)) {
+		nfds = fi_epoll_wait(tcpx_cq->epoll_fd, contexts,
+				     MAX_EPOLL_EVENTS, 0);
+		for (i = 0; i < nfds; i++) {
+			util_ep = contexts[i];
+			util_ep->progress(util_ep);
+		}
+	}
+
+	/* hand the kernel whatever the endpoints just posted */
+	if (domain->uring)
+		tcpx_uring_progress(domain->uring);
+	tcpx_cq_trim(cq);
+	cq->cq_fastlock_release(&cq->ep_list_lock);
+}
+
+static void tcpx_cq_set_active(struct util_cq *cq,
+			       struct tcpx_active_entry *active, int set)
+{
+	struct tcpx_cq *tcpx_cq;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	fastlock_acquire(&tcpx_cq->active_lock);
+	if (set && dlist_empty(&active->entry))
+		dlist_insert_tail(&active->entry, &tcpx_cq->active_list);
+	else if (!set && !dlist_empty(&active->entry))
+		dlist_remove_init(&active->entry);
+	fastlock_release(&tcpx_cq->active_lock);
+}
+
+static void tcpx_cq_ep_set_active(struct tcpx_ep *ep, int set)
+{
+	if (ep->thread) {
+		tcpx_thread_set_active(ep, set);
+		return;
+	}
+
+	tcpx_cq_set_active(ep->util_ep.rx_cq, &ep->rx_active, set);
+	if (ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+		tcpx_cq_set_active(ep->util_ep.tx_cq, &ep->tx_active, set);
+}
+
+/*
+ * Called with the ep lock held.  Epoll reports new socket data, so an
+ * endpoint must be progressed without waiting only while it has sends
+ * queued or staged data that has not been parsed yet.
+ */
+void tcpx_cq_update_active(struct tcpx_ep *ep)
+{
+	int set;
+
+	if (ep->cm_state != TCPX_EP_CONNECTED)
+		return;
+
+	/* with an io_uring, posted ops report back through the ring */
+	if (ep->uring)
+		set = (!slist_empty(&ep->tx_queue) && !ep->uring_tx_posted) ||
+		      !ep->uring_rx_posted;
+	else
+		set = !slist_empty(&ep->tx_queue) ||
+		      (ep->stage_buf.off != ep->stage_buf.len &&
+		       !tcpx_ep_rx_blocked(ep));
+
+	tcpx_cq_ep_set_active(ep, set);
+}
+
+/* Called with the ep lock held after a receive is queued */
+void tcpx_cq_recv_posted(struct tcpx_ep *ep)
+{
+	if (ep->cm_state == TCPX_EP_CONNECTED && tcpx_ep_rx_blocked(ep))
+		tcpx_cq_ep_set_active(ep, 1);
+}
+
+/*
+ * For a shared receive context that has room again.  It cannot take the
+ * ep lock, but the endpoint is only marked active: progress drops it from
+ * the active list again if it has nothing to do.
+ */
+void tcpx_cq_ep_wake(struct tcpx_ep *ep)
+{
+	tcpx_cq_ep_set_active(ep, 1);
+}
+
+static int tcpx_cq_epoll_add(struct util_cq *cq, struct tcpx_ep *ep)
+{
+	struct tcpx_cq *tcpx_cq;
+	uint32_t i;
+	int ret;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	for (i = 0; i <= ep->stripe_cnt; i++) {
+		ret = fi_epoll_add(tcpx_cq->epoll_fd, tcpx_ep_rx_fd(ep, i),
+				   FI_EPOLL_IN, &ep->util_ep);
+		if (ret)
+			goto err;
+	}
+	ofi_atomic_inc32(&tcpx_cq->epoll_cnt);
+	return FI_SUCCESS;
+err:
+	while (i--)
+		fi_epoll_del(tcpx_cq->epoll_fd, tcpx_ep_rx_fd(ep, i));
+	return ret;
+}
+
+static void tcpx_cq_epoll_del(struct util_cq *cq, struct tcpx_ep *ep)
+{
+	struct tcpx_cq *tcpx_cq;
+	uint32_t i;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	for (i = 0; i <= ep->stripe_cnt; i++)
+		fi_epoll_del(tcpx_cq->epoll_fd, tcpx_ep_rx_fd(ep, i));
+	ofi_atomic_dec32(&tcpx_cq->epoll_cnt);
+}
+
+/*
+ * An RDM endpoint registers the fd of its connection manager's wait set,
+ * so that it is progressed only while connections are being set up.
+ */
+int tcpx_cq_rdm_add(struct util_cq *cq, struct tcpx_rdm *rdm, int fd)
+{
+	struct tcpx_cq *tcpx_cq;
+	int ret;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	ret = fi_epoll_add(tcpx_cq->epoll_fd, fd, FI_EPOLL_IN, &rdm->util_ep);
+	if (ret)
+		return ret;
+
+	if (cq->wait) {
+		ret = ofi_wait_fd_add(cq->wait, fd, FI_EPOLL_IN,
+				      tcpx_eq_wait_try_func, NULL, NULL);
+		if (ret) {
+			fi_epoll_del(tcpx_cq->epoll_fd, fd);
+			return ret;
+		}
+	}
+	ofi_atomic_inc32(&tcpx_cq->epoll_cnt);
+	return FI_SUCCESS;
+}
+
+void tcpx_cq_rdm_del(struct util_cq *cq, int fd)
+{
+	struct tcpx_cq *tcpx_cq;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	cq->cq_fastlock_acquire(&cq->ep_list_lock);
+	fi_epoll_del(tcpx_cq->epoll_fd, fd);
+	ofi_atomic_dec32(&tcpx_cq->epoll_cnt);
+	cq->cq_fastlock_release(&cq->ep_list_lock);
+
+	if (cq->wait)
+		ofi_wait_fd_del(cq->wait, fd);
+}
+
+/*
+ * Called with the ep lock held.  With progress threads, a thread owns the
+ * endpoint.  Otherwise endpoints do their socket I/O through the domain's
+ * io_uring when it has one, unless they send with MSG_ZEROCOPY or have
+ * stripe sockets; anything else is driven by socket readiness.
+ */
+int tcpx_cq_ep_add(struct tcpx_ep *ep)
+{
+	struct tcpx_domain *domain;
+	int ret;
+
+	domain = container_of(ep->util_ep.domain, struct tcpx_domain,
+			      util_domain);
+	if (domain->threads)
+		return tcpx_thread_ep_add(ep, domain->threads);
+
+	if (domain->uring && !ep->zc_enabled && !ep->stripe_cnt)
+		return tcpx_uring_ep_add(ep, domain->uring);
+
+	ret = tcpx_cq_epoll_add(ep->util_ep.rx_cq, ep);
+	if (ret || ep->util_ep.tx_cq == ep->util_ep.rx_cq)
+		return ret;
+
+	ret = tcpx_cq_epoll_add(ep->util_ep.tx_cq, ep);
+	if (ret)
+		tcpx_cq_epoll_del(ep->util_ep.rx_cq, ep);
+	return ret;
+}
+
+void tcpx_cq_ep_del(struct tcpx_ep *ep)
+{
+	if (ep->thread) {
+		tcpx_thread_ep_del(ep);
+		return;
+	}
+
+	fastlock_acquire(&ep->lock);
+	/* an RDM connection that failed to connect was never added */
+	if (ep->cm_state == TCPX_EP_CONNECTING ||
+	    ep->cm_state == TCPX_EP_ERROR)
+		goto out;
+
+	if (!ep->uring) {
+		tcpx_cq_epoll_del(ep->util_ep.rx_cq, ep);
+		if (ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+			tcpx_cq_epoll_del(ep->util_ep.tx_cq, ep);
+	}
+
+	/* keep a concurrent progress call from requeuing the endpoint */
+	if (ep->cm_state == TCPX_EP_CONNECTED)
+		ep->cm_state = TCPX_EP_SHUTDOWN;
+
+	tcpx_cq_set_active(ep->util_ep.rx_cq, &ep->rx_active, 0);
+	if (ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+		tcpx_cq_set_active(ep->util_ep.tx_cq, &ep->tx_active, 0);
+out:
+	fastlock_release(&ep->lock);
+	if (ep->uring)
+		tcpx_uring_ep_del(ep);
+}
+
 static int tcpx_cq_close(struct fid *fid)
 {
 	int ret;
@@ -56,6 +325,8 @@ static int tcpx_cq_close(struct fid *fid)
 	if (ret)
 		return ret;
 
+	fi_epoll_close(tcpx_cq->epoll_fd);
+	fastlock_destroy(&tcpx_cq->active_lock);
 	free(tcpx_cq);
 	return 0;
 }
@@ -68,7 +339,7 @@ struct tcpx_xfer_entry *tcpx_xfer_entry_alloc(struct tcpx_cq *tcpx_cq,
 	tcpx_cq->util_cq.cq_fastlock_acquire(&tcpx_cq->util_cq.cq_lock);
 
 	/* optimization: don't allocate queue_entry when cq is full */
-	if (ofi_cirque_isfull(tcpx_cq->util_cq.cirq)) {
+	if (ofi_cq_isfull(&tcpx_cq->util_cq)) {
 		tcpx_cq->util_cq.cq_fastlock_release(&tcpx_cq->util_cq.cq_lock);
 		return NULL;
 	}
@@ -91,9 +362,11 @@ void tcpx_xfer_entry_release(struct tcpx_cq *tcpx_cq,
 	}
 
 	xfer_entry->hdr.base_hdr.flags = 0;
+	xfer_entry->hdr.base_hdr.stripes = 0;
 
 	xfer_entry->flags = 0;
 	xfer_entry->context = 0;
+	xfer_entry->zc_pending = false;
 
 	tcpx_cq->util_cq.cq_fastlock_acquire(&tcpx_cq->util_cq.cq_lock);
 	util_buf_release(tcpx_cq->buf_pools[xfer_entry->hdr.base_hdr.op_data].pool,
@@ -101,16 +374,55 @@ void tcpx_xfer_entry_release(struct tcpx_cq *tcpx_cq,
 	tcpx_cq->util_cq.cq_fastlock_release(&tcpx_cq->util_cq.cq_lock);
 }
 
+/*
+ * Wait set check for endpoints using the domain's io_uring.  Endpoints on
+ * the active list have ops to post, which only happens from CQ progress.
+ */
+int tcpx_cq_uring_wait_try(void *arg)
+{
+	struct util_cq *cq = arg;
+	struct tcpx_domain *domain;
+	struct tcpx_cq *tcpx_cq;
+	int empty;
+
+	tcpx_cq = container_of(cq, struct tcpx_cq, util_cq);
+	fastlock_acquire(&tcpx_cq->active_lock);
+	empty = dlist_empty(&tcpx_cq->active_list);
+	fastlock_release(&tcpx_cq->active_lock);
+	if (!empty)
+		return -FI_EAGAIN;
+
+	domain = container_of(cq->domain, struct tcpx_domain, util_domain);
+	return tcpx_uring_wait_try(domain->uring);
+}
+
+/* ofi_cq_signal would make a blocked reader give up with -FI_ECANCELED */
+void tcpx_cq_signal(struct util_cq *cq, struct tcpx_ep *ep)
+{
+	if (cq->wait)
+		cq->wait->signal(cq->wait);
+}
+
 void tcpx_cq_report_completion(struct util_cq *cq,
 			       struct tcpx_xfer_entry *xfer_entry,
 			       int err)
 {
 	struct fi_cq_err_entry err_entry;
-	uint64_t data = 0;
+	uint64_t data = 0, tag = 0;
+	size_t len = 0;
+	void *buf = NULL;
+
+	if (xfer_entry->mrecv) {
+		buf = xfer_entry->mrecv_buf;
+		tcpx_mrecv_put(xfer_entry);
+	}
 
 	if (!(xfer_entry->flags & FI_COMPLETION))
 		return;
 
+	if (xfer_entry->flags & FI_TAGGED)
+		tag = xfer_entry->tag;
+
 	if (xfer_entry->hdr.base_hdr.flags &
 	    OFI_REMOTE_CQ_DATA) {
 		data = *((uint64_t *)
@@ -125,7 +437,7 @@ void tcpx_cq_report_completion(struct util_cq *cq,
 		err_entry.len = 0;
 		err_entry.buf = NULL;
 		err_entry.data = data;
-		err_entry.tag = 0;
+		err_entry.tag = tag;
 		err_entry.olen = 0;
 		err_entry.err = err;
 		err_entry.prov_errno = ofi_sockerr();
@@ -134,11 +446,13 @@ void tcpx_cq_report_completion(struct util_cq *cq,
 
 		ofi_cq_write_error(cq, &err_entry);
 	} else {
+		if (xfer_entry->flags & FI_RECV)
+			len = xfer_entry->hdr.base_hdr.size -
+			      xfer_entry->hdr.base_hdr.payload_off;
 		ofi_cq_write(cq, xfer_entry->context,
-			     xfer_entry->flags, 0, NULL,
-			     data, 0);
-		if (cq->wait)
-			ofi_cq_signal(&cq->cq_fid);
+			     xfer_entry->flags, len, buf,
+			     data, tag);
+		tcpx_cq_signal(cq, xfer_entry->ep);
 	}
 }
 
@@ -173,60 +487,120 @@ static struct fi_ops tcpx_cq_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
-/* Using this function to preset some values of buffers managed by util_buf_pool api.
- * Note that the util_buf_pool uses first sizeof(slist_entry) bytes in every buffer
- * internally for keeping buf list. So don't try to set those values. They won't stick
+/*
+ * With FI_TCP_SPIN_TIME, a blocking read first polls the CQ for that long.
+ * Each poll progresses all of the CQ's endpoints through one epoll call,
+ * and no endpoint lock is held between polls.  The spin is spent once per
+ * call, however many endpoints are bound.
  */
-static int tcpx_buf_pool_init(void *pool_ctx, void *addr,
-			      size_t len, void **context)
+static ssize_t tcpx_cq_sreadfrom(struct fid_cq *cq_fid, void *buf,
+				 size_t count, fi_addr_t *src_addr,
+				 const void *cond, int timeout)
 {
-	struct tcpx_buf_pool *pool = (struct tcpx_buf_pool *)pool_ctx;
-	struct tcpx_xfer_entry *xfer_entry;
-	int i;
+	uint64_t start, end;
+	ssize_t ret;
+
+	if (tcpx_env.spin_time) {
+		start = fi_gettime_us();
+		end = start + tcpx_env.spin_time;
+		do {
+			ret = ofi_cq_readfrom(cq_fid, buf, count, src_addr);
+			if (ret != -FI_EAGAIN)
+				return ret;
+		} while (fi_gettime_us() < end);
+
+		if (timeout > 0)
+			timeout = MAX(timeout - (int) ((fi_gettime_us() -
+						start) / 1000), 0);
+	}
 
-	for (i = 0; i < pool->pool->attr.chunk_cnt; i++) {
-		xfer_entry = (struct tcpx_xfer_entry *)
-			((char *)addr + i * pool->pool->entry_sz);
-
-		xfer_entry->hdr.base_hdr.version = TCPX_HDR_VERSION;
-		xfer_entry->hdr.base_hdr.op_data = pool->op_type;
-		switch (pool->op_type) {
-		case TCPX_OP_MSG_RECV:
-		case TCPX_OP_MSG_SEND:
-		case TCPX_OP_MSG_RESP:
-			xfer_entry->hdr.base_hdr.op = ofi_op_msg;
-			break;
-		case TCPX_OP_WRITE:
-		case TCPX_OP_REMOTE_WRITE:
-			xfer_entry->hdr.base_hdr.op = ofi_op_write;
-			break;
-		case TCPX_OP_READ_REQ:
-			xfer_entry->hdr.base_hdr.op = ofi_op_read_req;
-			break;
-		case TCPX_OP_READ_RSP:
-			xfer_entry->hdr.base_hdr.op = ofi_op_read_rsp;
-			break;
-		case TCPX_OP_REMOTE_READ:
-			break;
-		default:
-			assert(0);
-			break;
-		}
+	return ofi_cq_sreadfrom(cq_fid, buf, count, src_addr, cond, timeout);
+}
+
+static ssize_t tcpx_cq_sread(struct fid_cq *cq_fid, void *buf, size_t count,
+			     const void *cond, int timeout)
+{
+	return tcpx_cq_sreadfrom(cq_fid, buf, count, NULL, cond, timeout);
+}
+
+static const char *tcpx_cq_strerror(struct fid_cq *cq_fid, int prov_errno,
+				    const void *err_data, char *buf, size_t len)
+{
+	return fi_strerror(prov_errno);
+}
+
+static struct fi_ops_cq tcpx_cq_ops = {
+	.size = sizeof(struct fi_ops_cq),
+	.read = ofi_cq_read,
+	.readfrom = ofi_cq_readfrom,
+	.readerr = ofi_cq_readerr,
+	.sread = tcpx_cq_sread,
+	.sreadfrom = tcpx_cq_sreadfrom,
+	.signal = ofi_cq_signal,
+	.strerror = tcpx_cq_strerror,
+};
+
+/* Presets some values of buffers managed by the util_buf_pool api.  The
+ * pool calls this for each buffer the first time it is handed out.
+ */
+static void tcpx_buf_pool_init(void *pool_ctx, void *buf)
+{
+	struct tcpx_buf_pool *pool = (struct tcpx_buf_pool *)pool_ctx;
+	struct tcpx_xfer_entry *xfer_entry = buf;
+
+	xfer_entry->hdr.base_hdr.version = TCPX_HDR_VERSION;
+	xfer_entry->hdr.base_hdr.op_data = pool->op_type;
+	xfer_entry->zc_pending = false;
+	xfer_entry->mrecv = NULL;
+	switch (pool->op_type) {
+	case TCPX_OP_MSG_RECV:
+	case TCPX_OP_MSG_SEND:
+	case TCPX_OP_MSG_RESP:
+		xfer_entry->hdr.base_hdr.op = ofi_op_msg;
+		break;
+	case TCPX_OP_WRITE:
+	case TCPX_OP_REMOTE_WRITE:
+		xfer_entry->hdr.base_hdr.op = ofi_op_write;
+		break;
+	case TCPX_OP_READ_REQ:
+		xfer_entry->hdr.base_hdr.op = ofi_op_read_req;
+		break;
+	case TCPX_OP_READ_RSP:
+		xfer_entry->hdr.base_hdr.op = ofi_op_read_rsp;
+		break;
+	case TCPX_OP_TAGGED_SEND:
+		xfer_entry->hdr.base_hdr.op = ofi_op_tagged;
+		break;
+	case TCPX_OP_REMOTE_READ:
+		break;
+	default:
+		assert(0);
+		break;
 	}
-	return FI_SUCCESS;
 }
 
 static int tcpx_buf_pools_create(struct tcpx_buf_pool *buf_pools)
 {
+	struct util_buf_attr attr = {
+		.size		= sizeof(struct tcpx_xfer_entry),
+		.alignment	= 16,
+		.max_cnt	= 0,
+		.chunk_cnt	= TCPX_POOL_CHUNK_CNT,
+		.init		= tcpx_buf_pool_init,
+		.track_used	= 1,
+		.trim_idle_ms	= TCPX_POOL_TRIM_MS,
+		.trim_hwm	= TCPX_POOL_CHUNK_CNT,
+		.indexing	= {
+			.used		= 1,
+		},
+	};
 	int i, ret;
 
 	for (i = 0; i < TCPX_OP_CODE_MAX; i++) {
 		buf_pools[i].op_type = i;
 
-		ret = util_buf_pool_create_ex(&buf_pools[i].pool,
-					      sizeof(struct tcpx_xfer_entry),
-					      16, 0, 1024, tcpx_buf_pool_init,
-					      NULL, &buf_pools[i]);
+		attr.ctx = &buf_pools[i];
+		ret = util_buf_pool_create_attr(&attr, &buf_pools[i].pool);
 		if (ret) {
 			FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 				"Unable to create buf pool\n");
@@ -246,6 +620,7 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 {
 	int ret;
 	struct tcpx_cq *tcpx_cq;
+	struct tcpx_domain *tcpx_domain;
 
 	tcpx_cq = calloc(1, sizeof(*tcpx_cq));
 	if (!tcpx_cq)
@@ -258,15 +633,38 @@ int tcpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto free_cq;
 
-	ret = ofi_cq_init(&tcpx_prov, domain, attr, &tcpx_cq->util_cq,
-			  &ofi_cq_progress, context);
+	ret = fi_epoll_create(&tcpx_cq->epoll_fd);
 	if (ret)
 		goto destroy_pool;
 
+	ofi_atomic_initialize32(&tcpx_cq->epoll_cnt, 0);
+	dlist_init(&tcpx_cq->active_list);
+	fastlock_init(&tcpx_cq->active_lock);
+
+	ret = ofi_cq_init(&tcpx_prov, domain, attr, &tcpx_cq->util_cq,
+			  &tcpx_cq_progress, context);
+	if (ret)
+		goto close_epoll;
+
+	/* progress threads write completions behind the application's back,
+	 * but a single reader can still skip the lock */
+	tcpx_domain = container_of(domain, struct tcpx_domain,
+				   util_domain.domain_fid);
+	if (tcpx_domain->threads) {
+		tcpx_cq->util_cq.cq_fastlock_acquire = ofi_fastlock_acquire;
+		tcpx_cq->util_cq.cq_fastlock_release = ofi_fastlock_release;
+		(void) ofi_cq_enable_spsc(&tcpx_cq->util_cq);
+	}
+
 	*cq_fid = &tcpx_cq->util_cq.cq_fid;
 	(*cq_fid)->fid.ops = &tcpx_cq_fi_ops;
+	if (tcpx_cq->util_cq.wait)
+		(*cq_fid)->ops = &tcpx_cq_ops;
 	return 0;
 
+close_epoll:
+	fastlock_destroy(&tcpx_cq->active_lock);
+	fi_epoll_close(tcpx_cq->epoll_fd);
 destroy_pool:
 	tcpx_buf_pools_destroy(tcpx_cq->buf_pools);
 free_cq:
@@ -35,6 +35,8 @@
 
 #include "tcpx.h"
 extern struct fi_ops_msg tcpx_srx_msg_ops;
+extern struct fi_ops_tagged tcpx_srx_tagged_ops;
+extern struct fi_ops_ep tcpx_srx_ep_ops;
 
 static int tcpx_srx_ctx_close(struct fid *fid)
 {
@@ -51,6 +53,19 @@ static int tcpx_srx_ctx_close(struct fid *fid)
 		util_buf_release(srx_ctx->buf_pool, xfer_entry);
 	}
 
+	while (!slist_empty(&srx_ctx->tag_queue)) {
+		entry = slist_remove_head(&srx_ctx->tag_queue);
+		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		util_buf_release(srx_ctx->buf_pool, xfer_entry);
+	}
+
+	while (!slist_empty(&srx_ctx->unexp_queue)) {
+		entry = slist_remove_head(&srx_ctx->unexp_queue);
+		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		free(xfer_entry->unexp_buf);
+		util_buf_release(srx_ctx->buf_pool, xfer_entry);
+	}
+
 	util_buf_pool_destroy(srx_ctx->buf_pool);
 	fastlock_destroy(&srx_ctx->lock);
 	free(srx_ctx);
@@ -79,8 +94,14 @@ static int tcpx_srx_ctx(struct fid_domain *domain, struct fi_rx_attr *attr,
 	srx_ctx->rx_fid.fid.context = context;
 	srx_ctx->rx_fid.fid.ops = &fi_ops_srx_ctx;
 
+	srx_ctx->rx_fid.ops = &tcpx_srx_ep_ops;
 	srx_ctx->rx_fid.msg = &tcpx_srx_msg_ops;
+	srx_ctx->rx_fid.tagged = &tcpx_srx_tagged_ops;
+	srx_ctx->min_multi_recv = TCPX_MIN_MULTI_RECV;
 	slist_init(&srx_ctx->rx_queue);
+	slist_init(&srx_ctx->tag_queue);
+	slist_init(&srx_ctx->unexp_queue);
+	dlist_init(&srx_ctx->blocked_list);
 
 	ret = fastlock_init(&srx_ctx->lock);
 	if (ret)
@@ -126,6 +147,10 @@ static int tcpx_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	if (tcpx_domain->uring)
+		tcpx_uring_close(tcpx_domain->uring);
+	if (tcpx_domain->threads)
+		tcpx_threads_close(tcpx_domain->threads);
 	free(tcpx_domain);
 	return 0;
 }
@@ -163,12 +188,36 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err;
 
+	ret = ofi_mr_domain_cache_init(&tcpx_domain->util_domain);
+	if (ret)
+		goto close;
+
+	if (tcpx_env.progress_threads) {
+		ret = tcpx_threads_open(&tcpx_domain->threads,
+					tcpx_env.progress_threads);
+		if (ret) {
+			FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "unable to start "
+				"progress threads (%d)\n", ret);
+			goto close;
+		}
+	} else if (tcpx_env.io_uring) {
+		ret = tcpx_uring_open(&tcpx_domain->uring,
+				      tcpx_env.io_uring_size);
+		if (ret) {
+			FI_INFO(&tcpx_prov, FI_LOG_DOMAIN, "unable to set up "
+				"io_uring (%d), using socket calls\n", ret);
+			tcpx_domain->uring = NULL;
+		}
+	}
+
 	*domain = &tcpx_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &tcpx_domain_fi_ops;
 	(*domain)->ops = &tcpx_domain_ops;
 	(*domain)->mr = &tcpx_domain_fi_ops_mr;
 
 	return 0;
+close:
+	ofi_domain_close(&tcpx_domain->util_domain);
 err:
 	free(tcpx_domain);
 	return ret;
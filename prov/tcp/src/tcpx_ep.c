@@ -40,6 +40,7 @@
 
 extern struct fi_ops_rma tcpx_rma_ops;
 extern struct fi_ops_msg tcpx_msg_ops;
+extern struct fi_ops_tagged tcpx_tagged_ops;
 
 void tcpx_hdr_none(struct tcpx_base_hdr *hdr) {}
 
@@ -57,6 +58,9 @@ void tcpx_hdr_bswap(struct tcpx_base_hdr *hdr)
 		ptr += sizeof(uint64_t);
 	}
 
+	if (hdr->op == ofi_op_tagged)
+		*((uint64_t *)ptr) = ntohll(*((uint64_t *) ptr));
+
 	rma_iov = (struct ofi_rma_iov *)ptr;
 	for ( i = 0; i < hdr->rma_iov_cnt; i++) {
 		rma_iov[i].addr = ntohll(rma_iov[i].addr);
@@ -65,7 +69,25 @@ void tcpx_hdr_bswap(struct tcpx_base_hdr *hdr)
 	}
 }
 
-static int tcpx_setup_socket(SOCKET sock)
+/* Best effort: raising SO_BUSY_POLL needs CAP_NET_ADMIN, so failures
+ * only cost latency, not correctness.
+ */
+static void tcpx_setup_latency(SOCKET sock)
+{
+#ifdef SO_BUSY_POLL
+	if (tcpx_env.busy_poll &&
+	    setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL,
+		       (char *) &tcpx_env.busy_poll,
+		       sizeof(tcpx_env.busy_poll)))
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"setsockopt busy_poll failed: %s\n",
+			strerror(ofi_sockerr()));
+#endif
+	if (tcpx_env.latency)
+		tcpx_quickack(sock);
+}
+
+int tcpx_setup_socket(SOCKET sock)
 {
 	int ret, optval = 1;
 
@@ -83,6 +105,7 @@ static int tcpx_setup_socket(SOCKET sock)
 		return ret;
 	}
 
+	tcpx_setup_latency(sock);
 	return ret;
 }
 
@@ -112,6 +135,7 @@ static int tcpx_ep_connect(struct fid_ep *ep, const void *addr,
 
 	cm_ctx->fid = &tcpx_ep->util_ep.ep_fid.fid;
 	cm_ctx->type = CLIENT_SEND_CONNREQ;
+	cm_ctx->stripes.cnt = tcpx_env.stripes;
 
 	if (paramlen) {
 		cm_ctx->cm_data_sz = paramlen;
@@ -279,6 +303,7 @@ void tcpx_rx_msg_release(struct tcpx_xfer_entry *rx_entry)
 	if (rx_entry->ep->srx_ctx) {
 		tcpx_srx_xfer_release(rx_entry->ep->srx_ctx, rx_entry);
 	} else {
+		tcpx_mrecv_release(rx_entry);
 		tcpx_cq = container_of(rx_entry->ep->util_ep.rx_cq,
 				       struct tcpx_cq, util_cq);
 		tcpx_xfer_entry_release(tcpx_cq, rx_entry);
@@ -292,6 +317,11 @@ static void tcpx_ep_tx_rx_queues_release(struct tcpx_ep *ep)
 	struct tcpx_cq *tcpx_cq;
 
 	fastlock_acquire(&ep->lock);
+	/* a posted receive the close cut short */
+	if (ep->cur_rx_entry && !ep->cur_rx_entry->unexp &&
+	    ep->cur_rx_entry->hdr.base_hdr.op_data == TCPX_OP_MSG_RECV)
+		tcpx_rx_msg_release(ep->cur_rx_entry);
+
 	while (!slist_empty(&ep->tx_queue)) {
 		entry = ep->tx_queue.head;
 		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
@@ -310,6 +340,15 @@ static void tcpx_ep_tx_rx_queues_release(struct tcpx_ep *ep)
 		tcpx_xfer_entry_release(tcpx_cq, xfer_entry);
 	}
 
+	while (!slist_empty(&ep->tag_queue)) {
+		entry = ep->tag_queue.head;
+		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		slist_remove_head(&ep->tag_queue);
+		tcpx_cq = container_of(xfer_entry->ep->util_ep.rx_cq,
+				       struct tcpx_cq, util_cq);
+		tcpx_xfer_entry_release(tcpx_cq, xfer_entry);
+	}
+
 	while (!slist_empty(&ep->rma_read_queue)) {
 		entry = ep->rma_read_queue.head;
 		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
@@ -328,6 +367,15 @@ static void tcpx_ep_tx_rx_queues_release(struct tcpx_ep *ep)
 		tcpx_xfer_entry_release(tcpx_cq, xfer_entry);
 	}
 
+	while (!slist_empty(&ep->tx_zc_queue)) {
+		entry = ep->tx_zc_queue.head;
+		xfer_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		slist_remove_head(&ep->tx_zc_queue);
+		tcpx_cq = container_of(xfer_entry->ep->util_ep.tx_cq,
+				       struct tcpx_cq, util_cq);
+		tcpx_xfer_entry_release(tcpx_cq, xfer_entry);
+	}
+
 	fastlock_release(&ep->lock);
 }
 
@@ -336,15 +384,21 @@ static int tcpx_ep_close(struct fid *fid)
 	struct tcpx_ep *ep = container_of(fid, struct tcpx_ep,
 					  util_ep.ep_fid.fid);
 
-	tcpx_ep_tx_rx_queues_release(ep);
+	if (ep->srx_ctx)
+		tcpx_srx_ep_del(ep->srx_ctx, ep);
+	/* before tcpx_cq_ep_del detaches the endpoint from its io_uring */
 	tcpx_cq_wait_ep_del(ep);
+	tcpx_cq_ep_del(ep);
+	tcpx_ep_tx_rx_queues_release(ep);
 	if (ep->util_ep.eq->wait)
 		ofi_wait_fd_del(ep->util_ep.eq->wait, ep->conn_fd);
 
 	ofi_close_socket(ep->conn_fd);
+	tcpx_ep_stripes_close(ep);
 	ofi_endpoint_close(&ep->util_ep);
 	fastlock_destroy(&ep->lock);
 
+	free(ep->stage_buf.buf);
 	free(ep);
 	return 0;
 }
@@ -390,9 +444,12 @@ static struct fi_ops tcpx_ep_fi_ops = {
 static int tcpx_ep_getopt(fid_t fid, int level, int optname,
 			  void *optval, size_t *optlen)
 {
+	struct tcpx_ep *ep;
+
 	if (level != FI_OPT_ENDPOINT)
 		return -ENOPROTOOPT;
 
+	ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
 	switch (optname) {
 	case FI_OPT_CM_DATA_SIZE:
 		if (*optlen < sizeof(size_t)) {
@@ -402,6 +459,35 @@ static int tcpx_ep_getopt(fid_t fid, int level, int optname,
 		*((size_t *) optval) = TCPX_MAX_CM_DATA_SIZE;
 		*optlen = sizeof(size_t);
 		break;
+	case FI_OPT_MIN_MULTI_RECV:
+		if (*optlen < sizeof(size_t)) {
+			*optlen = sizeof(size_t);
+			return -FI_ETOOSMALL;
+		}
+		*((size_t *) optval) = ep->min_multi_recv;
+		*optlen = sizeof(size_t);
+		break;
+	default:
+		return -FI_ENOPROTOOPT;
+	}
+	return FI_SUCCESS;
+}
+
+static int tcpx_ep_setopt(fid_t fid, int level, int optname,
+			  const void *optval, size_t optlen)
+{
+	struct tcpx_ep *ep;
+
+	if (level != FI_OPT_ENDPOINT)
+		return -ENOPROTOOPT;
+
+	ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
+	switch (optname) {
+	case FI_OPT_MIN_MULTI_RECV:
+		if (optlen != sizeof(size_t))
+			return -FI_EINVAL;
+		ep->min_multi_recv = *((const size_t *) optval);
+		break;
 	default:
 		return -FI_ENOPROTOOPT;
 	}
@@ -412,7 +498,7 @@ static struct fi_ops_ep tcpx_ep_ops = {
 	.size = sizeof(struct fi_ops_ep),
 	.cancel = fi_no_cancel,
 	.getopt = tcpx_ep_getopt,
-	.setopt = fi_no_setopt,
+	.setopt = tcpx_ep_setopt,
 	.tx_ctx = fi_no_tx_ctx,
 	.rx_ctx = fi_no_rx_ctx,
 	.rx_size_left = fi_no_rx_size_left,
@@ -429,7 +515,10 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	struct tcpx_ep *ep;
 	struct tcpx_pep *pep;
 	struct tcpx_conn_handle *handle;
-	int ret;
+	int i, ret;
+
+	if (info && info->ep_attr && info->ep_attr->type == FI_EP_RDM)
+		return tcpx_rdm_open(domain, info, ep_fid, context);
 
 	ep = calloc(1, sizeof(*ep));
 	if (!ep)
@@ -453,6 +542,7 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 			ep->conn_fd = handle->conn_fd;
 			ep->hdr_bswap = handle->endian_match ?
 					tcpx_hdr_none : tcpx_hdr_bswap;
+			ep->stripe_cnt = handle->stripe_cnt;
 			free(handle);
 
 			ret = tcpx_setup_socket(ep->conn_fd);
@@ -477,31 +567,52 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (ret)
 		goto err3;
 
+	ep->stage_buf.buf = malloc(STAGE_BUF_SIZE);
+	if (!ep->stage_buf.buf) {
+		ret = -FI_ENOMEM;
+		goto err4;
+	}
 	ep->stage_buf.size = STAGE_BUF_SIZE;
 	ep->stage_buf.len = 0;
 	ep->stage_buf.off = 0;
 
 	slist_init(&ep->rx_queue);
+	slist_init(&ep->tag_queue);
 	slist_init(&ep->tx_queue);
 	slist_init(&ep->rma_read_queue);
 	slist_init(&ep->tx_rsp_pend_queue);
+	slist_init(&ep->tx_zc_queue);
 
 	ep->rx_detect.done_len = 0;
 	ep->rx_detect.hdr_len = sizeof(ep->rx_detect.hdr.base_hdr);
 
+	dlist_init(&ep->srx_entry);
+	dlist_init(&ep->rx_active.entry);
+	ep->rx_active.ep = ep;
+	dlist_init(&ep->tx_active.entry);
+	ep->tx_active.ep = ep;
+
+	ep->min_multi_recv = TCPX_MIN_MULTI_RECV;
+	ep->stripe_sock = INVALID_SOCKET;
+	for (i = 0; i < TCPX_MAX_STRIPES; i++)
+		ep->stripes[i].fd = INVALID_SOCKET;
+
 	*ep_fid = &ep->util_ep.ep_fid;
 	(*ep_fid)->fid.ops = &tcpx_ep_fi_ops;
 	(*ep_fid)->ops = &tcpx_ep_ops;
 	(*ep_fid)->cm = &tcpx_cm_ops;
 	(*ep_fid)->msg = &tcpx_msg_ops;
+	(*ep_fid)->tagged = &tcpx_tagged_ops;
 	(*ep_fid)->rma = &tcpx_rma_ops;
 
 	ep->get_rx_entry[ofi_op_msg] = tcpx_get_rx_entry_op_msg;
-	ep->get_rx_entry[ofi_op_tagged] = tcpx_get_rx_entry_op_invalid;
+	ep->get_rx_entry[ofi_op_tagged] = tcpx_get_rx_entry_op_tagged;
 	ep->get_rx_entry[ofi_op_read_req] = tcpx_get_rx_entry_op_read_req;
 	ep->get_rx_entry[ofi_op_read_rsp] = tcpx_get_rx_entry_op_read_rsp;
 	ep->get_rx_entry[ofi_op_write] =tcpx_get_rx_entry_op_write;
 	return 0;
+err4:
+	fastlock_destroy(&ep->lock);
 err3:
 	ofi_close_socket(ep->conn_fd);
 err2:
@@ -619,18 +730,21 @@ static int tcpx_pep_listen(struct fid_pep *pep)
 static int tcpx_pep_reject(struct fid_pep *pep, fid_t handle,
 			   const void *param, size_t paramlen)
 {
-	struct ofi_ctrl_hdr hdr;
+	struct {
+		struct ofi_ctrl_hdr	hdr;
+		struct tcpx_cm_stripes	stripes;
+	} msg;
 	struct tcpx_conn_handle *tcpx_handle;
 	int ret;
 
 	tcpx_handle = container_of(handle, struct tcpx_conn_handle, handle);
 
-	memset(&hdr, 0, sizeof(hdr));
-	hdr.version = TCPX_CTRL_HDR_VERSION;
-	hdr.type = ofi_ctrl_nack;
-	hdr.seg_size = htons((uint16_t) paramlen);
+	memset(&msg, 0, sizeof(msg));
+	msg.hdr.version = TCPX_CTRL_HDR_VERSION;
+	msg.hdr.type = ofi_ctrl_nack;
+	msg.hdr.seg_size = htons((uint16_t) paramlen);
 
-	ret = ofi_sendall_socket(tcpx_handle->conn_fd, &hdr, sizeof(hdr));
+	ret = ofi_sendall_socket(tcpx_handle->conn_fd, &msg, sizeof(msg));
 	if (!ret && paramlen)
 		(void) ofi_sendall_socket(tcpx_handle->conn_fd, param, paramlen);
 
@@ -43,7 +43,7 @@
 #if HAVE_GETIFADDRS
 static void tcpx_getinfo_ifs(struct fi_info **info)
 {
-	struct fi_info *head = NULL, *tail = NULL, *cur;
+	struct fi_info *head = NULL, *tail = NULL, *cur, *src;
 	struct slist addr_list;
 	size_t addrlen;
 	uint32_t addr_format;
@@ -58,16 +58,6 @@ static void tcpx_getinfo_ifs(struct fi_info **info)
 	slist_foreach(&addr_list, entry, prev) {
 		addr_entry = container_of(entry, struct ofi_addr_list_entry, entry);
 
-		cur = fi_dupinfo(*info);
-		if (!cur)
-			break;
-
-		if (!head)
-			head = cur;
-		else
-			tail->next = cur;
-		tail = cur;
-
 		switch (addr_entry->ipaddr.sin.sin_family) {
 		case AF_INET:
 			addrlen = sizeof(struct sockaddr_in);
@@ -81,14 +71,27 @@ static void tcpx_getinfo_ifs(struct fi_info **info)
 			continue;
 		}
 
-		cur->src_addr = mem_dup(&addr_entry->ipaddr.sa, addrlen);
-		if (cur->src_addr) {
-			cur->src_addrlen = addrlen;
-			cur->addr_format = addr_format;
+		/* one entry per interface for each endpoint type */
+		for (src = *info; src; src = src->next) {
+			cur = fi_dupinfo(src);
+			if (!cur)
+				break;
+
+			if (!head)
+				head = cur;
+			else
+				tail->next = cur;
+			tail = cur;
+
+			cur->src_addr = mem_dup(&addr_entry->ipaddr.sa, addrlen);
+			if (cur->src_addr) {
+				cur->src_addrlen = addrlen;
+				cur->addr_format = addr_format;
+			}
+			/* TODO: rework util code
+			util_set_fabric_domain(&tcpx_prov, cur);
+			*/
 		}
-		/* TODO: rework util code
-		util_set_fabric_domain(&tcpx_prov, cur);
-		*/
 	}
 
 	ofi_free_list_of_addr(&addr_list);
@@ -116,6 +119,81 @@ static int tcpx_getinfo(uint32_t version, const char *node, const char *service,
 	return 0;
 }
 
+struct tcpx_env tcpx_env = {
+	.zerocopy_size = 0,
+	.io_uring = 0,
+	.io_uring_size = 256,
+	.stripes = 0,
+	.stripe_size = 262144,
+	.progress_threads = 0,
+	.progress_affinity = NULL,
+	.latency = 0,
+	.busy_poll = 0,
+	.spin_time = 0,
+	.unexp_size = 64 * 1024 * 1024,
+};
+
+static void tcpx_init_env(void)
+{
+	char *io_engine = NULL;
+
+	fi_param_get_str(&tcpx_prov, "io_engine", &io_engine);
+	if (io_engine && !strcasecmp(io_engine, "io_uring")) {
+		if (HAVE_TCP_IO_URING)
+			tcpx_env.io_uring = 1;
+		else
+			FI_INFO(&tcpx_prov, FI_LOG_CORE,
+				"io_uring not supported, using sockets\n");
+	} else if (io_engine && strcasecmp(io_engine, "socket")) {
+		FI_WARN(&tcpx_prov, FI_LOG_CORE,
+			"unknown io_engine %s, using sockets\n", io_engine);
+	}
+	fi_param_get_size_t(&tcpx_prov, "io_uring_size",
+			    &tcpx_env.io_uring_size);
+
+	fi_param_get_size_t(&tcpx_prov, "zerocopy_size",
+			    &tcpx_env.zerocopy_size);
+	if (tcpx_env.zerocopy_size && !TCPX_HAVE_ZEROCOPY) {
+		FI_INFO(&tcpx_prov, FI_LOG_CORE,
+			"MSG_ZEROCOPY not supported, ignoring zerocopy_size\n");
+		tcpx_env.zerocopy_size = 0;
+	}
+
+	fi_param_get_int(&tcpx_prov, "stripes", &tcpx_env.stripes);
+	if (tcpx_env.stripes < 0 || tcpx_env.stripes > TCPX_MAX_STRIPES) {
+		FI_WARN(&tcpx_prov, FI_LOG_CORE,
+			"stripes must be between 0 and %d\n",
+			TCPX_MAX_STRIPES);
+		tcpx_env.stripes = MAX(MIN(tcpx_env.stripes,
+					   TCPX_MAX_STRIPES), 0);
+	}
+	fi_param_get_size_t(&tcpx_prov, "stripe_size",
+			    &tcpx_env.stripe_size);
+
+	fi_param_get_int(&tcpx_prov, "progress_threads",
+			 &tcpx_env.progress_threads);
+	if (tcpx_env.progress_threads < 0) {
+		FI_WARN(&tcpx_prov, FI_LOG_CORE,
+			"progress_threads must not be negative\n");
+		tcpx_env.progress_threads = 0;
+	}
+	fi_param_get_str(&tcpx_prov, "progress_affinity",
+			 &tcpx_env.progress_affinity);
+
+	fi_param_get_bool(&tcpx_prov, "latency", &tcpx_env.latency);
+	if (tcpx_env.latency)
+		tcpx_env.busy_poll = TCPX_LATENCY_BUSY_POLL;
+	fi_param_get_int(&tcpx_prov, "busy_poll", &tcpx_env.busy_poll);
+	fi_param_get_int(&tcpx_prov, "spin_time", &tcpx_env.spin_time);
+	fi_param_get_size_t(&tcpx_prov, "unexp_size", &tcpx_env.unexp_size);
+	if (tcpx_env.busy_poll < 0 || tcpx_env.spin_time < 0) {
+		FI_WARN(&tcpx_prov, FI_LOG_CORE,
+			"busy_poll and spin_time must not be negative\n");
+		tcpx_env.busy_poll = MAX(tcpx_env.busy_poll, 0);
+		tcpx_env.spin_time = MAX(tcpx_env.spin_time, 0);
+	}
+}
+
 static void fi_tcp_fini(void)
 {
 	/* empty as of now */
@@ -137,6 +215,44 @@ TCP_INI
 #endif
 	fi_param_define(&tcpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
+	fi_param_define(&tcpx_prov, "zerocopy_size", FI_PARAM_SIZE_T,
+			"Send transfers of at least this many bytes with "
+			"MSG_ZEROCOPY (default: 0, disabled)");
+	fi_param_define(&tcpx_prov, "io_engine", FI_PARAM_STRING,
+			"How socket I/O is issued: 'socket' for direct "
+			"calls or 'io_uring' for a ring per domain "
+			"(default: socket)");
+	fi_param_define(&tcpx_prov, "io_uring_size", FI_PARAM_SIZE_T,
+			"Number of submission entries in each domain's "
+			"io_uring (default: 256)");
+	fi_param_define(&tcpx_prov, "stripes", FI_PARAM_INT,
+			"Number of extra sockets opened with each connection "
+			"to spread large transfers over (default: 0)");
+	fi_param_define(&tcpx_prov, "stripe_size", FI_PARAM_SIZE_T,
+			"Transfers of at least this many bytes are striped "
+			"(default: 262144)");
+	fi_param_define(&tcpx_prov, "progress_threads", FI_PARAM_INT,
+			"Number of threads per domain that progress connected "
+			"endpoints in the background (default: 0, progress "
+			"from CQ calls)");
+	fi_param_define(&tcpx_prov, "progress_affinity", FI_PARAM_STRING,
+			"CPUs for the progress threads, one per thread in "
+			"order. Usage: id_start[-id_end[:stride]][,]");
+	fi_param_define(&tcpx_prov, "latency", FI_PARAM_BOOL,
+			"Tune sockets and progress for small message latency "
+			"over throughput and CPU use (default: no)");
+	fi_param_define(&tcpx_prov, "busy_poll", FI_PARAM_INT,
+			"Microseconds the kernel busy polls the device queue "
+			"on a blocking socket read, via SO_BUSY_POLL "
+			"(default: 0, or 50 with FI_TCP_LATENCY)");
+	fi_param_define(&tcpx_prov, "spin_time", FI_PARAM_INT,
+			"Microseconds a blocking CQ read polls for "
+			"completions before sleeping (default: 0)");
+	fi_param_define(&tcpx_prov, "unexp_size", FI_PARAM_SIZE_T,
+			"Bytes of unexpected messages a shared receive context "
+			"buffers before its connections stop reading "
+			"(default: 67108864)");
+	tcpx_init_env();
 
 	return &tcpx_prov;
 }
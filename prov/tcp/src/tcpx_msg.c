@@ -60,6 +60,9 @@ tcpx_alloc_recv_entry(struct tcpx_ep *tcpx_ep)
 	recv_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_MSG_RECV);
 	if (recv_entry) {
 		recv_entry->ep = tcpx_ep;
+		recv_entry->mrecv = NULL;
+		recv_entry->mrecv_refs = 0;
+		recv_entry->mrecv_retired = false;
 	}
 	return recv_entry;
 }
@@ -84,10 +87,113 @@ static inline void tcpx_queue_recv(struct tcpx_ep *tcpx_ep,
 				   struct tcpx_xfer_entry *recv_entry)
 {
 	fastlock_acquire(&tcpx_ep->lock);
-	slist_insert_tail(&recv_entry->entry, &tcpx_ep->rx_queue);
+	slist_insert_tail(&recv_entry->entry, (recv_entry->flags & FI_TAGGED) ?
+			  &tcpx_ep->tag_queue : &tcpx_ep->rx_queue);
+	tcpx_cq_recv_posted(tcpx_ep);
 	fastlock_release(&tcpx_ep->lock);
 }
 
+/*
+ * Cut the receive for a message of len bytes, which must fit, from the
+ * front of an FI_MULTI_RECV buffer.  Returns true once the buffer has
+ * less than min_multi_recv bytes left and should leave its queue.
+ */
+bool tcpx_mrecv_claim(struct tcpx_xfer_entry *mrecv,
+		      struct tcpx_xfer_entry *recv_entry, size_t len,
+		      size_t min_multi_recv)
+{
+	assert(len <= mrecv->iov[0].iov_len);
+
+	recv_entry->flags = mrecv->flags & ~FI_MULTI_RECV;
+	recv_entry->context = mrecv->context;
+	recv_entry->iov_cnt = 1;
+	recv_entry->iov[0].iov_base = mrecv->iov[0].iov_base;
+	recv_entry->iov[0].iov_len = len;
+	recv_entry->unexp = false;
+	recv_entry->mrecv = mrecv;
+	recv_entry->mrecv_buf = mrecv->iov[0].iov_base;
+
+	mrecv->iov[0].iov_base = (uint8_t *) mrecv->iov[0].iov_base + len;
+	mrecv->iov[0].iov_len -= len;
+	mrecv->mrecv_refs++;
+	if (mrecv->iov[0].iov_len < min_multi_recv)
+		mrecv->mrecv_retired = true;
+	return mrecv->mrecv_retired;
+}
+
+/*
+ * Called once a multi-receive buffer has been taken out of its queue
+ * because the next message does not fit in the space left.  The message
+ * goes to the next posted receive instead.  If no receive cut from the
+ * buffer is outstanding, its FI_MULTI_RECV completion is written here
+ * and true is returned for the caller to release it.
+ */
+bool tcpx_mrecv_retire(struct tcpx_ep *ep, struct tcpx_xfer_entry *mrecv)
+{
+	mrecv->mrecv_retired = true;
+	if (mrecv->mrecv_refs)
+		return false;
+
+	if (mrecv->flags & FI_COMPLETION) {
+		ofi_cq_write(ep->util_ep.rx_cq, mrecv->context, mrecv->flags,
+			     0, NULL, 0, 0);
+		tcpx_cq_signal(ep->util_ep.rx_cq, ep);
+	}
+	return true;
+}
+
+/*
+ * Called when a receive cut from a multi-receive buffer completes.  The
+ * last completion of a retired buffer carries FI_MULTI_RECV and keeps
+ * recv_entry->mrecv so that the buffer is released along with it.
+ */
+void tcpx_mrecv_put(struct tcpx_xfer_entry *recv_entry)
+{
+	struct tcpx_rx_ctx *srx_ctx = recv_entry->ep->srx_ctx;
+	struct tcpx_xfer_entry *mrecv = recv_entry->mrecv;
+	bool last;
+
+	/* the ep lock covers buffers posted to the ep itself */
+	if (srx_ctx)
+		fastlock_acquire(&srx_ctx->lock);
+	last = !--mrecv->mrecv_refs && mrecv->mrecv_retired;
+	if (srx_ctx)
+		fastlock_release(&srx_ctx->lock);
+
+	if (last)
+		recv_entry->flags |= FI_MULTI_RECV;
+	else
+		recv_entry->mrecv = NULL;
+}
+
+void tcpx_mrecv_release(struct tcpx_xfer_entry *recv_entry)
+{
+	struct tcpx_xfer_entry *mrecv = recv_entry->mrecv;
+	struct tcpx_rx_ctx *srx_ctx;
+	struct tcpx_cq *tcpx_cq;
+
+	if (!mrecv)
+		return;
+
+	if (!(recv_entry->flags & FI_MULTI_RECV)) {
+		tcpx_mrecv_put(recv_entry);
+		if (!recv_entry->mrecv)
+			return;
+	}
+	recv_entry->mrecv = NULL;
+
+	srx_ctx = recv_entry->ep->srx_ctx;
+	if (srx_ctx) {
+		fastlock_acquire(&srx_ctx->lock);
+		util_buf_release(srx_ctx->buf_pool, mrecv);
+		fastlock_release(&srx_ctx->lock);
+	} else {
+		tcpx_cq = container_of(recv_entry->ep->util_ep.rx_cq,
+				       struct tcpx_cq, util_cq);
+		tcpx_xfer_entry_release(tcpx_cq, mrecv);
+	}
+}
+
 static ssize_t tcpx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
 			    uint64_t flags)
 {
@@ -97,6 +203,8 @@ static ssize_t tcpx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
 	assert(msg->iov_count <= TCPX_IOV_LIMIT);
+	if ((flags & FI_MULTI_RECV) && msg->iov_count != 1)
+		return -FI_EINVAL;
 
 	recv_entry = tcpx_alloc_recv_entry(tcpx_ep);
 	if (!recv_entry)
@@ -130,7 +238,8 @@ static ssize_t tcpx_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
 	recv_entry->iov[0].iov_base = buf;
 	recv_entry->iov[0].iov_len = len;
 
-	recv_entry->flags = ((tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION) |
+	recv_entry->flags = ((tcpx_ep->util_ep.rx_op_flags &
+			      (FI_COMPLETION | FI_MULTI_RECV)) |
 			     FI_MSG | FI_RECV);
 	recv_entry->context = context;
 
@@ -147,6 +256,8 @@ static ssize_t tcpx_recvv(struct fid_ep *ep, const struct iovec *iov, void **des
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
 	assert(count <= TCPX_IOV_LIMIT);
+	if ((tcpx_ep->util_ep.rx_op_flags & FI_MULTI_RECV) && count != 1)
+		return -FI_EINVAL;
 
 	recv_entry = tcpx_alloc_recv_entry(tcpx_ep);
 	if (!recv_entry)
@@ -155,7 +266,8 @@ static ssize_t tcpx_recvv(struct fid_ep *ep, const struct iovec *iov, void **des
 	recv_entry->iov_cnt = count;
 	memcpy(recv_entry->iov, iov, count * sizeof(*iov));
 
-	recv_entry->flags = ((tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION) |
+	recv_entry->flags = ((tcpx_ep->util_ep.rx_op_flags &
+			      (FI_COMPLETION | FI_MULTI_RECV)) |
 			     FI_MSG | FI_RECV);
 	recv_entry->context = context;
 
@@ -431,3 +543,223 @@ struct fi_ops_msg tcpx_msg_ops = {
 	.senddata = tcpx_senddata,
 	.injectdata = tcpx_injectdata,
 };
+
+static ssize_t tcpx_trecv_entry(struct tcpx_ep *tcpx_ep,
+				const struct iovec *iov, size_t count,
+				uint64_t tag, uint64_t ignore, uint64_t flags,
+				void *context)
+{
+	struct tcpx_xfer_entry *recv_entry;
+
+	assert(count <= TCPX_IOV_LIMIT);
+
+	recv_entry = tcpx_alloc_recv_entry(tcpx_ep);
+	if (!recv_entry)
+		return -FI_EAGAIN;
+
+	recv_entry->iov_cnt = count;
+	memcpy(recv_entry->iov, iov, count * sizeof(*iov));
+	recv_entry->tag = tag;
+	recv_entry->ignore = ignore;
+
+	recv_entry->flags = ((tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION) |
+			     flags | FI_TAGGED | FI_RECV);
+	recv_entry->context = context;
+
+	tcpx_queue_recv(tcpx_ep, recv_entry);
+	return FI_SUCCESS;
+}
+
+static ssize_t tcpx_trecvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+			     uint64_t flags)
+{
+	struct tcpx_ep *tcpx_ep;
+
+	if (flags & (FI_PEEK | FI_CLAIM | FI_MULTI_RECV))
+		return -FI_EOPNOTSUPP;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	return tcpx_trecv_entry(tcpx_ep, msg->msg_iov, msg->iov_count,
+				msg->tag, msg->ignore, flags, msg->context);
+}
+
+static ssize_t tcpx_trecv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+			  fi_addr_t src_addr, uint64_t tag, uint64_t ignore,
+			  void *context)
+{
+	struct tcpx_ep *tcpx_ep;
+	struct iovec iov;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return tcpx_trecv_entry(tcpx_ep, &iov, 1, tag, ignore, 0, context);
+}
+
+static ssize_t tcpx_trecvv(struct fid_ep *ep, const struct iovec *iov,
+			   void **desc, size_t count, fi_addr_t src_addr,
+			   uint64_t tag, uint64_t ignore, void *context)
+{
+	struct tcpx_ep *tcpx_ep;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	return tcpx_trecv_entry(tcpx_ep, iov, count, tag, ignore, 0, context);
+}
+
+static ssize_t tcpx_tsend_entry(struct tcpx_ep *tcpx_ep,
+				const struct iovec *iov, size_t count,
+				uint64_t data, uint64_t tag, uint64_t flags,
+				void *context)
+{
+	struct tcpx_xfer_entry *tx_entry;
+	struct tcpx_cq *tcpx_cq;
+	uint64_t data_len;
+	size_t offset;
+
+	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq,
+			       util_cq);
+
+	tx_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_TAGGED_SEND);
+	if (!tx_entry)
+		return -FI_EAGAIN;
+
+	assert(count <= TCPX_IOV_LIMIT);
+	data_len = ofi_total_iov_len(iov, count);
+	assert(!(flags & FI_INJECT) || (data_len <= TCPX_MAX_INJECT_SZ));
+
+	offset = sizeof(tx_entry->hdr.base_hdr);
+	if (flags & FI_REMOTE_CQ_DATA) {
+		tx_entry->hdr.base_hdr.flags |= OFI_REMOTE_CQ_DATA;
+		tx_entry->hdr.cq_data_hdr.cq_data = data;
+		offset += sizeof(data);
+	}
+
+	*tcpx_hdr_tag(&tx_entry->hdr.base_hdr) = tag;
+	offset += sizeof(tag);
+
+	tx_entry->hdr.base_hdr.payload_off = (uint8_t) offset;
+	tx_entry->hdr.base_hdr.size = offset + data_len;
+	if (flags & FI_INJECT) {
+		ofi_copy_iov_buf(iov, count, 0,
+				 (uint8_t *) &tx_entry->hdr + offset,
+				 data_len, OFI_COPY_IOV_TO_BUF);
+		tx_entry->iov_cnt = 1;
+		offset += data_len;
+	} else {
+		memcpy(&tx_entry->iov[1], iov, count * sizeof(*iov));
+		tx_entry->iov_cnt = count + 1;
+	}
+	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
+	tx_entry->iov[0].iov_len = offset;
+
+	tx_entry->flags = flags | FI_TAGGED | FI_SEND;
+	if (flags & (FI_TRANSMIT_COMPLETE | FI_DELIVERY_COMPLETE)) {
+		tx_entry->hdr.base_hdr.flags |= OFI_DELIVERY_COMPLETE;
+		tx_entry->flags &= ~FI_COMPLETION;
+	}
+
+	tx_entry->ep = tcpx_ep;
+	tx_entry->context = context;
+	tx_entry->tag = tag;
+	tx_entry->rem_len = tx_entry->hdr.base_hdr.size;
+
+	tcpx_ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+	fastlock_acquire(&tcpx_ep->lock);
+	tcpx_tx_queue_insert(tcpx_ep, tx_entry);
+	fastlock_release(&tcpx_ep->lock);
+	return FI_SUCCESS;
+}
+
+static inline uint64_t tcpx_tx_flags(struct tcpx_ep *tcpx_ep)
+{
+	return tcpx_ep->util_ep.tx_op_flags & FI_COMPLETION;
+}
+
+static ssize_t tcpx_tsendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+			     uint64_t flags)
+{
+	struct tcpx_ep *tcpx_ep;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	return tcpx_tsend_entry(tcpx_ep, msg->msg_iov, msg->iov_count,
+				msg->data, msg->tag,
+				tcpx_tx_flags(tcpx_ep) | flags, msg->context);
+}
+
+static ssize_t tcpx_tsend(struct fid_ep *ep, const void *buf, size_t len,
+			  void *desc, fi_addr_t dest_addr, uint64_t tag,
+			  void *context)
+{
+	struct tcpx_ep *tcpx_ep;
+	struct iovec iov;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_tsend_entry(tcpx_ep, &iov, 1, 0, tag,
+				tcpx_tx_flags(tcpx_ep), context);
+}
+
+static ssize_t tcpx_tsendv(struct fid_ep *ep, const struct iovec *iov,
+			   void **desc, size_t count, fi_addr_t dest_addr,
+			   uint64_t tag, void *context)
+{
+	struct tcpx_ep *tcpx_ep;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	return tcpx_tsend_entry(tcpx_ep, iov, count, 0, tag,
+				tcpx_tx_flags(tcpx_ep), context);
+}
+
+static ssize_t tcpx_tinject(struct fid_ep *ep, const void *buf, size_t len,
+			    fi_addr_t dest_addr, uint64_t tag)
+{
+	struct tcpx_ep *tcpx_ep;
+	struct iovec iov;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_tsend_entry(tcpx_ep, &iov, 1, 0, tag, FI_INJECT, NULL);
+}
+
+static ssize_t tcpx_tsenddata(struct fid_ep *ep, const void *buf, size_t len,
+			      void *desc, uint64_t data, fi_addr_t dest_addr,
+			      uint64_t tag, void *context)
+{
+	struct tcpx_ep *tcpx_ep;
+	struct iovec iov;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_tsend_entry(tcpx_ep, &iov, 1, data, tag,
+				tcpx_tx_flags(tcpx_ep) | FI_REMOTE_CQ_DATA,
+				context);
+}
+
+static ssize_t tcpx_tinjectdata(struct fid_ep *ep, const void *buf, size_t len,
+				uint64_t data, fi_addr_t dest_addr, uint64_t tag)
+{
+	struct tcpx_ep *tcpx_ep;
+	struct iovec iov;
+
+	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_tsend_entry(tcpx_ep, &iov, 1, data, tag,
+				FI_INJECT | FI_REMOTE_CQ_DATA, NULL);
+}
+
+struct fi_ops_tagged tcpx_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = tcpx_trecv,
+	.recvv = tcpx_trecvv,
+	.recvmsg = tcpx_trecvmsg,
+	.send = tcpx_tsend,
+	.sendv = tcpx_tsendv,
+	.sendmsg = tcpx_tsendmsg,
+	.inject = tcpx_tinject,
+	.senddata = tcpx_tsenddata,
+	.injectdata = tcpx_tinjectdata,
+};
@@ -91,27 +91,14 @@ int tcpx_ep_shutdown_report(struct tcpx_ep *ep, fid_t fid)
 	return FI_SUCCESS;
 }
 
-static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+void tcpx_tx_entry_complete(struct tcpx_xfer_entry *tx_entry, int ret)
 {
 	struct tcpx_cq *tcpx_cq;
-	int ret;
-
-	ret = tcpx_send_msg(tx_entry);
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-		return;
-
-	if (ret) {
-		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "msg send failed\n");
-
-		tcpx_ep_shutdown_report(tx_entry->ep,
-					&tx_entry->ep->util_ep.ep_fid.fid);
-	}
 
 	/* Keep this path below as a single pass path.*/
 	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	tcpx_cq_report_completion(tx_entry->ep->util_ep.tx_cq,
 				  tx_entry, -ret);
-	slist_remove_head(&tx_entry->ep->tx_queue);
 
 	if (tx_entry->hdr.base_hdr.flags &
 	    (OFI_DELIVERY_COMPLETE | OFI_COMMIT_COMPLETE)) {
@@ -125,6 +112,61 @@ static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
 	}
 }
 
+static void tcpx_tx_entry_done(struct tcpx_xfer_entry *tx_entry, int ret)
+{
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "msg send failed\n");
+
+		tcpx_ep_shutdown_report(tx_entry->ep,
+					&tx_entry->ep->util_ep.ep_fid.fid);
+	}
+
+	slist_remove_head(&tx_entry->ep->tx_queue);
+
+	/* the user buffer stays pinned until the kernel releases it, and
+	 * later sends complete behind it to keep FI_ORDER_STRICT.  Sends
+	 * waiting on the peer's response must be on tx_rsp_pend_queue
+	 * before it arrives; that response follows the data anyway. */
+	if (!ret && !(tx_entry->hdr.base_hdr.flags &
+		      (OFI_DELIVERY_COMPLETE | OFI_COMMIT_COMPLETE)) &&
+	    (tx_entry->zc_pending ||
+	     !slist_empty(&tx_entry->ep->tx_zc_queue))) {
+		slist_insert_tail(&tx_entry->entry, &tx_entry->ep->tx_zc_queue);
+		return;
+	}
+	tcpx_tx_entry_complete(tx_entry, ret);
+}
+
+static int tcpx_tx_entry_use_zc(struct tcpx_xfer_entry *tx_entry)
+{
+	return tx_entry->ep->zc_enabled &&
+	       tx_entry->rem_len >= tcpx_env.zerocopy_size;
+}
+
+/* A striped entry stays at the head of the queue while its chunks go out */
+static inline int tcpx_tx_entry_striping(struct tcpx_xfer_entry *tx_entry)
+{
+	return tx_entry->hdr.base_hdr.stripes && !tx_entry->rem_len;
+}
+
+static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+{
+	int ret;
+
+	ret = tcpx_tx_entry_use_zc(tx_entry) ? tcpx_send_msg_zc(tx_entry) :
+					       tcpx_send_msg(tx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+		return;
+
+	if (!ret && tx_entry->hdr.base_hdr.stripes) {
+		tcpx_stripe_tx_init(tx_entry);
+		ret = tcpx_send_stripes(tx_entry);
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			return;
+	}
+	tcpx_tx_entry_done(tx_entry, ret);
+}
+
 static int tcpx_prepare_rx_entry_resp(struct tcpx_xfer_entry *rx_entry)
 {
 	struct tcpx_cq *tcpx_tx_cq;
@@ -168,7 +210,8 @@ static int process_rx_entry(struct tcpx_xfer_entry *rx_entry)
 	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
 		return ret;
 
-	if (ret) {
+	/* a truncated striped message leaves the connection usable */
+	if (ret && ret != -FI_ETRUNC) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
 			"msg recv Failed ret = %d\n", ret);
 
@@ -411,13 +454,57 @@ tcpx_rx_detect_init(struct tcpx_rx_detect *rx_detect)
 	rx_detect->done_len = 0;
 }
 
+/* The header stays complete while no rx entry is available for it */
+static inline int tcpx_rx_detect_done(struct tcpx_rx_detect *rx_detect)
+{
+	return rx_detect->done_len == rx_detect->hdr_len;
+}
+
+static int tcpx_get_rx_entry_srx(struct tcpx_ep *tcpx_ep, uint64_t rx_flags);
+
+/* Start receiving the message in ep->rx_detect into a posted rx_entry */
+static int tcpx_rx_entry_start(struct tcpx_ep *tcpx_ep,
+			       struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_rx_detect *rx_detect = &tcpx_ep->rx_detect;
+	int ret;
+
+	tcpx_ep->cur_rx_proc_fn = process_rx_entry;
+
+	memcpy(&rx_entry->hdr, &rx_detect->hdr,
+	       (size_t) rx_detect->hdr.base_hdr.payload_off);
+	rx_entry->ep = tcpx_ep;
+	rx_entry->hdr.base_hdr.op_data = TCPX_OP_MSG_RECV;
+	rx_entry->rem_len = rx_entry->hdr.base_hdr.size - rx_detect->done_len;
+
+	if (rx_detect->hdr.base_hdr.flags & OFI_REMOTE_CQ_DATA)
+		rx_entry->flags |= FI_REMOTE_CQ_DATA;
+
+	/* striped payloads that do not fit are dropped as they arrive */
+	ret = ofi_truncate_iov(rx_entry->iov,
+			       &rx_entry->iov_cnt,
+			       rx_entry->rem_len);
+	if (ret && !rx_entry->hdr.base_hdr.stripes) {
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+			"posted rx buffer size is not big enough\n");
+		tcpx_cq_report_completion(rx_entry->ep->util_ep.rx_cq,
+					  rx_entry, -ret);
+		tcpx_rx_msg_release(rx_entry);
+		return ret;
+	}
+
+	tcpx_rx_detect_init(rx_detect);
+	tcpx_ep->cur_rx_entry = rx_entry;
+	return FI_SUCCESS;
+}
+
 int tcpx_get_rx_entry_op_msg(struct tcpx_ep *tcpx_ep)
 {
-	struct tcpx_xfer_entry *rx_entry;
+	struct tcpx_xfer_entry *rx_entry, *mrecv;
 	struct tcpx_xfer_entry *tx_entry;
 	struct tcpx_cq *tcpx_cq;
 	struct tcpx_rx_detect *rx_detect = &tcpx_ep->rx_detect;
-	int ret;
+	size_t len;
 
 	tcpx_cq = container_of(tcpx_ep->util_ep.rx_cq,
 			       struct tcpx_cq, util_cq);
@@ -438,46 +525,74 @@ int tcpx_get_rx_entry_op_msg(struct tcpx_ep *tcpx_ep)
 		return -FI_EAGAIN;
 	}
 
-	if (tcpx_ep->srx_ctx){
-		rx_entry = tcpx_srx_dequeue(tcpx_ep->srx_ctx);
-		if (!rx_entry)
-			return -FI_EAGAIN;
+	if (tcpx_ep->srx_ctx)
+		return tcpx_get_rx_entry_srx(tcpx_ep,
+					     tcpx_ep->util_ep.rx_op_flags &
+					     FI_COMPLETION);
 
-	} else {
-		if (slist_empty(&tcpx_ep->rx_queue))
+	len = rx_detect->hdr.base_hdr.size - rx_detect->done_len;
+	while (!slist_empty(&tcpx_ep->rx_queue)) {
+		rx_entry = container_of(tcpx_ep->rx_queue.head,
+					struct tcpx_xfer_entry, entry);
+		if (!(rx_entry->flags & FI_MULTI_RECV)) {
+			slist_remove_head(&tcpx_ep->rx_queue);
+			return tcpx_rx_entry_start(tcpx_ep, rx_entry);
+		}
+
+		mrecv = rx_entry;
+		if (len > mrecv->iov[0].iov_len) {
+			slist_remove_head(&tcpx_ep->rx_queue);
+			if (tcpx_mrecv_retire(tcpx_ep, mrecv))
+				tcpx_xfer_entry_release(tcpx_cq, mrecv);
+			continue;
+		}
+
+		rx_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_MSG_RECV);
+		if (!rx_entry)
 			return -FI_EAGAIN;
 
-		rx_entry = container_of(slist_remove_head(&tcpx_ep->rx_queue),
-					struct tcpx_xfer_entry, entry);
+		rx_entry->ep = tcpx_ep;
+		if (tcpx_mrecv_claim(mrecv, rx_entry, len,
+				     tcpx_ep->min_multi_recv))
+			slist_remove_head(&tcpx_ep->rx_queue);
+		return tcpx_rx_entry_start(tcpx_ep, rx_entry);
 	}
-	tcpx_ep->cur_rx_proc_fn = process_rx_entry;
+	return -FI_EAGAIN;
+}
 
-	memcpy(&rx_entry->hdr, &tcpx_ep->rx_detect.hdr,
-	       (size_t) tcpx_ep->rx_detect.hdr.base_hdr.payload_off);
-	rx_entry->ep = tcpx_ep;
-	rx_entry->hdr.base_hdr.op_data = TCPX_OP_MSG_RECV;
-	rx_entry->rem_len = rx_entry->hdr.base_hdr.size - rx_detect->done_len;
-	if (tcpx_ep->srx_ctx)
-		rx_entry->flags |= tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION;
+static int tcpx_match_tag(struct slist_entry *item, const void *arg)
+{
+	struct tcpx_xfer_entry *recv_entry;
 
-	if (rx_detect->hdr.base_hdr.flags & OFI_REMOTE_CQ_DATA)
-		rx_entry->flags |= FI_REMOTE_CQ_DATA;
+	recv_entry = container_of(item, struct tcpx_xfer_entry, entry);
+	return ofi_match_tag(recv_entry->tag, recv_entry->ignore,
+			     *((const uint64_t *) arg));
+}
 
-	ret = ofi_truncate_iov(rx_entry->iov,
-			       &rx_entry->iov_cnt,
-			       rx_entry->rem_len);
-	if (ret) {
-		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
-			"posted rx buffer size is not big enough\n");
-		tcpx_cq_report_completion(rx_entry->ep->util_ep.rx_cq,
-					  rx_entry, -ret);
-		tcpx_rx_msg_release(rx_entry);
-		return ret;
-	}
+/*
+ * Without a shared receive context there is no unexpected message
+ * buffering: the connection waits until a matching receive is posted.
+ */
+int tcpx_get_rx_entry_op_tagged(struct tcpx_ep *tcpx_ep)
+{
+	struct tcpx_xfer_entry *rx_entry;
+	struct slist_entry *item;
+	uint64_t tag;
 
-	tcpx_rx_detect_init(rx_detect);
-	tcpx_ep->cur_rx_entry = rx_entry;
-	return FI_SUCCESS;
+	if (tcpx_ep->srx_ctx)
+		return tcpx_get_rx_entry_srx(tcpx_ep,
+					     tcpx_ep->util_ep.rx_op_flags &
+					     FI_COMPLETION);
+
+	tag = *tcpx_hdr_tag(&tcpx_ep->rx_detect.hdr.base_hdr);
+	item = slist_remove_first_match(&tcpx_ep->tag_queue, tcpx_match_tag,
+					&tag);
+	if (!item)
+		return -FI_EAGAIN;
+
+	rx_entry = container_of(item, struct tcpx_xfer_entry, entry);
+	rx_entry->tag = tag;
+	return tcpx_rx_entry_start(tcpx_ep, rx_entry);
 }
 
 int tcpx_get_rx_entry_op_read_req(struct tcpx_ep *tcpx_ep)
@@ -583,22 +698,93 @@ int tcpx_get_rx_entry_op_read_rsp(struct tcpx_ep *tcpx_ep)
 	return FI_SUCCESS;
 }
 
+static int process_rx_unexp_entry(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_ep *ep = rx_entry->ep;
+	int ret;
+
+	ret = tcpx_recv_msg_data(rx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+		return ret;
+
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"msg recv Failed ret = %d\n", ret);
+
+		tcpx_ep_shutdown_report(ep, &ep->util_ep.ep_fid.fid);
+	}
+
+	/* the entry now belongs to the shared context's unexpected queue */
+	ep->cur_rx_entry = NULL;
+	tcpx_srx_unexp_done(ep->srx_ctx, rx_entry, -ret);
+	return FI_SUCCESS;
+}
+
+/*
+ * ofi_op_msg and ofi_op_tagged through a shared receive context.  rx_flags
+ * is the endpoint's FI_COMPLETION, which receives posted to the context
+ * cannot know about.
+ */
+static int tcpx_get_rx_entry_srx(struct tcpx_ep *tcpx_ep, uint64_t rx_flags)
+{
+	struct tcpx_xfer_entry *rx_entry;
+	int ret;
+
+	rx_entry = tcpx_srx_match(tcpx_ep->srx_ctx, tcpx_ep);
+	if (!rx_entry)
+		return -FI_EAGAIN;
+
+	rx_entry->flags |= rx_flags;
+	if (rx_entry->unexp) {
+		tcpx_ep->cur_rx_proc_fn = process_rx_unexp_entry;
+	} else {
+		tcpx_ep->cur_rx_proc_fn = process_rx_entry;
+		ret = ofi_truncate_iov(rx_entry->iov, &rx_entry->iov_cnt,
+				       rx_entry->rem_len);
+		if (ret && !rx_entry->hdr.base_hdr.stripes) {
+			FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+				"posted rx buffer size is not big enough\n");
+			tcpx_cq_report_completion(rx_entry->ep->util_ep.rx_cq,
+						  rx_entry, -ret);
+			tcpx_rx_msg_release(rx_entry);
+			return ret;
+		}
+	}
+
+	tcpx_rx_detect_init(&tcpx_ep->rx_detect);
+	tcpx_ep->cur_rx_entry = rx_entry;
+	return FI_SUCCESS;
+}
+
+/*
+ * The connections of an RDM endpoint.  Receives posted through the RDM
+ * already carry its flags, but a user srx bound to it may be posted to
+ * directly, so the connection holds the RDM's FI_COMPLETION as well.
+ */
+int tcpx_get_rx_entry_op_srx(struct tcpx_ep *tcpx_ep)
+{
+	return tcpx_get_rx_entry_srx(tcpx_ep, tcpx_ep->util_ep.rx_op_flags &
+					      FI_COMPLETION);
+}
+
 static void tcpx_process_stage_buffer(struct tcpx_ep *ep)
 {
 	int ret;
 
 	while (ep->stage_buf.len != ep->stage_buf.off) {
 		if (!ep->cur_rx_entry) {
-			ret = tcpx_recv_hdr(ep->conn_fd, &ep->stage_buf,
-					    &ep->rx_detect);
-			if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-				return;
+			if (!tcpx_rx_detect_done(&ep->rx_detect)) {
+				ret = tcpx_recv_hdr(ep->uring ? INVALID_SOCKET :
+						    ep->conn_fd, &ep->stage_buf,
+						    &ep->rx_detect);
+				if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+					return;
 
-			if (ret)
-				goto err1;
+				if (ret)
+					goto err1;
 
-			// TODO: Fix possiblity of multiple passes here.
-			ep->hdr_bswap(&ep->rx_detect.hdr.base_hdr);
+				ep->hdr_bswap(&ep->rx_detect.hdr.base_hdr);
+			}
 
 			ret = ep->get_rx_entry[ep->rx_detect.hdr.base_hdr.op](ep);
 			if (ret == -FI_EAGAIN)
@@ -607,7 +793,9 @@ static void tcpx_process_stage_buffer(struct tcpx_ep *ep)
 				goto err2;
 		}
 		assert(ep->cur_rx_proc_fn != NULL);
-		ep->cur_rx_proc_fn(ep->cur_rx_entry);
+		/* buffered data belongs to later messages */
+		if (ep->cur_rx_proc_fn(ep->cur_rx_entry) == -FI_EAGAIN)
+			return;
 	}
 	return;
 err2:
@@ -622,26 +810,37 @@ static void tcpx_process_rx_msg(struct tcpx_ep *ep)
 {
 	int ret;
 
+	/* the ring owns the socket: parse whatever it delivered */
+	if (ep->uring) {
+		tcpx_process_stage_buffer(ep);
+		return;
+	}
+
 	if (!ep->cur_rx_entry) {
-		if (ep->stage_buf.len == ep->stage_buf.off) {
-			ret = tcpx_read_to_buffer(ep->conn_fd, &ep->stage_buf);
-			if (ret && !OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-				goto err1;
+		if (!tcpx_rx_detect_done(&ep->rx_detect)) {
+			if (ep->stage_buf.len == ep->stage_buf.off) {
+				ret = tcpx_read_to_buffer(ep->conn_fd,
+							  &ep->stage_buf);
+				if (ret && !OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+					goto err1;
 
-			tcpx_process_stage_buffer(ep);
-			return;
-		}
+				if (!ret && tcpx_env.latency)
+					tcpx_quickack(ep->conn_fd);
 
-		ret = tcpx_recv_hdr(ep->conn_fd, &ep->stage_buf,
-				    &ep->rx_detect);
-		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-			return;
+				tcpx_process_stage_buffer(ep);
+				return;
+			}
 
-		if (ret)
-			goto err1;
+			ret = tcpx_recv_hdr(ep->conn_fd, &ep->stage_buf,
+					    &ep->rx_detect);
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+				return;
+
+			if (ret)
+				goto err1;
 
-		// TODO: Fix possiblity of multiple passes here.
-		ep->hdr_bswap(&ep->rx_detect.hdr.base_hdr);
+			ep->hdr_bswap(&ep->rx_detect.hdr.base_hdr);
+		}
 
 		ret = ep->get_rx_entry[ep->rx_detect.hdr.base_hdr.op](ep);
 		if (ret == -FI_EAGAIN)
@@ -661,23 +860,134 @@ err1:
 		tcpx_ep_shutdown_report(ep, &ep->util_ep.ep_fid.fid);
 }
 
-static void process_tx_queue(struct tcpx_ep *ep)
+static size_t tcpx_tx_queue_gather(struct tcpx_ep *ep, struct iovec *iov)
 {
 	struct tcpx_xfer_entry *tx_entry;
 	struct slist_entry *entry;
+	size_t iov_cnt = 0;
 
-	if (slist_empty(&ep->tx_queue))
+	for (entry = ep->tx_queue.head; entry; entry = entry->next) {
+		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		if (iov_cnt + tx_entry->iov_cnt > TCPX_TX_IOV_MAX ||
+		    (iov_cnt && tcpx_tx_entry_use_zc(tx_entry)))
+			break;
+
+		memcpy(&iov[iov_cnt], tx_entry->iov,
+		       tx_entry->iov_cnt * sizeof(*iov));
+		iov_cnt += tx_entry->iov_cnt;
+
+		/* its chunks must go out before anything queued behind it */
+		if (tx_entry->hdr.base_hdr.stripes)
+			break;
+	}
+	return iov_cnt;
+}
+
+/*
+ * Hand bytes_sent worth of the gathered iovs back to the queued entries.
+ * Returns -FI_EAGAIN if the last entry touched was only partially sent.
+ */
+int tcpx_tx_queue_sent(struct tcpx_ep *ep, ssize_t bytes_sent)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	while (bytes_sent) {
+		tx_entry = container_of(ep->tx_queue.head,
+					struct tcpx_xfer_entry, entry);
+		if ((size_t) bytes_sent < tx_entry->rem_len) {
+			tx_entry->rem_len -= bytes_sent;
+			ofi_consume_iov(tx_entry->iov,
+					&tx_entry->iov_cnt, bytes_sent);
+			return -FI_EAGAIN;
+		}
+
+		bytes_sent -= tx_entry->rem_len;
+		tx_entry->rem_len = 0;
+		if (tx_entry->hdr.base_hdr.stripes) {
+			assert(!bytes_sent);
+			tcpx_stripe_tx_init(tx_entry);
+			break;
+		}
+		tcpx_tx_entry_done(tx_entry, 0);
+	}
+	return FI_SUCCESS;
+}
+
+void tcpx_tx_queue_error(struct tcpx_ep *ep, int err)
+{
+	struct tcpx_xfer_entry *tx_entry;
+
+	tx_entry = container_of(ep->tx_queue.head,
+				struct tcpx_xfer_entry, entry);
+	tcpx_tx_entry_done(tx_entry, err == EPIPE ? -FI_ENOTCONN : -err);
+}
+
+/*
+ * Gather as many queued entries as fit into one sendmsg call and keep
+ * going until the queue is empty or the socket would block.  With an
+ * io_uring the gathered send is queued on the ring instead, and its
+ * completion hands the sent bytes back to the queue.
+ */
+static void process_tx_queue(struct tcpx_ep *ep)
+{
+	struct iovec iov[TCPX_TX_IOV_MAX];
+	struct tcpx_xfer_entry *tx_entry;
+	struct msghdr msg = {0};
+	ssize_t bytes_sent;
+	int ret;
+
+	if (ep->uring) {
+		if (!ep->uring_tx_posted && !slist_empty(&ep->tx_queue))
+			tcpx_uring_post_send(ep, tcpx_tx_queue_gather(ep,
+							ep->uring_iov));
 		return;
+	}
 
-	entry = ep->tx_queue.head;
-	tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
-	process_tx_entry(tx_entry);
+	while (!slist_empty(&ep->tx_queue)) {
+		tx_entry = container_of(ep->tx_queue.head,
+					struct tcpx_xfer_entry, entry);
+		if (tcpx_tx_entry_striping(tx_entry)) {
+			ret = tcpx_send_stripes(tx_entry);
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+				return;
+
+			tcpx_tx_entry_done(tx_entry, ret);
+			if (ret)
+				return;
+			continue;
+		}
+
+		if (tcpx_tx_entry_use_zc(tx_entry)) {
+			ret = tcpx_send_msg_zc(tx_entry);
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+				return;
+
+			tcpx_tx_entry_done(tx_entry, ret);
+			if (ret)
+				return;
+			continue;
+		}
+
+		msg.msg_iov = iov;
+		msg.msg_iovlen = tcpx_tx_queue_gather(ep, iov);
+		bytes_sent = ofi_sendmsg_tcp(ep->conn_fd, &msg, MSG_NOSIGNAL);
+		if (bytes_sent < 0) {
+			if (!OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()))
+				tcpx_tx_queue_error(ep, ofi_sockerr());
+			return;
+		}
+
+		if (tcpx_tx_queue_sent(ep, bytes_sent))
+			return;
+	}
 }
 
 void tcpx_ep_progress(struct tcpx_ep *ep)
 {
 	tcpx_process_rx_msg(ep);
 	process_tx_queue(ep);
+	if (!slist_empty(&ep->tx_zc_queue))
+		tcpx_zc_progress(ep);
 }
 
 void tcpx_progress(struct util_ep *util_ep)
@@ -687,20 +997,41 @@ void tcpx_progress(struct util_ep *util_ep)
 	ep = container_of(util_ep, struct tcpx_ep, util_ep);
 	fastlock_acquire(&ep->lock);
 	ep->progress_func(ep);
+	if (ep->uring)
+		tcpx_uring_post_recv(ep);
+	tcpx_cq_update_active(ep);
 	fastlock_release(&ep->lock);
 	return;
 }
 
+/* The wait sets of both CQs poll the socket, and either may be waited on */
+static int tcpx_ep_wait_mod(struct tcpx_ep *ep, uint32_t events)
+{
+	struct util_cq *cqs[2] = { ep->util_ep.rx_cq, ep->util_ep.tx_cq };
+	struct util_wait_fd *wait_fd;
+	int i, ret;
+
+	for (i = 0; i < 2; i++) {
+		if (!cqs[i] || !cqs[i]->wait || (i && cqs[1] == cqs[0]))
+			continue;
+
+		wait_fd = container_of(cqs[i]->wait, struct util_wait_fd,
+				       util_wait);
+		ret = fi_epoll_mod(wait_fd->epoll_fd, ep->conn_fd, events,
+				   NULL);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
 static int tcpx_try_func(void *util_ep)
 {
 	uint32_t events;
-	struct util_wait_fd *wait_fd;
 	struct tcpx_ep *ep;
 	int ret;
 
 	ep = container_of(util_ep, struct tcpx_ep, util_ep);
-	wait_fd = container_of(((struct util_ep *)util_ep)->rx_cq->wait,
-			       struct util_wait_fd, util_wait);
 
 	fastlock_acquire(&ep->lock);
 	if (!slist_empty(&ep->tx_queue) && !ep->send_ready_monitor) {
@@ -716,7 +1047,7 @@ static int tcpx_try_func(void *util_ep)
 	return FI_SUCCESS;
 
 epoll_mod:
-	ret = fi_epoll_mod(wait_fd->epoll_fd, ep->conn_fd, events, NULL);
+	ret = tcpx_ep_wait_mod(ep, events);
 	if (ret)
 		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
 			"invalid op type\n");
@@ -724,44 +1055,122 @@ epoll_mod:
 	return ret;
 }
 
+static int tcpx_wait_ep_add(struct util_cq *cq, struct tcpx_ep *ep)
+{
+	uint32_t i;
+	int ret;
+
+	if (ep->uring)
+		return ofi_wait_fd_add(cq->wait, tcpx_uring_fd(ep->uring),
+				       FI_EPOLL_IN, tcpx_cq_uring_wait_try,
+				       cq, NULL);
+
+	for (i = 0; i <= ep->stripe_cnt; i++) {
+		ret = ofi_wait_fd_add(cq->wait, tcpx_ep_rx_fd(ep, i),
+				      FI_EPOLL_IN, tcpx_try_func,
+				      (void *) &ep->util_ep, NULL);
+		if (ret) {
+			while (i--)
+				ofi_wait_fd_del(cq->wait, tcpx_ep_rx_fd(ep, i));
+			return ret;
+		}
+	}
+	return FI_SUCCESS;
+}
+
+static void tcpx_wait_ep_del(struct util_cq *cq, struct tcpx_ep *ep)
+{
+	uint32_t i;
+
+	if (ep->uring) {
+		ofi_wait_fd_del(cq->wait, tcpx_uring_fd(ep->uring));
+		return;
+	}
+
+	for (i = 0; i <= ep->stripe_cnt; i++)
+		ofi_wait_fd_del(cq->wait, tcpx_ep_rx_fd(ep, i));
+}
+
+/*
+ * A blocking read on either CQ must wake for the endpoint: transmit
+ * completions may wait on an acknowledgement from the peer.
+ */
 int tcpx_cq_wait_ep_add(struct tcpx_ep *ep)
 {
-	if (!ep->util_ep.rx_cq->wait)
+	struct util_cq *rx_cq = ep->util_ep.rx_cq, *tx_cq = ep->util_ep.tx_cq;
+	int ret;
+
+	/* the progress thread signals the CQ as it writes completions */
+	if (ep->thread)
 		return FI_SUCCESS;
 
-	return ofi_wait_fd_add(ep->util_ep.rx_cq->wait,
-			       ep->conn_fd, FI_EPOLL_IN,
-			       tcpx_try_func, (void *)&ep->util_ep,
-			       NULL);
+	if (rx_cq && rx_cq->wait) {
+		ret = tcpx_wait_ep_add(rx_cq, ep);
+		if (ret)
+			return ret;
+	}
+
+	if (tx_cq && tx_cq != rx_cq && tx_cq->wait) {
+		ret = tcpx_wait_ep_add(tx_cq, ep);
+		if (ret && rx_cq && rx_cq->wait)
+			tcpx_wait_ep_del(rx_cq, ep);
+		return ret;
+	}
+	return FI_SUCCESS;
 }
 
 void tcpx_cq_wait_ep_del(struct tcpx_ep *ep)
 {
+	struct util_cq *rx_cq = ep->util_ep.rx_cq, *tx_cq = ep->util_ep.tx_cq;
+
 	fastlock_acquire(&ep->lock);
-	if (ep->cm_state == TCPX_EP_CONNECTING) {
+	if (ep->cm_state == TCPX_EP_CONNECTING ||
+	    ep->cm_state == TCPX_EP_ERROR || ep->thread)
 		goto out;
-	}
 
-	if (ep->util_ep.rx_cq->wait) {
-		ofi_wait_fd_del(ep->util_ep.rx_cq->wait, ep->conn_fd);
-	}
+	if (rx_cq && rx_cq->wait)
+		tcpx_wait_ep_del(rx_cq, ep);
+	if (tx_cq && tx_cq != rx_cq && tx_cq->wait)
+		tcpx_wait_ep_del(tx_cq, ep);
 out:
 	fastlock_release(&ep->lock);
 }
 
+/*
+ * Send the payload of a large transfer over the stripe sockets; only its
+ * header goes on the connection itself.
+ */
+static void tcpx_tx_entry_stripe(struct tcpx_ep *ep,
+				 struct tcpx_xfer_entry *tx_entry)
+{
+	if (!ep->stripe_cnt || ep->stripe_ready != ep->stripe_cnt ||
+	    tx_entry->iov_cnt < 2 ||
+	    tx_entry->rem_len - tx_entry->iov[0].iov_len < tcpx_env.stripe_size)
+		return;
+
+	tx_entry->hdr.base_hdr.stripes = (uint8_t) ep->stripe_cnt;
+	tx_entry->data_iov_cnt = tx_entry->iov_cnt - 1;
+	tx_entry->iov_cnt = 1;
+	tx_entry->rem_len = tx_entry->iov[0].iov_len;
+}
+
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry)
 {
 	int empty;
 	struct util_wait *wait = tcpx_ep->util_ep.tx_cq->wait;
 
+	tcpx_tx_entry_stripe(tcpx_ep, tx_entry);
 	empty = slist_empty(&tcpx_ep->tx_queue);
 	slist_insert_tail(&tx_entry->entry, &tcpx_ep->tx_queue);
 
 	if (empty) {
 		process_tx_entry(tx_entry);
 
-		if (!slist_empty(&tcpx_ep->tx_queue) && wait)
-			wait->signal(wait);
+		if (!slist_empty(&tcpx_ep->tx_queue)) {
+			tcpx_cq_update_active(tcpx_ep);
+			if (wait)
+				wait->signal(wait);
+		}
 	}
 }
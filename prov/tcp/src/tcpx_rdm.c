@@ -0,0 +1,1042 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <rdma/fi_errno.h>
+#include <ofi_prov.h>
+#include <ofi_util.h>
+#include <ofi_iov.h>
+#include "tcpx.h"
+
+/* The connections' info: same attributes, but FI_EP_MSG and no tags */
+static int tcpx_rdm_msg_info(const struct fi_info *info,
+			     struct fi_info **msg_info)
+{
+	union ofi_sock_ip addr;
+	size_t addrlen;
+
+	*msg_info = fi_dupinfo(info);
+	if (!*msg_info)
+		return -FI_ENOMEM;
+
+	(*msg_info)->ep_attr->type = FI_EP_MSG;
+	(*msg_info)->ep_attr->mem_tag_format = 0;
+	(*msg_info)->caps &= ~FI_TAGGED;
+	(*msg_info)->tx_attr->caps &= ~FI_TAGGED;
+	(*msg_info)->rx_attr->caps &= ~FI_TAGGED;
+
+	free((*msg_info)->dest_addr);
+	(*msg_info)->dest_addr = NULL;
+	(*msg_info)->dest_addrlen = 0;
+	if ((*msg_info)->src_addr)
+		return FI_SUCCESS;
+
+	/* listen on every interface of the family we send to */
+	memset(&addr, 0, sizeof(addr));
+	if (info->dest_addr &&
+	    ((struct sockaddr *) info->dest_addr)->sa_family == AF_INET6) {
+		addr.sin6.sin6_family = AF_INET6;
+		addrlen = sizeof(addr.sin6);
+		(*msg_info)->addr_format = FI_SOCKADDR_IN6;
+	} else {
+		addr.sin.sin_family = AF_INET;
+		addrlen = sizeof(addr.sin);
+		(*msg_info)->addr_format = FI_SOCKADDR_IN;
+	}
+
+	(*msg_info)->src_addr = mem_dup(&addr, addrlen);
+	if (!(*msg_info)->src_addr) {
+		fi_freeinfo(*msg_info);
+		return -FI_ENOMEM;
+	}
+	(*msg_info)->src_addrlen = addrlen;
+	return FI_SUCCESS;
+}
+
+/*
+ * Called with rdm->lock held.  The CQs are attached directly rather than
+ * through fi_ep_bind: accepts run from CQ progress, which holds the CQs'
+ * ep_list_lock.
+ */
+static int tcpx_rdm_conn_open(struct tcpx_rdm *rdm, struct fi_info *info,
+			      struct tcpx_ep **ep)
+{
+	struct fid_ep *ep_fid;
+	int ret;
+
+	ret = tcpx_endpoint(&rdm->util_ep.domain->domain_fid, info,
+			    &ep_fid, rdm);
+	if (ret)
+		return ret;
+
+	*ep = container_of(ep_fid, struct tcpx_ep, util_ep.ep_fid);
+	ofi_ep_bind_eq(&(*ep)->util_ep,
+		       container_of(rdm->eq, struct util_eq, eq_fid));
+
+	(*ep)->util_ep.tx_cq = rdm->util_ep.tx_cq;
+	ofi_atomic_inc32(&rdm->util_ep.tx_cq->ref);
+	(*ep)->util_ep.rx_cq = rdm->util_ep.rx_cq;
+	ofi_atomic_inc32(&rdm->util_ep.rx_cq->ref);
+	(*ep)->util_ep.rx_op_flags |= rdm->util_ep.rx_op_flags & FI_COMPLETION;
+	(*ep)->srx_ctx = rdm->srx_ctx;
+
+	(*ep)->get_rx_entry[ofi_op_msg] = tcpx_get_rx_entry_op_srx;
+	(*ep)->get_rx_entry[ofi_op_tagged] = tcpx_get_rx_entry_op_srx;
+	(*ep)->get_rx_entry[ofi_op_read_req] = tcpx_get_rx_entry_op_invalid;
+	(*ep)->get_rx_entry[ofi_op_read_rsp] = tcpx_get_rx_entry_op_invalid;
+	(*ep)->get_rx_entry[ofi_op_write] = tcpx_get_rx_entry_op_invalid;
+
+	(*ep)->rdm_addr = FI_ADDR_NOTAVAIL;
+	dlist_insert_tail(&(*ep)->ep_entry, &rdm->conn_list);
+	return FI_SUCCESS;
+}
+
+/*
+ * Called with rdm->lock held.  Moves a failed connection to dead_list.
+ * It is closed by the next send rather than here: connection events are
+ * handled from CQ progress, which holds the ep_list_lock closing takes.
+ */
+static void tcpx_rdm_conn_drop(struct tcpx_rdm *rdm, struct tcpx_ep *ep)
+{
+	if (ep->rdm_addr != FI_ADDR_NOTAVAIL) {
+		ofi_idm_clear(&rdm->conn_idm, (int) ep->rdm_addr);
+		ep->rdm_addr = FI_ADDR_NOTAVAIL;
+	}
+	dlist_remove(&ep->ep_entry);
+	dlist_insert_tail(&ep->ep_entry, &rdm->dead_list);
+}
+
+/*
+ * Called with rdm->lock held.  Events can still be queued for a connection
+ * that was dropped, and closed, after they were written.
+ */
+static struct tcpx_ep *tcpx_rdm_conn_find(struct tcpx_rdm *rdm, fid_t fid)
+{
+	struct tcpx_ep *ep;
+
+	dlist_foreach_container(&rdm->conn_list, struct tcpx_ep, ep, ep_entry) {
+		if (&ep->util_ep.ep_fid.fid == fid)
+			return ep;
+	}
+	return NULL;
+}
+
+static void tcpx_rdm_conns_close(struct dlist_entry *conn_list)
+{
+	struct tcpx_ep *ep;
+
+	while (!dlist_empty(conn_list)) {
+		dlist_pop_front(conn_list, struct tcpx_ep, ep, ep_entry);
+		fi_close(&ep->util_ep.ep_fid.fid);
+	}
+}
+
+/*
+ * Called with rdm->lock held.  A peer connects with the address it listens
+ * on, so a connection it opened is used to send back to it rather than
+ * opening a second one.  Peers that connect to each other at the same
+ * time each keep sending on their own connection.
+ */
+static struct tcpx_ep *tcpx_rdm_conn_lookup(struct tcpx_rdm *rdm,
+					    const struct sockaddr *peer)
+{
+	struct tcpx_ep *ep;
+
+	dlist_foreach_container(&rdm->conn_list, struct tcpx_ep, ep, ep_entry) {
+		if (ep->rdm_addr == FI_ADDR_NOTAVAIL &&
+		    (ep->cm_state == TCPX_EP_CONNECTING ||
+		     ep->cm_state == TCPX_EP_CONNECTED) &&
+		    ofi_equals_sockaddr(&ep->rdm_peer.sa, peer))
+			return ep;
+	}
+	return NULL;
+}
+
+/* Called with rdm->lock held */
+static int tcpx_rdm_connect(struct tcpx_rdm *rdm, fi_addr_t addr,
+			    struct tcpx_ep **ep)
+{
+	void *peer;
+	int ret;
+
+	peer = ofi_ip_av_get_addr(rdm->util_ep.av, addr);
+	*ep = tcpx_rdm_conn_lookup(rdm, peer);
+	if (*ep) {
+		if (ofi_idm_set(&rdm->conn_idm, (int) addr, *ep) < 0)
+			return -FI_ENOMEM;
+		(*ep)->rdm_addr = addr;
+		return FI_SUCCESS;
+	}
+
+	ret = tcpx_rdm_conn_open(rdm, rdm->msg_info, ep);
+	if (ret)
+		return ret;
+
+	if (ofi_idm_set(&rdm->conn_idm, (int) addr, *ep) < 0) {
+		tcpx_rdm_conn_drop(rdm, *ep);
+		return -FI_ENOMEM;
+	}
+	(*ep)->rdm_addr = addr;
+
+	/* lets the peer send to us over this connection */
+	ret = fi_connect(&(*ep)->util_ep.ep_fid, peer, &rdm->name,
+			 ofi_sizeofaddr(&rdm->name.sa));
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"connect to peer %" PRIu64 " failed: %d\n", addr, ret);
+		tcpx_rdm_conn_drop(rdm, *ep);
+	}
+	return ret;
+}
+
+/*
+ * Returns the connection to send to addr on, with its lock held, starting
+ * to set it up if there is none yet.  Sends queue on the connection until
+ * it is established.  Taking the ep lock before dropping rdm->lock keeps
+ * a dropped connection open until this send is done with it.
+ */
+static int tcpx_rdm_get_conn(struct tcpx_rdm *rdm, fi_addr_t addr,
+			     struct tcpx_ep **ep)
+{
+	struct dlist_entry dead_list;
+	int ret = FI_SUCCESS;
+
+	fastlock_acquire(&rdm->lock);
+	if (!dlist_empty(&rdm->dead_list)) {
+		dlist_init(&dead_list);
+		dlist_splice_tail(&dead_list, &rdm->dead_list);
+		fastlock_release(&rdm->lock);
+		tcpx_rdm_conns_close(&dead_list);
+		fastlock_acquire(&rdm->lock);
+	}
+
+	*ep = ofi_idm_lookup(&rdm->conn_idm, (int) addr);
+	if (!*ep) {
+		ret = tcpx_rdm_connect(rdm, addr, ep);
+		if (ret)
+			goto unlock;
+	} else if ((*ep)->cm_state != TCPX_EP_CONNECTED &&
+		   (*ep)->cm_state != TCPX_EP_CONNECTING) {
+		/* fail this send; the next one opens a new connection.  The
+		 * connection itself is dropped by its FI_SHUTDOWN event. */
+		ofi_idm_clear(&rdm->conn_idm, (int) addr);
+		(*ep)->rdm_addr = FI_ADDR_NOTAVAIL;
+		ret = -FI_ENOTCONN;
+		goto unlock;
+	}
+	fastlock_acquire(&(*ep)->lock);
+unlock:
+	fastlock_release(&rdm->lock);
+	return ret;
+}
+
+static void tcpx_rdm_accept(struct tcpx_rdm *rdm,
+			    struct fi_eq_cm_entry *cm_entry, size_t paramlen)
+{
+	struct tcpx_ep *ep;
+	int ret;
+
+	ret = tcpx_rdm_conn_open(rdm, cm_entry->info, &ep);
+	if (!ret) {
+		ret = fi_accept(&ep->util_ep.ep_fid, NULL, 0);
+		if (ret)
+			tcpx_rdm_conn_drop(rdm, ep);
+		else if (paramlen <= sizeof(ep->rdm_peer))
+			memcpy(&ep->rdm_peer, cm_entry->data, paramlen);
+	}
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"unable to accept connection: %d\n", ret);
+
+	fi_freeinfo(cm_entry->info);
+}
+
+/*
+ * Called with rdm->lock held.  Fails the sends that were queued waiting
+ * for the connection and drops it.
+ */
+static void tcpx_rdm_conn_error(struct tcpx_rdm *rdm,
+				struct fi_eq_err_entry *err_entry)
+{
+	struct tcpx_xfer_entry *tx_entry;
+	struct slist_entry *entry;
+	struct tcpx_cq *tcpx_cq;
+	struct tcpx_ep *ep;
+
+	FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL, "connection error: %s\n",
+		fi_strerror(err_entry->err));
+	ep = tcpx_rdm_conn_find(rdm, err_entry->fid);
+	if (!ep)
+		return;
+
+	tcpx_cq = container_of(ep->util_ep.tx_cq, struct tcpx_cq, util_cq);
+
+	fastlock_acquire(&ep->lock);
+	if (ep->cm_state != TCPX_EP_CONNECTING) {
+		fastlock_release(&ep->lock);
+		return;
+	}
+
+	ep->cm_state = TCPX_EP_ERROR;
+	while (!slist_empty(&ep->tx_queue)) {
+		entry = slist_remove_head(&ep->tx_queue);
+		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
+		tcpx_cq_report_completion(&tcpx_cq->util_cq, tx_entry,
+					  err_entry->err);
+		tcpx_xfer_entry_release(tcpx_cq, tx_entry);
+	}
+	fastlock_release(&ep->lock);
+	tcpx_rdm_conn_drop(rdm, ep);
+}
+
+/*
+ * Without a source address the listener is bound to the wildcard address,
+ * which peers cannot connect to.  Report the address of the fastest
+ * interface of the same family instead, as fi_getinfo lists them.
+ */
+static int tcpx_rdm_set_name(struct tcpx_rdm *rdm)
+{
+	struct ofi_addr_list_entry *addr_entry;
+	struct slist_entry *entry, *prev;
+	struct slist addr_list;
+	size_t addrlen;
+	uint16_t port;
+	int ret;
+
+	addrlen = sizeof(rdm->name);
+	ret = fi_getname(&rdm->pep->fid, &rdm->name, &addrlen);
+	if (ret || !ofi_is_any_addr(&rdm->name.sa))
+		return ret;
+
+	port = ofi_addr_get_port(&rdm->name.sa);
+	ret = -FI_EADDRNOTAVAIL;
+	slist_init(&addr_list);
+	ofi_get_list_of_addr(&tcpx_prov, "iface", &addr_list);
+
+	(void) prev;
+	slist_foreach(&addr_list, entry, prev) {
+		addr_entry = container_of(entry, struct ofi_addr_list_entry,
+					  entry);
+		if (addr_entry->ipaddr.sa.sa_family != rdm->name.sa.sa_family)
+			continue;
+
+		memcpy(&rdm->name, &addr_entry->ipaddr,
+		       ofi_sizeofaddr(&addr_entry->ipaddr.sa));
+		ofi_addr_set_port(&rdm->name.sa, port);
+		ret = FI_SUCCESS;
+		break;
+	}
+	ofi_free_list_of_addr(&addr_list);
+
+	if (ret)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"no local address to report for the listener\n");
+	return ret;
+}
+
+#ifdef HAVE_EPOLL
+static int tcpx_rdm_cm_fd(struct tcpx_rdm *rdm)
+{
+	struct util_wait_fd *wait_fd;
+	struct util_eq *eq;
+
+	eq = container_of(rdm->eq, struct util_eq, eq_fid);
+	wait_fd = container_of(eq->wait, struct util_wait_fd, util_wait);
+	return wait_fd->epoll_fd;
+}
+#else
+static int tcpx_rdm_cm_fd(struct tcpx_rdm *rdm)
+{
+	return INVALID_SOCKET;
+}
+#endif
+
+/*
+ * Runs from CQ progress when the connection manager's wait set is
+ * readable: accepts peers' connections and finishes our own.
+ */
+void tcpx_rdm_progress(struct util_ep *util_ep)
+{
+	union {
+		struct fi_eq_cm_entry	cm_entry;
+		uint8_t			data[sizeof(struct fi_eq_cm_entry) +
+					     TCPX_MAX_CM_DATA_SIZE];
+	} entry;
+	struct fi_eq_err_entry err_entry;
+	struct util_wait_fd *wait_fd;
+	struct tcpx_rdm *rdm;
+	struct tcpx_ep *ep;
+	struct util_eq *eq;
+	uint32_t event;
+	ssize_t ret;
+
+	rdm = container_of(util_ep, struct tcpx_rdm, util_ep);
+	eq = container_of(rdm->eq, struct util_eq, eq_fid);
+	wait_fd = container_of(eq->wait, struct util_wait_fd, util_wait);
+
+	fastlock_acquire(&rdm->lock);
+	/* leave the wait set readable only while sockets need attention */
+	fd_signal_reset(&wait_fd->signal);
+	for (;;) {
+		ret = fi_eq_read(rdm->eq, &event, &entry, sizeof(entry), 0);
+		if (ret == -FI_EAVAIL) {
+			memset(&err_entry, 0, sizeof(err_entry));
+			if (fi_eq_readerr(rdm->eq, &err_entry, 0) < 0)
+				break;
+			tcpx_rdm_conn_error(rdm, &err_entry);
+			continue;
+		}
+		if (ret < 0)
+			break;
+
+		switch (event) {
+		case FI_CONNREQ:
+			tcpx_rdm_accept(rdm, &entry.cm_entry,
+					ret - sizeof(entry.cm_entry));
+			break;
+		case FI_CONNECTED:
+			FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL,
+			       "connection established\n");
+			break;
+		case FI_SHUTDOWN:
+			FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+				"connection closed by peer\n");
+			ep = tcpx_rdm_conn_find(rdm, entry.cm_entry.fid);
+			if (ep)
+				tcpx_rdm_conn_drop(rdm, ep);
+			break;
+		default:
+			break;
+		}
+	}
+	fastlock_release(&rdm->lock);
+}
+
+static ssize_t tcpx_rdm_send_entry(struct tcpx_rdm *rdm,
+				   const struct iovec *iov, size_t count,
+				   fi_addr_t dest_addr, uint64_t data,
+				   uint64_t tag, uint64_t flags, void *context)
+{
+	struct tcpx_xfer_entry *tx_entry;
+	struct tcpx_cq *tcpx_cq;
+	struct tcpx_ep *ep;
+	uint64_t data_len;
+	size_t offset;
+	int ret;
+
+	ret = tcpx_rdm_get_conn(rdm, dest_addr, &ep);
+	if (ret)
+		return ret;
+
+	tcpx_cq = container_of(ep->util_ep.tx_cq, struct tcpx_cq, util_cq);
+	tx_entry = tcpx_xfer_entry_alloc(tcpx_cq, (flags & FI_TAGGED) ?
+					 TCPX_OP_TAGGED_SEND :
+					 TCPX_OP_MSG_SEND);
+	if (!tx_entry) {
+		ret = -FI_EAGAIN;
+		goto unlock;
+	}
+
+	assert(count <= TCPX_IOV_LIMIT);
+	data_len = ofi_total_iov_len(iov, count);
+	assert(!(flags & FI_INJECT) || (data_len <= TCPX_MAX_INJECT_SZ));
+
+	offset = sizeof(tx_entry->hdr.base_hdr);
+	if (flags & FI_REMOTE_CQ_DATA) {
+		tx_entry->hdr.base_hdr.flags |= OFI_REMOTE_CQ_DATA;
+		tx_entry->hdr.cq_data_hdr.cq_data = data;
+		offset += sizeof(data);
+	}
+
+	if (flags & FI_TAGGED) {
+		*tcpx_hdr_tag(&tx_entry->hdr.base_hdr) = tag;
+		offset += sizeof(tag);
+	}
+
+	tx_entry->hdr.base_hdr.payload_off = (uint8_t) offset;
+	tx_entry->hdr.base_hdr.size = offset + data_len;
+	if (flags & FI_INJECT) {
+		ofi_copy_iov_buf(iov, count, 0,
+				 (uint8_t *) &tx_entry->hdr + offset,
+				 data_len, OFI_COPY_IOV_TO_BUF);
+		tx_entry->iov_cnt = 1;
+		offset += data_len;
+	} else {
+		memcpy(&tx_entry->iov[1], iov, count * sizeof(*iov));
+		tx_entry->iov_cnt = count + 1;
+	}
+	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
+	tx_entry->iov[0].iov_len = offset;
+
+	tx_entry->flags = flags | FI_SEND;
+	tx_entry->ep = ep;
+	tx_entry->context = context;
+	tx_entry->tag = tag;
+	tx_entry->rem_len = tx_entry->hdr.base_hdr.size;
+
+	switch (ep->cm_state) {
+	case TCPX_EP_CONNECTED:
+		ep->hdr_bswap(&tx_entry->hdr.base_hdr);
+		tcpx_tx_queue_insert(ep, tx_entry);
+		break;
+	case TCPX_EP_CONNECTING:
+		/* hdr_bswap is only known once the peer responds; the header
+		 * is swapped when the connection is enabled */
+		slist_insert_tail(&tx_entry->entry, &ep->tx_queue);
+		break;
+	default:
+		tcpx_xfer_entry_release(tcpx_cq, tx_entry);
+		ret = -FI_ENOTCONN;
+		break;
+	}
+unlock:
+	fastlock_release(&ep->lock);
+	return ret;
+}
+
+static inline uint64_t tcpx_rdm_tx_flags(struct tcpx_rdm *rdm)
+{
+	return rdm->util_ep.tx_op_flags & FI_COMPLETION;
+}
+
+static inline uint64_t tcpx_rdm_rx_flags(struct tcpx_rdm *rdm)
+{
+	return rdm->util_ep.rx_op_flags & FI_COMPLETION;
+}
+
+/* FI_MULTI_RECV in the default flags only applies to untagged receives */
+static inline uint64_t tcpx_rdm_recv_flags(struct tcpx_rdm *rdm)
+{
+	return rdm->util_ep.rx_op_flags & (FI_COMPLETION | FI_MULTI_RECV);
+}
+
+static ssize_t tcpx_rdm_recvmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
+				uint64_t flags)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_srx_post(rdm->srx_ctx, msg->msg_iov, msg->iov_count, 0, 0,
+			     tcpx_rdm_rx_flags(rdm) | flags | FI_MSG,
+			     msg->context);
+}
+
+static ssize_t tcpx_rdm_recv(struct fid_ep *ep_fid, void *buf, size_t len,
+			     void *desc, fi_addr_t src_addr, void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return tcpx_srx_post(rdm->srx_ctx, &iov, 1, 0, 0,
+			     tcpx_rdm_recv_flags(rdm) | FI_MSG, context);
+}
+
+static ssize_t tcpx_rdm_recvv(struct fid_ep *ep_fid, const struct iovec *iov,
+			      void **desc, size_t count, fi_addr_t src_addr,
+			      void *context)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_srx_post(rdm->srx_ctx, iov, count, 0, 0,
+			     tcpx_rdm_recv_flags(rdm) | FI_MSG, context);
+}
+
+static ssize_t tcpx_rdm_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
+				uint64_t flags)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_rdm_send_entry(rdm, msg->msg_iov, msg->iov_count,
+				   msg->addr, msg->data, 0,
+				   tcpx_rdm_tx_flags(rdm) | flags | FI_MSG,
+				   msg->context);
+}
+
+static ssize_t tcpx_rdm_send(struct fid_ep *ep_fid, const void *buf, size_t len,
+			     void *desc, fi_addr_t dest_addr, void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, 0, 0,
+				   tcpx_rdm_tx_flags(rdm) | FI_MSG, context);
+}
+
+static ssize_t tcpx_rdm_sendv(struct fid_ep *ep_fid, const struct iovec *iov,
+			      void **desc, size_t count, fi_addr_t dest_addr,
+			      void *context)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_rdm_send_entry(rdm, iov, count, dest_addr, 0, 0,
+				   tcpx_rdm_tx_flags(rdm) | FI_MSG, context);
+}
+
+static ssize_t tcpx_rdm_inject(struct fid_ep *ep_fid, const void *buf,
+			       size_t len, fi_addr_t dest_addr)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, 0, 0,
+				   FI_MSG | FI_INJECT, NULL);
+}
+
+static ssize_t tcpx_rdm_senddata(struct fid_ep *ep_fid, const void *buf,
+				 size_t len, void *desc, uint64_t data,
+				 fi_addr_t dest_addr, void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, data, 0,
+				   tcpx_rdm_tx_flags(rdm) | FI_MSG |
+				   FI_REMOTE_CQ_DATA, context);
+}
+
+static ssize_t tcpx_rdm_injectdata(struct fid_ep *ep_fid, const void *buf,
+				   size_t len, uint64_t data,
+				   fi_addr_t dest_addr)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, data, 0,
+				   FI_MSG | FI_INJECT | FI_REMOTE_CQ_DATA,
+				   NULL);
+}
+
+static struct fi_ops_msg tcpx_rdm_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = tcpx_rdm_recv,
+	.recvv = tcpx_rdm_recvv,
+	.recvmsg = tcpx_rdm_recvmsg,
+	.send = tcpx_rdm_send,
+	.sendv = tcpx_rdm_sendv,
+	.sendmsg = tcpx_rdm_sendmsg,
+	.inject = tcpx_rdm_inject,
+	.senddata = tcpx_rdm_senddata,
+	.injectdata = tcpx_rdm_injectdata,
+};
+
+static ssize_t tcpx_rdm_trecvmsg(struct fid_ep *ep_fid,
+				 const struct fi_msg_tagged *msg,
+				 uint64_t flags)
+{
+	struct tcpx_rdm *rdm;
+
+	if (flags & (FI_PEEK | FI_CLAIM))
+		return -FI_EOPNOTSUPP;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_srx_post(rdm->srx_ctx, msg->msg_iov, msg->iov_count,
+			     msg->tag, msg->ignore,
+			     tcpx_rdm_rx_flags(rdm) | flags | FI_TAGGED,
+			     msg->context);
+}
+
+static ssize_t tcpx_rdm_trecv(struct fid_ep *ep_fid, void *buf, size_t len,
+			      void *desc, fi_addr_t src_addr, uint64_t tag,
+			      uint64_t ignore, void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return tcpx_srx_post(rdm->srx_ctx, &iov, 1, tag, ignore,
+			     tcpx_rdm_rx_flags(rdm) | FI_TAGGED, context);
+}
+
+static ssize_t tcpx_rdm_trecvv(struct fid_ep *ep_fid, const struct iovec *iov,
+			       void **desc, size_t count, fi_addr_t src_addr,
+			       uint64_t tag, uint64_t ignore, void *context)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_srx_post(rdm->srx_ctx, iov, count, tag, ignore,
+			     tcpx_rdm_rx_flags(rdm) | FI_TAGGED, context);
+}
+
+static ssize_t tcpx_rdm_tsendmsg(struct fid_ep *ep_fid,
+				 const struct fi_msg_tagged *msg,
+				 uint64_t flags)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_rdm_send_entry(rdm, msg->msg_iov, msg->iov_count,
+				   msg->addr, msg->data, msg->tag,
+				   tcpx_rdm_tx_flags(rdm) | flags | FI_TAGGED,
+				   msg->context);
+}
+
+static ssize_t tcpx_rdm_tsend(struct fid_ep *ep_fid, const void *buf,
+			      size_t len, void *desc, fi_addr_t dest_addr,
+			      uint64_t tag, void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, 0, tag,
+				   tcpx_rdm_tx_flags(rdm) | FI_TAGGED, context);
+}
+
+static ssize_t tcpx_rdm_tsendv(struct fid_ep *ep_fid, const struct iovec *iov,
+			       void **desc, size_t count, fi_addr_t dest_addr,
+			       uint64_t tag, void *context)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	return tcpx_rdm_send_entry(rdm, iov, count, dest_addr, 0, tag,
+				   tcpx_rdm_tx_flags(rdm) | FI_TAGGED, context);
+}
+
+static ssize_t tcpx_rdm_tinject(struct fid_ep *ep_fid, const void *buf,
+				size_t len, fi_addr_t dest_addr, uint64_t tag)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, 0, tag,
+				   FI_TAGGED | FI_INJECT, NULL);
+}
+
+static ssize_t tcpx_rdm_tsenddata(struct fid_ep *ep_fid, const void *buf,
+				  size_t len, void *desc, uint64_t data,
+				  fi_addr_t dest_addr, uint64_t tag,
+				  void *context)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, data, tag,
+				   tcpx_rdm_tx_flags(rdm) | FI_TAGGED |
+				   FI_REMOTE_CQ_DATA, context);
+}
+
+static ssize_t tcpx_rdm_tinjectdata(struct fid_ep *ep_fid, const void *buf,
+				    size_t len, uint64_t data,
+				    fi_addr_t dest_addr, uint64_t tag)
+{
+	struct tcpx_rdm *rdm;
+	struct iovec iov;
+
+	rdm = container_of(ep_fid, struct tcpx_rdm, util_ep.ep_fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	return tcpx_rdm_send_entry(rdm, &iov, 1, dest_addr, data, tag,
+				   FI_TAGGED | FI_INJECT | FI_REMOTE_CQ_DATA,
+				   NULL);
+}
+
+static struct fi_ops_tagged tcpx_rdm_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = tcpx_rdm_trecv,
+	.recvv = tcpx_rdm_trecvv,
+	.recvmsg = tcpx_rdm_trecvmsg,
+	.send = tcpx_rdm_tsend,
+	.sendv = tcpx_rdm_tsendv,
+	.sendmsg = tcpx_rdm_tsendmsg,
+	.inject = tcpx_rdm_tinject,
+	.senddata = tcpx_rdm_tsenddata,
+	.injectdata = tcpx_rdm_tinjectdata,
+};
+
+static int tcpx_rdm_getname(fid_t fid, void *addr, size_t *addrlen)
+{
+	struct tcpx_rdm *rdm;
+	size_t addrlen_in = *addrlen;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	*addrlen = ofi_sizeofaddr(&rdm->name.sa);
+	memcpy(addr, &rdm->name, MIN(addrlen_in, *addrlen));
+	return (addrlen_in < *addrlen) ? -FI_ETOOSMALL : FI_SUCCESS;
+}
+
+static struct fi_ops_cm tcpx_rdm_cm_ops = {
+	.size = sizeof(struct fi_ops_cm),
+	.setname = fi_no_setname,
+	.getname = tcpx_rdm_getname,
+	.getpeer = fi_no_getpeer,
+	.connect = fi_no_connect,
+	.listen = fi_no_listen,
+	.accept = fi_no_accept,
+	.reject = fi_no_reject,
+	.shutdown = fi_no_shutdown,
+	.join = fi_no_join,
+};
+
+/* FI_OPT_MIN_MULTI_RECV applies to the receives posted to srx_ctx */
+static int tcpx_rdm_getopt(fid_t fid, int level, int optname,
+			   void *optval, size_t *optlen)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	return fi_getopt(&rdm->srx_ctx->rx_fid.fid, level, optname,
+			 optval, optlen);
+}
+
+static int tcpx_rdm_setopt(fid_t fid, int level, int optname,
+			   const void *optval, size_t optlen)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	return fi_setopt(&rdm->srx_ctx->rx_fid.fid, level, optname,
+			 optval, optlen);
+}
+
+static struct fi_ops_ep tcpx_rdm_ep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = fi_no_cancel,
+	.getopt = tcpx_rdm_getopt,
+	.setopt = tcpx_rdm_setopt,
+	.tx_ctx = fi_no_tx_ctx,
+	.rx_ctx = fi_no_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
+
+static int tcpx_rdm_enable(struct tcpx_rdm *rdm)
+{
+	struct util_cq *tx_cq = rdm->util_ep.tx_cq;
+	struct util_cq *rx_cq = rdm->util_ep.rx_cq;
+	int fd, ret;
+
+	if (!tx_cq || !rx_cq)
+		return -FI_ENOCQ;
+	if (!rdm->util_ep.av)
+		return -FI_ENOAV;
+	if (rdm->cm_fd != INVALID_SOCKET)
+		return FI_SUCCESS;
+
+	fd = tcpx_rdm_cm_fd(rdm);
+	if (fd == INVALID_SOCKET)
+		return -FI_ENOSYS;
+
+	ret = tcpx_cq_rdm_add(rx_cq, rdm, fd);
+	if (ret)
+		return ret;
+
+	if (tx_cq != rx_cq) {
+		ret = tcpx_cq_rdm_add(tx_cq, rdm, fd);
+		if (ret) {
+			tcpx_cq_rdm_del(rx_cq, fd);
+			return ret;
+		}
+	}
+	rdm->cm_fd = fd;
+	return FI_SUCCESS;
+}
+
+static int tcpx_rdm_ctrl(struct fid *fid, int command, void *arg)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	switch (command) {
+	case FI_ENABLE:
+		return tcpx_rdm_enable(rdm);
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
+/*
+ * A user srx replaces the one opened with the endpoint.  Connections take
+ * srx_ctx when they are opened, so this must happen before fi_enable.
+ */
+static int tcpx_rdm_bind_srx(struct tcpx_rdm *rdm, struct fid *bfid)
+{
+	if (rdm->cm_fd != INVALID_SOCKET)
+		return -FI_EOPBADSTATE;
+
+	if (rdm->srx_owned)
+		fi_close(&rdm->srx_ctx->rx_fid.fid);
+	rdm->srx_ctx = container_of(bfid, struct tcpx_rx_ctx, rx_fid.fid);
+	rdm->srx_owned = false;
+	return FI_SUCCESS;
+}
+
+static int tcpx_rdm_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	if (bfid->fclass == FI_CLASS_SRX_CTX)
+		return tcpx_rdm_bind_srx(rdm, bfid);
+
+	return ofi_ep_bind(&rdm->util_ep, bfid, flags);
+}
+
+static int tcpx_rdm_close(struct fid *fid)
+{
+	struct tcpx_rdm *rdm;
+
+	rdm = container_of(fid, struct tcpx_rdm, util_ep.ep_fid.fid);
+	if (rdm->cm_fd != INVALID_SOCKET) {
+		tcpx_cq_rdm_del(rdm->util_ep.rx_cq, rdm->cm_fd);
+		if (rdm->util_ep.tx_cq != rdm->util_ep.rx_cq)
+			tcpx_cq_rdm_del(rdm->util_ep.tx_cq, rdm->cm_fd);
+	}
+
+	tcpx_rdm_conns_close(&rdm->conn_list);
+	tcpx_rdm_conns_close(&rdm->dead_list);
+	ofi_idm_reset(&rdm->conn_idm);
+
+	fi_close(&rdm->pep->fid);
+	fi_close(&rdm->eq->fid);
+	if (rdm->srx_owned)
+		fi_close(&rdm->srx_ctx->rx_fid.fid);
+	ofi_endpoint_close(&rdm->util_ep);
+	fi_freeinfo(rdm->msg_info);
+	fastlock_destroy(&rdm->lock);
+	free(rdm);
+	return 0;
+}
+
+static struct fi_ops tcpx_rdm_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = tcpx_rdm_close,
+	.bind = tcpx_rdm_bind,
+	.control = tcpx_rdm_ctrl,
+	.ops_open = fi_no_ops_open,
+};
+
+int tcpx_rdm_open(struct fid_domain *domain, struct fi_info *info,
+		  struct fid_ep **ep_fid, void *context)
+{
+	struct fi_eq_attr eq_attr = {
+		.wait_obj = FI_WAIT_NONE,
+	};
+	struct fid_fabric *fabric;
+	struct tcpx_rdm *rdm;
+	struct fid_ep *srx;
+	int ret;
+
+	rdm = calloc(1, sizeof(*rdm));
+	if (!rdm)
+		return -FI_ENOMEM;
+
+	ret = ofi_endpoint_init(domain, &tcpx_util_prov, info, &rdm->util_ep,
+				context, tcpx_rdm_progress);
+	if (ret)
+		goto err1;
+
+	ret = tcpx_rdm_msg_info(info, &rdm->msg_info);
+	if (ret)
+		goto err2;
+
+	ret = fi_srx_context(domain, info->rx_attr, &srx, rdm);
+	if (ret)
+		goto err3;
+	rdm->srx_ctx = container_of(srx, struct tcpx_rx_ctx, rx_fid);
+	rdm->srx_owned = true;
+
+	fabric = &rdm->util_ep.domain->fabric->fabric_fid;
+	ret = tcpx_eq_create(fabric, &eq_attr, &rdm->eq, rdm);
+	if (ret)
+		goto err4;
+
+	ret = tcpx_passive_ep(fabric, rdm->msg_info, &rdm->pep, rdm);
+	if (ret)
+		goto err5;
+
+	ret = fi_pep_bind(rdm->pep, &rdm->eq->fid, 0);
+	if (ret)
+		goto err6;
+
+	ret = fi_listen(rdm->pep);
+	if (ret)
+		goto err6;
+
+	ret = tcpx_rdm_set_name(rdm);
+	if (ret)
+		goto err6;
+
+	dlist_init(&rdm->conn_list);
+	dlist_init(&rdm->dead_list);
+	fastlock_init(&rdm->lock);
+	rdm->cm_fd = INVALID_SOCKET;
+
+	*ep_fid = &rdm->util_ep.ep_fid;
+	(*ep_fid)->fid.ops = &tcpx_rdm_fi_ops;
+	(*ep_fid)->ops = &tcpx_rdm_ep_ops;
+	(*ep_fid)->cm = &tcpx_rdm_cm_ops;
+	(*ep_fid)->msg = &tcpx_rdm_msg_ops;
+	(*ep_fid)->tagged = &tcpx_rdm_tagged_ops;
+	return 0;
+err6:
+	fi_close(&rdm->pep->fid);
+err5:
+	fi_close(&rdm->eq->fid);
+err4:
+	fi_close(&srx->fid);
+err3:
+	fi_freeinfo(rdm->msg_info);
+err2:
+	ofi_endpoint_close(&rdm->util_ep);
+err1:
+	free(rdm);
+	return ret;
+}
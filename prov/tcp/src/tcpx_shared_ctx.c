@@ -1,5 +1,6 @@
 /*
  * Copyright (c) 2018 Intel Corporation. All rights reserved.
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
  *
  * This software is available to you under a choice of one of two
  * licenses.  You may choose to be licensed under the terms of the GNU
@@ -35,6 +36,7 @@
 
 #include <sys/types.h>
 #include <ofi_util.h>
+#include <ofi_iov.h>
 #include <unistd.h>
 
 
@@ -44,118 +46,368 @@ void tcpx_srx_xfer_release(struct tcpx_rx_ctx *srx_ctx,
 	if (xfer_entry->ep->cur_rx_entry == xfer_entry)
 		xfer_entry->ep->cur_rx_entry = NULL;
 
+	tcpx_mrecv_release(xfer_entry);
 	fastlock_acquire(&srx_ctx->lock);
 	util_buf_release(srx_ctx->buf_pool, xfer_entry);
 	fastlock_release(&srx_ctx->lock);
 }
 
-static inline void tcpx_srx_recv_init(struct tcpx_xfer_entry *recv_entry,
-				      uint64_t base_flags, void *context)
+static int tcpx_srx_match_tag(struct slist_entry *item, const void *arg)
 {
-	recv_entry->flags = base_flags | FI_MSG | FI_RECV;
-	recv_entry->context = context;
+	struct tcpx_xfer_entry *recv_entry;
+
+	recv_entry = container_of(item, struct tcpx_xfer_entry, entry);
+	return ofi_match_tag(recv_entry->tag, recv_entry->ignore,
+			     *((const uint64_t *) arg));
 }
 
-static inline void tcpx_srx_recv_init_iov(struct tcpx_xfer_entry *recv_entry,
-					  size_t count, const struct iovec *iov)
+static int tcpx_srx_match_unexp(struct slist_entry *item, const void *arg)
 {
-	recv_entry->iov_cnt = count;
-	memcpy(&recv_entry->iov[0], iov, count * sizeof(*iov));
+	const struct tcpx_xfer_entry *recv_entry = arg;
+	struct tcpx_xfer_entry *unexp_entry;
+
+	unexp_entry = container_of(item, struct tcpx_xfer_entry, entry);
+	if (!(recv_entry->flags & FI_TAGGED))
+		return unexp_entry->hdr.base_hdr.op == ofi_op_msg;
+
+	return unexp_entry->hdr.base_hdr.op == ofi_op_tagged &&
+	       ofi_match_tag(recv_entry->tag, recv_entry->ignore,
+			     unexp_entry->tag);
 }
 
-struct tcpx_xfer_entry *
-tcpx_srx_dequeue(struct tcpx_rx_ctx *srx_ctx)
+static int tcpx_srx_match_entry(struct slist_entry *item, const void *arg)
 {
-	struct tcpx_xfer_entry *xfer_entry;
+	return item == arg;
+}
 
+static inline size_t tcpx_srx_unexp_len(struct tcpx_xfer_entry *unexp_entry)
+{
+	return unexp_entry->hdr.base_hdr.size -
+	       unexp_entry->hdr.base_hdr.payload_off;
+}
+
+/*
+ * Called with srx_ctx->lock held once a receive is posted or buffer space
+ * is freed: connections that stopped reading may go on.
+ */
+static void tcpx_srx_wake(struct tcpx_rx_ctx *srx_ctx)
+{
+	struct tcpx_ep *ep;
+
+	while (!dlist_empty(&srx_ctx->blocked_list)) {
+		dlist_pop_front(&srx_ctx->blocked_list, struct tcpx_ep, ep,
+				srx_entry);
+		dlist_init(&ep->srx_entry);
+		tcpx_cq_ep_wake(ep);
+	}
+}
+
+static void tcpx_srx_unexp_free(struct tcpx_rx_ctx *srx_ctx,
+				struct tcpx_xfer_entry *unexp_entry)
+{
+	free(unexp_entry->unexp_buf);
 	fastlock_acquire(&srx_ctx->lock);
-	if (!slist_empty(&srx_ctx->rx_queue)) {
-		xfer_entry = container_of(slist_remove_head(&srx_ctx->rx_queue),
-					  struct tcpx_xfer_entry, entry);
-	} else {
-		xfer_entry = NULL;
+	srx_ctx->unexp_size -= tcpx_srx_unexp_len(unexp_entry);
+	tcpx_srx_wake(srx_ctx);
+	fastlock_release(&srx_ctx->lock);
+}
+
+void tcpx_srx_ep_del(struct tcpx_rx_ctx *srx_ctx, struct tcpx_ep *ep)
+{
+	fastlock_acquire(&srx_ctx->lock);
+	if (!dlist_empty(&ep->srx_entry))
+		dlist_remove_init(&ep->srx_entry);
+	fastlock_release(&srx_ctx->lock);
+}
+
+/* Copy a fully received unexpected message into the receive it matched */
+static void tcpx_srx_unexp_complete(struct tcpx_rx_ctx *srx_ctx,
+				    struct tcpx_xfer_entry *unexp_entry,
+				    struct tcpx_xfer_entry *recv_entry, int err)
+{
+	struct tcpx_base_hdr *hdr = &unexp_entry->hdr.base_hdr;
+	uint64_t len = hdr->size - hdr->payload_off;
+
+	if (!err && ofi_copy_to_iov(recv_entry->iov, recv_entry->iov_cnt, 0,
+				    unexp_entry->unexp_buf, len) != len)
+		err = FI_ETRUNC;
+
+	memcpy(&recv_entry->hdr, hdr, hdr->payload_off);
+	recv_entry->ep = unexp_entry->ep;
+	recv_entry->tag = unexp_entry->tag;
+	recv_entry->flags |= unexp_entry->flags & FI_COMPLETION;
+	tcpx_cq_report_completion(recv_entry->ep->util_ep.rx_cq,
+				  recv_entry, err);
+
+	tcpx_srx_unexp_free(srx_ctx, unexp_entry);
+	tcpx_srx_xfer_release(srx_ctx, unexp_entry);
+	tcpx_srx_xfer_release(srx_ctx, recv_entry);
+}
+
+/*
+ * Hand the unexpected messages already queued to a new multi-receive
+ * buffer, up to the first one that does not fit in the space left; the
+ * buffer is only queued itself if space remains afterwards.  Called
+ * with srx_ctx->lock held, which is dropped before completing messages.
+ */
+static void tcpx_srx_post_mrecv(struct tcpx_rx_ctx *srx_ctx,
+				struct tcpx_xfer_entry *mrecv)
+{
+	struct tcpx_xfer_entry *unexp_entry, *recv_entry;
+	struct slist_entry *item;
+	struct slist done_queue;
+	bool retired = false;
+
+	slist_init(&done_queue);
+	while (!retired) {
+		item = slist_remove_first_match(&srx_ctx->unexp_queue,
+						tcpx_srx_match_unexp, mrecv);
+		if (!item)
+			break;
+
+		unexp_entry = container_of(item, struct tcpx_xfer_entry, entry);
+		if (tcpx_srx_unexp_len(unexp_entry) > mrecv->iov[0].iov_len) {
+			slist_insert_head(item, &srx_ctx->unexp_queue);
+			retired = true;
+			if (tcpx_mrecv_retire(unexp_entry->ep, mrecv))
+				util_buf_release(srx_ctx->buf_pool, mrecv);
+			break;
+		}
+
+		recv_entry = util_buf_alloc(srx_ctx->buf_pool);
+		if (!recv_entry) {
+			slist_insert_head(item, &srx_ctx->unexp_queue);
+			break;
+		}
+
+		retired = tcpx_mrecv_claim(mrecv, recv_entry,
+					   tcpx_srx_unexp_len(unexp_entry),
+					   srx_ctx->min_multi_recv);
+		unexp_entry->unexp_match = recv_entry;
+		if (unexp_entry->unexp_done)
+			slist_insert_tail(item, &done_queue);
+	}
+
+	if (!retired) {
+		slist_insert_tail(&mrecv->entry, &srx_ctx->rx_queue);
+		tcpx_srx_wake(srx_ctx);
 	}
 	fastlock_release(&srx_ctx->lock);
-	return xfer_entry;
+
+	while (!slist_empty(&done_queue)) {
+		unexp_entry = container_of(slist_remove_head(&done_queue),
+					   struct tcpx_xfer_entry, entry);
+		tcpx_srx_unexp_complete(srx_ctx, unexp_entry,
+					unexp_entry->unexp_match, 0);
+	}
 }
 
-static ssize_t tcpx_srx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
-				uint64_t flags)
+ssize_t tcpx_srx_post(struct tcpx_rx_ctx *srx_ctx, const struct iovec *iov,
+		      size_t count, uint64_t tag, uint64_t ignore,
+		      uint64_t flags, void *context)
 {
-	struct tcpx_xfer_entry *recv_entry;
-	struct tcpx_rx_ctx *srx_ctx;
-	ssize_t ret = FI_SUCCESS;
+	struct tcpx_xfer_entry *recv_entry, *unexp_entry = NULL;
+	struct slist_entry *item;
 
-	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
-	assert(msg->iov_count <= TCPX_IOV_LIMIT);
+	assert(count <= TCPX_IOV_LIMIT);
+	if (flags & FI_MULTI_RECV) {
+		if (flags & FI_TAGGED)
+			return -FI_EOPNOTSUPP;
+		if (count != 1)
+			return -FI_EINVAL;
+	}
 
 	fastlock_acquire(&srx_ctx->lock);
 	recv_entry = util_buf_alloc(srx_ctx->buf_pool);
 	if (!recv_entry) {
-		ret = -FI_EAGAIN;
-		goto unlock;
+		fastlock_release(&srx_ctx->lock);
+		return -FI_EAGAIN;
 	}
 
-	tcpx_srx_recv_init(recv_entry, flags, msg->context);
-	tcpx_srx_recv_init_iov(recv_entry, msg->iov_count, msg->msg_iov);
+	recv_entry->flags = flags | FI_RECV;
+	recv_entry->context = context;
+	recv_entry->iov_cnt = count;
+	memcpy(&recv_entry->iov[0], iov, count * sizeof(*iov));
+	recv_entry->tag = tag;
+	recv_entry->ignore = ignore;
+	recv_entry->unexp = false;
+	recv_entry->mrecv = NULL;
 
-	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
-unlock:
+	if (flags & FI_MULTI_RECV) {
+		recv_entry->mrecv_refs = 0;
+		recv_entry->mrecv_retired = false;
+		tcpx_srx_post_mrecv(srx_ctx, recv_entry);
+		return FI_SUCCESS;
+	}
+
+	item = slist_remove_first_match(&srx_ctx->unexp_queue,
+					tcpx_srx_match_unexp, recv_entry);
+	if (item) {
+		unexp_entry = container_of(item, struct tcpx_xfer_entry, entry);
+		if (!unexp_entry->unexp_done) {
+			/* still arriving, handed over once it is complete */
+			unexp_entry->unexp_match = recv_entry;
+			unexp_entry = NULL;
+		}
+	} else {
+		slist_insert_tail(&recv_entry->entry, (flags & FI_TAGGED) ?
+				  &srx_ctx->tag_queue : &srx_ctx->rx_queue);
+		tcpx_srx_wake(srx_ctx);
+	}
 	fastlock_release(&srx_ctx->lock);
-	return ret;
+
+	if (unexp_entry)
+		tcpx_srx_unexp_complete(srx_ctx, unexp_entry, recv_entry, 0);
+	return FI_SUCCESS;
 }
 
-static ssize_t tcpx_srx_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
-			     fi_addr_t src_addr, void *context)
+/*
+ * Find the posted receive for the header in ep->rx_detect, or buffer the
+ * message if there is none so that the connection keeps flowing.  Once
+ * tcpx_env.unexp_size bytes are buffered, the connection stops reading
+ * instead until a receive is posted or buffered data is claimed.
+ */
+struct tcpx_xfer_entry *tcpx_srx_match(struct tcpx_rx_ctx *srx_ctx,
+				       struct tcpx_ep *ep)
 {
-	struct tcpx_xfer_entry *recv_entry;
-	struct tcpx_rx_ctx *srx_ctx;
-	ssize_t ret = FI_SUCCESS;
-
-	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	struct tcpx_base_hdr *hdr = &ep->rx_detect.hdr.base_hdr;
+	struct tcpx_xfer_entry *rx_entry, *mrecv;
+	struct slist_entry *item;
+	size_t len = hdr->size - ep->rx_detect.done_len;
+	uint64_t tag = 0;
 
 	fastlock_acquire(&srx_ctx->lock);
-	recv_entry = util_buf_alloc(srx_ctx->buf_pool);
-	if (!recv_entry) {
-		ret = -FI_EAGAIN;
-		goto unlock;
+	if (hdr->op == ofi_op_tagged) {
+		tag = *tcpx_hdr_tag(hdr);
+		item = slist_remove_first_match(&srx_ctx->tag_queue,
+						tcpx_srx_match_tag, &tag);
+	} else {
+		item = NULL;
+		while (!slist_empty(&srx_ctx->rx_queue)) {
+			mrecv = container_of(srx_ctx->rx_queue.head,
+					     struct tcpx_xfer_entry, entry);
+			if (!(mrecv->flags & FI_MULTI_RECV)) {
+				item = slist_remove_head(&srx_ctx->rx_queue);
+				break;
+			}
+
+			if (len > mrecv->iov[0].iov_len) {
+				slist_remove_head(&srx_ctx->rx_queue);
+				if (tcpx_mrecv_retire(ep, mrecv))
+					util_buf_release(srx_ctx->buf_pool,
+							 mrecv);
+				continue;
+			}
+
+			rx_entry = util_buf_alloc(srx_ctx->buf_pool);
+			if (!rx_entry)
+				goto unlock;
+
+			if (tcpx_mrecv_claim(mrecv, rx_entry, len,
+					     srx_ctx->min_multi_recv))
+				slist_remove_head(&srx_ctx->rx_queue);
+			goto found;
+		}
 	}
 
-	tcpx_srx_recv_init(recv_entry, 0, context);
-	recv_entry->iov_cnt = 1;
-	recv_entry->iov[0].iov_base = buf;
-	recv_entry->iov[0].iov_len = len;
+	if (item) {
+		rx_entry = container_of(item, struct tcpx_xfer_entry, entry);
+	} else {
+		/* a message larger than the limit still gets through alone */
+		if (srx_ctx->unexp_size &&
+		    srx_ctx->unexp_size + len > tcpx_env.unexp_size) {
+			rx_entry = NULL;
+			goto unlock;
+		}
+
+		rx_entry = util_buf_alloc(srx_ctx->buf_pool);
+		if (!rx_entry)
+			goto unlock;
+
+		rx_entry->unexp_buf = malloc(hdr->size - ep->rx_detect.done_len);
+		if (!rx_entry->unexp_buf && hdr->size != ep->rx_detect.done_len) {
+			util_buf_release(srx_ctx->buf_pool, rx_entry);
+			rx_entry = NULL;
+			goto unlock;
+		}
+		rx_entry->flags = FI_RECV | (hdr->op == ofi_op_tagged ?
+					     FI_TAGGED : FI_MSG);
+		rx_entry->context = NULL;
+		rx_entry->iov_cnt = 1;
+		rx_entry->iov[0].iov_base = rx_entry->unexp_buf;
+		rx_entry->iov[0].iov_len = hdr->size - ep->rx_detect.done_len;
+		rx_entry->unexp = true;
+		rx_entry->unexp_done = false;
+		rx_entry->unexp_match = NULL;
+		rx_entry->mrecv = NULL;
+		slist_insert_tail(&rx_entry->entry, &srx_ctx->unexp_queue);
+		srx_ctx->unexp_size += len;
+	}
 
-	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
+found:
+	memcpy(&rx_entry->hdr, hdr, (size_t) hdr->payload_off);
+	rx_entry->hdr.base_hdr.op_data = TCPX_OP_MSG_RECV;
+	rx_entry->ep = ep;
+	rx_entry->tag = tag;
+	rx_entry->rem_len = hdr->size - ep->rx_detect.done_len;
 unlock:
+	if (!rx_entry && dlist_empty(&ep->srx_entry))
+		dlist_insert_tail(&ep->srx_entry, &srx_ctx->blocked_list);
 	fastlock_release(&srx_ctx->lock);
-	return ret;
+	return rx_entry;
 }
 
-static ssize_t tcpx_srx_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
-			      size_t count, fi_addr_t src_addr, void *context)
+/* Called once the data of an unexpected message is in, or failed to come */
+void tcpx_srx_unexp_done(struct tcpx_rx_ctx *srx_ctx,
+			 struct tcpx_xfer_entry *unexp_entry, int err)
 {
 	struct tcpx_xfer_entry *recv_entry;
+
+	fastlock_acquire(&srx_ctx->lock);
+	recv_entry = unexp_entry->unexp_match;
+	unexp_entry->unexp_done = true;
+	if (err && !recv_entry)
+		slist_remove_first_match(&srx_ctx->unexp_queue,
+					 tcpx_srx_match_entry, unexp_entry);
+	fastlock_release(&srx_ctx->lock);
+
+	if (recv_entry) {
+		tcpx_srx_unexp_complete(srx_ctx, unexp_entry, recv_entry, err);
+	} else if (err) {
+		tcpx_srx_unexp_free(srx_ctx, unexp_entry);
+		tcpx_srx_xfer_release(srx_ctx, unexp_entry);
+	}
+}
+
+static ssize_t tcpx_srx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
+				uint64_t flags)
+{
 	struct tcpx_rx_ctx *srx_ctx;
-	ssize_t ret = FI_SUCCESS;
 
 	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
-	assert(count <= TCPX_IOV_LIMIT);
+	return tcpx_srx_post(srx_ctx, msg->msg_iov, msg->iov_count, 0, 0,
+			     flags | FI_MSG, msg->context);
+}
 
-	fastlock_acquire(&srx_ctx->lock);
-	recv_entry = util_buf_alloc(srx_ctx->buf_pool);
-	if (!recv_entry) {
-		ret = -FI_EAGAIN;
-		goto unlock;
-	}
+static ssize_t tcpx_srx_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+			     fi_addr_t src_addr, void *context)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+	struct iovec iov;
+
+	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return tcpx_srx_post(srx_ctx, &iov, 1, 0, 0, FI_MSG, context);
+}
 
-	tcpx_srx_recv_init(recv_entry, 0, context);
-	tcpx_srx_recv_init_iov(recv_entry, count, iov);
+static ssize_t tcpx_srx_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+			      size_t count, fi_addr_t src_addr, void *context)
+{
+	struct tcpx_rx_ctx *srx_ctx;
 
-	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
-unlock:
-	fastlock_release(&srx_ctx->lock);
-	return ret;
+	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	return tcpx_srx_post(srx_ctx, iov, count, 0, 0, FI_MSG, context);
 }
 
 struct fi_ops_msg tcpx_srx_msg_ops = {
@@ -170,3 +422,110 @@ struct fi_ops_msg tcpx_srx_msg_ops = {
 	.senddata = fi_no_msg_senddata,
 	.injectdata = fi_no_msg_injectdata,
 };
+
+static ssize_t tcpx_srx_trecvmsg(struct fid_ep *ep,
+				 const struct fi_msg_tagged *msg,
+				 uint64_t flags)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	if (flags & (FI_PEEK | FI_CLAIM))
+		return -FI_EOPNOTSUPP;
+
+	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	return tcpx_srx_post(srx_ctx, msg->msg_iov, msg->iov_count, msg->tag,
+			     msg->ignore, flags | FI_TAGGED, msg->context);
+}
+
+static ssize_t tcpx_srx_trecv(struct fid_ep *ep, void *buf, size_t len,
+			      void *desc, fi_addr_t src_addr, uint64_t tag,
+			      uint64_t ignore, void *context)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+	struct iovec iov;
+
+	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return tcpx_srx_post(srx_ctx, &iov, 1, tag, ignore, FI_TAGGED, context);
+}
+
+static ssize_t tcpx_srx_trecvv(struct fid_ep *ep, const struct iovec *iov,
+			       void **desc, size_t count, fi_addr_t src_addr,
+			       uint64_t tag, uint64_t ignore, void *context)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	srx_ctx = container_of(ep, struct tcpx_rx_ctx, rx_fid);
+	return tcpx_srx_post(srx_ctx, iov, count, tag, ignore, FI_TAGGED,
+			     context);
+}
+
+struct fi_ops_tagged tcpx_srx_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = tcpx_srx_trecv,
+	.recvv = tcpx_srx_trecvv,
+	.recvmsg = tcpx_srx_trecvmsg,
+	.send = fi_no_tagged_send,
+	.sendv = fi_no_tagged_sendv,
+	.sendmsg = fi_no_tagged_sendmsg,
+	.inject = fi_no_tagged_inject,
+	.senddata = fi_no_tagged_senddata,
+	.injectdata = fi_no_tagged_injectdata,
+};
+
+static int tcpx_srx_getopt(fid_t fid, int level, int optname,
+			   void *optval, size_t *optlen)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	if (level != FI_OPT_ENDPOINT)
+		return -FI_ENOPROTOOPT;
+
+	srx_ctx = container_of(fid, struct tcpx_rx_ctx, rx_fid.fid);
+	switch (optname) {
+	case FI_OPT_MIN_MULTI_RECV:
+		if (*optlen < sizeof(size_t)) {
+			*optlen = sizeof(size_t);
+			return -FI_ETOOSMALL;
+		}
+		*((size_t *) optval) = srx_ctx->min_multi_recv;
+		*optlen = sizeof(size_t);
+		break;
+	default:
+		return -FI_ENOPROTOOPT;
+	}
+	return FI_SUCCESS;
+}
+
+static int tcpx_srx_setopt(fid_t fid, int level, int optname,
+			   const void *optval, size_t optlen)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	if (level != FI_OPT_ENDPOINT)
+		return -FI_ENOPROTOOPT;
+
+	srx_ctx = container_of(fid, struct tcpx_rx_ctx, rx_fid.fid);
+	switch (optname) {
+	case FI_OPT_MIN_MULTI_RECV:
+		if (optlen != sizeof(size_t))
+			return -FI_EINVAL;
+		srx_ctx->min_multi_recv = *((const size_t *) optval);
+		break;
+	default:
+		return -FI_ENOPROTOOPT;
+	}
+	return FI_SUCCESS;
+}
+
+struct fi_ops_ep tcpx_srx_ep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = fi_no_cancel,
+	.getopt = tcpx_srx_getopt,
+	.setopt = tcpx_srx_setopt,
+	.tx_ctx = fi_no_tx_ctx,
+	.rx_ctx = fi_no_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
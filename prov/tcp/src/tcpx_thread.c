@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <rdma/fi_errno.h>
+#include <ofi_prov.h>
+#include <ofi_util.h>
+#include "tcpx.h"
+
+/*
+ * Auto progress: a domain's connected endpoints are spread over a few
+ * threads, each waiting on the sockets of the endpoints it owns.  As with
+ * CQ progress, only an endpoint whose work its socket can't signal, sends
+ * queued or staged data it can still parse, sits on its thread's active
+ * list and is progressed without waiting.  One waiting for a receive to
+ * be posted stops polling its socket, and is put back there by the post.
+ */
+struct tcpx_thread {
+	pthread_t		thread;
+	int			index;
+	/* CPU the thread is pinned to, or -1 */
+	volatile int		cpu;
+	volatile int		run;
+	fi_epoll_t		epoll_fd;
+	struct fd_signal	signal;
+	/* held while progressing, so endpoints can leave safely */
+	fastlock_t		lock;
+	/* bumped when an endpoint leaves, to drop stale epoll events */
+	ofi_atomic32_t		del_gen;
+	struct dlist_entry	active_list;
+	/* endpoints the thread owns, linked by thread_entry */
+	struct dlist_entry	ep_list;
+	/* protects active_list, ep_list and sleeping */
+	fastlock_t		active_lock;
+	bool			sleeping;
+};
+
+struct tcpx_threads {
+	int			cnt;
+	ofi_atomic32_t		next;
+	struct tcpx_thread	thread[];
+};
+
+/* pin thread i to the i-th CPU of FI_TCP_PROGRESS_AFFINITY */
+static void tcpx_thread_set_affinity(struct tcpx_thread *thread)
+{
+#ifdef __linux__
+	cpu_set_t cpus;
+	int cpu, i;
+#endif
+
+	if (!tcpx_env.progress_affinity)
+		return;
+
+	if (ofi_set_thread_affinity(tcpx_env.progress_affinity)) {
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+			"unable to set progress thread affinity\n");
+		return;
+	}
+
+#ifdef __linux__
+	if (pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) ||
+	    !CPU_COUNT(&cpus))
+		return;
+
+	i = thread->index % CPU_COUNT(&cpus);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus) && !i--)
+			break;
+	}
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if (!pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+		thread->cpu = cpu;
+#endif
+}
+
+static void tcpx_thread_epoll_del(struct tcpx_thread *thread,
+				  struct tcpx_ep *ep)
+{
+	uint32_t i;
+
+	for (i = 0; i <= ep->stripe_cnt; i++)
+		fi_epoll_del(thread->epoll_fd, tcpx_ep_rx_fd(ep, i));
+}
+
+static void tcpx_thread_progress_ep(struct tcpx_thread *thread,
+				    struct util_ep *util_ep)
+{
+	struct tcpx_ep *ep;
+	bool blocked;
+	uint32_t i;
+
+	ep = container_of(util_ep, struct tcpx_ep, util_ep);
+	tcpx_progress(util_ep);
+
+	/* a socket that was shut down stays readable */
+	if (ep->cm_state != TCPX_EP_CONNECTED) {
+		tcpx_thread_epoll_del(thread, ep);
+		return;
+	}
+
+	/* and so does one whose data waits for a receive; posting it puts
+	 * the endpoint back on the active list, which resumes polling */
+	fastlock_acquire(&ep->lock);
+	blocked = tcpx_ep_rx_blocked(ep);
+	if (blocked != ep->thread_muted) {
+		for (i = 0; i <= ep->stripe_cnt; i++)
+			fi_epoll_mod(thread->epoll_fd, tcpx_ep_rx_fd(ep, i),
+				     blocked ? 0 : FI_EPOLL_IN, util_ep);
+		ep->thread_muted = blocked;
+	}
+	fastlock_release(&ep->lock);
+}
+
+/*
+ * Called with thread->lock held, after sleeping for TCPX_POOL_TRIM_MS.
+ * The application may not be reading its CQs to trim their pools.
+ */
+static void tcpx_thread_trim(struct tcpx_thread *thread)
+{
+	struct tcpx_ep *ep;
+
+	fastlock_acquire(&thread->active_lock);
+	dlist_foreach_container(&thread->ep_list, struct tcpx_ep, ep,
+				thread_entry) {
+		tcpx_cq_trim(ep->util_ep.rx_cq);
+		if (ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+			tcpx_cq_trim(ep->util_ep.tx_cq);
+	}
+	fastlock_release(&thread->active_lock);
+}
+
+static void *tcpx_thread_run(void *arg)
+{
+	struct tcpx_thread *thread = arg;
+	void *contexts[MAX_EPOLL_EVENTS];
+	struct tcpx_active_entry *active;
+	struct dlist_entry active_list;
+	int32_t gen;
+	int nfds, i, timeout;
+
+	tcpx_thread_set_affinity(thread);
+	while (thread->run) {
+		fastlock_acquire(&thread->active_lock);
+		if (!dlist_empty(&thread->active_list))
+			timeout = 0;
+		else if (!dlist_empty(&thread->ep_list))
+			timeout = TCPX_POOL_TRIM_MS;
+		else
+			timeout = -1;
+		thread->sleeping = (timeout != 0);
+		fastlock_release(&thread->active_lock);
+
+		gen = ofi_atomic_get32(&thread->del_gen);
+		nfds = fi_epoll_wait(thread->epoll_fd, contexts,
+				     MAX_EPOLL_EVENTS, timeout);
+
+		fastlock_acquire(&thread->active_lock);
+		thread->sleeping = false;
+		fastlock_release(&thread->active_lock);
+
+		fastlock_acquire(&thread->lock);
+		if (!nfds && timeout > 0)
+			tcpx_thread_trim(thread);
+		if (gen != ofi_atomic_get32(&thread->del_gen))
+			nfds = 0;
+
+		for (i = 0; i < nfds; i++) {
+			if (contexts[i] == &thread->signal) {
+				fastlock_acquire(&thread->active_lock);
+				fd_signal_reset(&thread->signal);
+				fastlock_release(&thread->active_lock);
+				continue;
+			}
+			tcpx_thread_progress_ep(thread, contexts[i]);
+		}
+
+		/* Endpoints requeue themselves if they still need progress */
+		dlist_init(&active_list);
+		fastlock_acquire(&thread->active_lock);
+		dlist_splice_tail(&active_list, &thread->active_list);
+		while (!dlist_empty(&active_list)) {
+			dlist_pop_front(&active_list, struct tcpx_active_entry,
+					active, entry);
+			dlist_init(&active->entry);
+			fastlock_release(&thread->active_lock);
+
+			tcpx_thread_progress_ep(thread, &active->ep->util_ep);
+
+			fastlock_acquire(&thread->active_lock);
+		}
+		fastlock_release(&thread->active_lock);
+		fastlock_release(&thread->lock);
+	}
+	return NULL;
+}
+
+static void tcpx_thread_stop(struct tcpx_thread *thread)
+{
+	thread->run = 0;
+	fastlock_acquire(&thread->active_lock);
+	fd_signal_set(&thread->signal);
+	fastlock_release(&thread->active_lock);
+	pthread_join(thread->thread, NULL);
+}
+
+static void tcpx_thread_cleanup(struct tcpx_thread *thread)
+{
+	fi_epoll_close(thread->epoll_fd);
+	fd_signal_free(&thread->signal);
+	fastlock_destroy(&thread->active_lock);
+	fastlock_destroy(&thread->lock);
+}
+
+static int tcpx_thread_init(struct tcpx_thread *thread, int index)
+{
+	int ret;
+
+	thread->index = index;
+	thread->cpu = -1;
+	ret = fi_epoll_create(&thread->epoll_fd);
+	if (ret)
+		return ret;
+
+	ret = fd_signal_init(&thread->signal);
+	if (ret)
+		goto err1;
+
+	ret = fi_epoll_add(thread->epoll_fd, fd_signal_get(&thread->signal),
+			   FI_EPOLL_IN, &thread->signal);
+	if (ret)
+		goto err2;
+
+	fastlock_init(&thread->lock);
+	fastlock_init(&thread->active_lock);
+	ofi_atomic_initialize32(&thread->del_gen, 0);
+	dlist_init(&thread->active_list);
+	dlist_init(&thread->ep_list);
+
+	thread->run = 1;
+	if (pthread_create(&thread->thread, NULL, tcpx_thread_run, thread)) {
+		ret = -FI_ENOMEM;
+		goto err3;
+	}
+	return FI_SUCCESS;
+err3:
+	fastlock_destroy(&thread->active_lock);
+	fastlock_destroy(&thread->lock);
+err2:
+	fd_signal_free(&thread->signal);
+err1:
+	fi_epoll_close(thread->epoll_fd);
+	return ret;
+}
+
+int tcpx_threads_open(struct tcpx_threads **threads, int cnt)
+{
+	int i, ret;
+
+	*threads = calloc(1, sizeof(**threads) +
+			  cnt * sizeof((*threads)->thread[0]));
+	if (!*threads)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		ret = tcpx_thread_init(&(*threads)->thread[i], i);
+		if (ret)
+			goto err;
+	}
+	(*threads)->cnt = cnt;
+	ofi_atomic_initialize32(&(*threads)->next, 0);
+	return FI_SUCCESS;
+err:
+	while (i--) {
+		tcpx_thread_stop(&(*threads)->thread[i]);
+		tcpx_thread_cleanup(&(*threads)->thread[i]);
+	}
+	free(*threads);
+	*threads = NULL;
+	return ret;
+}
+
+void tcpx_threads_close(struct tcpx_threads *threads)
+{
+	int i;
+
+	for (i = 0; i < threads->cnt; i++) {
+		tcpx_thread_stop(&threads->thread[i]);
+		tcpx_thread_cleanup(&threads->thread[i]);
+	}
+	free(threads);
+}
+
+/* With FI_TCP_LATENCY, prefer the thread pinned to the CPU the kernel
+ * delivers the socket's packets on, so progress runs where the data is
+ * already cache hot.  Otherwise endpoints are handed out round robin.
+ */
+static struct tcpx_thread *
+tcpx_thread_select(struct tcpx_ep *ep, struct tcpx_threads *threads)
+{
+#ifdef SO_INCOMING_CPU
+	socklen_t len = sizeof(int);
+	int cpu, i;
+
+	if (tcpx_env.latency &&
+	    !getsockopt(ep->conn_fd, SOL_SOCKET, SO_INCOMING_CPU,
+			(char *) &cpu, &len) && cpu >= 0) {
+		for (i = 0; i < threads->cnt; i++) {
+			if (threads->thread[i].cpu == cpu)
+				return &threads->thread[i];
+		}
+	}
+#endif
+	return &threads->thread[(uint32_t) ofi_atomic_inc32(&threads->next) %
+				threads->cnt];
+}
+
+/* Called with the ep lock held. */
+int tcpx_thread_ep_add(struct tcpx_ep *ep, struct tcpx_threads *threads)
+{
+	struct tcpx_thread *thread;
+	uint32_t i;
+	int ret;
+
+	thread = tcpx_thread_select(ep, threads);
+	for (i = 0; i <= ep->stripe_cnt; i++) {
+		ret = fi_epoll_add(thread->epoll_fd, tcpx_ep_rx_fd(ep, i),
+				   FI_EPOLL_IN, &ep->util_ep);
+		if (ret) {
+			while (i--)
+				fi_epoll_del(thread->epoll_fd,
+					     tcpx_ep_rx_fd(ep, i));
+			return ret;
+		}
+	}
+
+	ep->thread = thread;
+	fastlock_acquire(&thread->active_lock);
+	dlist_insert_tail(&ep->thread_entry, &thread->ep_list);
+	fastlock_release(&thread->active_lock);
+	return FI_SUCCESS;
+}
+
+void tcpx_thread_ep_del(struct tcpx_ep *ep)
+{
+	struct tcpx_thread *thread = ep->thread;
+
+	fastlock_acquire(&thread->lock);
+	fastlock_acquire(&ep->lock);
+	tcpx_thread_epoll_del(thread, ep);
+
+	/* keep a late tcpx_progress call from requeuing the endpoint */
+	if (ep->cm_state == TCPX_EP_CONNECTED)
+		ep->cm_state = TCPX_EP_SHUTDOWN;
+	tcpx_thread_set_active(ep, 0);
+	fastlock_acquire(&thread->active_lock);
+	dlist_remove(&ep->thread_entry);
+	fastlock_release(&thread->active_lock);
+	ofi_atomic_inc32(&thread->del_gen);
+	fastlock_release(&ep->lock);
+	fastlock_release(&thread->lock);
+}
+
+/* Called with the ep lock held */
+void tcpx_thread_set_active(struct tcpx_ep *ep, int set)
+{
+	struct tcpx_thread *thread = ep->thread;
+
+	fastlock_acquire(&thread->active_lock);
+	if (set && dlist_empty(&ep->rx_active.entry)) {
+		dlist_insert_tail(&ep->rx_active.entry, &thread->active_list);
+		if (thread->sleeping) {
+			fd_signal_set(&thread->signal);
+			thread->sleeping = false;
+		}
+	} else if (!set && !dlist_empty(&ep->rx_active.entry)) {
+		dlist_remove_init(&ep->rx_active.entry);
+	}
+	fastlock_release(&thread->active_lock);
+}
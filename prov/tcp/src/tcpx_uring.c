@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *	   Redistribution and use in source and binary forms, with or
+ *	   without modification, are permitted provided that the following
+ *	   conditions are met:
+ *
+ *		- Redistributions of source code must retain the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer.
+ *
+ *		- Redistributions in binary form must reproduce the above
+ *		  copyright notice, this list of conditions and the following
+ *		  disclaimer in the documentation and/or other materials
+ *		  provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <rdma/fi_errno.h>
+#include <ofi_prov.h>
+#include <ofi_util.h>
+#include "tcpx.h"
+
+#if HAVE_TCP_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* low bits of a CQE's user_data say which endpoint op finished */
+#define TCPX_URING_RECV		1
+#define TCPX_URING_SEND		2
+#define TCPX_URING_OP_MASK	3
+#define TCPX_URING_REAP_CNT	64
+
+/*
+ * A domain-wide ring shared by its endpoints.  Each connected endpoint keeps
+ * at most one recv (into its stage buffer) and one gathered sendmsg in
+ * flight.  Posting only fills SQEs; they reach the kernel in a single
+ * io_uring_enter call per CQ progress, and completions are read straight
+ * from the mapped CQ ring without a syscall.
+ */
+struct tcpx_uring {
+	int			fd;
+	fastlock_t		lock;
+	void			*ring;
+	size_t			ring_size;
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_size;
+	unsigned		*sq_head;
+	unsigned		*sq_tail;
+	unsigned		*sq_flags;
+	unsigned		*sq_array;
+	unsigned		sq_mask;
+	unsigned		sq_entries;
+	unsigned		sq_pending;
+	unsigned		*cq_head;
+	unsigned		*cq_tail;
+	unsigned		cq_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+static int tcpx_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int tcpx_uring_enter(int fd, unsigned to_submit, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, 0,
+			     flags, NULL, 0);
+}
+
+int tcpx_uring_open(struct tcpx_uring **uring, size_t size)
+{
+	struct io_uring_params params;
+	struct tcpx_uring *ring;
+	char *ptr;
+	int ret;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -FI_ENOMEM;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = (unsigned) size * 2;
+	ring->fd = tcpx_uring_setup((unsigned) size, &params);
+	if (ring->fd < 0) {
+		ret = -errno;
+		goto free;
+	}
+
+	/* fast poll lets socket ops wait in the kernel instead of failing
+	 * with EAGAIN; the other features came with earlier kernels */
+	if (!(params.features & IORING_FEAT_FAST_POLL) ||
+	    !(params.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(params.features & IORING_FEAT_NODROP)) {
+		ret = -FI_ENOSYS;
+		goto close;
+	}
+
+	ring->ring_size = MAX(params.sq_off.array +
+			      params.sq_entries * sizeof(unsigned),
+			      params.cq_off.cqes +
+			      params.cq_entries * sizeof(struct io_uring_cqe));
+	ring->ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd,
+			  IORING_OFF_SQ_RING);
+	if (ring->ring == MAP_FAILED) {
+		ret = -errno;
+		goto close;
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ret = -errno;
+		goto unmap;
+	}
+
+	ptr = ring->ring;
+	ring->sq_head = (unsigned *) (ptr + params.sq_off.head);
+	ring->sq_tail = (unsigned *) (ptr + params.sq_off.tail);
+	ring->sq_flags = (unsigned *) (ptr + params.sq_off.flags);
+	ring->sq_array = (unsigned *) (ptr + params.sq_off.array);
+	ring->sq_mask = *(unsigned *) (ptr + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head = (unsigned *) (ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned *) (ptr + params.cq_off.tail);
+	ring->cq_mask = *(unsigned *) (ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (ptr + params.cq_off.cqes);
+
+	fastlock_init(&ring->lock);
+	*uring = ring;
+	return 0;
+
+unmap:
+	munmap(ring->ring, ring->ring_size);
+close:
+	close(ring->fd);
+free:
+	free(ring);
+	return ret;
+}
+
+void tcpx_uring_close(struct tcpx_uring *ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	munmap(ring->ring, ring->ring_size);
+	close(ring->fd);
+	fastlock_destroy(&ring->lock);
+	free(ring);
+}
+
+/* Called with the ring lock held */
+static struct io_uring_sqe *tcpx_uring_get_sqe(struct tcpx_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head, tail;
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	tail = *ring->sq_tail;
+	if (tail - head >= ring->sq_entries)
+		return NULL;
+
+	sqe = &ring->sqes[tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/* Called with the ring lock held, after filling the SQE from get_sqe */
+static void tcpx_uring_push(struct tcpx_uring *ring)
+{
+	unsigned tail;
+
+	tail = *ring->sq_tail;
+	ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->sq_pending++;
+}
+
+static int tcpx_uring_cancel(struct tcpx_uring *ring, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = tcpx_uring_get_sqe(ring);
+	if (!sqe)
+		return -FI_EAGAIN;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	tcpx_uring_push(ring);
+	return 0;
+}
+
+/* Called with the ep lock held */
+int tcpx_uring_post_recv(struct tcpx_ep *ep)
+{
+	struct tcpx_uring *ring = ep->uring;
+	struct io_uring_sqe *sqe;
+
+	if (ep->uring_rx_posted || ep->cm_state == TCPX_EP_SHUTDOWN ||
+	    ep->stage_buf.len != ep->stage_buf.off)
+		return 0;
+
+	fastlock_acquire(&ring->lock);
+	sqe = tcpx_uring_get_sqe(ring);
+	if (!sqe) {
+		fastlock_release(&ring->lock);
+		return -FI_EAGAIN;
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = ep->conn_fd;
+	sqe->addr = (uintptr_t) ep->stage_buf.buf;
+	sqe->len = (unsigned) ep->stage_buf.size;
+	sqe->user_data = (uintptr_t) ep | TCPX_URING_RECV;
+	tcpx_uring_push(ring);
+	fastlock_release(&ring->lock);
+
+	ep->uring_rx_posted = true;
+	return 0;
+}
+
+/* Called with the ep lock held, iov_cnt entries of uring_iov filled in */
+int tcpx_uring_post_send(struct tcpx_ep *ep, size_t iov_cnt)
+{
+	struct tcpx_uring *ring = ep->uring;
+	struct io_uring_sqe *sqe;
+
+	fastlock_acquire(&ring->lock);
+	sqe = tcpx_uring_get_sqe(ring);
+	if (!sqe) {
+		fastlock_release(&ring->lock);
+		return -FI_EAGAIN;
+	}
+
+	ep->uring_msg.msg_iov = ep->uring_iov;
+	ep->uring_msg.msg_iovlen = iov_cnt;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = ep->conn_fd;
+	sqe->addr = (uintptr_t) &ep->uring_msg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = (uintptr_t) ep | TCPX_URING_SEND;
+	tcpx_uring_push(ring);
+	fastlock_release(&ring->lock);
+
+	ep->uring_tx_posted = true;
+	return 0;
+}
+
+static void tcpx_uring_complete(struct io_uring_cqe *cqe)
+{
+	struct tcpx_ep *ep;
+
+	/* cancel requests carry no endpoint */
+	if (!cqe->user_data)
+		return;
+
+	ep = (struct tcpx_ep *) (uintptr_t)
+	     (cqe->user_data & ~(uint64_t) TCPX_URING_OP_MASK);
+
+	fastlock_acquire(&ep->lock);
+	if ((cqe->user_data & TCPX_URING_OP_MASK) == TCPX_URING_RECV) {
+		ep->uring_rx_posted = false;
+		if (ep->cm_state != TCPX_EP_CONNECTED)
+			goto out;
+
+		if (cqe->res > 0)
+			tcpx_stage_buf_filled(&ep->stage_buf, cqe->res);
+		else if (!cqe->res ||
+			 !OFI_SOCK_TRY_SND_RCV_AGAIN(-cqe->res))
+			tcpx_ep_shutdown_report(ep, &ep->util_ep.ep_fid.fid);
+	} else {
+		ep->uring_tx_posted = false;
+		if (ep->cm_state != TCPX_EP_CONNECTED)
+			goto out;
+
+		if (cqe->res >= 0)
+			tcpx_tx_queue_sent(ep, cqe->res);
+		else if (!OFI_SOCK_TRY_SND_RCV_AGAIN(-cqe->res))
+			tcpx_tx_queue_error(ep, -cqe->res);
+	}
+	tcpx_cq_update_active(ep);
+out:
+	fastlock_release(&ep->lock);
+}
+
+/*
+ * Submit whatever the endpoints posted and dispatch finished ops.  CQEs
+ * are copied out under the ring lock and handled after dropping it, as
+ * endpoints take the ring lock while holding their own.
+ */
+void tcpx_uring_progress(struct tcpx_uring *ring)
+{
+	struct io_uring_cqe cqes[TCPX_URING_REAP_CNT];
+	unsigned head, tail, cnt, i;
+	int ret;
+
+	fastlock_acquire(&ring->lock);
+	if (ring->sq_pending) {
+		ret = tcpx_uring_enter(ring->fd, ring->sq_pending, 0);
+		if (ret > 0)
+			ring->sq_pending -= ret;
+	}
+#ifdef IORING_SQ_CQ_OVERFLOW
+	if (__atomic_load_n(ring->sq_flags, __ATOMIC_ACQUIRE) &
+	    IORING_SQ_CQ_OVERFLOW)
+		tcpx_uring_enter(ring->fd, 0, IORING_ENTER_GETEVENTS);
+#endif
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	for (cnt = 0; head != tail && cnt < TCPX_URING_REAP_CNT; cnt++)
+		cqes[cnt] = ring->cqes[head++ & ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	fastlock_release(&ring->lock);
+
+	for (i = 0; i < cnt; i++)
+		tcpx_uring_complete(&cqes[i]);
+}
+
+int tcpx_uring_fd(struct tcpx_uring *ring)
+{
+	return ring->fd;
+}
+
+/*
+ * The ring, not the sockets, is what a CQ wait set polls for endpoints
+ * using it: its fd is readable while CQEs are waiting.  SQEs that were
+ * never handed to the kernel will not complete on their own.
+ */
+int tcpx_uring_wait_try(struct tcpx_uring *ring)
+{
+	int ret = FI_SUCCESS;
+
+	fastlock_acquire(&ring->lock);
+	if (ring->sq_pending ||
+	    *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		ret = -FI_EAGAIN;
+	fastlock_release(&ring->lock);
+	return ret;
+}
+
+/* Called with the ep lock held, before the endpoint is connected */
+int tcpx_uring_ep_add(struct tcpx_ep *ep, struct tcpx_uring *uring)
+{
+	ep->uring_iov = calloc(TCPX_TX_IOV_MAX, sizeof(*ep->uring_iov));
+	if (!ep->uring_iov)
+		return -FI_ENOMEM;
+
+	ep->uring = uring;
+	(void) tcpx_uring_post_recv(ep);
+	return 0;
+}
+
+/*
+ * The kernel may still be writing into the stage buffer or reading the
+ * gathered iovs, so cancel whatever is posted and wait for it to finish
+ * before the endpoint goes away.
+ */
+void tcpx_uring_ep_del(struct tcpx_ep *ep)
+{
+	struct tcpx_uring *ring = ep->uring;
+	bool canceled = false, posted;
+
+	for (;;) {
+		fastlock_acquire(&ep->lock);
+		posted = ep->uring_rx_posted || ep->uring_tx_posted;
+		if (posted && !canceled) {
+			fastlock_acquire(&ring->lock);
+			canceled = (!ep->uring_rx_posted ||
+				    !tcpx_uring_cancel(ring, (uintptr_t) ep |
+						       TCPX_URING_RECV)) &&
+				   (!ep->uring_tx_posted ||
+				    !tcpx_uring_cancel(ring, (uintptr_t) ep |
+						       TCPX_URING_SEND));
+			fastlock_release(&ring->lock);
+		}
+		fastlock_release(&ep->lock);
+		if (!posted)
+			break;
+
+		tcpx_uring_progress(ring);
+	}
+
+	free(ep->uring_iov);
+	ep->uring_iov = NULL;
+	ep->uring = NULL;
+}
+
+#else /* HAVE_TCP_IO_URING */
+
+int tcpx_uring_open(struct tcpx_uring **uring, size_t size)
+{
+	return -FI_ENOSYS;
+}
+
+void tcpx_uring_close(struct tcpx_uring *uring)
+{
+}
+
+int tcpx_uring_ep_add(struct tcpx_ep *ep, struct tcpx_uring *uring)
+{
+	return -FI_ENOSYS;
+}
+
+void tcpx_uring_ep_del(struct tcpx_ep *ep)
+{
+}
+
+int tcpx_uring_post_recv(struct tcpx_ep *ep)
+{
+	return -FI_ENOSYS;
+}
+
+int tcpx_uring_post_send(struct tcpx_ep *ep, size_t iov_cnt)
+{
+	return -FI_ENOSYS;
+}
+
+void tcpx_uring_progress(struct tcpx_uring *uring)
+{
+}
+
+int tcpx_uring_fd(struct tcpx_uring *uring)
+{
+	return INVALID_SOCKET;
+}
+
+int tcpx_uring_wait_try(struct tcpx_uring *uring)
+{
+	return FI_SUCCESS;
+}
+
+#endif /* HAVE_TCP_IO_URING */
@@ -34,6 +34,14 @@ AC_DEFUN([FI_UDP_CONFIGURE],[
 				[udp_shm_happy=0])])
 	      ])
 
+	# batch datagrams with sendmmsg/recvmmsg where available
+	udp_mmsg_happy=0
+	AS_IF([test $udp_h_happy -eq 1],
+	      [AC_CHECK_FUNC([sendmmsg],
+			     [AC_CHECK_FUNC([recvmmsg], [udp_mmsg_happy=1])])])
+	AC_DEFINE_UNQUOTED([HAVE_UDP_MMSG], [$udp_mmsg_happy],
+			   [Whether the udp provider can use sendmmsg/recvmmsg])
+
 	AS_IF([test $udp_h_happy -eq 1 && \
 	       test $udp_shm_happy -eq 1], [$1], [$2])
 ])
@@ -41,6 +41,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -68,6 +69,19 @@
 #define UDPX_MINOR_VERSION 1
 
 
+#if defined(__linux__) && defined(UDP_SEGMENT) && defined(UDP_GRO)
+#define UDPX_HAVE_GSO		1
+#else
+#define UDPX_HAVE_GSO		0
+#endif
+
+struct udpx_env {
+	int	gso;
+	int	gro;
+	int	tx_drop_rate;
+};
+
+extern struct udpx_env udpx_env;
 extern struct fi_provider udpx_prov;
 extern struct util_prov udpx_util_prov;
 extern struct fi_info udpx_info;
@@ -94,7 +108,44 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+/* Most datagrams passed to the kernel in one sendmmsg/recvmmsg call */
+#define UDPX_MMSG_MAX		64
+
+/* A send posted with FI_MORE, held until the burst is flushed */
+struct udpx_tx_entry {
+	void			*context;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	uint8_t			iov_count;
+	size_t			len;
+	socklen_t		addrlen;
+	union ofi_sock_ip	addr;
+};
+
+/* Kernel limits on one UDP_SEGMENT send */
+#define UDPX_GSO_MAX_SEGS	64
+#define UDPX_GSO_MAX_BYTES	65507
+#define UDPX_GRO_BUF_SIZE	65536
+
+/* A coalesced UDP_GRO receive, handed out one segment per posted buffer */
+struct udpx_gro {
+	char			*buf;
+	size_t			len;
+	size_t			off;
+	size_t			seg_size;
+	struct sockaddr_in6	addr;
+};
+
+OFI_DECLARE_CIRQUE(struct udpx_tx_entry, udpx_tx_cirq);
+
+#if !HAVE_UDP_MMSG
+struct mmsghdr {
+	struct msghdr		msg_hdr;
+	unsigned int		msg_len;
+};
+#endif
+
 struct udpx_ep;
+struct udpx_sep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
 typedef void (*udpx_tx_comp_func)(struct udpx_ep *ep, void *context);
@@ -104,15 +155,46 @@ struct udpx_ep {
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	struct udpx_tx_cirq	*txq;    /* protected by tx_cq lock */
+	int			gso;     /* protected by tx_cq lock */
+	unsigned int		tx_more; /* protected by tx_cq lock */
+	struct udpx_gro		gro;     /* protected by rx_cq lock */
 	SOCKET			sock;
 	int			is_bound;
 	ofi_atomic32_t		ref;
+	struct udpx_sep		*sep;    /* owns sock for tx/rx contexts */
 };
 
 int udpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep, void *context);
 
 
+#define UDPX_MAX_CTX		16
+
+/*
+ * A scalable endpoint owns one socket per rx context, all bound to the
+ * same address with SO_REUSEPORT.  The kernel hashes incoming flows
+ * across the sockets.  Tx contexts send through the rx context sockets
+ * so that peers see a single source address.
+ */
+struct udpx_sep {
+	struct fid_ep		sep_fid;
+	struct util_domain	*domain;
+	struct fi_info		*info;
+	struct util_av		*av;
+	size_t			tx_cnt;
+	size_t			rx_cnt;
+	SOCKET			sock[UDPX_MAX_CTX];
+	struct udpx_ep		*tx_ctx[UDPX_MAX_CTX];
+	struct udpx_ep		*rx_ctx[UDPX_MAX_CTX];
+	fastlock_t		lock;    /* protects av and context tables */
+	ofi_atomic32_t		ref;
+};
+
+int udpx_scalable_ep(struct fid_domain *domain, struct fi_info *info,
+		     struct fid_ep **sep, void *context);
+
+
 int udpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		 struct fid_cq **cq, void *context);
 
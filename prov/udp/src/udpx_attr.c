@@ -70,8 +70,8 @@ struct fi_domain_attr udpx_domain_attr = {
 	.ep_cnt = 256,
 	.tx_ctx_cnt = 256,
 	.rx_ctx_cnt = 256,
-	.max_ep_tx_ctx = 1,
-	.max_ep_rx_ctx = 1
+	.max_ep_tx_ctx = UDPX_MAX_CTX,
+	.max_ep_rx_ctx = UDPX_MAX_CTX
 };
 
 struct fi_fabric_attr udpx_fabric_attr = {
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <ofi_iov.h>
 #include "udpx.h"
 
 
@@ -270,32 +271,334 @@ static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
 	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
 }
 
+static int udpx_recvmmsg(SOCKET sock, struct mmsghdr *msgs, unsigned int cnt)
+{
+#if HAVE_UDP_MMSG
+	return recvmmsg(sock, msgs, cnt, 0, NULL);
+#else
+	ssize_t ret;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = ofi_recvmsg_udp(sock, &msgs[i].msg_hdr, 0);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgs[i].msg_len = (unsigned int) ret;
+	}
+	return (int) i;
+#endif
+}
+
+static int udpx_sendmmsg(SOCKET sock, struct mmsghdr *msgs, unsigned int cnt)
+{
+#if HAVE_UDP_MMSG
+	return sendmmsg(sock, msgs, cnt, 0);
+#else
+	ssize_t ret;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		ret = ofi_sendmsg_udp(sock, &msgs[i].msg_hdr, 0);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msgs[i].msg_len = (unsigned int) ret;
+	}
+	return (int) i;
+#endif
+}
+
+static inline struct udpx_tx_entry *
+udpx_tx_entry_at(struct udpx_ep *ep, size_t i)
+{
+	return &ep->txq->buf[(ep->txq->rcnt + i) & ep->txq->size_mask];
+}
+
+/*
+ * Number of held datagrams, starting at pos, that can go out as one
+ * UDP_SEGMENT send: same destination and size, except that a shorter
+ * datagram may end the run.
+ */
+static size_t udpx_gso_run(struct udpx_ep *ep, size_t pos, size_t avail)
+{
+	struct udpx_tx_entry *first, *next;
+	size_t n, total;
+
+	first = udpx_tx_entry_at(ep, pos);
+	if (!ep->gso || !first->len)
+		return 1;
+
+	for (n = 1, total = first->len;
+	     pos + n < avail && n < UDPX_GSO_MAX_SEGS; n++) {
+		next = udpx_tx_entry_at(ep, pos + n);
+		if (next->addrlen != first->addrlen ||
+		    memcmp(&next->addr, &first->addr, first->addrlen) ||
+		    !next->len || next->len > first->len ||
+		    total + next->len > UDPX_GSO_MAX_BYTES)
+			break;
+
+		total += next->len;
+		if (next->len < first->len) {
+			n++;
+			break;
+		}
+	}
+	return n;
+}
+
+#if UDPX_HAVE_GSO
+union udpx_gso_ctrl {
+	struct cmsghdr		align;
+	char			buf[CMSG_SPACE(sizeof(uint16_t))];
+};
+
+static void udpx_gso_set(struct msghdr *hdr, union udpx_gso_ctrl *ctrl,
+			 size_t seg_size)
+{
+	struct cmsghdr *cmsg;
+	uint16_t size = (uint16_t) seg_size;
+
+	hdr->msg_control = ctrl->buf;
+	hdr->msg_controllen = sizeof(ctrl->buf);
+	cmsg = CMSG_FIRSTHDR(hdr);
+	cmsg->cmsg_level = IPPROTO_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(size));
+	memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+}
+#else
+union udpx_gso_ctrl {
+	char			buf[1];
+};
+
+#define udpx_gso_set(hdr, ctrl, seg_size) do { } while (0)
+#endif
+
+/*
+ * Called with the tx CQ lock held.  Sends held datagrams in batches, as
+ * long as the CQ has room for their completions.  Runs of datagrams
+ * bound for the same address are merged into one UDP_SEGMENT send each,
+ * which the kernel splits again below the socket layer.  A datagram the
+ * socket rejects is dropped from the queue and returned in err_entry, to
+ * be reported once the lock is released.
+ */
+static int udpx_tx_flush(struct udpx_ep *ep, struct fi_cq_err_entry *err_entry)
+{
+	struct mmsghdr msgs[UDPX_MMSG_MAX];
+	struct iovec iovs[UDPX_MMSG_MAX * UDPX_IOV_LIMIT];
+	union udpx_gso_ctrl ctrl[UDPX_MMSG_MAX];
+	size_t nents[UDPX_MMSG_MAX];
+	struct udpx_tx_entry *entry;
+	size_t avail, pos, cnt, iov_cnt, i, j;
+	int ret;
+
+	while (!ofi_cirque_isempty(ep->txq)) {
+		avail = MIN(ofi_cirque_usedcnt(ep->txq),
+			    ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq));
+		if (!avail)
+			return 0;
+
+		for (pos = cnt = iov_cnt = 0; pos < avail &&
+		     cnt < UDPX_MMSG_MAX; pos += nents[cnt++]) {
+			entry = udpx_tx_entry_at(ep, pos);
+			nents[cnt] = udpx_gso_run(ep, pos, avail);
+
+			msgs[cnt].msg_hdr.msg_name = &entry->addr;
+			msgs[cnt].msg_hdr.msg_namelen = entry->addrlen;
+			msgs[cnt].msg_hdr.msg_iov = &iovs[iov_cnt];
+			msgs[cnt].msg_hdr.msg_control = NULL;
+			msgs[cnt].msg_hdr.msg_controllen = 0;
+			msgs[cnt].msg_hdr.msg_flags = 0;
+			for (i = 0; i < nents[cnt]; i++) {
+				entry = udpx_tx_entry_at(ep, pos + i);
+				for (j = 0; j < entry->iov_count; j++)
+					iovs[iov_cnt++] = entry->iov[j];
+			}
+			msgs[cnt].msg_hdr.msg_iovlen = &iovs[iov_cnt] -
+						       msgs[cnt].msg_hdr.msg_iov;
+			if (nents[cnt] > 1)
+				udpx_gso_set(&msgs[cnt].msg_hdr, &ctrl[cnt],
+					     udpx_tx_entry_at(ep, pos)->len);
+		}
+
+		ret = udpx_sendmmsg(ep->sock, msgs, (unsigned int) cnt);
+		if (ret < 0) {
+			ret = -ofi_sockerr();
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+				return -FI_EAGAIN;
+
+			/* the route cannot offload segmentation */
+			if (nents[0] > 1) {
+				FI_INFO(&udpx_prov, FI_LOG_EP_DATA,
+					"UDP_SEGMENT send failed (%s), "
+					"disabling GSO\n", strerror(-ret));
+				ep->gso = 0;
+				continue;
+			}
+
+			entry = ofi_cirque_remove(ep->txq);
+			memset(err_entry, 0, sizeof(*err_entry));
+			err_entry->op_context = entry->context;
+			err_entry->flags = FI_SEND;
+			err_entry->err = -ret;
+			err_entry->prov_errno = -ret;
+			return ret;
+		}
+
+		for (i = 0; i < (size_t) ret; i++) {
+			for (j = 0; j < nents[i]; j++) {
+				entry = ofi_cirque_remove(ep->txq);
+				ep->tx_comp(ep, entry->context);
+			}
+		}
+	}
+	return 0;
+}
+
+static void udpx_tx_report(struct udpx_ep *ep, int ret,
+			   struct fi_cq_err_entry *err_entry)
+{
+	if (ret && ret != -FI_EAGAIN &&
+	    ofi_cq_write_error(ep->util_ep.tx_cq, err_entry))
+		FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+			"unable to report send error\n");
+}
+
+static void udpx_ep_progress_tx(struct udpx_ep *ep)
+{
+	struct fi_cq_err_entry err_entry;
+	int ret;
+
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	ret = udpx_tx_flush(ep, &err_entry);
+	/* a full socket buffer drains on its own: keep a waiter polling */
+	if (ret == -FI_EAGAIN && ep->util_ep.tx_cq->wait)
+		ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	udpx_tx_report(ep, ret, &err_entry);
+}
+
+#if UDPX_HAVE_GSO
+/* Read the next, possibly coalesced, datagram into the GRO buffer. */
+static int udpx_gro_recv(struct udpx_ep *ep)
+{
+	union {
+		struct cmsghdr	align;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr hdr;
+	struct iovec iov;
+	ssize_t ret;
+	int seg_size;
+
+	iov.iov_base = ep->gro.buf;
+	iov.iov_len = UDPX_GRO_BUF_SIZE;
+	hdr.msg_name = &ep->gro.addr;
+	hdr.msg_namelen = sizeof(ep->gro.addr);
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = ctrl.buf;
+	hdr.msg_controllen = sizeof(ctrl.buf);
+	hdr.msg_flags = 0;
+
+	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
+	if (ret < 0)
+		return -ofi_sockerr();
+
+	ep->gro.len = ret;
+	ep->gro.off = 0;
+	ep->gro.seg_size = ret;
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level == IPPROTO_UDP &&
+		    cmsg->cmsg_type == UDP_GRO) {
+			memcpy(&seg_size, CMSG_DATA(cmsg), sizeof(seg_size));
+			if (seg_size > 0)
+				ep->gro.seg_size = seg_size;
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Called with the rx CQ lock held.  Each segment of a coalesced receive
+ * completes one posted buffer; segments left over once the posted
+ * buffers or the CQ run out wait in the GRO buffer for the next call.
+ */
+static void udpx_ep_progress_gro(struct udpx_ep *ep)
+{
+	struct udpx_ep_entry *entry;
+	size_t cnt, seg, len;
+
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	while (cnt--) {
+		if (ep->gro.off == ep->gro.len && udpx_gro_recv(ep))
+			break;
+
+		entry = ofi_cirque_head(ep->rxq);
+		seg = MIN(ep->gro.seg_size, ep->gro.len - ep->gro.off);
+		len = ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+				      ep->gro.buf + ep->gro.off, seg);
+		/* an empty datagram is consumed by completing it */
+		ep->gro.off = seg ? ep->gro.off + seg : ep->gro.len;
+		ep->rx_comp(ep, entry->context, 0, len, NULL, &ep->gro.addr);
+		ofi_cirque_discard(ep->rxq);
+	}
+}
+#else
+#define udpx_ep_progress_gro(ep) do { } while (0)
+#endif
+
+/*
+ * Receive into as many posted buffers as the socket has datagrams for,
+ * with a single recvmmsg.  Batches are bounded by the room left in the
+ * CQ, so unreported datagrams stay queued in the socket.
+ */
 static void udpx_ep_progress(struct util_ep *util_ep)
 {
 	struct udpx_ep *ep;
 	struct udpx_ep_entry *entry;
-	struct msghdr hdr;
-	struct sockaddr_in6 addr;
-	ssize_t ret;
+	struct mmsghdr msgs[UDPX_MMSG_MAX];
+	struct sockaddr_in6 addr[UDPX_MMSG_MAX];
+	size_t cnt, i;
+	int ret;
 
 	ep = container_of(util_ep, struct udpx_ep, util_ep);
-	hdr.msg_name = &addr;
-	hdr.msg_namelen = sizeof(addr);
-	hdr.msg_control = NULL;
-	hdr.msg_controllen = 0;
-	hdr.msg_flags = 0;
+	if (ep->util_ep.tx_cq && !ofi_cirque_isempty(ep->txq))
+		udpx_ep_progress_tx(ep);
+
+	if (!ep->util_ep.rx_cq)
+		return;
 
 	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
-	if (ofi_cirque_isempty(ep->rxq))
+	if (ep->gro.buf) {
+		udpx_ep_progress_gro(ep);
 		goto out;
+	}
 
-	entry = ofi_cirque_head(ep->rxq);
-	hdr.msg_iov = entry->iov;
-	hdr.msg_iovlen = entry->iov_count;
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	cnt = MIN(cnt, UDPX_MMSG_MAX);
+	if (!cnt)
+		goto out;
 
-	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
-	if (ret >= 0) {
-		ep->rx_comp(ep, entry->context, 0, ret, NULL, &addr);
+	for (i = 0; i < cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) & ep->rxq->size_mask];
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msgs[i].msg_hdr.msg_iov = entry->iov;
+		msgs[i].msg_hdr.msg_iovlen = entry->iov_count;
+		msgs[i].msg_hdr.msg_control = NULL;
+		msgs[i].msg_hdr.msg_controllen = 0;
+		msgs[i].msg_hdr.msg_flags = 0;
+	}
+
+	ret = udpx_recvmmsg(ep->sock, msgs, (unsigned int) cnt);
+	for (i = 0; ret > 0 && i < (size_t) ret; i++) {
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, msgs[i].msg_len, NULL,
+			    &addr[i]);
 		ofi_cirque_discard(ep->rxq);
 	}
 out:
@@ -387,13 +690,28 @@ udpx_dest_addrlen(struct udpx_ep *ep, fi_addr_t addr, uint64_t flags)
 		ep->util_ep.av->addrlen;
 }
 
+/*
+ * Testing aid: lose every Nth send posted with FI_MORE.  Called with the
+ * tx CQ lock held.
+ */
+static int udpx_tx_drop(struct udpx_ep *ep)
+{
+	return udpx_env.tx_drop_rate > 0 &&
+	       !(++ep->tx_more % (unsigned int) udpx_env.tx_drop_rate);
+}
+
 static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 			   const void *addr, size_t addrlen, void *context)
 {
+	struct fi_cq_err_entry err_entry;
+	int flush_ret;
 	ssize_t ret;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	/* held FI_MORE sends go out first */
+	flush_ret = udpx_tx_flush(ep, &err_entry);
+	if (!ofi_cirque_isempty(ep->txq) ||
+	    ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
 		ret = -FI_EAGAIN;
 		goto out;
 	}
@@ -408,6 +726,7 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 	}
 out:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	udpx_tx_report(ep, flush_ret, &err_entry);
 	return ret;
 }
 
@@ -432,14 +751,68 @@ static ssize_t udpx_send_mc(struct fid_ep *ep_fid, const void *buf, size_t len,
 			   context);
 }
 
+/* Called with the tx CQ lock held. */
+static void udpx_tx_queue(struct udpx_ep *ep, const struct fi_msg *msg,
+			  uint64_t flags)
+{
+	struct udpx_tx_entry *entry;
+
+	entry = ofi_cirque_tail(ep->txq);
+	entry->context = msg->context;
+	for (entry->iov_count = 0; entry->iov_count < msg->iov_count;
+	     entry->iov_count++) {
+		entry->iov[entry->iov_count] = msg->msg_iov[entry->iov_count];
+	}
+	entry->len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	entry->addrlen = (socklen_t) udpx_dest_addrlen(ep, msg->addr, flags);
+	memcpy(&entry->addr, udpx_dest_addr(ep, msg->addr, flags),
+	       entry->addrlen);
+	ofi_cirque_commit(ep->txq);
+}
+
+/*
+ * Sends posted with FI_MORE are held and go out together with the next
+ * send without it, in as few sendmmsg calls as possible.
+ */
 static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 			    uint64_t flags)
 {
 	struct udpx_ep *ep;
 	struct msghdr hdr;
+	struct fi_cq_err_entry err_entry;
+	int flush_ret = 0;
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	if (msg->iov_count > UDPX_IOV_LIMIT)
+		return -FI_EINVAL;
+
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq) <=
+	    ofi_cirque_usedcnt(ep->txq)) {
+		ret = -FI_EAGAIN;
+		goto out;
+	}
+
+	if (!ofi_cirque_isempty(ep->txq) || (flags & FI_MORE)) {
+		if (ofi_cirque_isfull(ep->txq)) {
+			flush_ret = udpx_tx_flush(ep, &err_entry);
+			if (ofi_cirque_isfull(ep->txq)) {
+				ret = -FI_EAGAIN;
+				goto out;
+			}
+		}
+
+		if ((flags & FI_MORE) && udpx_tx_drop(ep))
+			ep->tx_comp(ep, msg->context);
+		else
+			udpx_tx_queue(ep, msg, flags);
+		if (!(flags & FI_MORE) && !flush_ret)
+			flush_ret = udpx_tx_flush(ep, &err_entry);
+		ret = 0;
+		goto out;
+	}
+
 	hdr.msg_name = (void *)udpx_dest_addr(ep, msg->addr, flags);
 	hdr.msg_namelen = (int)udpx_dest_addrlen(ep, msg->addr, flags);
 	hdr.msg_iov = (struct iovec *)msg->msg_iov;
@@ -448,12 +821,6 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	hdr.msg_controllen = 0;
 	hdr.msg_flags = 0;
 
-	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
-		ret = -FI_EAGAIN;
-		goto out;
-	}
-
 	ret = ofi_sendmsg_udp(ep->sock, &hdr, 0);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
@@ -463,6 +830,7 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	}
 out:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	udpx_tx_report(ep, flush_ret, &err_entry);
 	return ret;
 }
 
@@ -501,6 +869,12 @@ static ssize_t udpx_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	if (!ofi_cirque_isempty(ep->txq)) {
+		udpx_ep_progress_tx(ep);
+		if (!ofi_cirque_isempty(ep->txq))
+			return -FI_EAGAIN;
+	}
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
 				(socklen_t)ep->util_ep.av->addrlen);
@@ -514,6 +888,12 @@ static ssize_t udpx_inject_mc(struct fid_ep *ep_fid, const void *buf,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	if (!ofi_cirque_isempty(ep->txq)) {
+		udpx_ep_progress_tx(ep);
+		if (!ofi_cirque_isempty(ep->txq))
+			return -FI_EAGAIN;
+	}
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				(const void *)(uintptr_t)dest_addr,
 				(socklen_t)ofi_sizeofaddr((const void *)(uintptr_t)dest_addr));
@@ -546,6 +926,29 @@ static struct fi_ops_msg udpx_msg_mcast_ops = {
 	.injectdata = fi_no_msg_injectdata,
 };
 
+static void udpx_sep_remove_ctx(struct udpx_ep *ep)
+{
+	struct udpx_sep *sep = ep->sep;
+	struct udpx_ep **ctx;
+	size_t i, cnt;
+
+	if (ep->util_ep.ep_fid.fid.fclass == FI_CLASS_TX_CTX) {
+		ctx = sep->tx_ctx;
+		cnt = sep->tx_cnt;
+	} else {
+		ctx = sep->rx_ctx;
+		cnt = sep->rx_cnt;
+	}
+
+	fastlock_acquire(&sep->lock);
+	for (i = 0; i < cnt; i++) {
+		if (ctx[i] == ep)
+			ctx[i] = NULL;
+	}
+	fastlock_release(&sep->lock);
+	ofi_atomic_dec32(&sep->ref);
+}
+
 static int udpx_ep_close(struct fid *fid)
 {
 	struct udpx_ep *ep;
@@ -557,6 +960,14 @@ static int udpx_ep_close(struct fid *fid)
 		return -FI_EBUSY;
 	}
 
+	if (ep->util_ep.tx_cq) {
+		if (!ofi_cirque_isempty(ep->txq))
+			udpx_ep_progress_tx(ep);
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
+	}
+
 	if (ep->util_ep.rx_cq) {
 		if (ep->util_ep.rx_cq->wait) {
 			wait = container_of(ep->util_ep.rx_cq->wait,
@@ -568,8 +979,13 @@ static int udpx_ep_close(struct fid *fid)
 				&ep->util_ep.ep_fid.fid);
 	}
 
+	free(ep->gro.buf);
+	udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
-	ofi_close_socket(ep->sock);
+	if (ep->sep)
+		udpx_sep_remove_ctx(ep);
+	else
+		ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
 	return 0;
@@ -590,6 +1006,13 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 		ofi_atomic_inc32(&cq->ref);
 		ep->tx_comp = cq->wait ? udpx_tx_comp_signal :
 					 udpx_tx_comp;
+
+		/* reading the tx CQ flushes held sends */
+		ret = fid_list_insert(&cq->ep_list,
+				      &cq->ep_list_lock,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
 	}
 
 	if (flags & FI_RECV) {
@@ -658,7 +1081,7 @@ static int udpx_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 	return ret;
 }
 
-static void udpx_bind_src_addr(struct udpx_ep *ep)
+static int udpx_src_addr(struct sockaddr_in *sin)
 {
 	int ret;
 	struct addrinfo ai, *rai = NULL, *cur_ai;
@@ -672,7 +1095,7 @@ static void udpx_bind_src_addr(struct udpx_ep *ep)
 	if (ret) {
 		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
 			"getaddrinfo failed\n");
-		return;
+		return -FI_EADDRNOTAVAIL;
 	}
 
 	for (cur_ai = rai; cur_ai && cur_ai->ai_family != AF_INET;
@@ -680,15 +1103,27 @@ static void udpx_bind_src_addr(struct udpx_ep *ep)
 		;
 
 	if (cur_ai) {
-		ret = udpx_setname(&ep->util_ep.ep_fid.fid, cur_ai->ai_addr,
-				   cur_ai->ai_addrlen);
+		memcpy(sin, cur_ai->ai_addr, sizeof(*sin));
+		ret = 0;
 	} else {
 		ret = -FI_EADDRNOTAVAIL;
 	}
+	freeaddrinfo(rai);
+	return ret;
+}
+
+static void udpx_bind_src_addr(struct udpx_ep *ep)
+{
+	struct sockaddr_in sin;
+	int ret;
+
+	ret = udpx_src_addr(&sin);
+	if (!ret)
+		ret = udpx_setname(&ep->util_ep.ep_fid.fid, &sin,
+				   sizeof(sin));
 	if (ret) {
 		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "failed to set addr\n");
 	}
-	freeaddrinfo(rai);
 }
 
 static int udpx_ep_ctrl(struct fid *fid, int command, void *arg)
@@ -698,6 +1133,19 @@ static int udpx_ep_ctrl(struct fid *fid, int command, void *arg)
 	ep = container_of(fid, struct udpx_ep, util_ep.ep_fid.fid);
 	switch (command) {
 	case FI_ENABLE:
+		if (fid->fclass == FI_CLASS_TX_CTX) {
+			if (!ep->util_ep.tx_cq)
+				return -FI_ENOCQ;
+			if (!ep->util_ep.av)
+				return -FI_ENOAV;
+			break;
+		}
+		if (fid->fclass == FI_CLASS_RX_CTX) {
+			if (!ep->util_ep.rx_cq)
+				return -FI_ENOCQ;
+			break;
+		}
+
 		if (!ep->util_ep.rx_cq || !ep->util_ep.tx_cq)
 			return -FI_ENOCQ;
 		if (!ep->util_ep.av)
@@ -720,17 +1168,51 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+static void udpx_ep_init_gro(struct udpx_ep *ep)
+{
+#if UDPX_HAVE_GSO
+	int optval = 1;
+
+	if (setsockopt(ep->sock, IPPROTO_UDP, UDP_GRO, (char *) &optval,
+		       sizeof(optval))) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"setsockopt UDP_GRO failed: %s\n",
+			strerror(ofi_sockerr()));
+		return;
+	}
+
+	ep->gro.buf = malloc(UDPX_GRO_BUF_SIZE);
+	if (!ep->gro.buf) {
+		optval = 0;
+		(void) setsockopt(ep->sock, IPPROTO_UDP, UDP_GRO,
+				  (char *) &optval, sizeof(optval));
+	}
+#endif
+}
+
+static int udpx_ep_init_queues(struct udpx_ep *ep, struct fi_info *info)
+{
+	ofi_atomic_initialize32(&ep->ref, 0);
+	ep->rxq = udpx_rx_cirq_create(info->rx_attr->size);
+	if (!ep->rxq)
+		return -FI_ENOMEM;
+
+	ep->txq = udpx_tx_cirq_create(UDPX_MMSG_MAX);
+	if (!ep->txq) {
+		udpx_rx_cirq_free(ep->rxq);
+		return -FI_ENOMEM;
+	}
+	return 0;
+}
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
 	int ret;
 
-	ofi_atomic_initialize32(&ep->ref, 0);
-	ep->rxq = udpx_rx_cirq_create(info->rx_attr->size);
-	if (!ep->rxq) {
-		ret = -FI_ENOMEM;
+	ret = udpx_ep_init_queues(ep, info);
+	if (ret)
 		return ret;
-	}
 
 	family = info->src_addr ?
 		 ((struct sockaddr *) info->src_addr)->sa_family : AF_INET;
@@ -751,10 +1233,14 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+	ep->gso = udpx_env.gso;
+	if (udpx_env.gro)
+		udpx_ep_init_gro(ep);
 	return 0;
 err2:
 	ofi_close_socket(ep->sock);
 err1:
+	udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
 	return ret;
 }
@@ -792,3 +1278,375 @@ err1:
 	free(ep);
 	return ret;
 }
+
+static int udpx_sep_getname(fid_t fid, void *addr, size_t *addrlen)
+{
+	struct udpx_sep *sep = container_of(fid, struct udpx_sep, sep_fid.fid);
+	size_t buflen = *addrlen;
+
+	if (ofi_getsockname(sep->sock[0], addr, (socklen_t *)addrlen))
+		return -ofi_sockerr();
+
+	return buflen < *addrlen ? -FI_ETOOSMALL : 0;
+}
+
+static struct fi_ops_cm udpx_sep_cm_ops = {
+	.size = sizeof(struct fi_ops_cm),
+	.setname = fi_no_setname,
+	.getname = udpx_sep_getname,
+	.getpeer = fi_no_getpeer,
+	.connect = fi_no_connect,
+	.listen = fi_no_listen,
+	.accept = fi_no_accept,
+	.reject = fi_no_reject,
+	.shutdown = fi_no_shutdown,
+	.join = fi_no_join,
+};
+
+/* Called with the sep lock held */
+static int udpx_ctx_open(struct udpx_sep *sep, struct fi_info *info,
+			 size_t fclass, int index, struct fid_ep **ctx_fid,
+			 void *context)
+{
+	struct udpx_ep *ep, **slot;
+	int ret;
+
+	slot = (fclass == FI_CLASS_TX_CTX) ? &sep->tx_ctx[index] :
+					     &sep->rx_ctx[index];
+	if (*slot) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"context %d already open\n", index);
+		return -FI_EBUSY;
+	}
+
+	ep = calloc(1, sizeof(*ep));
+	if (!ep)
+		return -FI_ENOMEM;
+
+	ret = ofi_endpoint_init(&sep->domain->domain_fid, &udpx_util_prov,
+				info, &ep->util_ep, context, udpx_ep_progress);
+	if (ret)
+		goto err1;
+
+	ret = udpx_ep_init_queues(ep, info);
+	if (ret)
+		goto err2;
+
+	if (sep->av) {
+		ret = ofi_ep_bind_av(&ep->util_ep, sep->av);
+		if (ret)
+			goto err3;
+	}
+
+	ep->sep = sep;
+	ep->sock = sep->sock[index % sep->rx_cnt];
+	ep->is_bound = 1;
+	ep->gso = udpx_env.gso;
+	if (fclass == FI_CLASS_RX_CTX && udpx_env.gro)
+		udpx_ep_init_gro(ep);
+
+	*slot = ep;
+	ofi_atomic_inc32(&sep->ref);
+
+	*ctx_fid = &ep->util_ep.ep_fid;
+	(*ctx_fid)->fid.fclass = fclass;
+	(*ctx_fid)->fid.ops = &udpx_ep_fi_ops;
+	(*ctx_fid)->ops = &udpx_ep_ops;
+	(*ctx_fid)->cm = &udpx_cm_ops;
+	(*ctx_fid)->msg = (info->tx_attr->op_flags & FI_MULTICAST) ?
+			  &udpx_msg_mcast_ops : &udpx_msg_ops;
+	return 0;
+err3:
+	udpx_tx_cirq_free(ep->txq);
+	udpx_rx_cirq_free(ep->rxq);
+err2:
+	ofi_endpoint_close(&ep->util_ep);
+err1:
+	free(ep);
+	return ret;
+}
+
+static int udpx_sep_tx_ctx(struct fid_ep *sep_fid, int index,
+			   struct fi_tx_attr *attr, struct fid_ep **tx_ep,
+			   void *context)
+{
+	struct udpx_sep *sep;
+	struct fi_info *info;
+	int ret;
+
+	sep = container_of(sep_fid, struct udpx_sep, sep_fid);
+	if (index < 0 || (size_t) index >= sep->tx_cnt)
+		return -FI_EINVAL;
+
+	info = fi_dupinfo(sep->info);
+	if (!info)
+		return -FI_ENOMEM;
+	if (attr)
+		*info->tx_attr = *attr;
+
+	fastlock_acquire(&sep->lock);
+	ret = udpx_ctx_open(sep, info, FI_CLASS_TX_CTX, index, tx_ep, context);
+	fastlock_release(&sep->lock);
+	fi_freeinfo(info);
+	return ret;
+}
+
+static int udpx_sep_rx_ctx(struct fid_ep *sep_fid, int index,
+			   struct fi_rx_attr *attr, struct fid_ep **rx_ep,
+			   void *context)
+{
+	struct udpx_sep *sep;
+	struct fi_info *info;
+	int ret;
+
+	sep = container_of(sep_fid, struct udpx_sep, sep_fid);
+	if (index < 0 || (size_t) index >= sep->rx_cnt)
+		return -FI_EINVAL;
+
+	info = fi_dupinfo(sep->info);
+	if (!info)
+		return -FI_ENOMEM;
+	if (attr)
+		*info->rx_attr = *attr;
+
+	fastlock_acquire(&sep->lock);
+	ret = udpx_ctx_open(sep, info, FI_CLASS_RX_CTX, index, rx_ep, context);
+	fastlock_release(&sep->lock);
+	fi_freeinfo(info);
+	return ret;
+}
+
+static struct fi_ops_ep udpx_sep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = fi_no_cancel,
+	.getopt = udpx_getopt,
+	.setopt = udpx_setopt,
+	.tx_ctx = udpx_sep_tx_ctx,
+	.rx_ctx = udpx_sep_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
+
+static int udpx_sep_close(struct fid *fid)
+{
+	struct udpx_sep *sep;
+	size_t i;
+
+	sep = container_of(fid, struct udpx_sep, sep_fid.fid);
+	if (ofi_atomic_get32(&sep->ref)) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "SEP busy\n");
+		return -FI_EBUSY;
+	}
+
+	for (i = 0; i < sep->rx_cnt; i++)
+		ofi_close_socket(sep->sock[i]);
+	if (sep->av)
+		ofi_atomic_dec32(&sep->av->ref);
+	ofi_atomic_dec32(&sep->domain->ref);
+	fastlock_destroy(&sep->lock);
+	fi_freeinfo(sep->info);
+	free(sep);
+	return 0;
+}
+
+static int udpx_sep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
+{
+	struct udpx_sep *sep;
+	struct util_av *av;
+	size_t i;
+	int ret;
+
+	ret = ofi_ep_bind_valid(&udpx_prov, bfid, flags);
+	if (ret)
+		return ret;
+
+	if (bfid->fclass != FI_CLASS_AV) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "invalid fid class\n");
+		return -FI_EINVAL;
+	}
+
+	sep = container_of(fid, struct udpx_sep, sep_fid.fid);
+	av = container_of(bfid, struct util_av, av_fid.fid);
+
+	fastlock_acquire(&sep->lock);
+	if (sep->av) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "duplicate AV binding\n");
+		ret = -FI_EINVAL;
+		goto out;
+	}
+	sep->av = av;
+	ofi_atomic_inc32(&av->ref);
+
+	/* contexts opened before the bind share the sep's AV */
+	for (i = 0; i < sep->tx_cnt && !ret; i++) {
+		if (sep->tx_ctx[i] && !sep->tx_ctx[i]->util_ep.av)
+			ret = ofi_ep_bind_av(&sep->tx_ctx[i]->util_ep, av);
+	}
+	for (i = 0; i < sep->rx_cnt && !ret; i++) {
+		if (sep->rx_ctx[i] && !sep->rx_ctx[i]->util_ep.av)
+			ret = ofi_ep_bind_av(&sep->rx_ctx[i]->util_ep, av);
+	}
+out:
+	fastlock_release(&sep->lock);
+	return ret;
+}
+
+static int udpx_sep_ctrl(struct fid *fid, int command, void *arg)
+{
+	switch (command) {
+	case FI_ENABLE:
+		/* contexts are enabled individually */
+		return 0;
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
+static struct fi_ops udpx_sep_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = udpx_sep_close,
+	.bind = udpx_sep_bind,
+	.control = udpx_sep_ctrl,
+	.ops_open = fi_no_ops_open,
+};
+
+static int udpx_sep_open_sock(SOCKET *sock, const struct sockaddr *addr,
+			      socklen_t addrlen)
+{
+	int optval = 1;
+	int ret;
+
+	*sock = socket(addr->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (*sock == INVALID_SOCKET)
+		return -ofi_sockerr();
+
+#ifdef SO_REUSEPORT
+	if (setsockopt(*sock, SOL_SOCKET, SO_REUSEPORT, (char *) &optval,
+		       sizeof(optval))) {
+		ret = -ofi_sockerr();
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"setsockopt SO_REUSEPORT failed: %s\n",
+			strerror(-ret));
+		goto err;
+	}
+#endif
+
+	ofi_straddr_dbg(&udpx_prov, FI_LOG_EP_CTRL, "bind addr: ", addr);
+	if (bind(*sock, addr, addrlen)) {
+		ret = -ofi_sockerr();
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "bind %d (%s)\n",
+			-ret, strerror(-ret));
+		goto err;
+	}
+
+	ret = fi_fd_nonblock((int)*sock);
+	if (ret)
+		goto err;
+	return 0;
+err:
+	ofi_close_socket(*sock);
+	return ret;
+}
+
+static int udpx_sep_init(struct udpx_sep *sep, struct fi_info *info)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	size_t i;
+	int ret;
+
+	if (info->src_addr) {
+		if (info->src_addrlen > sizeof(addr))
+			return -FI_EINVAL;
+		memcpy(&addr, info->src_addr, info->src_addrlen);
+		addrlen = (socklen_t) info->src_addrlen;
+	} else {
+		ret = udpx_src_addr((struct sockaddr_in *) &addr);
+		if (ret)
+			return ret;
+		addrlen = sizeof(struct sockaddr_in);
+	}
+
+	/* every socket binds the port picked for the first one */
+	for (i = 0; i < sep->rx_cnt; i++) {
+		ret = udpx_sep_open_sock(&sep->sock[i],
+					 (struct sockaddr *) &addr, addrlen);
+		if (ret)
+			goto err;
+
+		if (!i) {
+			addrlen = sizeof(addr);
+			if (ofi_getsockname(sep->sock[0],
+					    (struct sockaddr *) &addr,
+					    &addrlen)) {
+				ret = -ofi_sockerr();
+				i++;
+				goto err;
+			}
+		}
+	}
+	return 0;
+err:
+	while (i--)
+		ofi_close_socket(sep->sock[i]);
+	return ret;
+}
+
+int udpx_scalable_ep(struct fid_domain *domain, struct fi_info *info,
+		     struct fid_ep **sep_fid, void *context)
+{
+	struct util_domain *util_domain;
+	struct udpx_sep *sep;
+	int ret;
+
+	util_domain = container_of(domain, struct util_domain, domain_fid);
+	if (!info || !info->ep_attr || !info->rx_attr || !info->tx_attr)
+		return -FI_EINVAL;
+
+	ret = ofi_prov_check_info(&udpx_util_prov,
+				  util_domain->fabric->fabric_fid.api_version,
+				  info);
+	if (ret)
+		return ret;
+
+	if (info->ep_attr->tx_ctx_cnt > UDPX_MAX_CTX ||
+	    info->ep_attr->rx_ctx_cnt > UDPX_MAX_CTX) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"unsupported context count\n");
+		return -FI_EINVAL;
+	}
+
+	sep = calloc(1, sizeof(*sep));
+	if (!sep)
+		return -FI_ENOMEM;
+
+	sep->info = fi_dupinfo(info);
+	if (!sep->info) {
+		ret = -FI_ENOMEM;
+		goto err1;
+	}
+
+	sep->domain = util_domain;
+	sep->tx_cnt = MAX(info->ep_attr->tx_ctx_cnt, 1);
+	sep->rx_cnt = MAX(info->ep_attr->rx_ctx_cnt, 1);
+	ret = udpx_sep_init(sep, info);
+	if (ret)
+		goto err2;
+
+	fastlock_init(&sep->lock);
+	ofi_atomic_initialize32(&sep->ref, 0);
+	ofi_atomic_inc32(&util_domain->ref);
+
+	sep->sep_fid.fid.fclass = FI_CLASS_SEP;
+	sep->sep_fid.fid.context = context;
+	sep->sep_fid.fid.ops = &udpx_sep_fi_ops;
+	sep->sep_fid.ops = &udpx_sep_ops;
+	sep->sep_fid.cm = &udpx_sep_cm_ops;
+	*sep_fid = &sep->sep_fid;
+	return 0;
+err2:
+	fi_freeinfo(sep->info);
+err1:
+	free(sep);
+	return ret;
+}
@@ -113,6 +113,25 @@ static int udpx_getinfo(uint32_t version, const char *node, const char *service,
 	return 0;
 }
 
+struct udpx_env udpx_env = {
+	.gso = UDPX_HAVE_GSO,
+	/* receiving one datagram per call is slower when peers don't GSO */
+	.gro = 0,
+};
+
+static void udpx_init_env(void)
+{
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_env.gso);
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_env.gro);
+	fi_param_get_int(&udpx_prov, "tx_drop_rate", &udpx_env.tx_drop_rate);
+	if (!UDPX_HAVE_GSO && (udpx_env.gso || udpx_env.gro)) {
+		FI_INFO(&udpx_prov, FI_LOG_CORE,
+			"UDP GSO/GRO not supported, ignoring gso and gro\n");
+		udpx_env.gso = 0;
+		udpx_env.gro = 0;
+	}
+}
+
 static void udpx_fini(void)
 {
 	/* yawn */
@@ -131,6 +150,16 @@ UDP_INI
 {
 	fi_param_define(&udpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"Send runs of held same-size datagrams to the same "
+			"address as one UDP_SEGMENT send (default: yes)");
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"Receive coalesced datagrams with UDP_GRO and split "
+			"them into posted buffers (default: no)");
+	fi_param_define(&udpx_prov, "tx_drop_rate", FI_PARAM_INT,
+			"Drop every Nth datagram sent with FI_MORE, for "
+			"testing (default: 0, never)");
+	udpx_init_env();
 
 	return &udpx_prov;
 }
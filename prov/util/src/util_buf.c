@@ -38,60 +38,115 @@
 #include <ofi_mem.h>
 #include <ofi.h>
 #include <ofi_osd.h>
+#include <ofi_util.h>
 
 
-int util_buf_grow(struct util_buf_pool *pool)
+static size_t util_buf_region_slot(struct util_buf_pool *pool)
 {
-	void *buf;
-	int ret;
 	size_t i;
-	struct util_buf_region *buf_region;
-	ssize_t hp_size;
-	struct util_buf_footer *buf_ftr;
 
-	if (pool->attr.max_cnt && pool->num_allocated >= pool->attr.max_cnt) {
-		return -1;
+	/* reuse a slot freed by trimming so buffer indices stay dense */
+	if (pool->num_allocated < pool->regions_cnt * pool->attr.chunk_cnt) {
+		for (i = 0; i < pool->regions_cnt; i++) {
+			if (!pool->regions_table[i])
+				return i;
+		}
 	}
+	return pool->regions_cnt;
+}
 
-	buf_region = calloc(1, sizeof(*buf_region));
-	if (!buf_region)
-		return -1;
-
-	buf_region->pool = pool;
-	dlist_init(&buf_region->buf_list);
-
-	if (pool->attr.is_mmap_region) {
-		hp_size = ofi_get_hugepage_size();
-		if (hp_size < 0)
-			goto err1;
+static int util_buf_region_alloc_mem(struct util_buf_pool *pool,
+				     struct util_buf_region *buf_region,
+				     uint8_t is_mmap_region)
+{
+	size_t size = pool->attr.chunk_cnt * pool->entry_sz;
+	ssize_t page_sz;
+	int ret;
 
-		buf_region->size = fi_get_aligned_sz(pool->attr.chunk_cnt *
-						     pool->entry_sz, hp_size);
+	if (is_mmap_region) {
+		page_sz = ofi_get_hugepage_size();
+		if (page_sz < 0)
+			return (int) page_sz;
 
-		ret = ofi_alloc_hugepage_buf((void **)&buf_region->mem_region,
+		buf_region->size = fi_get_aligned_sz(size, page_sz);
+		ret = ofi_alloc_hugepage_buf((void **) &buf_region->mem_region,
 					     buf_region->size);
 		if (ret) {
 			FI_DBG(&core_prov, FI_LOG_CORE,
 			       "Huge page allocation failed: %s\n",
 			       fi_strerror(-ret));
+			return ret;
+		}
+		buf_region->mem_type = UTIL_BUF_MEM_HUGEPAGES;
+		return 0;
+	}
 
-			if (pool->num_allocated > 0)
-				goto err1;
-
-			pool->attr.is_mmap_region = 0;
+	page_sz = ofi_sysconf(_SC_PAGESIZE);
+	if (size >= UTIL_BUF_POOL_MMAP_MIN_SIZE && page_sz > 0 &&
+	    pool->attr.alignment <= (size_t) page_sz) {
+		buf_region->size = fi_get_aligned_sz(size, page_sz);
+		ret = ofi_alloc_page_buf((void **) &buf_region->mem_region,
+					 buf_region->size);
+		if (!ret) {
+			buf_region->mem_type = UTIL_BUF_MEM_PAGES;
+			return 0;
 		}
 	}
 
-	if (!pool->attr.is_mmap_region) {
-		buf_region->size = pool->attr.chunk_cnt * pool->entry_sz;
+	buf_region->size = size;
+	buf_region->mem_type = UTIL_BUF_MEM_ALIGNED;
+	return ofi_memalign((void **) &buf_region->mem_region,
+			    pool->attr.alignment, buf_region->size);
+}
+
+static void util_buf_region_free_mem(struct util_buf_region *buf_region)
+{
+	int ret;
 
-		ret = ofi_memalign((void **)&buf_region->mem_region,
-				   pool->attr.alignment, buf_region->size);
-		if (ret)
-			goto err1;
+	switch (buf_region->mem_type) {
+	case UTIL_BUF_MEM_HUGEPAGES:
+		ret = ofi_free_hugepage_buf(buf_region->mem_region,
+					    buf_region->size);
+		if (ret) {
+			FI_DBG(&core_prov, FI_LOG_CORE,
+			       "Huge page free failed: %s\n",
+			       fi_strerror(-ret));
+			assert(0);
+		}
+		break;
+	case UTIL_BUF_MEM_PAGES:
+		ret = ofi_free_page_buf(buf_region->mem_region,
+					buf_region->size);
+		assert(!ret);
+		break;
+	default:
+		ofi_freealign(buf_region->mem_region);
+		break;
 	}
+}
+
+/*
+ * Allocates the memory of a region and runs the alloc handler.  Entries
+ * are set up later, one at a time, as they are first handed out.
+ */
+static struct util_buf_region *
+util_buf_region_alloc(struct util_buf_pool *pool, uint8_t is_mmap_region)
+{
+	struct util_buf_region *buf_region;
+	int ret;
+
+	buf_region = calloc(1, sizeof(*buf_region));
+	if (!buf_region)
+		return NULL;
+
+	buf_region->pool = pool;
+	dlist_init(&buf_region->entry);
+	dlist_init(&buf_region->buf_list);
+
+	ret = util_buf_region_alloc_mem(pool, buf_region, is_mmap_region);
+	if (ret)
+		goto err1;
 
-	memset(buf_region->mem_region, 0, buf_region->size);
 	if (pool->attr.alloc_hndlr) {
 		ret = pool->attr.alloc_hndlr(pool->attr.ctx,
 					     buf_region->mem_region,
@@ -100,72 +155,289 @@ int util_buf_grow(struct util_buf_pool *pool)
 		if (ret)
 			goto err2;
 	}
+	return buf_region;
+err2:
+	util_buf_region_free_mem(buf_region);
+err1:
+	free(buf_region);
+	return NULL;
+}
 
-	if (!(pool->regions_cnt % UTIL_BUF_POOL_REGION_CHUNK_CNT)) {
-		struct util_buf_region **new_table =
-			realloc(pool->regions_table,
-				(pool->regions_cnt +
-				 UTIL_BUF_POOL_REGION_CHUNK_CNT) *
-				sizeof(*pool->regions_table));
-		if (!new_table)
-			goto err3;
-		pool->regions_table = new_table;
-	}
-	pool->regions_table[pool->regions_cnt] = buf_region;
-	pool->regions_cnt++;
+static void util_buf_region_free(struct util_buf_pool *pool,
+				 struct util_buf_region *buf_region)
+{
+	if (pool->attr.free_hndlr)
+		pool->attr.free_hndlr(pool->attr.ctx, buf_region->context);
+	util_buf_region_free_mem(buf_region);
+	free(buf_region);
+}
+
+struct util_buf_footer *util_buf_region_init_next(struct util_buf_pool *pool,
+						  struct util_buf_region *buf_region)
+{
+	struct util_buf_footer *buf_ftr;
+	void *buf;
+
+	assert(buf_region->init_cnt < pool->attr.chunk_cnt);
+	buf = buf_region->mem_region + buf_region->init_cnt * pool->entry_sz;
+	if (buf_region->mem_type == UTIL_BUF_MEM_ALIGNED)
+		memset(buf, 0, pool->entry_sz);
 
-	for (i = 0; i < pool->attr.chunk_cnt; i++) {
-		buf = (buf_region->mem_region + i * pool->entry_sz);
-		buf_ftr = util_buf_get_ftr(pool, buf);
+	buf_ftr = util_buf_get_ftr(pool, buf);
+	buf_ftr->region = buf_region;
+	buf_ftr->index = buf_region->index * pool->attr.chunk_cnt +
+			 buf_region->init_cnt++;
 
-		if (pool->attr.init) {
+	if (pool->attr.init) {
 #if ENABLE_DEBUG
-			if (!pool->attr.indexing.ordered) {
-				buf_ftr->entry.slist.next = (void *) OFI_MAGIC_64;
+		if (!pool->attr.indexing.ordered) {
+			buf_ftr->entry.slist.next = (void *) OFI_MAGIC_64;
 
-				pool->attr.init(pool->attr.ctx, buf);
+			pool->attr.init(pool->attr.ctx, buf);
 
-				assert(buf_ftr->entry.slist.next == (void *) OFI_MAGIC_64);
-			} else {
-				buf_ftr->entry.dlist.next = (void *) OFI_MAGIC_64;
-				buf_ftr->entry.dlist.prev = (void *) OFI_MAGIC_64;
+			assert(buf_ftr->entry.slist.next == (void *) OFI_MAGIC_64);
+		} else {
+			buf_ftr->entry.dlist.next = (void *) OFI_MAGIC_64;
+			buf_ftr->entry.dlist.prev = (void *) OFI_MAGIC_64;
 
-				pool->attr.init(pool->attr.ctx, buf);
+			pool->attr.init(pool->attr.ctx, buf);
 
-				assert((buf_ftr->entry.dlist.next == (void *) OFI_MAGIC_64) &&
-				       (buf_ftr->entry.dlist.prev == (void *) OFI_MAGIC_64));
-			}
+			assert((buf_ftr->entry.dlist.next == (void *) OFI_MAGIC_64) &&
+			       (buf_ftr->entry.dlist.prev == (void *) OFI_MAGIC_64));
+		}
 #else
-			pool->attr.init(pool->attr.ctx, buf);
+		pool->attr.init(pool->attr.ctx, buf);
 #endif
+	}
+	return buf_ftr;
+}
+
+void *util_buf_get_lazy(struct util_buf_pool *pool)
+{
+	struct util_buf_region *buf_region = pool->lazy_region;
+	struct util_buf_footer *buf_ftr;
+
+	assert(buf_region);
+	buf_ftr = util_buf_region_init_next(pool, buf_region);
+	if (buf_region->init_cnt == pool->attr.chunk_cnt)
+		pool->lazy_region = NULL;
+
+	buf_region->num_used++;
+	buf_region->active = 1;
+	return util_buf_get_data(pool, buf_ftr);
+}
+
+static int util_buf_region_add(struct util_buf_pool *pool,
+			       struct util_buf_region *buf_region)
+{
+	struct util_buf_region **new_table;
+	struct util_buf_footer *buf_ftr;
+	size_t slot;
+
+	slot = util_buf_region_slot(pool);
+	if (slot == pool->regions_cnt) {
+		if (!(pool->regions_cnt % UTIL_BUF_POOL_REGION_CHUNK_CNT)) {
+			new_table = realloc(pool->regions_table,
+					    (pool->regions_cnt +
+					     UTIL_BUF_POOL_REGION_CHUNK_CNT) *
+					    sizeof(*pool->regions_table));
+			if (!new_table)
+				return -1;
+			pool->regions_table = new_table;
 		}
+		pool->regions_cnt++;
+	}
+	pool->regions_table[slot] = buf_region;
+	buf_region->index = slot;
+	buf_region->active = 1;
 
-		buf_ftr->region = buf_region;
-		buf_ftr->index = pool->num_allocated + i;
-		if (!pool->attr.indexing.ordered) {
+	if (pool->attr.indexing.ordered) {
+		dlist_insert_order(&pool->list.regions,
+				   util_buf_region_is_lower,
+				   &buf_region->entry);
+	} else {
+		/* only util_buf_grow callers that skip util_buf_avail
+		 * can get here with entries left in the previous region */
+		while (pool->lazy_region &&
+		       pool->lazy_region->init_cnt < pool->attr.chunk_cnt) {
+			buf_ftr = util_buf_region_init_next(pool,
+							    pool->lazy_region);
 			slist_insert_tail(&buf_ftr->entry.slist,
 					  &pool->list.buffers);
-		} else {
-			dlist_insert_tail(&buf_ftr->entry.dlist,
-					  &buf_region->buf_list);
 		}
+		pool->lazy_region = buf_region;
 	}
 
-	if (pool->attr.indexing.ordered) {
-		dlist_insert_tail(&buf_region->entry,
-				  &pool->list.regions);
+	pool->num_allocated += pool->attr.chunk_cnt;
+	pool->peak_allocated = MAX(pool->peak_allocated, pool->num_allocated);
+	pool->grow_cnt++;
+	return 0;
+}
+
+/*
+ * Pools created with bg_grow keep one spare region, allocated and passed
+ * to the alloc handler by a worker thread shared by all pools.  Growing
+ * the pool adopts the spare, and requests the next one, so that memory
+ * registration stays off the allocation path.  The worker is started on
+ * first use and runs until the library is unloaded.
+ */
+extern struct ofi_common_locks common_locks;
+
+static struct {
+	pthread_t		thread;
+	pthread_cond_t		cond;
+	struct dlist_entry	pool_list;
+	int			started;
+	int			stop;
+} util_buf_bg = {
+	.pool_list = { &util_buf_bg.pool_list, &util_buf_bg.pool_list },
+};
+
+static void *util_buf_bg_thread(void *arg)
+{
+	struct util_buf_pool *pool;
+	struct util_buf_region *buf_region;
+	uint8_t is_mmap_region;
+
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	while (!util_buf_bg.stop) {
+		if (dlist_empty(&util_buf_bg.pool_list)) {
+			pthread_cond_wait(&util_buf_bg.cond,
+					  &common_locks.util_buf_bg_lock);
+			continue;
+		}
+
+		pool = container_of(util_buf_bg.pool_list.next,
+				    struct util_buf_pool, bg_entry);
+		dlist_remove_init(&pool->bg_entry);
+		pool->bg_busy = 1;
+		is_mmap_region = pool->attr.is_mmap_region;
+		pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+
+		buf_region = util_buf_region_alloc(pool, is_mmap_region);
+		if (!buf_region && is_mmap_region)
+			buf_region = util_buf_region_alloc(pool, 0);
+
+		pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+		pool->spare = buf_region;
+		pool->bg_busy = 0;
+		pthread_cond_broadcast(&util_buf_bg.cond);
 	}
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+	return arg;
+}
 
-	pool->num_allocated += pool->attr.chunk_cnt;
+static int util_buf_bg_start(void)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	if (!util_buf_bg.started) {
+		pthread_cond_init(&util_buf_bg.cond, NULL);
+		ret = pthread_create(&util_buf_bg.thread, NULL,
+				     util_buf_bg_thread, NULL);
+		if (ret)
+			pthread_cond_destroy(&util_buf_bg.cond);
+		else
+			util_buf_bg.started = 1;
+	}
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+	return ret;
+}
+
+void util_buf_bg_cleanup(void)
+{
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	if (!util_buf_bg.started) {
+		pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+		return;
+	}
+	util_buf_bg.stop = 1;
+	pthread_cond_broadcast(&util_buf_bg.cond);
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+
+	pthread_join(util_buf_bg.thread, NULL);
+	pthread_cond_destroy(&util_buf_bg.cond);
+	util_buf_bg.started = 0;
+	util_buf_bg.stop = 0;
+}
+
+static void util_buf_bg_request(struct util_buf_pool *pool)
+{
+	if (pool->attr.max_cnt && pool->num_allocated +
+	    pool->attr.chunk_cnt >= pool->attr.max_cnt)
+		return;
+
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	if (!pool->spare && !pool->bg_busy && dlist_empty(&pool->bg_entry)) {
+		dlist_insert_tail(&pool->bg_entry, &util_buf_bg.pool_list);
+		pthread_cond_signal(&util_buf_bg.cond);
+	}
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+}
+
+static struct util_buf_region *util_buf_bg_take(struct util_buf_pool *pool)
+{
+	struct util_buf_region *buf_region;
+
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	buf_region = pool->spare;
+	pool->spare = NULL;
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+	return buf_region;
+}
+
+static void util_buf_bg_release(struct util_buf_pool *pool)
+{
+	struct util_buf_region *buf_region;
+
+	pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+	if (!dlist_empty(&pool->bg_entry))
+		dlist_remove_init(&pool->bg_entry);
+	while (pool->bg_busy)
+		pthread_cond_wait(&util_buf_bg.cond,
+				  &common_locks.util_buf_bg_lock);
+	buf_region = pool->spare;
+	pool->spare = NULL;
+	pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+
+	if (buf_region)
+		util_buf_region_free(pool, buf_region);
+}
+
+int util_buf_grow(struct util_buf_pool *pool)
+{
+	struct util_buf_region *buf_region = NULL;
+
+	if (pool->attr.max_cnt && pool->num_allocated >= pool->attr.max_cnt) {
+		return -1;
+	}
+
+	if (pool->attr.bg_grow)
+		buf_region = util_buf_bg_take(pool);
+
+	if (!buf_region) {
+		buf_region = util_buf_region_alloc(pool,
+						   pool->attr.is_mmap_region);
+		if (!buf_region && pool->attr.is_mmap_region &&
+		    !pool->num_allocated) {
+			pthread_mutex_lock(&common_locks.util_buf_bg_lock);
+			pool->attr.is_mmap_region = 0;
+			pthread_mutex_unlock(&common_locks.util_buf_bg_lock);
+			buf_region = util_buf_region_alloc(pool, 0);
+		}
+		if (!buf_region)
+			return -1;
+	}
+
+	if (util_buf_region_add(pool, buf_region)) {
+		util_buf_region_free(pool, buf_region);
+		return -1;
+	}
+
+	if (pool->attr.bg_grow)
+		util_buf_bg_request(pool);
 	return 0;
-err3:
-	if (pool->attr.free_hndlr)
-	    pool->attr.free_hndlr(pool->attr.ctx, buf_region->context);
-err2:
-	ofi_freealign(buf_region->mem_region);
-err1:
-	free(buf_region);
-	return -1;
 }
 
 int util_buf_pool_create_attr(struct util_buf_attr *attr,
@@ -173,6 +445,7 @@ int util_buf_pool_create_attr(struct util_buf_attr *attr,
 {
 	size_t entry_sz;
 	ssize_t hp_size;
+	int bg_grow = 0;
 
 	(*buf_pool) = calloc(1, sizeof(**buf_pool));
 	if (!*buf_pool)
@@ -195,6 +468,19 @@ int util_buf_pool_create_attr(struct util_buf_attr *attr,
 	else
 		dlist_init(&(*buf_pool)->list.regions);
 
+	dlist_init(&(*buf_pool)->bg_entry);
+	if (attr->bg_grow) {
+		fi_param_get_bool(NULL, "buf_pool_bg_grow", &bg_grow);
+		if (bg_grow && util_buf_bg_start()) {
+			FI_WARN(&core_prov, FI_LOG_CORE,
+				"Unable to start buffer pool thread\n");
+			bg_grow = 0;
+		}
+		(*buf_pool)->attr.bg_grow = (uint8_t) bg_grow;
+		if (bg_grow)
+			util_buf_bg_request(*buf_pool);
+	}
+
 	return FI_SUCCESS;
 }
 
@@ -225,36 +511,140 @@ int util_buf_pool_create_ex(struct util_buf_pool **buf_pool,
 void util_buf_pool_destroy(struct util_buf_pool *pool)
 {
 	struct util_buf_region *buf_region;
-	int ret;
 	size_t i;
 
+	if (pool->attr.bg_grow)
+		util_buf_bg_release(pool);
+
 	for (i = 0; i < pool->regions_cnt; i++) {
 		buf_region = pool->regions_table[i];
+		if (!buf_region)
+			continue;
 #if ENABLE_DEBUG
 		if (pool->attr.track_used)
 			assert(buf_region->num_used == 0);
 #endif
-		if (pool->attr.free_hndlr)
-			pool->attr.free_hndlr(pool->attr.ctx, buf_region->context);
-		if (pool->attr.is_mmap_region) {
-			ret = ofi_free_hugepage_buf(buf_region->mem_region,
-						    buf_region->size);
-			if (ret) {
-				FI_DBG(&core_prov, FI_LOG_CORE,
-				       "Huge page free failed: %s\n",
-				       fi_strerror(-ret));
-				assert(0);
-			}
-		} else {
-			ofi_freealign(buf_region->mem_region);
-		}
-
-		free(buf_region);
+		util_buf_region_free(pool, buf_region);
 	}
 	free(pool->regions_table);
 	free(pool);
 }
 
+static void util_buf_unlink_trimmed(struct util_buf_pool *pool)
+{
+	struct util_buf_footer *buf_ftr;
+	struct slist_entry *item, *next, *tail;
+	size_t i;
+
+	if (pool->attr.indexing.ordered) {
+		/* fully free regions are always on the regions list */
+		for (i = 0; i < pool->regions_cnt; i++) {
+			if (pool->regions_table[i] &&
+			    pool->regions_table[i]->trim)
+				dlist_remove(&pool->regions_table[i]->entry);
+		}
+		return;
+	}
+
+	item = pool->list.buffers.head;
+	tail = pool->list.buffers.tail;
+	slist_init(&pool->list.buffers);
+	while (item) {
+		next = (item == tail) ? NULL : item->next;
+		buf_ftr = container_of(item, struct util_buf_footer,
+				       entry.slist);
+		if (!buf_ftr->region->trim)
+			slist_insert_tail(item, &pool->list.buffers);
+		item = next;
+	}
+}
+
+/*
+ * Scans the pool once per trim period.  A region that had no buffer
+ * allocated from it since the previous scan, and has none in use, is
+ * freed, provided trim_hwm free buffers remain.  Newer regions are
+ * freed first.  Returns the number of regions freed.
+ */
+int util_buf_pool_trim(struct util_buf_pool *pool, uint64_t now_ms)
+{
+	struct util_buf_region *buf_region;
+	size_t i, used_cnt = 0, free_cnt, trim_cnt = 0;
+
+	if (!pool->attr.trim_idle_ms || now_ms < pool->trim_time)
+		return 0;
+	pool->trim_time = now_ms + pool->attr.trim_idle_ms;
+
+	for (i = 0; i < pool->regions_cnt; i++) {
+		if (pool->regions_table[i])
+			used_cnt += pool->regions_table[i]->num_used;
+	}
+	free_cnt = pool->num_allocated - used_cnt;
+
+	for (i = pool->regions_cnt; i-- > 0; ) {
+		buf_region = pool->regions_table[i];
+		if (!buf_region)
+			continue;
+
+		if (buf_region->num_used || buf_region->active) {
+			buf_region->active = 0;
+			buf_region->idle = 0;
+			continue;
+		}
+
+		if (!buf_region->idle) {
+			buf_region->idle = 1;
+			continue;
+		}
+
+		if (free_cnt < pool->attr.trim_hwm + pool->attr.chunk_cnt)
+			continue;
+
+		buf_region->trim = 1;
+		free_cnt -= pool->attr.chunk_cnt;
+		trim_cnt++;
+	}
+
+	if (!trim_cnt)
+		return 0;
+
+	util_buf_unlink_trimmed(pool);
+	for (i = 0; i < pool->regions_cnt; i++) {
+		buf_region = pool->regions_table[i];
+		if (!buf_region || !buf_region->trim)
+			continue;
+
+		pool->regions_table[i] = NULL;
+		pool->num_allocated -= pool->attr.chunk_cnt;
+		if (pool->lazy_region == buf_region)
+			pool->lazy_region = NULL;
+		util_buf_region_free(pool, buf_region);
+	}
+	pool->trim_cnt += trim_cnt;
+
+	FI_DBG(&core_prov, FI_LOG_CORE,
+	       "freed %zu regions, %zu of %zu buffers in use\n",
+	       trim_cnt, used_cnt, pool->num_allocated);
+	return (int) trim_cnt;
+}
+
+void util_buf_pool_get_stats(struct util_buf_pool *pool,
+			     struct util_buf_pool_stats *stats)
+{
+	size_t i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < pool->regions_cnt; i++) {
+		if (!pool->regions_table[i])
+			continue;
+		stats->region_cnt++;
+		stats->used_cnt += pool->regions_table[i]->num_used;
+	}
+	stats->buf_cnt = pool->num_allocated;
+	stats->peak_buf_cnt = pool->peak_allocated;
+	stats->grow_cnt = pool->grow_cnt;
+	stats->trim_cnt = pool->trim_cnt;
+}
+
 int util_buf_is_lower(struct dlist_entry *item, const void *arg)
 {
 	struct util_buf_footer *buf_ftr1 =
@@ -272,16 +662,6 @@ int util_buf_region_is_lower(struct dlist_entry *item, const void *arg)
 			     struct util_buf_region, entry);
 	struct util_buf_region *buf_region2 =
 		container_of(item, struct util_buf_region, entry);
-	struct util_buf_footer *buf_region1_head =
-		container_of(buf_region1->buf_list.next,
-			     struct util_buf_footer, entry.dlist);
-	struct util_buf_footer *buf_region2_head =
-		container_of(buf_region2->buf_list.next,
-			     struct util_buf_footer, entry.dlist);
-	size_t buf_region1_index =
-		(size_t)(buf_region1_head->index / buf_region1->pool->attr.chunk_cnt);
-	size_t buf_region2_index =
-		(size_t)(buf_region2_head->index / buf_region2->pool->attr.chunk_cnt);
 
-	return (buf_region1_index < buf_region2_index);
+	return (buf_region1->index < buf_region2->index);
 }
@@ -44,13 +44,19 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags, siz
 {
 	struct util_cq_oflow_err_entry *entry;
 
-	assert(ofi_cirque_isfull(cq->cirq));
+	assert(ofi_cq_isfull(cq));
 
 	if (!(entry = calloc(1, sizeof(*entry))))
 		return -FI_ENOMEM;
 
-	entry->parent_comp = ofi_cirque_tail(cq->cirq);
-	entry->parent_comp->flags |= UTIL_FLAG_OVERFLOW;
+	/* The reader may be copying out the head entry, so the entry is
+	 * only queued.  Later completions queue behind it. */
+	if (cq->spsc) {
+		ofi_atomic_inc32(&cq->oflow_cnt);
+	} else {
+		entry->parent_comp = ofi_cirque_tail(cq->cirq);
+		entry->parent_comp->flags |= UTIL_FLAG_OVERFLOW;
+	}
 
 	entry->comp.op_context = context;
 	entry->comp.flags = flags;
@@ -80,7 +86,9 @@ int ofi_cq_write_error(struct util_cq *cq,
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
 
-	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
+	if (cq->spsc) {
+		ofi_atomic_inc32(&cq->oflow_cnt);
+	} else if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		comp = ofi_cirque_tail(cq->cirq);
 		comp->flags |= (UTIL_FLAG_ERROR | UTIL_FLAG_OVERFLOW);
 		entry->parent_comp = ofi_cirque_tail(cq->cirq);
@@ -201,6 +209,73 @@ static void util_cq_read_tagged(void **dst, void *src)
 	*(char **)dst += sizeof(struct fi_cq_tagged_entry);
 }
 
+/* Entries ahead of the copy position to prefetch in the bulk readers */
+#define UTIL_CQ_PREFETCH_DIST 4
+
+#define UTIL_CQ_DEFINE_READ_BULK(name, type)				\
+static void util_cq_read_##name##_bulk(void **dst,			\
+				       struct fi_cq_tagged_entry *src,	\
+				       size_t cnt)			\
+{									\
+	type *out = *dst;						\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		if (i + UTIL_CQ_PREFETCH_DIST < cnt)			\
+			ofi_prefetch(&src[i + UTIL_CQ_PREFETCH_DIST]);	\
+		out[i] = *(type *) &src[i];				\
+	}								\
+	*dst = &out[cnt];						\
+}
+
+UTIL_CQ_DEFINE_READ_BULK(ctx, struct fi_cq_entry)
+UTIL_CQ_DEFINE_READ_BULK(msg, struct fi_cq_msg_entry)
+UTIL_CQ_DEFINE_READ_BULK(data, struct fi_cq_data_entry)
+
+/* Ring entries are stored in the tagged format */
+static void util_cq_read_tagged_bulk(void **dst,
+				     struct fi_cq_tagged_entry *src, size_t cnt)
+{
+	memcpy(*dst, src, cnt * sizeof(*src));
+	*(char **) dst += cnt * sizeof(*src);
+}
+
+/* Copies cnt entries starting at index, which must not wrap */
+static inline
+void util_cq_copy_out(struct util_cq *cq, void **buf, fi_addr_t *src_addr,
+		      size_t index, size_t cnt)
+{
+	if (src_addr && cq->src)
+		memcpy(src_addr, &cq->src[index], cnt * sizeof(*src_addr));
+	cq->read_entries(buf, &cq->cirq->buf[index], cnt);
+}
+
+/*
+ * Reads entries from the head of the ring up to the first one with
+ * overflow or error completions queued behind it, or the end of the
+ * buffer, and returns how many were read.
+ */
+static size_t util_cq_read_run(struct util_cq *cq, void **buf,
+			       fi_addr_t *src_addr, size_t count)
+{
+	struct util_comp_cirq *cirq = cq->cirq;
+	size_t i, index;
+
+	index = ofi_cirque_rindex(cirq);
+	count = MIN(count, cirq->size - index);
+	for (i = 0; i < count; i++) {
+		if (OFI_UNLIKELY(cirq->buf[index + i].flags &
+				 (UTIL_FLAG_ERROR | UTIL_FLAG_OVERFLOW)))
+			break;
+	}
+
+	if (i) {
+		util_cq_copy_out(cq, buf, src_addr, index, i);
+		cirq->rcnt += i;
+	}
+	return i;
+}
+
 static inline
 void util_cq_read_oflow_entry(struct util_cq *cq,
 			      struct util_cq_oflow_err_entry *oflow_entry,
@@ -230,15 +305,97 @@ void util_cq_read_entry(struct util_cq *cq, struct fi_cq_tagged_entry *entry,
 	ofi_cirque_discard(cq->cirq);
 }
 
+#ifdef ofi_atomic_acquire_fence
+static inline size_t util_cq_spsc_usedcnt(struct util_cq *cq)
+{
+	size_t wcnt;
+
+	wcnt = *(volatile size_t *) &cq->cirq->wcnt;
+	ofi_atomic_acquire_fence();
+	return wcnt - cq->cirq->rcnt;
+}
+
+/* Entries in the ring never carry the overflow or error flags */
+static size_t util_cq_spsc_read_ring(struct util_cq *cq, void **buf,
+				     size_t count, fi_addr_t *src_addr)
+{
+	struct util_comp_cirq *cirq = cq->cirq;
+	size_t cnt, index;
+
+	count = MIN(count, util_cq_spsc_usedcnt(cq));
+	index = ofi_cirque_rindex(cirq);
+	cnt = MIN(count, cirq->size - index);
+	util_cq_copy_out(cq, buf, src_addr, index, cnt);
+	if (cnt < count)
+		util_cq_copy_out(cq, buf, src_addr ? src_addr + cnt : NULL,
+				 0, count - cnt);
+
+	/* hand the entries back to the writers */
+	ofi_atomic_release_fence();
+	*(volatile size_t *) &cirq->rcnt = cirq->rcnt + count;
+	return count;
+}
+
+/*
+ * Completions queued on oflow_err_list are newer than any in the ring,
+ * and writers don't use the ring again until the queue drains.  The
+ * queue is only read with cq_lock held, after emptying the ring.
+ */
+static ssize_t util_cq_spsc_readfrom(struct util_cq *cq, void *buf,
+				     size_t count, fi_addr_t *src_addr)
+{
+	struct util_cq_oflow_err_entry *entry;
+	ssize_t i;
+
+	if (!util_cq_spsc_usedcnt(cq) || !count) {
+		cq->progress(cq);
+		if (!util_cq_spsc_usedcnt(cq) &&
+		    !ofi_atomic_get32(&cq->oflow_cnt))
+			return -FI_EAGAIN;
+	}
+
+	if (!ofi_atomic_get32(&cq->oflow_cnt))
+		return util_cq_spsc_read_ring(cq, &buf, count, src_addr);
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	i = util_cq_spsc_read_ring(cq, &buf, count, src_addr);
+	while (i < (ssize_t) count && !slist_empty(&cq->oflow_err_list)) {
+		entry = container_of(cq->oflow_err_list.head,
+				     struct util_cq_oflow_err_entry, list_entry);
+		if (entry->comp.err) {
+			if (!i)
+				i = -FI_EAVAIL;
+			break;
+		}
+
+		slist_remove_head(&cq->oflow_err_list);
+		ofi_atomic_dec32(&cq->oflow_cnt);
+		if (src_addr && cq->src)
+			src_addr[i] = entry->src;
+		cq->read_entry(&buf, &entry->comp);
+		free(entry);
+		i++;
+	}
+	cq->cq_fastlock_release(&cq->cq_lock);
+	return i;
+}
+#endif
+
 ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			fi_addr_t *src_addr)
 {
 	struct util_cq *cq;
 	struct fi_cq_tagged_entry *entry;
 	ssize_t i;
+	size_t run;
 
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
 
+#ifdef ofi_atomic_acquire_fence
+	if (cq->spsc)
+		return util_cq_spsc_readfrom(cq, buf, count, src_addr);
+#endif
+
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	if (ofi_cirque_isempty(cq->cirq) || !count) {
 		cq->cq_fastlock_release(&cq->cq_lock);
@@ -254,6 +411,13 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		count = ofi_cirque_usedcnt(cq->cirq);
 
 	for (i = 0; i < (ssize_t)count; i++) {
+		run = util_cq_read_run(cq, &buf, src_addr ? src_addr + i : NULL,
+				       count - i);
+		if (run) {
+			i += run - 1;
+			continue;
+		}
+
 		entry = ofi_cirque_head(cq->cirq);
 		if (OFI_UNLIKELY(entry->flags & (UTIL_FLAG_ERROR |
 						 UTIL_FLAG_OVERFLOW))) {
@@ -328,8 +492,18 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	api_version = cq->domain->fabric->fabric_fid.api_version;
 
 	cq->cq_fastlock_acquire(&cq->cq_lock);
-	if (ofi_cirque_isempty(cq->cirq) ||
-	    !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_ERROR)) {
+	if (cq->spsc) {
+		/* the error is reported once the ring is empty */
+		if (!ofi_cirque_isempty(cq->cirq) ||
+		    slist_empty(&cq->oflow_err_list) ||
+		    !container_of(cq->oflow_err_list.head,
+				  struct util_cq_oflow_err_entry,
+				  list_entry)->comp.err) {
+			ret = -FI_EAGAIN;
+			goto unlock;
+		}
+	} else if (ofi_cirque_isempty(cq->cirq) ||
+		   !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_ERROR)) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
@@ -347,6 +521,11 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 		memcpy(buf, &err->comp, sizeof(struct fi_cq_err_entry_1_0));
 	}
 
+	if (cq->spsc) {
+		ofi_atomic_dec32(&cq->oflow_cnt);
+		goto out;
+	}
+
 	cirq_entry = ofi_cirque_head(cq->cirq);
 	if (!(cirq_entry->flags & UTIL_FLAG_OVERFLOW)) {
 		ofi_cirque_discard(cq->cirq);
@@ -368,6 +547,7 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 		cirq_entry->flags &= ~(UTIL_FLAG_ERROR | UTIL_FLAG_OVERFLOW);
 	}
 
+out:
 	ret = 1;
 	free(err);
 unlock:
@@ -506,7 +686,8 @@ static struct fi_ops util_cq_fi_ops = {
 };
 
 static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
-		      fi_cq_read_func read_entry, struct util_cq *cq,
+		      fi_cq_read_func read_entry,
+		      fi_cq_read_bulk_func read_entries, struct util_cq *cq,
 		      void *context)
 {
 	struct fi_wait_attr wait_attr;
@@ -529,6 +710,9 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 	}
 	slist_init(&cq->oflow_err_list);
 	cq->read_entry = read_entry;
+	cq->read_entries = read_entries;
+	cq->spsc = 0;
+	ofi_atomic_initialize32(&cq->oflow_cnt, 0);
 
 	cq->cq_fid.fid.fclass = FI_CLASS_CQ;
 	cq->cq_fid.fid.context = context;
@@ -584,6 +768,28 @@ int ofi_check_bind_cq_flags(struct util_ep *ep, struct util_cq *cq,
 	return FI_SUCCESS;
 }
 
+/*
+ * Lets the application read completions without taking cq_lock, for
+ * domains where it reads a CQ from one thread at a time.  Writers keep
+ * serializing on cq_lock, so this pays off when they run on provider
+ * threads, which need a real lock.  Providers enabling this must write
+ * every completion through the ofi_cq_write calls.
+ */
+int ofi_cq_enable_spsc(struct util_cq *cq)
+{
+#ifdef ofi_atomic_acquire_fence
+	if (cq->domain->threading != FI_THREAD_DOMAIN &&
+	    cq->domain->threading != FI_THREAD_COMPLETION)
+		return -FI_ENOSYS;
+
+	assert(ofi_cirque_isempty(cq->cirq));
+	cq->spsc = 1;
+	return 0;
+#else
+	return -FI_ENOSYS;
+#endif
+}
+
 void ofi_cq_progress(struct util_cq *cq)
 {
 	struct util_ep *ep;
@@ -605,6 +811,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		 ofi_cq_progress_func progress, void *context)
 {
 	fi_cq_read_func read_func;
+	fi_cq_read_bulk_func read_bulk;
 	int ret;
 
 	assert(progress);
@@ -620,22 +827,26 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	case FI_CQ_FORMAT_UNSPEC:
 	case FI_CQ_FORMAT_CONTEXT:
 		read_func = util_cq_read_ctx;
+		read_bulk = util_cq_read_ctx_bulk;
 		break;
 	case FI_CQ_FORMAT_MSG:
 		read_func = util_cq_read_msg;
+		read_bulk = util_cq_read_msg_bulk;
 		break;
 	case FI_CQ_FORMAT_DATA:
 		read_func = util_cq_read_data;
+		read_bulk = util_cq_read_data_bulk;
 		break;
 	case FI_CQ_FORMAT_TAGGED:
 		read_func = util_cq_read_tagged;
+		read_bulk = util_cq_read_tagged_bulk;
 		break;
 	default:
 		assert(0);
 		return -FI_EINVAL;
 	}
 
-	ret = fi_cq_init(domain, attr, read_func, cq, context);
+	ret = fi_cq_init(domain, attr, read_func, read_bulk, cq, context);
 	if (ret)
 		return ret;
 
@@ -52,9 +52,11 @@ int ofi_domain_bind_eq(struct util_domain *domain, struct util_eq *eq)
 
 int ofi_domain_close(struct util_domain *domain)
 {
-	if (ofi_atomic_get32(&domain->ref))
+	/* the MR cache holds a reference until it is cleaned up */
+	if (ofi_atomic_get32(&domain->ref) > (domain->mr_cache ? 1 : 0))
 		return -FI_EBUSY;
 
+	ofi_mr_domain_cache_cleanup(domain);
 	if (domain->mr_map.rbtree)
 		ofi_mr_map_close(&domain->mr_map);
 
@@ -85,6 +87,7 @@ static int util_domain_init(struct util_domain *domain,
 	domain->mr_mode = info->domain_attr->mr_mode;
 	domain->addr_format = info->addr_format;
 	domain->av_type = info->domain_attr->av_type;
+	domain->mr_cache = NULL;
 	domain->name = strdup(info->domain_attr->name);
 	domain->threading = info->domain_attr->threading;
 	domain->data_progress = info->domain_attr->data_progress;
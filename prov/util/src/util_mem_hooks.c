@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2018 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <ofi_mr.h>
+
+/*
+ * The memhooks monitor patches the entry of the libc functions that
+ * release or move memory, so that calls made from within libc (e.g. by
+ * free) are seen as well.  Each patched function jumps to a replacement
+ * that notifies the monitor and then issues the system call directly.
+ * Memory returned with brk/sbrk and shared memory detached with shmdt is
+ * not tracked.
+ *
+ * Other threads may be running the functions while they are patched, so
+ * the jump is installed with a single aligned 8-byte store that replaces
+ * exactly one instruction.  A function whose entry can't be patched that
+ * way, or whose replacement is out of reach of a rel32 jump, disables
+ * the monitor.  It is only used if requested with FI_MR_CACHE_MONITOR.
+ */
+#if ENABLE_MEMHOOKS_MONITOR && defined(__linux__) && defined(__x86_64__) && \
+    HAVE_LIBDL
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* jmp rel32 */
+#define OFI_PATCH_SIZE	5
+
+struct ofi_memhooks_patch {
+	const char	*symbol;
+	void		*hook;
+	uint64_t	*word;
+	uint64_t	data;
+	uint64_t	saved;
+};
+
+static struct ofi_range_monitor memhooks;
+
+static int ofi_munmap_hook(void *addr, size_t len)
+{
+	ofi_monitor_notify(&memhooks, addr, len);
+	return syscall(SYS_munmap, addr, len);
+}
+
+static void *ofi_mremap_hook(void *old_addr, size_t old_len,
+			     size_t new_len, int flags, ...)
+{
+	void *new_addr = NULL;
+	va_list args;
+
+	if (flags & MREMAP_FIXED) {
+		va_start(args, flags);
+		new_addr = va_arg(args, void *);
+		va_end(args);
+	}
+
+	ofi_monitor_notify(&memhooks, old_addr, old_len);
+	return (void *) syscall(SYS_mremap, old_addr, old_len, new_len,
+				flags, new_addr);
+}
+
+static int ofi_madvise_hook(void *addr, size_t len, int advice)
+{
+	switch (advice) {
+	case MADV_DONTNEED:
+#ifdef MADV_FREE
+	case MADV_FREE:
+#endif
+#ifdef MADV_REMOVE
+	case MADV_REMOVE:
+#endif
+		ofi_monitor_notify(&memhooks, addr, len);
+		break;
+	default:
+		break;
+	}
+	return syscall(SYS_madvise, addr, len, advice);
+}
+
+static void *ofi_mmap_hook(void *addr, size_t len, int prot, int flags,
+			   int fd, off_t offset)
+{
+	if (flags & MAP_FIXED)
+		ofi_monitor_notify(&memhooks, addr, len);
+	return (void *) syscall(SYS_mmap, addr, len, prot, flags, fd, offset);
+}
+
+static struct ofi_memhooks_patch memhooks_patches[] = {
+	{ .symbol = "munmap", .hook = ofi_munmap_hook },
+	{ .symbol = "mremap", .hook = ofi_mremap_hook },
+	{ .symbol = "madvise", .hook = ofi_madvise_hook },
+	{ .symbol = "mmap", .hook = ofi_mmap_hook },
+};
+
+#define OFI_PATCH_CNT (sizeof(memhooks_patches) / sizeof(memhooks_patches[0]))
+
+static int ofi_memhooks_write(uint64_t *word, uint64_t old, uint64_t new)
+{
+	size_t page_size = ofi_sysconf(_SC_PAGESIZE);
+	void *page;
+
+	page = (void *) ((uintptr_t) word & ~(page_size - 1));
+	if (mprotect(page, page_size, PROT_READ | PROT_WRITE | PROT_EXEC))
+		return -errno;
+
+	if (*word == old) {
+		__atomic_store_n(word, new, __ATOMIC_SEQ_CST);
+		__builtin___clear_cache((char *) word, (char *) (word + 1));
+	}
+
+	return mprotect(page, page_size, PROT_READ | PROT_EXEC) ? -errno : 0;
+}
+
+static void ofi_memhooks_unpatch(void)
+{
+	size_t i;
+
+	for (i = 0; i < OFI_PATCH_CNT; i++) {
+		(void) ofi_memhooks_write(memhooks_patches[i].word,
+					  memhooks_patches[i].data,
+					  memhooks_patches[i].saved);
+	}
+}
+
+static int ofi_memhooks_start(struct ofi_mem_monitor *notifier)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < OFI_PATCH_CNT; i++) {
+		ret = ofi_memhooks_write(memhooks_patches[i].word,
+					 memhooks_patches[i].saved,
+					 memhooks_patches[i].data);
+		if (ret) {
+			FI_WARN(&core_prov, FI_LOG_MR,
+				"Unable to patch %s: %s\n",
+				memhooks_patches[i].symbol, fi_strerror(-ret));
+			ofi_memhooks_unpatch();
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static void ofi_memhooks_stop(struct ofi_mem_monitor *notifier)
+{
+	ofi_memhooks_unpatch();
+}
+
+/*
+ * Return the offset of the instruction that the jump replaces, or -1 if
+ * it is shorter than the jump.  An endbr64 is kept, as the functions are
+ * also reached through indirect calls.  Only mov $imm32, %r32 is known
+ * to be long enough, which is how the plain system call wrappers start.
+ */
+static int ofi_memhooks_site(const uint8_t *func)
+{
+	static const uint8_t endbr64[] = { 0xf3, 0x0f, 0x1e, 0xfa };
+	int off = 0;
+
+	if (!memcmp(func, endbr64, sizeof(endbr64)))
+		off = sizeof(endbr64);
+
+	return (func[off] >= 0xb8 && func[off] <= 0xbf) ? off : -1;
+}
+
+static int ofi_memhooks_prepare(struct ofi_memhooks_patch *patch, void *libc)
+{
+	uint8_t *func, *site, *data;
+	int64_t rel;
+	int32_t rel32;
+	int off;
+
+	func = dlsym(libc, patch->symbol);
+	if (!func) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Unable to find %s in libc\n", patch->symbol);
+		return -FI_ENOENT;
+	}
+
+	off = ofi_memhooks_site(func);
+	site = func + off;
+	if (off < 0 || ((uintptr_t) site & 7) > 8 - OFI_PATCH_SIZE) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Entry of %s can't be patched atomically\n",
+			patch->symbol);
+		return -FI_ENOSYS;
+	}
+
+	rel = (intptr_t) patch->hook - (intptr_t) (site + OFI_PATCH_SIZE);
+	if (rel < INT32_MIN || rel > INT32_MAX) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Replacement of %s is out of jump range\n",
+			patch->symbol);
+		return -FI_ENOSYS;
+	}
+
+	patch->word = (uint64_t *) ((uintptr_t) site & ~(uintptr_t) 7);
+	patch->saved = *patch->word;
+	patch->data = patch->saved;
+
+	rel32 = (int32_t) rel;
+	data = (uint8_t *) &patch->data + ((uintptr_t) site & 7);
+	data[0] = 0xe9;
+	memcpy(&data[1], &rel32, sizeof(rel32));
+	return 0;
+}
+
+void ofi_memhooks_init(void)
+{
+	void *libc;
+	size_t i;
+	int ret = 0;
+
+	/* Patch libc itself, not an interposer found first in the scope */
+	libc = dlopen("libc.so.6", RTLD_NOLOAD | RTLD_LAZY);
+	if (!libc) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Unable to find libc, memhooks disabled\n");
+		return;
+	}
+
+	for (i = 0; i < OFI_PATCH_CNT && !ret; i++)
+		ret = ofi_memhooks_prepare(&memhooks_patches[i], libc);
+	dlclose(libc);
+	if (ret)
+		return;
+
+	if (ofi_range_monitor_init(&memhooks))
+		return;
+
+	memhooks.monitor.start = ofi_memhooks_start;
+	memhooks.monitor.stop = ofi_memhooks_stop;
+	memhooks_monitor = &memhooks.monitor;
+}
+
+void ofi_memhooks_cleanup(void)
+{
+	if (!memhooks_monitor)
+		return;
+
+	ofi_memhooks_unpatch();
+	ofi_range_monitor_cleanup(&memhooks);
+	memhooks_monitor = NULL;
+}
+
+#else
+
+void ofi_memhooks_init(void)
+{
+}
+
+void ofi_memhooks_cleanup(void)
+{
+}
+
+#endif
@@ -31,8 +31,31 @@
  * SOFTWARE.
  */
 
+#include "config.h"
+
 #include <ofi_mr.h>
+#include <ofi_util.h>
+#include <ofi_iov.h>
+
+#if HAVE_UFFD_UNMAP
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <ofi_signal.h>
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#endif
+
+extern struct ofi_common_locks common_locks;
+
+struct ofi_mem_monitor *memhooks_monitor;
+struct ofi_mem_monitor *uffd_monitor;
+struct ofi_mem_monitor *default_monitor;
 
+static size_t ofi_monitor_page_size;
 
 void ofi_monitor_init(struct ofi_mem_monitor *monitor)
 {
@@ -44,9 +67,24 @@ void ofi_monitor_cleanup(struct ofi_mem_monitor *monitor)
 	assert(ofi_atomic_get32(&monitor->refcnt) == 0);
 }
 
-void ofi_monitor_add_queue(struct ofi_mem_monitor *monitor,
-			   struct ofi_notification_queue *nq)
+int ofi_monitor_add_queue(struct ofi_mem_monitor *monitor,
+			  struct ofi_notification_queue *nq)
 {
+	int ret = 0;
+
+	pthread_mutex_lock(&common_locks.monitor_lock);
+	if (!ofi_atomic_get32(&monitor->refcnt) && monitor->start)
+		ret = monitor->start(monitor);
+	if (!ret)
+		ofi_atomic_inc32(&monitor->refcnt);
+	pthread_mutex_unlock(&common_locks.monitor_lock);
+	if (ret) {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Unable to start memory monitor: %s\n",
+			fi_strerror(-ret));
+		return ret;
+	}
+
 	fastlock_init(&nq->lock);
 	dlist_init(&nq->list);
 	fastlock_acquire(&nq->lock);
@@ -54,13 +92,18 @@ void ofi_monitor_add_queue(struct ofi_mem_monitor *monitor,
 	fastlock_release(&nq->lock);
 
 	nq->monitor = monitor;
-	ofi_atomic_inc32(&monitor->refcnt);
+	return 0;
 }
 
 void ofi_monitor_del_queue(struct ofi_notification_queue *nq)
 {
+	struct ofi_mem_monitor *monitor = nq->monitor;
+
 	assert(dlist_empty(&nq->list) && (nq->refcnt == 0));
-	ofi_atomic_dec32(&nq->monitor->refcnt);
+	pthread_mutex_lock(&common_locks.monitor_lock);
+	if (!ofi_atomic_dec32(&monitor->refcnt) && monitor->stop)
+		monitor->stop(monitor);
+	pthread_mutex_unlock(&common_locks.monitor_lock);
 	fastlock_destroy(&nq->lock);
 }
 
@@ -76,6 +119,7 @@ int ofi_monitor_subscribe(struct ofi_notification_queue *nq,
 
 	/* Ensure the subscription is initialized before we can get events */
 	dlist_init(&subscription->entry);
+	dlist_init(&subscription->monitor_entry);
 
 	subscription->nq = nq;
 	subscription->iov.iov_base = addr;
@@ -127,3 +171,494 @@ struct ofi_subscription *ofi_monitor_get_event(struct ofi_notification_queue *nq
 
 	return subscription;
 }
+
+
+/*
+ * Range monitor
+ */
+
+struct ofi_monitor_node {
+	struct iovec		iov;
+	struct dlist_entry	subscription_list;
+	struct dlist_entry	free_entry;
+};
+
+static int ofi_monitor_range_cmp(void *a, void *b)
+{
+	struct iovec *iov1 = a, *iov2 = b;
+
+	if (ofi_iov_end(iov1) <= iov2->iov_base)
+		return -1;
+	else if (iov1->iov_base >= ofi_iov_end(iov2))
+		return 1;
+	else
+		return 0;
+}
+
+static void ofi_monitor_page_align(struct iovec *iov, const void *addr,
+				   size_t len)
+{
+	uintptr_t start, end;
+
+	start = (uintptr_t) addr & ~(ofi_monitor_page_size - 1);
+	end = ((uintptr_t) addr + len + ofi_monitor_page_size - 1) &
+	      ~(ofi_monitor_page_size - 1);
+	iov->iov_base = (void *) start;
+	iov->iov_len = end - start;
+}
+
+static void ofi_monitor_free_nodes(struct dlist_entry *free_list)
+{
+	struct ofi_monitor_node *node;
+
+	while (!dlist_empty(free_list)) {
+		dlist_pop_front(free_list, struct ofi_monitor_node,
+				node, free_entry);
+		free(node);
+	}
+}
+
+/*
+ * Nodes overlapping the new range are merged into a single node, so that
+ * the pages of different nodes never overlap.  Nodes are freed outside
+ * of the lock, since free() may itself be intercepted by the monitor.
+ */
+static int ofi_range_subscribe(struct ofi_mem_monitor *notifier,
+			       struct ofi_subscription *subscription)
+{
+	struct ofi_range_monitor *monitor =
+		container_of(notifier, struct ofi_range_monitor, monitor);
+	struct ofi_subscription *merged;
+	struct ofi_monitor_node *node, *old;
+	struct dlist_entry free_list;
+	RbtIterator iter;
+	uintptr_t end;
+	void *key;
+	int ret = 0;
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		return -FI_ENOMEM;
+
+	ofi_monitor_page_align(&node->iov, subscription->iov.iov_base,
+			       subscription->iov.iov_len);
+	dlist_init(&node->subscription_list);
+	dlist_init(&free_list);
+
+	pthread_mutex_lock(&monitor->lock);
+	if (monitor->add_range) {
+		ret = monitor->add_range(monitor, node->iov.iov_base,
+					 node->iov.iov_len);
+		if (ret) {
+			dlist_insert_tail(&node->free_entry, &free_list);
+			goto unlock;
+		}
+	}
+
+	while ((iter = rbtFind(monitor->ranges, &node->iov))) {
+		rbtKeyValue(monitor->ranges, iter, &key, (void **) &old);
+		rbtErase(monitor->ranges, iter);
+
+		end = MAX((uintptr_t) ofi_iov_end(&node->iov),
+			  (uintptr_t) ofi_iov_end(&old->iov));
+		node->iov.iov_base = MIN(node->iov.iov_base, old->iov.iov_base);
+		node->iov.iov_len = end - (uintptr_t) node->iov.iov_base;
+		dlist_splice_tail(&node->subscription_list,
+				  &old->subscription_list);
+		dlist_insert_tail(&old->free_entry, &free_list);
+	}
+
+	if (rbtInsert(monitor->ranges, &node->iov, node) != RBT_STATUS_OK) {
+		/* subscriptions taken from merged nodes are no longer
+		 * tracked, so report them as invalid */
+		while (!dlist_empty(&node->subscription_list)) {
+			dlist_pop_front(&node->subscription_list,
+					struct ofi_subscription, merged,
+					monitor_entry);
+			dlist_init(&merged->monitor_entry);
+			ofi_monitor_add_event_to_nq(merged);
+		}
+		dlist_insert_tail(&node->free_entry, &free_list);
+		ret = -FI_ENOMEM;
+		goto unlock;
+	}
+	dlist_insert_tail(&subscription->monitor_entry,
+			  &node->subscription_list);
+unlock:
+	pthread_mutex_unlock(&monitor->lock);
+	ofi_monitor_free_nodes(&free_list);
+	return ret;
+}
+
+static void ofi_range_unsubscribe(struct ofi_mem_monitor *notifier,
+				  struct ofi_subscription *subscription)
+{
+	struct ofi_range_monitor *monitor =
+		container_of(notifier, struct ofi_range_monitor, monitor);
+	struct ofi_monitor_node *node = NULL;
+	RbtIterator iter;
+	struct iovec iov;
+	void *key;
+
+	ofi_monitor_page_align(&iov, subscription->iov.iov_base,
+			       subscription->iov.iov_len);
+
+	pthread_mutex_lock(&monitor->lock);
+	if (dlist_empty(&subscription->monitor_entry))
+		goto unlock;
+
+	iter = rbtFind(monitor->ranges, &iov);
+	assert(iter);
+	rbtKeyValue(monitor->ranges, iter, &key, (void **) &node);
+	dlist_remove_init(&subscription->monitor_entry);
+
+	if (dlist_empty(&node->subscription_list)) {
+		rbtErase(monitor->ranges, iter);
+		if (monitor->del_range)
+			monitor->del_range(monitor, node->iov.iov_base,
+					   node->iov.iov_len);
+	} else {
+		node = NULL;
+	}
+unlock:
+	pthread_mutex_unlock(&monitor->lock);
+	free(node);
+}
+
+void ofi_monitor_notify(struct ofi_range_monitor *monitor,
+			const void *addr, size_t len)
+{
+	struct ofi_subscription *subscription;
+	struct ofi_monitor_node *node;
+	struct iovec iov = {
+		.iov_base = (void *) addr,
+		.iov_len = len,
+	};
+	RbtIterator iter;
+	void *key;
+
+	if (!len)
+		return;
+
+	pthread_mutex_lock(&monitor->lock);
+	for (iter = rbtFindLeftmost(monitor->ranges, &iov,
+				    ofi_monitor_range_cmp);
+	     iter; iter = rbtNext(monitor->ranges, iter)) {
+		rbtKeyValue(monitor->ranges, iter, &key, (void **) &node);
+		if (ofi_monitor_range_cmp(&iov, &node->iov))
+			break;
+
+		dlist_foreach_container(&node->subscription_list,
+					struct ofi_subscription,
+					subscription, monitor_entry)
+			ofi_monitor_add_event_to_nq(subscription);
+	}
+	pthread_mutex_unlock(&monitor->lock);
+}
+
+int ofi_range_monitor_init(struct ofi_range_monitor *monitor)
+{
+#ifndef _WIN32
+	pthread_mutexattr_t attr;
+#endif
+	int ret;
+
+	if (!ofi_monitor_page_size)
+		ofi_monitor_page_size = ofi_sysconf(_SC_PAGESIZE);
+
+	monitor->ranges = rbtNew(ofi_monitor_range_cmp);
+	if (!monitor->ranges)
+		return -FI_ENOMEM;
+
+	/* intercepted calls may be made while the lock is held */
+#ifndef _WIN32
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	ret = pthread_mutex_init(&monitor->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+#else
+	ret = pthread_mutex_init(&monitor->lock, NULL);
+#endif
+	if (ret) {
+		rbtDelete(monitor->ranges);
+		return -ret;
+	}
+
+	ofi_monitor_init(&monitor->monitor);
+	monitor->monitor.subscribe = ofi_range_subscribe;
+	monitor->monitor.unsubscribe = ofi_range_unsubscribe;
+	return 0;
+}
+
+void ofi_range_monitor_cleanup(struct ofi_range_monitor *monitor)
+{
+	ofi_monitor_cleanup(&monitor->monitor);
+	rbtDelete(monitor->ranges);
+	pthread_mutex_destroy(&monitor->lock);
+}
+
+
+/*
+ * userfaultfd monitor
+ *
+ * Subscribed pages are registered for missing page faults, which is the
+ * mode required to receive unmap, remove (madvise) and remap events.
+ * Released pages are unregistered as soon as the event is read.  Faults
+ * that still hit them are resolved with the zero page, as the kernel
+ * would have done without the registration.
+ *
+ * Unprivileged processes can only create a userfaultfd that handles
+ * faults raised in user mode (Linux 5.11 and later), unless the
+ * vm.unprivileged_userfaultfd sysctl is set.  Faults from system calls
+ * on registered pages then fail with EFAULT, which is why released
+ * pages are unregistered right away.
+ */
+#if HAVE_UFFD_UNMAP
+
+static struct {
+	struct ofi_range_monitor	monitor;
+	pthread_t			thread;
+	struct fd_signal		signal;
+	int				fd;
+} uffd;
+
+static int ofi_uffd_add_range(struct ofi_range_monitor *monitor,
+			      void *addr, size_t len)
+{
+	struct uffdio_register reg;
+
+	reg.range.start = (uintptr_t) addr;
+	reg.range.len = len;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(uffd.fd, UFFDIO_REGISTER, &reg)) {
+		FI_DBG(&core_prov, FI_LOG_MR,
+		       "uffd register %p (len: %zu) failed: %s\n",
+		       addr, len, strerror(errno));
+		return -errno;
+	}
+	return 0;
+}
+
+static void ofi_uffd_del_range(struct ofi_range_monitor *monitor,
+			       void *addr, size_t len)
+{
+	struct uffdio_range range;
+
+	/* fails harmlessly if the range was unmapped */
+	range.start = (uintptr_t) addr;
+	range.len = len;
+	(void) ioctl(uffd.fd, UFFDIO_UNREGISTER, &range);
+}
+
+static void ofi_uffd_pagefault(struct uffd_msg *msg)
+{
+	struct uffdio_zeropage zero;
+
+	zero.range.start = msg->arg.pagefault.address &
+			   ~((uint64_t) ofi_monitor_page_size - 1);
+	zero.range.len = ofi_monitor_page_size;
+	zero.mode = 0;
+	if (!ioctl(uffd.fd, UFFDIO_ZEROPAGE, &zero))
+		return;
+
+	if (errno == EEXIST) {
+		(void) ioctl(uffd.fd, UFFDIO_WAKE, &zero.range);
+		return;
+	}
+
+	/* e.g. huge pages: stop monitoring the range, which wakes the
+	 * faulting thread, and invalidate its subscriptions */
+	ofi_monitor_notify(&uffd.monitor, (void *) (uintptr_t)
+			   zero.range.start, ofi_monitor_page_size);
+	(void) ioctl(uffd.fd, UFFDIO_UNREGISTER, &zero.range);
+}
+
+static void *ofi_uffd_handler(void *arg)
+{
+	struct pollfd fds[2];
+	struct uffd_msg msg;
+	ssize_t ret;
+
+	fds[0].fd = uffd.fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = fd_signal_get(&uffd.signal);
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		ret = poll(fds, 2, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+
+		/* the thread that caused an event is released once the
+		 * event is read, so read before taking any lock */
+		ret = read(uffd.fd, &msg, sizeof(msg));
+		if (ret != sizeof(msg)) {
+			if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			break;
+		}
+
+		switch (msg.event) {
+		case UFFD_EVENT_PAGEFAULT:
+			ofi_uffd_pagefault(&msg);
+			break;
+		case UFFD_EVENT_REMOVE:
+			ofi_monitor_notify(&uffd.monitor,
+				(void *) (uintptr_t) msg.arg.remove.start,
+				(size_t) (msg.arg.remove.end -
+					  msg.arg.remove.start));
+			ofi_uffd_del_range(&uffd.monitor,
+				(void *) (uintptr_t) msg.arg.remove.start,
+				(size_t) (msg.arg.remove.end -
+					  msg.arg.remove.start));
+			break;
+		case UFFD_EVENT_UNMAP:
+			ofi_monitor_notify(&uffd.monitor,
+				(void *) (uintptr_t) msg.arg.remove.start,
+				(size_t) (msg.arg.remove.end -
+					  msg.arg.remove.start));
+			break;
+		case UFFD_EVENT_REMAP:
+			ofi_monitor_notify(&uffd.monitor,
+				(void *) (uintptr_t) msg.arg.remap.from,
+				(size_t) msg.arg.remap.len);
+			break;
+		default:
+			FI_WARN(&core_prov, FI_LOG_MR,
+				"Unhandled uffd event %d\n", msg.event);
+			break;
+		}
+	}
+	return arg;
+}
+
+static int ofi_uffd_start(struct ofi_mem_monitor *notifier)
+{
+	struct uffdio_api api;
+	int ret;
+
+	uffd.fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd.fd < 0 && errno == EPERM)
+		uffd.fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK |
+				  UFFD_USER_MODE_ONLY);
+	if (uffd.fd < 0) {
+		ret = -errno;
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Unable to create userfaultfd: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_EVENT_UNMAP | UFFD_FEATURE_EVENT_REMOVE |
+		       UFFD_FEATURE_EVENT_REMAP;
+	if (ioctl(uffd.fd, UFFDIO_API, &api)) {
+		ret = -errno;
+		goto err1;
+	}
+
+	ret = fd_signal_init(&uffd.signal);
+	if (ret)
+		goto err1;
+
+	ret = pthread_create(&uffd.thread, NULL, ofi_uffd_handler, NULL);
+	if (ret) {
+		ret = -ret;
+		goto err2;
+	}
+	return 0;
+err2:
+	fd_signal_free(&uffd.signal);
+err1:
+	close(uffd.fd);
+	uffd.fd = -1;
+	return ret;
+}
+
+static void ofi_uffd_stop(struct ofi_mem_monitor *notifier)
+{
+	fd_signal_set(&uffd.signal);
+	pthread_join(uffd.thread, NULL);
+	fd_signal_free(&uffd.signal);
+	close(uffd.fd);
+	uffd.fd = -1;
+}
+
+static void ofi_uffd_init(void)
+{
+	uffd.fd = -1;
+	if (ofi_range_monitor_init(&uffd.monitor))
+		return;
+
+	uffd.monitor.monitor.start = ofi_uffd_start;
+	uffd.monitor.monitor.stop = ofi_uffd_stop;
+	uffd.monitor.add_range = ofi_uffd_add_range;
+	uffd.monitor.del_range = ofi_uffd_del_range;
+	uffd_monitor = &uffd.monitor.monitor;
+}
+
+static void ofi_uffd_cleanup(void)
+{
+	if (!uffd_monitor)
+		return;
+
+	if (uffd.fd >= 0)
+		ofi_uffd_stop(uffd_monitor);
+	ofi_range_monitor_cleanup(&uffd.monitor);
+	uffd_monitor = NULL;
+}
+
+#else /* HAVE_UFFD_UNMAP */
+
+static void ofi_uffd_init(void)
+{
+}
+
+static void ofi_uffd_cleanup(void)
+{
+}
+
+#endif /* HAVE_UFFD_UNMAP */
+
+void ofi_monitors_init(void)
+{
+	char *name = NULL;
+
+	fi_param_define(NULL, "mr_cache_monitor", FI_PARAM_STRING,
+			"Define the monitor used by memory registration caches"
+			" to detect memory that is freed or unmapped: memhooks,"
+			" userfaultfd or disabled.  memhooks patches libc and"
+			" is only used if requested (default: userfaultfd)");
+	fi_param_get_str(NULL, "mr_cache_monitor", &name);
+
+	if (name && !strcasecmp(name, "memhooks"))
+		ofi_memhooks_init();
+	ofi_uffd_init();
+
+	if (!name || !strcasecmp(name, "userfaultfd")) {
+		default_monitor = uffd_monitor;
+	} else if (!strcasecmp(name, "memhooks")) {
+		default_monitor = memhooks_monitor;
+	} else if (!strcasecmp(name, "disabled")) {
+		default_monitor = NULL;
+	} else {
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Unknown memory monitor %s\n", name);
+		default_monitor = uffd_monitor;
+	}
+
+	if (name && strcasecmp(name, "disabled") && !default_monitor)
+		FI_WARN(&core_prov, FI_LOG_MR,
+			"Memory monitor %s is not available\n", name);
+}
+
+void ofi_monitors_cleanup(void)
+{
+	default_monitor = NULL;
+	ofi_uffd_cleanup();
+	ofi_memhooks_cleanup();
+}
@@ -38,6 +38,10 @@
 #include <ofi_mr.h>
 #include <ofi_list.h>
 
+/* Bounds the nodes visited by a lockless find, which may run while the
+ * tree is being rebalanced.  A valid AVL tree is far shallower. */
+#define OFI_MR_ITREE_MAX_DEPTH	128
+
 static int util_mr_find_within(void *a, void *b)
 {
 	struct iovec *iov1 = a, *iov2 = b;
@@ -62,13 +66,52 @@ static int util_mr_find_overlap(void *a, void *b)
 		return 0;
 }
 
+static void util_mr_entry_init(void *pool_ctx, void *buf)
+{
+	struct ofi_mr_entry *entry = buf;
+
+	ofi_atomic_initialize32(&entry->use_cnt, 0);
+}
+
+/* Takes a reference on an entry that may be freed concurrently */
+static int util_mr_entry_tryget(struct ofi_mr_entry *entry)
+{
+	int32_t cnt;
+
+	do {
+		cnt = ofi_atomic_get32(&entry->use_cnt);
+		if (!cnt)
+			return 0;
+	} while (!ofi_atomic_cas_bool32(&entry->use_cnt, cnt, cnt + 1));
+	return 1;
+}
+
+static int util_mr_storage_insert(struct ofi_mr_cache *cache,
+				  struct ofi_mr_entry *entry)
+{
+	int ret;
+
+	ofi_atomic_inc32(&cache->seq);
+	ret = cache->mr_storage.insert(&cache->mr_storage, &entry->iov, entry);
+	ofi_atomic_inc32(&cache->seq);
+	return ret;
+}
+
+static void util_mr_storage_erase(struct ofi_mr_cache *cache,
+				  struct ofi_mr_entry *entry)
+{
+	ofi_atomic_inc32(&cache->seq);
+	cache->mr_storage.erase(&cache->mr_storage, entry);
+	ofi_atomic_inc32(&cache->seq);
+}
+
 static void util_mr_free_entry(struct ofi_mr_cache *cache,
 			       struct ofi_mr_entry *entry)
 {
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "free %p (len: %" PRIu64 ")\n",
 	       entry->iov.iov_base, entry->iov.iov_len);
 
-	assert(!entry->cached);
+	assert(!entry->cached && !ofi_atomic_get32(&entry->use_cnt));
 	if (entry->subscribed) {
 		ofi_monitor_unsubscribe(&entry->subscription);
 		entry->subscribed = 0;
@@ -78,18 +121,27 @@ static void util_mr_free_entry(struct ofi_mr_cache *cache,
 	       (((ssize_t)cache->cached_size - (ssize_t)entry->iov.iov_len) >= 0));
 	cache->cached_cnt--;
 	cache->cached_size -= entry->iov.iov_len;
-	
+
 	util_buf_release(cache->entry_pool, entry);
 }
 
+/* The caller takes over the reference held by the cache */
 static void util_mr_uncache_entry(struct ofi_mr_cache *cache,
 				  struct ofi_mr_entry *entry)
 {
 	assert(entry->cached);
-	cache->mr_storage.erase(&cache->mr_storage, entry);
+	util_mr_storage_erase(cache, entry);
+	dlist_remove_init(&entry->lru_entry);
 	entry->cached = 0;
 }
 
+static void util_mr_put_entry(struct ofi_mr_cache *cache,
+			      struct ofi_mr_entry *entry)
+{
+	if (!ofi_atomic_dec32(&entry->use_cnt))
+		util_mr_free_entry(cache, entry);
+}
+
 static void
 util_mr_cache_process_events(struct ofi_mr_cache *cache)
 {
@@ -99,105 +151,146 @@ util_mr_cache_process_events(struct ofi_mr_cache *cache)
 	while ((subscription = ofi_monitor_get_event(&cache->nq))) {
 		entry = container_of(subscription, struct ofi_mr_entry,
 				     subscription);
-		if (entry->cached)
-			util_mr_uncache_entry(cache, entry);
+		if (!entry->cached)
+			continue;
+
+		util_mr_uncache_entry(cache, entry);
+		cache->invalidate_cnt++;
+		util_mr_put_entry(cache, entry);
+	}
+}
 
-		if (entry->use_cnt == 0) {
-			dlist_remove_init(&entry->lru_entry);
-			util_mr_free_entry(cache, entry);
+/*
+ * Clock eviction: the hand is the head of the LRU list.  Entries that
+ * were hit since the last pass, or are in use, are moved to the tail.
+ */
+static bool util_mr_cache_flush(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_entry *entry;
+	size_t cnt;
+
+	for (cnt = 2 * cache->cached_cnt;
+	     cnt && !dlist_empty(&cache->lru_list); cnt--) {
+		entry = container_of(cache->lru_list.next, struct ofi_mr_entry,
+				     lru_entry);
+		dlist_remove(&entry->lru_entry);
+		dlist_insert_tail(&entry->lru_entry, &cache->lru_list);
+
+		if (entry->referenced) {
+			entry->referenced = 0;
+			continue;
 		}
+
+		/* only the cache's reference left: claim it, so that
+		 * lockless searches can no longer take the entry */
+		if (!ofi_atomic_cas_bool32(&entry->use_cnt, 1, 0))
+			continue;
+
+		FI_DBG(cache->domain->prov, FI_LOG_MR,
+		       "flush %p (len: %" PRIu64 ")\n",
+		       entry->iov.iov_base, entry->iov.iov_len);
+		util_mr_uncache_entry(cache, entry);
+		cache->evict_cnt++;
+		util_mr_free_entry(cache, entry);
+		return true;
 	}
+	return false;
 }
 
 bool ofi_mr_cache_flush(struct ofi_mr_cache *cache)
 {
-	struct ofi_mr_entry *entry;
+	bool ret;
 
-	if (dlist_empty(&cache->lru_list))
-		return false;
+	fastlock_acquire(&cache->lock);
+	util_mr_cache_process_events(cache);
+	ret = util_mr_cache_flush(cache);
+	fastlock_release(&cache->lock);
+	return ret;
+}
 
-	dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
-			entry, lru_entry);
-	dlist_init(&entry->lru_entry);
-	FI_DBG(cache->domain->prov, FI_LOG_MR, "flush %p (len: %" PRIu64 ")\n",
-	       entry->iov.iov_base, entry->iov.iov_len);
+/* The entry may be freed by another thread once we drop our reference,
+ * unless it was the last one */
+static void util_mr_cache_release(struct ofi_mr_cache *cache,
+				  struct ofi_mr_entry *entry)
+{
+	if (ofi_atomic_dec32(&entry->use_cnt)) {
+		if (!dlist_empty(&cache->nq.list)) {
+			fastlock_acquire(&cache->lock);
+			util_mr_cache_process_events(cache);
+			fastlock_release(&cache->lock);
+		}
+		return;
+	}
 
-	util_mr_uncache_entry(cache, entry);
+	fastlock_acquire(&cache->lock);
 	util_mr_free_entry(cache, entry);
-	return true;
+	util_mr_cache_process_events(cache);
+	fastlock_release(&cache->lock);
 }
 
 void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 {
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "delete %p (len: %" PRIu64 ")\n",
 	       entry->iov.iov_base, entry->iov.iov_len);
-	cache->delete_cnt++;
-
-	util_mr_cache_process_events(cache);
-
-	if (--entry->use_cnt == 0) {
-		if (entry->cached) {
-			dlist_insert_tail(&entry->lru_entry, &cache->lru_list);
-		} else {
-			util_mr_free_entry(cache, entry);
-		}
-	}
+	ofi_atomic_inc64(&cache->delete_cnt);
+	util_mr_cache_release(cache, entry);
 }
 
 static int
 util_mr_cache_create(struct ofi_mr_cache *cache, const struct iovec *iov,
-		     uint64_t access, struct ofi_mr_entry **entry)
+		     uint64_t access, bool cache_entry,
+		     struct ofi_mr_entry **entry)
 {
 	int ret;
 
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "create %p (len: %" PRIu64 ")\n",
 	       iov->iov_base, iov->iov_len);
 
-	util_mr_cache_process_events(cache);
-
 	*entry = util_buf_alloc(cache->entry_pool);
 	if (OFI_UNLIKELY(!*entry))
 		return -FI_ENOMEM;
 
+	/* use_cnt stays 0 until the entry is registered, so stale
+	 * lockless searches can't take a reference on it */
 	(*entry)->iov = *iov;
-	(*entry)->use_cnt = 1;
+	(*entry)->access = access;
+	(*entry)->cached = 0;
+	(*entry)->subscribed = 0;
+	(*entry)->referenced = 0;
+	dlist_init(&(*entry)->lru_entry);
 
 	ret = cache->add_region(cache, *entry);
+	while (ret && util_mr_cache_flush(cache))
+		ret = cache->add_region(cache, *entry);
 	if (ret) {
-		while (ret && ofi_mr_cache_flush(cache)) {
-			ret = cache->add_region(cache, *entry);
-		}
-		if (ret) {
-			assert(!ofi_mr_cache_flush(cache));
-			util_buf_release(cache->entry_pool, *entry);
-			return ret;
-		}
+		util_buf_release(cache->entry_pool, *entry);
+		return ret;
 	}
+	ofi_atomic_inc32(&(*entry)->use_cnt);
 
+	/* the entry is freed on the last delete if it isn't cached */
 	cache->cached_size += iov->iov_len;
 	if ((++cache->cached_cnt > cache->max_cached_cnt) ||
-	    (cache->cached_size > cache->max_cached_size)) {
-		(*entry)->cached = 0;
-	} else {
-		if (cache->mr_storage.insert(&cache->mr_storage,
-					     &(*entry)->iov, *entry)) {
-			ret = -FI_ENOMEM;
-			goto err;
-		}
-		(*entry)->cached = 1;
+	    (cache->cached_size > cache->max_cached_size) || !cache_entry)
+		return 0;
 
-		ret = ofi_monitor_subscribe(&cache->nq, iov->iov_base, iov->iov_len,
-					    &(*entry)->subscription);
-		if (ret)
-			goto err;
-		(*entry)->subscribed = 1;
-	}
+	if (util_mr_storage_insert(cache, *entry))
+		return 0;
 
-	return 0;
+	ofi_atomic_inc32(&(*entry)->use_cnt);
+	(*entry)->cached = 1;
+	dlist_insert_tail(&(*entry)->lru_entry, &cache->lru_list);
 
-err:
-	util_mr_free_entry(cache, *entry);
-	return ret;
+	ret = ofi_monitor_subscribe(&cache->nq, iov->iov_base, iov->iov_len,
+				    &(*entry)->subscription);
+	if (ret) {
+		/* the range can't be monitored, so don't keep it */
+		util_mr_uncache_entry(cache, *entry);
+		ofi_atomic_dec32(&(*entry)->use_cnt);
+		return 0;
+	}
+	(*entry)->subscribed = 1;
+	return 0;
 }
 
 static int
@@ -227,75 +320,158 @@ util_mr_cache_merge(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 			ofi_monitor_unsubscribe(&old_entry->subscription);
 			old_entry->subscribed = 0;
 		}
-		cache->mr_storage.erase(&cache->mr_storage, old_entry);
-		old_entry->cached = 0;
-
-		if (old_entry->use_cnt == 0) {
-			dlist_remove_init(&old_entry->lru_entry);
-			util_mr_free_entry(cache, old_entry); 
-		}
+		util_mr_uncache_entry(cache, old_entry);
+		util_mr_put_entry(cache, old_entry);
 
 	} while ((old_entry = cache->mr_storage.find(&cache->mr_storage, &iov)));
 
-	return util_mr_cache_create(cache, &iov, attr->access, entry);
+	return util_mr_cache_create(cache, &iov, attr->access, true, entry);
+}
+
+static inline bool
+util_mr_entry_match(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
+		    struct ofi_mr_entry *entry)
+{
+	return ofi_iov_within(attr->mr_iov, &entry->iov) &&
+	       (!cache->match_access || (entry->access == attr->access));
+}
+
+static int
+util_mr_cache_search_lockless(struct ofi_mr_cache *cache,
+			      const struct fi_mr_attr *attr,
+			      struct ofi_mr_entry **entry)
+{
+#ifdef ofi_atomic_fence
+	struct ofi_mr_entry *found;
+	int32_t seq;
+
+	/* pending invalidations must be processed before a hit */
+	if (!cache->mr_storage.lockless_find || !dlist_empty(&cache->nq.list))
+		return 0;
+
+	seq = ofi_atomic_get32(&cache->seq);
+	if (seq & 1)
+		return 0;
+
+	found = cache->mr_storage.find(&cache->mr_storage, attr->mr_iov);
+	ofi_atomic_fence();
+	if (!found || (ofi_atomic_get32(&cache->seq) != seq))
+		return 0;
+
+	/* The entry may have been freed, or even reused for another
+	 * region, since it was found.  Once we hold a reference it can't
+	 * change, so check that it still covers the region. */
+	if (!util_mr_entry_tryget(found))
+		return 0;
+
+	ofi_atomic_fence();
+	if (!found->cached || !util_mr_entry_match(cache, attr, found)) {
+		util_mr_cache_release(cache, found);
+		return 0;
+	}
+
+	if (!found->referenced)
+		found->referenced = 1;
+	ofi_atomic_inc64(&cache->hit_cnt);
+	*entry = found;
+	return 1;
+#else
+	return 0;
+#endif
 }
 
 int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 			struct ofi_mr_entry **entry)
 {
-	util_mr_cache_process_events(cache);
+	int ret = 0;
 
 	assert(attr->iov_count == 1);
 	FI_DBG(cache->domain->prov, FI_LOG_MR, "search %p (len: %" PRIu64 ")\n",
 	       attr->mr_iov->iov_base, attr->mr_iov->iov_len);
-	cache->search_cnt++;
+
+	if (util_mr_cache_search_lockless(cache, attr, entry))
+		return 0;
+
+	fastlock_acquire(&cache->lock);
+	util_mr_cache_process_events(cache);
 
 	while (((cache->cached_cnt >= cache->max_cached_cnt) ||
 		(cache->cached_size >= cache->max_cached_size)) &&
-	       ofi_mr_cache_flush(cache))
+	       util_mr_cache_flush(cache))
 		;
 
 	*entry = cache->mr_storage.find(&cache->mr_storage, attr->mr_iov);
 	if (!*entry) {
-		return util_mr_cache_create(cache, attr->mr_iov,
-					    attr->access, entry);
+		cache->miss_cnt++;
+		ret = util_mr_cache_create(cache, attr->mr_iov,
+					   attr->access, true, entry);
+	} else if (!ofi_iov_within(attr->mr_iov, &(*entry)->iov)) {
+		/* This branch is always false if the merging entries
+		 * wasn't requested */
+		cache->miss_cnt++;
+		ret = util_mr_cache_merge(cache, attr, *entry, entry);
+	} else if (!util_mr_entry_match(cache, attr, *entry)) {
+		/* The region is cached with other access.  Caching both
+		 * would leave searches finding either one, so the new
+		 * entry is only used for this registration. */
+		cache->miss_cnt++;
+		ret = util_mr_cache_create(cache, attr->mr_iov,
+					   attr->access, false, entry);
+	} else {
+		ofi_atomic_inc64(&cache->hit_cnt);
+		ofi_atomic_inc32(&(*entry)->use_cnt);
+		(*entry)->referenced = 1;
 	}
+	fastlock_release(&cache->lock);
+	return ret;
+}
 
-	/* This branch is always false if the merging entries wasn't requested */
-	if (!ofi_iov_within(attr->mr_iov, &(*entry)->iov))
-		return util_mr_cache_merge(cache, attr, *entry, entry);
-
-	cache->hit_cnt++;
-	if ((*entry)->use_cnt++ == 0)
-		dlist_remove_init(&(*entry)->lru_entry);
-
-	return 0;
+void ofi_mr_cache_get_stats(struct ofi_mr_cache *cache,
+			    struct ofi_mr_cache_stats *stats)
+{
+	fastlock_acquire(&cache->lock);
+	stats->hit_cnt = (size_t) ofi_atomic_get64(&cache->hit_cnt);
+	stats->miss_cnt = cache->miss_cnt;
+	stats->search_cnt = stats->hit_cnt + stats->miss_cnt;
+	stats->delete_cnt = (size_t) ofi_atomic_get64(&cache->delete_cnt);
+	stats->evict_cnt = cache->evict_cnt;
+	stats->invalidate_cnt = cache->invalidate_cnt;
+	stats->cached_cnt = cache->cached_cnt;
+	stats->cached_size = cache->cached_size;
+	fastlock_release(&cache->lock);
 }
 
 void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 {
+	struct ofi_mr_cache_stats stats;
 	struct ofi_mr_entry *entry;
 	struct dlist_entry *tmp;
 
+	ofi_mr_cache_get_stats(cache, &stats);
 	FI_INFO(cache->domain->prov, FI_LOG_MR, "MR cache stats: "
-		"searches %zu, deletes %zu, hits %zu\n",
-		cache->search_cnt, cache->delete_cnt, cache->hit_cnt);
+		"searches %zu, deletes %zu, hits %zu, misses %zu, "
+		"evictions %zu, invalidations %zu\n",
+		stats.search_cnt, stats.delete_cnt, stats.hit_cnt,
+		stats.miss_cnt, stats.evict_cnt, stats.invalidate_cnt);
 
+	fastlock_acquire(&cache->lock);
 	util_mr_cache_process_events(cache);
 
 	dlist_foreach_container_safe(&cache->lru_list, struct ofi_mr_entry,
 				     entry, lru_entry, tmp) {
-		assert(entry->use_cnt == 0);
+		assert(ofi_atomic_get32(&entry->use_cnt) == 1);
 		util_mr_uncache_entry(cache, entry);
-		dlist_remove_init(&entry->lru_entry);
-		util_mr_free_entry(cache, entry);
+		util_mr_put_entry(cache, entry);
 	}
+	fastlock_release(&cache->lock);
+
 	cache->mr_storage.destroy(&cache->mr_storage);
 	ofi_monitor_del_queue(&cache->nq);
 	ofi_atomic_dec32(&cache->domain->ref);
 	util_buf_pool_destroy(cache->entry_pool);
 	assert(cache->cached_cnt == 0);
 	assert(cache->cached_size == 0);
+	fastlock_destroy(&cache->lock);
 }
 
 static void ofi_mr_rbt_storage_destroy(struct ofi_mr_storage *storage)
@@ -354,6 +530,275 @@ static int ofi_mr_cache_init_rbt_storage(struct ofi_mr_cache *cache)
 	cache->mr_storage.find = ofi_mr_rbt_storage_find;
 	cache->mr_storage.insert = ofi_mr_rbt_storage_insert;
 	cache->mr_storage.erase = ofi_mr_rbt_storage_erase;
+	cache->mr_storage.lockless_find = 0;
+	return 0;
+}
+
+/*
+ * Interval tree: an AVL tree ordered by region start, where each node
+ * also records the largest region end in its subtree.  Unlike the RB
+ * tree, it holds overlapping regions, and finds one covering (or, when
+ * merging, overlapping) the key in a single descent.
+ *
+ * Nodes come from a buffer pool that is only freed with the tree, and
+ * find reads each link once, so that it can run concurrently with
+ * updates.  Its result is only valid if no update ran meanwhile.
+ */
+struct ofi_mr_itree_node {
+	struct ofi_mr_itree_node	*left;
+	struct ofi_mr_itree_node	*right;
+	struct ofi_mr_entry		*entry;
+	uintptr_t			start;
+	uintptr_t			end;
+	uintptr_t			max_end;
+	int				height;
+};
+
+struct ofi_mr_itree {
+	struct ofi_mr_itree_node	*root;
+	struct util_buf_pool		*node_pool;
+	int				overlap;
+};
+
+#define ofi_mr_itree_read(ptr) (*(struct ofi_mr_itree_node * volatile *) &(ptr))
+
+static inline int ofi_mr_itree_height(struct ofi_mr_itree_node *node)
+{
+	return node ? node->height : 0;
+}
+
+static void ofi_mr_itree_update(struct ofi_mr_itree_node *node)
+{
+	node->height = MAX(ofi_mr_itree_height(node->left),
+			   ofi_mr_itree_height(node->right)) + 1;
+	node->max_end = node->end;
+	if (node->left && node->left->max_end > node->max_end)
+		node->max_end = node->left->max_end;
+	if (node->right && node->right->max_end > node->max_end)
+		node->max_end = node->right->max_end;
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_rotate_right(struct ofi_mr_itree_node *node)
+{
+	struct ofi_mr_itree_node *left = node->left;
+
+	node->left = left->right;
+	ofi_mr_itree_update(node);
+	left->right = node;
+	ofi_mr_itree_update(left);
+	return left;
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_rotate_left(struct ofi_mr_itree_node *node)
+{
+	struct ofi_mr_itree_node *right = node->right;
+
+	node->right = right->left;
+	ofi_mr_itree_update(node);
+	right->left = node;
+	ofi_mr_itree_update(right);
+	return right;
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_balance(struct ofi_mr_itree_node *node)
+{
+	int diff;
+
+	ofi_mr_itree_update(node);
+	diff = ofi_mr_itree_height(node->left) -
+	       ofi_mr_itree_height(node->right);
+	if (diff > 1) {
+		if (ofi_mr_itree_height(node->left->left) <
+		    ofi_mr_itree_height(node->left->right))
+			node->left = ofi_mr_itree_rotate_left(node->left);
+		return ofi_mr_itree_rotate_right(node);
+	} else if (diff < -1) {
+		if (ofi_mr_itree_height(node->right->right) <
+		    ofi_mr_itree_height(node->right->left))
+			node->right = ofi_mr_itree_rotate_right(node->right);
+		return ofi_mr_itree_rotate_left(node);
+	}
+	return node;
+}
+
+/* Orders by start, then end, then entry address, so that keys are unique */
+static int ofi_mr_itree_cmp(struct ofi_mr_itree_node *key,
+			    struct ofi_mr_itree_node *node)
+{
+	if (key->start != node->start)
+		return key->start < node->start ? -1 : 1;
+	if (key->end != node->end)
+		return key->end < node->end ? -1 : 1;
+	if (key->entry != node->entry)
+		return (uintptr_t) key->entry < (uintptr_t) node->entry ? -1 : 1;
+	return 0;
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_insert(struct ofi_mr_itree_node *root,
+		    struct ofi_mr_itree_node *node)
+{
+	if (!root)
+		return node;
+
+	if (ofi_mr_itree_cmp(node, root) < 0)
+		root->left = ofi_mr_itree_insert(root->left, node);
+	else
+		root->right = ofi_mr_itree_insert(root->right, node);
+	return ofi_mr_itree_balance(root);
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_remove_min(struct ofi_mr_itree_node *root,
+			struct ofi_mr_itree_node **min)
+{
+	if (!root->left) {
+		*min = root;
+		return root->right;
+	}
+	root->left = ofi_mr_itree_remove_min(root->left, min);
+	return ofi_mr_itree_balance(root);
+}
+
+static struct ofi_mr_itree_node *
+ofi_mr_itree_remove(struct ofi_mr_itree_node *root,
+		    struct ofi_mr_itree_node *key,
+		    struct ofi_mr_itree_node **found)
+{
+	struct ofi_mr_itree_node *min, *right;
+	int cmp;
+
+	if (!root)
+		return NULL;
+
+	cmp = ofi_mr_itree_cmp(key, root);
+	if (cmp < 0) {
+		root->left = ofi_mr_itree_remove(root->left, key, found);
+	} else if (cmp > 0) {
+		root->right = ofi_mr_itree_remove(root->right, key, found);
+	} else {
+		*found = root;
+		if (!root->right)
+			return root->left;
+
+		right = ofi_mr_itree_remove_min(root->right, &min);
+		min->right = right;
+		min->left = root->left;
+		return ofi_mr_itree_balance(min);
+	}
+	return ofi_mr_itree_balance(root);
+}
+
+static void ofi_mr_itree_storage_destroy(struct ofi_mr_storage *storage)
+{
+	struct ofi_mr_itree *tree = storage->storage;
+
+	util_buf_pool_destroy(tree->node_pool);
+	free(tree);
+}
+
+static struct ofi_mr_entry *
+ofi_mr_itree_storage_find(struct ofi_mr_storage *storage,
+			  const struct iovec *key)
+{
+	struct ofi_mr_itree *tree = storage->storage;
+	struct ofi_mr_itree_node *node, *left;
+	uintptr_t start, end;
+	int depth;
+
+	start = (uintptr_t) key->iov_base;
+	end = start + key->iov_len;
+	node = ofi_mr_itree_read(tree->root);
+
+	for (depth = 0; node && depth < OFI_MR_ITREE_MAX_DEPTH; depth++) {
+		left = ofi_mr_itree_read(node->left);
+		if (tree->overlap) {
+			if (node->start < end && node->end > start)
+				return node->entry;
+			node = (left && left->max_end > start) ?
+			       left : ofi_mr_itree_read(node->right);
+		} else {
+			if (node->start <= start && node->end >= end)
+				return node->entry;
+			/* Regions to the right all start after the key
+			 * if this one does.  Otherwise, regions to the left
+			 * all start before it, and one covers the key if
+			 * any of them extends past its end. */
+			node = ((node->start > start) ||
+				(left && left->max_end >= end)) ?
+			       left : ofi_mr_itree_read(node->right);
+		}
+	}
+	return NULL;
+}
+
+static int ofi_mr_itree_storage_insert(struct ofi_mr_storage *storage,
+				       struct iovec *key,
+				       struct ofi_mr_entry *entry)
+{
+	struct ofi_mr_itree *tree = storage->storage;
+	struct ofi_mr_itree_node *node;
+
+	node = util_buf_alloc(tree->node_pool);
+	if (!node)
+		return -FI_ENOMEM;
+
+	node->left = NULL;
+	node->right = NULL;
+	node->entry = entry;
+	node->start = (uintptr_t) entry->iov.iov_base;
+	node->end = node->start + entry->iov.iov_len;
+	node->max_end = node->end;
+	node->height = 1;
+
+	tree->root = ofi_mr_itree_insert(tree->root, node);
+	return 0;
+}
+
+static int ofi_mr_itree_storage_erase(struct ofi_mr_storage *storage,
+				      struct ofi_mr_entry *entry)
+{
+	struct ofi_mr_itree *tree = storage->storage;
+	struct ofi_mr_itree_node key, *found = NULL;
+
+	key.entry = entry;
+	key.start = (uintptr_t) entry->iov.iov_base;
+	key.end = key.start + entry->iov.iov_len;
+
+	tree->root = ofi_mr_itree_remove(tree->root, &key, &found);
+	if (!found)
+		return -FI_ENOENT;
+
+	util_buf_release(tree->node_pool, found);
+	return 0;
+}
+
+static int ofi_mr_cache_init_itree_storage(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_itree *tree;
+	int ret;
+
+	tree = calloc(1, sizeof(*tree));
+	if (!tree)
+		return -FI_ENOMEM;
+
+	ret = util_buf_pool_create(&tree->node_pool, sizeof(*tree->root),
+				   16, 0, 64);
+	if (ret) {
+		free(tree);
+		return ret;
+	}
+	tree->overlap = cache->merge_regions;
+
+	cache->mr_storage.storage = tree;
+	cache->mr_storage.destroy = ofi_mr_itree_storage_destroy;
+	cache->mr_storage.find = ofi_mr_itree_storage_find;
+	cache->mr_storage.insert = ofi_mr_itree_storage_insert;
+	cache->mr_storage.erase = ofi_mr_itree_storage_erase;
+	cache->mr_storage.lockless_find = 1;
 	return 0;
 }
 
@@ -361,6 +806,8 @@ static int ofi_mr_cache_init_storage(struct ofi_mr_cache *cache)
 {
 	switch (cache->mr_storage.type) {
 	case OFI_MR_STORAGE_DEFAULT:
+	case OFI_MR_STORAGE_INTERVAL:
+		return ofi_mr_cache_init_itree_storage(cache);
 	case OFI_MR_STORAGE_RBT:
 		return ofi_mr_cache_init_rbt_storage(cache);
 	case OFI_MR_STORAGE_USER:
@@ -377,8 +824,23 @@ int ofi_mr_cache_init(struct util_domain *domain,
 		      struct ofi_mem_monitor *monitor,
 		      struct ofi_mr_cache *cache)
 {
+	struct util_buf_attr attr = {
+		.size		= sizeof(struct ofi_mr_entry) +
+				  cache->entry_data_size,
+		.alignment	= 16,
+		.max_cnt	= 0,
+		.chunk_cnt	= cache->max_cached_cnt,
+		.init		= util_mr_entry_init,
+		.ctx		= cache,
+		.track_used	= 1,
+		.indexing	= {
+			.used		= 1,
+			.ordered	= 0,
+		},
+	};
 	int ret;
 	assert(cache->add_region && cache->delete_region);
+	assert(!(cache->merge_regions && cache->match_access));
 
 	ret = ofi_mr_cache_init_storage(cache);
 	if (ret)
@@ -387,27 +849,32 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	cache->domain = domain;
 	ofi_atomic_inc32(&domain->ref);
 
+	fastlock_init(&cache->lock);
+	ofi_atomic_initialize32(&cache->seq, 0);
 	dlist_init(&cache->lru_list);
 	cache->cached_cnt = 0;
 	cache->cached_size = 0;
 	if (!cache->max_cached_size)
 		cache->max_cached_size = SIZE_MAX;
-	cache->search_cnt = 0;
-	cache->delete_cnt = 0;
-	cache->hit_cnt = 0;
-	ofi_monitor_add_queue(monitor, &cache->nq);
-
-	ret = util_buf_pool_create(&cache->entry_pool,
-				   sizeof(struct ofi_mr_entry) +
-				   cache->entry_data_size,
-				   16, 0, cache->max_cached_cnt);
+	ofi_atomic_initialize64(&cache->hit_cnt, 0);
+	ofi_atomic_initialize64(&cache->delete_cnt, 0);
+	cache->miss_cnt = 0;
+	cache->evict_cnt = 0;
+	cache->invalidate_cnt = 0;
+	ret = ofi_monitor_add_queue(monitor, &cache->nq);
+	if (ret)
+		goto err1;
+
+	ret = util_buf_pool_create_attr(&attr, &cache->entry_pool);
 	if (ret)
-		goto err;
+		goto err2;
 
 	return 0;
-err:
-	ofi_atomic_dec32(&cache->domain->ref);
+err2:
 	ofi_monitor_del_queue(&cache->nq);
+err1:
+	fastlock_destroy(&cache->lock);
+	ofi_atomic_dec32(&cache->domain->ref);
 	cache->mr_storage.destroy(&cache->mr_storage);
 	return ret;
 }
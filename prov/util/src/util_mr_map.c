@@ -56,10 +56,52 @@ dup_mr_attr(const struct fi_mr_attr *attr)
 	return dup_attr;
 }
 
+static int ofi_mr_map_alloc_key(struct ofi_mr_map *map,
+				struct fi_mr_attr *item)
+{
+	int index;
+
+	/* once the indexer is full, keys are found through the RB tree */
+	index = ofi_idx_insert(&map->key_idx, item);
+	if (index < 0)
+		index = 0;
+
+	item->requested_key = (map->key++ << OFI_IDX_INDEX_BITS) | index;
+	if (!index && rbtInsert(map->rbtree, &item->requested_key, item))
+		return -FI_ENOMEM;
+
+	return 0;
+}
+
+static struct fi_mr_attr *
+ofi_mr_map_find(struct ofi_mr_map *map, uint64_t key)
+{
+	struct fi_mr_attr *attr;
+	void *itr, *key_ptr;
+	int index;
+
+	if (map->mode & FI_MR_PROV_KEY) {
+		index = (int) (key & OFI_MR_MAP_INDEX_MASK);
+		if (index) {
+			attr = ofi_idx_lookup(&map->key_idx, index);
+			return (attr && attr->requested_key == key) ?
+			       attr : NULL;
+		}
+	}
+
+	itr = rbtFind(map->rbtree, &key);
+	if (!itr)
+		return NULL;
+
+	rbtKeyValue(map->rbtree, itr, &key_ptr, (void **) &attr);
+	return attr;
+}
+
 int ofi_mr_map_insert(struct ofi_mr_map *map, const struct fi_mr_attr *attr,
 		      uint64_t *key, void *context)
 {
 	struct fi_mr_attr *item;
+	int ret;
 
 	item = dup_mr_attr(attr);
 	if (!item)
@@ -68,16 +110,23 @@ int ofi_mr_map_insert(struct ofi_mr_map *map, const struct fi_mr_attr *attr,
 	if (!(map->mode & FI_MR_VIRT_ADDR))
 		item->offset = (uintptr_t) attr->mr_iov[0].iov_base;
 
-	if (!(map->mode & FI_MR_PROV_KEY)) {
+	if (map->mode & FI_MR_PROV_KEY) {
+		ret = ofi_mr_map_alloc_key(map, item);
+		if (ret) {
+			free(item);
+			return ret;
+		}
+	} else {
 		if (rbtFind(map->rbtree, &item->requested_key)) {
 			free(item);
 			return -FI_ENOKEY;
 		}
-	} else {
-		item->requested_key = map->key++;
+		if (rbtInsert(map->rbtree, &item->requested_key, item)) {
+			free(item);
+			return -FI_ENOMEM;
+		}
 	}
 
-	rbtInsert(map->rbtree, &item->requested_key, item);
 	*key = item->requested_key;
 	item->context = context;
 
@@ -87,14 +136,9 @@ int ofi_mr_map_insert(struct ofi_mr_map *map, const struct fi_mr_attr *attr,
 void *ofi_mr_map_get(struct ofi_mr_map *map, uint64_t key)
 {
 	struct fi_mr_attr *attr;
-	void *itr, *key_ptr;
-
-	itr = rbtFind(map->rbtree, &key);
-	if (!itr)
-		return NULL;
 
-	rbtKeyValue(map->rbtree, itr, &key_ptr, (void **) &attr);
-	return attr->context;
+	attr = ofi_mr_map_find(map, key);
+	return attr ? attr->context : NULL;
 }
 
 int ofi_mr_map_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
@@ -102,15 +146,12 @@ int ofi_mr_map_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
 		      void **context)
 {
 	struct fi_mr_attr *attr;
-	void *itr, *key_ptr, *addr;
+	void *addr;
 
-	itr = rbtFind(map->rbtree, &key);
-	if (!itr)
+	attr = ofi_mr_map_find(map, key);
+	if (!attr)
 		return -FI_EINVAL;
 
-	rbtKeyValue(map->rbtree, itr, &key_ptr, (void **) &attr);
-	assert(attr);
-
 	if ((access & attr->access) != access) {
 		FI_DBG(map->prov, FI_LOG_MR, "verify_addr: invalid access\n");
 		return -FI_EACCES;
@@ -134,13 +175,24 @@ int ofi_mr_map_remove(struct ofi_mr_map *map, uint64_t key)
 {
 	struct fi_mr_attr *attr;
 	void *itr, *key_ptr;
+	int index;
 
-	itr = rbtFind(map->rbtree, &key);
-	if (!itr)
-		return -FI_ENOKEY;
+	index = (map->mode & FI_MR_PROV_KEY) ?
+		(int) (key & OFI_MR_MAP_INDEX_MASK) : 0;
+	if (index) {
+		attr = ofi_mr_map_find(map, key);
+		if (!attr)
+			return -FI_ENOKEY;
 
-	rbtKeyValue(map->rbtree, itr, &key_ptr, (void **) &attr);
-	rbtErase(map->rbtree, itr);
+		ofi_idx_remove(&map->key_idx, index);
+	} else {
+		itr = rbtFind(map->rbtree, &key);
+		if (!itr)
+			return -FI_ENOKEY;
+
+		rbtKeyValue(map->rbtree, itr, &key_ptr, (void **) &attr);
+		rbtErase(map->rbtree, itr);
+	}
 	free(attr);
 
 	return 0;
@@ -178,6 +230,7 @@ int ofi_mr_map_init(const struct fi_provider *prov, int mode,
 	}
 	map->prov = prov;
 	map->key = 1;
+	memset(&map->key_idx, 0, sizeof(map->key_idx));
 
 	return 0;
 }
@@ -185,6 +238,7 @@ int ofi_mr_map_init(const struct fi_provider *prov, int mode,
 void ofi_mr_map_close(struct ofi_mr_map *map)
 {
 	rbtDelete(map->rbtree);
+	ofi_idx_reset(&map->key_idx);
 }
 
 int ofi_mr_close(struct fid *fid)
@@ -194,11 +248,15 @@ int ofi_mr_close(struct fid *fid)
 
 	mr = container_of(fid, struct ofi_mr, mr_fid.fid);
 
-	fastlock_acquire(&mr->domain->lock);
-	ret = ofi_mr_map_remove(&mr->domain->mr_map, mr->key);
-	fastlock_release(&mr->domain->lock);
-	if (ret)
-		return ret;
+	if (mr->entry) {
+		ofi_mr_cache_delete(mr->domain->mr_cache, mr->entry);
+	} else {
+		fastlock_acquire(&mr->domain->lock);
+		ret = ofi_mr_map_remove(&mr->domain->mr_map, mr->key);
+		fastlock_release(&mr->domain->lock);
+		if (ret)
+			return ret;
+	}
 
 	ofi_atomic_dec32(&mr->domain->ref);
 	free(mr);
@@ -228,18 +286,29 @@ int ofi_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
 	if (!mr)
 		return -FI_ENOMEM;
 
-	fastlock_acquire(&domain->lock);
-
 	mr->mr_fid.fid.fclass = FI_CLASS_MR;
 	mr->mr_fid.fid.context = attr->context;
 	mr->mr_fid.fid.ops = &ofi_mr_fi_ops;
 	mr->domain = domain;
 	mr->flags = flags;
 
-	ret = ofi_mr_map_insert(&domain->mr_map, attr, &key, mr);
-	if (ret) {
-		free(mr);
-		goto out;
+	/* The cache registers regions itself, and takes the domain lock
+	 * to do so */
+	if (domain->mr_cache && attr->iov_count == 1 && !flags) {
+		ret = ofi_mr_cache_search(domain->mr_cache, attr, &mr->entry);
+		if (ret) {
+			free(mr);
+			return ret;
+		}
+		key = *(uint64_t *) mr->entry->data;
+	} else {
+		fastlock_acquire(&domain->lock);
+		ret = ofi_mr_map_insert(&domain->mr_map, attr, &key, mr);
+		fastlock_release(&domain->lock);
+		if (ret) {
+			free(mr);
+			return ret;
+		}
 	}
 
 	mr->mr_fid.key = mr->key = key;
@@ -247,10 +316,7 @@ int ofi_mr_regattr(struct fid *fid, const struct fi_mr_attr *attr,
 
 	*mr_fid = &mr->mr_fid;
 	ofi_atomic_inc32(&domain->ref);
-
-out:
-	fastlock_release(&domain->lock);
-	return ret;
+	return 0;
 }
 
 int ofi_mr_regv(struct fid *fid, const struct iovec *iov,
@@ -294,3 +360,87 @@ int ofi_mr_verify(struct ofi_mr_map *map, ssize_t len,
 	fastlock_release(&domain->lock);
 	return ret;
 }
+
+static int util_mr_cache_add_region(struct ofi_mr_cache *cache,
+				    struct ofi_mr_entry *entry)
+{
+	struct util_domain *domain = cache->domain;
+	struct fi_mr_attr attr = {
+		.mr_iov = &entry->iov,
+		.iov_count = 1,
+		.access = entry->access,
+	};
+	int ret;
+
+	fastlock_acquire(&domain->lock);
+	ret = ofi_mr_map_insert(&domain->mr_map, &attr,
+				(uint64_t *) entry->data, NULL);
+	fastlock_release(&domain->lock);
+	return ret;
+}
+
+static void util_mr_cache_delete_region(struct ofi_mr_cache *cache,
+					struct ofi_mr_entry *entry)
+{
+	struct util_domain *domain = cache->domain;
+
+	fastlock_acquire(&domain->lock);
+	(void) ofi_mr_map_remove(&domain->mr_map, *(uint64_t *) entry->data);
+	fastlock_release(&domain->lock);
+}
+
+/*
+ * Registrations through ofi_mr_regattr are cached when the provider
+ * selects its keys, so that a cached key can be handed out again.  Only
+ * virtual addressing is supported, since the offset of a region would
+ * otherwise be part of the key.  Called by providers whose MR ops are
+ * the util ones, after ofi_domain_init; ofi_domain_close cleans up.
+ */
+int ofi_mr_domain_cache_init(struct util_domain *domain)
+{
+	struct ofi_mr_cache *cache;
+	size_t max_cnt = 0, max_size = 0;
+	int ret;
+
+	if (!default_monitor ||
+	    (domain->mr_map.mode & (FI_MR_PROV_KEY | FI_MR_VIRT_ADDR)) !=
+	    (FI_MR_PROV_KEY | FI_MR_VIRT_ADDR))
+		return 0;
+
+	fi_param_get_size_t(NULL, "mr_cache_max_count", &max_cnt);
+	if (!max_cnt)
+		return 0;
+	fi_param_get_size_t(NULL, "mr_cache_max_size", &max_size);
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return -FI_ENOMEM;
+
+	cache->max_cached_cnt = max_cnt;
+	cache->max_cached_size = max_size;
+	cache->match_access = 1;
+	cache->entry_data_size = sizeof(uint64_t);
+	cache->add_region = util_mr_cache_add_region;
+	cache->delete_region = util_mr_cache_delete_region;
+	ret = ofi_mr_cache_init(domain, default_monitor, cache);
+	if (ret) {
+		FI_WARN(domain->prov, FI_LOG_MR,
+			"Unable to create MR cache, registrations are not "
+			"cached: %s\n", fi_strerror(-ret));
+		free(cache);
+		return 0;
+	}
+
+	domain->mr_cache = cache;
+	return 0;
+}
+
+void ofi_mr_domain_cache_cleanup(struct util_domain *domain)
+{
+	if (!domain->mr_cache)
+		return;
+
+	ofi_mr_cache_cleanup(domain->mr_cache);
+	free(domain->mr_cache);
+	domain->mr_cache = NULL;
+}
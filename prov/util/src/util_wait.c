@@ -275,7 +275,11 @@ static int util_wait_fd_run(struct fid_wait *wait_fid, int timeout)
 				return -FI_ETIMEDOUT;
 		}
 
+		/* task work queued by an io_uring interrupts the wait as a
+		 * signal would; the next try sees what it completed */
 		ret = fi_epoll_wait(wait->epoll_fd, ep_context, 1, timeout);
+		if (ret == -FI_EINTR)
+			continue;
 		if (ret < 0) {
 			FI_WARN(wait->util_wait.prov, FI_LOG_FABRIC,
 				"poll failed\n");
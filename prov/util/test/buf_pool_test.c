@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Checks util_buf_pool_trim on unordered and ordered pools: idle regions
+ * are freed while buffers in use elsewhere stay valid, the free lists
+ * no longer hand out trimmed buffers, and a region grown afterwards
+ * takes the freed slot so buffer indices stay dense.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ofi.h>
+#include <ofi_mem.h>
+
+#define CHUNK_CNT	16
+#define REGION_CNT	3
+#define BUF_CNT		(CHUNK_CNT * REGION_CNT)
+#define BUF_SIZE	64
+#define TRIM_IDLE_MS	10
+
+static int failed;
+static int region_cnt;
+
+#define check(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+			failed = 1;				\
+		}						\
+	} while (0)
+
+static int region_alloc(void *pool_ctx, void *addr, size_t len,
+			void **context)
+{
+	region_cnt++;
+	return 0;
+}
+
+static void region_free(void *pool_ctx, void *context)
+{
+	region_cnt--;
+}
+
+static struct util_buf_pool *create_pool(int ordered)
+{
+	struct util_buf_attr attr = {
+		.size		= BUF_SIZE,
+		.alignment	= 16,
+		.chunk_cnt	= CHUNK_CNT,
+		.alloc_hndlr	= region_alloc,
+		.free_hndlr	= region_free,
+		.track_used	= 1,
+		.trim_idle_ms	= TRIM_IDLE_MS,
+		.indexing	= {
+			.used		= 1,
+			.ordered	= (uint8_t) ordered,
+		},
+	};
+	struct util_buf_pool *pool;
+
+	if (util_buf_pool_create_attr(&attr, &pool))
+		return NULL;
+	return pool;
+}
+
+static void *buf_alloc(struct util_buf_pool *pool)
+{
+	return pool->attr.indexing.ordered ?
+	       util_buf_indexed_alloc(pool) : util_buf_alloc(pool);
+}
+
+static void buf_release(struct util_buf_pool *pool, void *buf)
+{
+	if (pool->attr.indexing.ordered)
+		util_buf_indexed_release(pool, buf);
+	else
+		util_buf_release(pool, buf);
+}
+
+static struct util_buf_region *buf_region(struct util_buf_pool *pool,
+					  void *buf)
+{
+	return util_buf_get_ftr(pool, buf)->region;
+}
+
+/* a region is freed on the third scan: one to clear active, one to mark
+ * it idle, and one to free it */
+static int trim_all(struct util_buf_pool *pool)
+{
+	int ret = 0;
+	uint64_t now;
+
+	for (now = 0; now <= 2 * TRIM_IDLE_MS; now += TRIM_IDLE_MS)
+		ret += util_buf_pool_trim(pool, now);
+	return ret;
+}
+
+/*
+ * Fills three regions and keeps one buffer of the middle one.  The
+ * other two regions must be freed, the kept buffer left untouched, and
+ * the free list must only hand out buffers of the middle region.
+ */
+static void test_trim_outstanding(int ordered)
+{
+	struct util_buf_pool_stats stats;
+	struct util_buf_region *kept_region;
+	struct util_buf_pool *pool;
+	void *bufs[BUF_CNT], *kept;
+	int i, ret;
+
+	pool = create_pool(ordered);
+	check(pool, "pool create failed");
+	if (!pool)
+		return;
+
+	for (i = 0; i < BUF_CNT; i++) {
+		bufs[i] = buf_alloc(pool);
+		check(bufs[i], "alloc %d failed", i);
+		if (!bufs[i])
+			goto out;
+	}
+	check(region_cnt == REGION_CNT, "%d regions allocated", region_cnt);
+
+	kept = bufs[CHUNK_CNT + CHUNK_CNT / 2];
+	kept_region = buf_region(pool, kept);
+	memset(kept, 0xa5, BUF_SIZE);
+	for (i = 0; i < BUF_CNT; i++) {
+		if (bufs[i] != kept)
+			buf_release(pool, bufs[i]);
+	}
+
+	ret = trim_all(pool);
+	check(ret == REGION_CNT - 1, "%d regions trimmed", ret);
+	check(region_cnt == 1, "%d regions left", region_cnt);
+
+	util_buf_pool_get_stats(pool, &stats);
+	check(stats.region_cnt == 1, "stats: %zu regions", stats.region_cnt);
+	check(stats.buf_cnt == CHUNK_CNT, "stats: %zu buffers", stats.buf_cnt);
+	check(stats.used_cnt == 1, "stats: %zu used", stats.used_cnt);
+	check(stats.trim_cnt == REGION_CNT - 1, "stats: %zu trimmed",
+	      stats.trim_cnt);
+
+	for (i = 0; i < BUF_SIZE; i++) {
+		if (((uint8_t *) kept)[i] != 0xa5)
+			break;
+	}
+	check(i == BUF_SIZE, "kept buffer changed at byte %d", i);
+
+	/* every free buffer must come from the region that is left */
+	for (i = 0; i < CHUNK_CNT - 1; i++) {
+		bufs[i] = buf_alloc(pool);
+		check(bufs[i] && buf_region(pool, bufs[i]) == kept_region,
+		      "buffer %d not from the kept region", i);
+		if (!bufs[i])
+			break;
+	}
+	while (i-- > 0)
+		buf_release(pool, bufs[i]);
+	buf_release(pool, kept);
+out:
+	util_buf_pool_destroy(pool);
+	check(region_cnt == 0, "%d regions leaked", region_cnt);
+}
+
+/*
+ * Trims the first of two regions, then grows the pool again.  The new
+ * region must reuse slot 0, so its buffers get the indices of the
+ * trimmed ones and util_buf_get_by_index finds them.
+ */
+static void test_trim_reuse(int ordered)
+{
+	struct util_buf_pool *pool;
+	void *bufs[2 * CHUNK_CNT];
+	size_t index;
+	int i, ret;
+
+	pool = create_pool(ordered);
+	check(pool, "pool create failed");
+	if (!pool)
+		return;
+
+	for (i = 0; i < 2 * CHUNK_CNT; i++) {
+		bufs[i] = buf_alloc(pool);
+		check(bufs[i], "alloc %d failed", i);
+		if (!bufs[i])
+			goto out;
+	}
+	for (i = 0; i < CHUNK_CNT; i++)
+		buf_release(pool, bufs[i]);
+
+	ret = trim_all(pool);
+	check(ret == 1, "%d regions trimmed", ret);
+	check(!pool->regions_table[0], "slot 0 still in use");
+
+	for (i = 0; i < CHUNK_CNT; i++) {
+		bufs[i] = buf_alloc(pool);
+		check(bufs[i], "alloc %d after trim failed", i);
+		if (!bufs[i])
+			goto out;
+
+		index = util_get_buf_index(pool, bufs[i]);
+		check(index < CHUNK_CNT, "buffer %d got index %zu", i, index);
+		check(util_buf_get_by_index(pool, index) == bufs[i],
+		      "index %zu maps to another buffer", index);
+	}
+	check(pool->regions_cnt == 2, "%zu region slots", pool->regions_cnt);
+	check(region_cnt == 2, "%d regions allocated", region_cnt);
+
+	for (i = 0; i < 2 * CHUNK_CNT; i++)
+		buf_release(pool, bufs[i]);
+out:
+	util_buf_pool_destroy(pool);
+	check(region_cnt == 0, "%d regions leaked", region_cnt);
+}
+
+int main(int argc, char **argv)
+{
+	int ordered;
+
+	for (ordered = 0; ordered <= 1; ordered++) {
+		test_trim_outstanding(ordered);
+		test_trim_reuse(ordered);
+		printf("%s pool: %s\n", ordered ? "ordered" : "unordered",
+		       failed ? "FAIL" : "PASS");
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
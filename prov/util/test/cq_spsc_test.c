@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks the lockless CQ used by tcp with progress threads at
+ * FI_THREAD_DOMAIN: completions written past a full ring queue behind
+ * it and are read in order, an injected error is reported by
+ * fi_cq_readerr only once everything written before it was read, and
+ * completions written after the error stay behind it.  The last test
+ * does the same with a writer thread racing the reader.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <ofi.h>
+#include <ofi_util.h>
+#include <rdma/fi_domain.h>
+
+#define TEST_SKIP	77
+#define CQ_SIZE		8
+#define RACE_CNT	200000
+#define RACE_ERR_EVERY	997
+
+static int failed;
+
+#define check(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+			failed = 1;				\
+		}						\
+	} while (0)
+
+/* contexts are sequence numbers, offset so none is NULL */
+#define seq_ctx(seq)	((void *) (uintptr_t) ((seq) + 1))
+#define ctx_seq(ctx)	((size_t) (uintptr_t) (ctx) - 1)
+
+static int write_comp(struct util_cq *cq, size_t seq)
+{
+	return ofi_cq_write(cq, seq_ctx(seq), FI_RECV, 0, NULL, 0, 0);
+}
+
+static int write_err(struct util_cq *cq, size_t seq)
+{
+	struct fi_cq_err_entry err_entry = {
+		.op_context = seq_ctx(seq),
+		.flags = FI_RECV,
+		.err = FI_EIO,
+		.prov_errno = -FI_EIO,
+	};
+
+	return ofi_cq_write_error(cq, &err_entry);
+}
+
+static size_t ring_cnt(struct util_cq *cq)
+{
+	return ofi_cirque_usedcnt(cq->cirq);
+}
+
+/* reads up to cnt completions, checking they continue from *seq */
+static ssize_t read_seq(struct fid_cq *cq, size_t cnt, size_t *seq)
+{
+	struct fi_cq_entry comp[CQ_SIZE];
+	ssize_t ret, i;
+
+	ret = fi_cq_read(cq, comp, MIN(cnt, CQ_SIZE));
+	for (i = 0; i < ret; i++, (*seq)++)
+		check(ctx_seq(comp[i].op_context) == *seq,
+		      "read %zu, expected %zu", ctx_seq(comp[i].op_context),
+		      *seq);
+	return ret;
+}
+
+static void read_err(struct fid_cq *cq, size_t *seq)
+{
+	struct fi_cq_err_entry err_entry = { 0 };
+	ssize_t ret;
+
+	ret = fi_cq_readerr(cq, &err_entry, 0);
+	check(ret == 1, "fi_cq_readerr returned %zd", ret);
+	if (ret != 1)
+		return;
+
+	check(err_entry.err == FI_EIO, "error %d", err_entry.err);
+	check(ctx_seq(err_entry.op_context) == *seq,
+	      "error for %zu, expected %zu", ctx_seq(err_entry.op_context),
+	      *seq);
+	(*seq)++;
+}
+
+static void test_overflow(struct fid_cq *cq_fid)
+{
+	struct util_cq *cq = container_of(cq_fid, struct util_cq, cq_fid);
+	size_t seq, cnt = CQ_SIZE + 4;
+	ssize_t ret;
+
+	for (seq = 0; seq < cnt; seq++)
+		check(!write_comp(cq, seq), "write %zu failed", seq);
+	check(ring_cnt(cq) == CQ_SIZE, "ring holds %zu", ring_cnt(cq));
+	check(ofi_atomic_get32(&cq->oflow_cnt) == 4,
+	      "%d queued on overflow", ofi_atomic_get32(&cq->oflow_cnt));
+
+	/* once a write overflows, later ones queue even with room left */
+	seq = 0;
+	ret = read_seq(cq_fid, 2, &seq);
+	check(ret == 2, "fi_cq_read returned %zd", ret);
+	check(!write_comp(cq, cnt), "write %zu failed", cnt);
+	check(ring_cnt(cq) == CQ_SIZE - 2, "ring holds %zu", ring_cnt(cq));
+
+	/* a read spanning the ring and the overflow queue keeps order */
+	while (seq <= cnt) {
+		ret = read_seq(cq_fid, CQ_SIZE, &seq);
+		check(ret > 0, "fi_cq_read returned %zd", ret);
+		if (ret <= 0)
+			break;
+	}
+	check(ofi_atomic_get32(&cq->oflow_cnt) == 0,
+	      "%d left on overflow", ofi_atomic_get32(&cq->oflow_cnt));
+
+	/* with the queue drained, writes go back to the ring */
+	check(!write_comp(cq, seq), "write %zu failed", seq);
+	check(ring_cnt(cq) == 1, "ring holds %zu", ring_cnt(cq));
+	ret = read_seq(cq_fid, CQ_SIZE, &seq);
+	check(ret == 1, "fi_cq_read returned %zd", ret);
+	ret = read_seq(cq_fid, CQ_SIZE, &seq);
+	check(ret == -FI_EAGAIN, "fi_cq_read on empty cq returned %zd", ret);
+}
+
+/* reads the completions up to the error at err_seq, then the error */
+static void read_to_err(struct fid_cq *cq, size_t *seq, size_t err_seq)
+{
+	struct fi_cq_err_entry err_entry = { 0 };
+	ssize_t ret;
+
+	while (*seq < err_seq) {
+		ret = read_seq(cq, CQ_SIZE, seq);
+		check(ret > 0, "fi_cq_read returned %zd", ret);
+		if (ret <= 0)
+			return;
+	}
+	check(*seq == err_seq, "read past the error to %zu", *seq);
+
+	ret = fi_cq_read(cq, &err_entry, 1);
+	check(ret == -FI_EAVAIL, "fi_cq_read at error returned %zd", ret);
+	read_err(cq, seq);
+	ret = fi_cq_readerr(cq, &err_entry, 0);
+	check(ret == -FI_EAGAIN, "second fi_cq_readerr returned %zd", ret);
+}
+
+static void test_error(struct fid_cq *cq_fid)
+{
+	struct util_cq *cq = container_of(cq_fid, struct util_cq, cq_fid);
+	struct fi_cq_err_entry err_entry = { 0 };
+	size_t seq, err_seq[2], end;
+	ssize_t ret;
+
+	/* an error right behind a full ring, then one behind overflows */
+	for (seq = 0; seq < CQ_SIZE; seq++)
+		check(!write_comp(cq, seq), "write %zu failed", seq);
+	err_seq[0] = seq++;
+	check(!write_err(cq, err_seq[0]), "write error failed");
+	for (; seq < err_seq[0] + 3; seq++)
+		check(!write_comp(cq, seq), "write %zu failed", seq);
+	err_seq[1] = seq++;
+	check(!write_err(cq, err_seq[1]), "write error failed");
+	for (end = seq + 2; seq < end; seq++)
+		check(!write_comp(cq, seq), "write %zu failed", seq);
+	check(ring_cnt(cq) == CQ_SIZE, "ring holds %zu", ring_cnt(cq));
+
+	/* completions written before the error come first */
+	ret = fi_cq_readerr(cq_fid, &err_entry, 0);
+	check(ret == -FI_EAGAIN, "fi_cq_readerr on full ring returned %zd",
+	      ret);
+
+	seq = 0;
+	read_to_err(cq_fid, &seq, err_seq[0]);
+	read_to_err(cq_fid, &seq, err_seq[1]);
+	while (seq < end) {
+		ret = read_seq(cq_fid, CQ_SIZE, &seq);
+		check(ret > 0, "fi_cq_read returned %zd", ret);
+		if (ret <= 0)
+			break;
+	}
+	check(ofi_atomic_get32(&cq->oflow_cnt) == 0,
+	      "%d left on overflow", ofi_atomic_get32(&cq->oflow_cnt));
+	check(ring_cnt(cq) == 0, "ring holds %zu", ring_cnt(cq));
+}
+
+static void *race_writer(void *arg)
+{
+	struct util_cq *cq = arg;
+	size_t seq;
+	int ret;
+
+	for (seq = 0; seq < RACE_CNT; seq++) {
+		if (seq % RACE_ERR_EVERY == RACE_ERR_EVERY - 1)
+			ret = write_err(cq, seq);
+		else
+			ret = write_comp(cq, seq);
+		if (ret) {
+			printf("FAIL %s: write %zu failed: %d\n", __func__,
+			       seq, ret);
+			failed = 1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void test_race(struct fid_cq *cq_fid)
+{
+	struct util_cq *cq = container_of(cq_fid, struct util_cq, cq_fid);
+	pthread_t thread;
+	size_t seq = 0;
+	ssize_t ret;
+
+	ret = pthread_create(&thread, NULL, race_writer, cq);
+	check(!ret, "pthread_create failed: %zd", ret);
+	if (ret)
+		return;
+
+	while (seq < RACE_CNT && !failed) {
+		ret = read_seq(cq_fid, CQ_SIZE, &seq);
+		if (ret == -FI_EAVAIL) {
+			check(seq % RACE_ERR_EVERY == RACE_ERR_EVERY - 1,
+			      "error reported at %zu", seq);
+			read_err(cq_fid, &seq);
+		} else if (ret == -FI_EAGAIN) {
+			sched_yield();
+		} else {
+			check(ret > 0, "fi_cq_read returned %zd", ret);
+		}
+	}
+	pthread_join(thread, NULL);
+	check(seq == RACE_CNT, "read %zu of %d", seq, RACE_CNT);
+}
+
+static struct fid_cq *open_cq(struct fid_domain *domain)
+{
+	struct fi_cq_attr cq_attr = {
+		.size = CQ_SIZE,
+		.format = FI_CQ_FORMAT_CONTEXT,
+	};
+	struct fid_cq *cq;
+	int ret;
+
+	ret = fi_cq_open(domain, &cq_attr, &cq, NULL);
+	check(!ret, "fi_cq_open failed: %s", fi_strerror(-ret));
+	return ret ? NULL : cq;
+}
+
+int main(int argc, char **argv)
+{
+	struct fi_info *hints, *info = NULL;
+	struct fid_fabric *fabric = NULL;
+	struct fid_domain *domain = NULL;
+	struct fid_cq *cq;
+	int ret;
+
+	setenv("FI_TCP_PROGRESS_THREADS", "1", 1);
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+	hints->fabric_attr->prov_name = strdup("tcp");
+	hints->ep_attr->type = FI_EP_MSG;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = fi_getinfo(fi_version(), NULL, NULL, 0, hints, &info);
+	fi_freeinfo(hints);
+	if (ret) {
+		printf("tcp: not available (%s), skipped\n", fi_strerror(-ret));
+		return TEST_SKIP;
+	}
+
+	ret = fi_fabric(info->fabric_attr, &fabric, NULL);
+	if (!ret)
+		ret = fi_domain(fabric, info, &domain, NULL);
+	check(!ret, "unable to open domain: %s", fi_strerror(-ret));
+	if (ret)
+		goto out;
+
+	cq = open_cq(domain);
+	if (!cq)
+		goto out;
+	if (!container_of(cq, struct util_cq, cq_fid)->spsc) {
+		printf("tcp: cq is not lockless, skipped\n");
+		fi_close(&cq->fid);
+		ret = TEST_SKIP;
+		goto out;
+	}
+	test_overflow(cq);
+	test_error(cq);
+	fi_close(&cq->fid);
+
+	cq = open_cq(domain);
+	if (!cq)
+		goto out;
+	test_race(cq);
+	fi_close(&cq->fid);
+
+	printf("tcp spsc cq: %s\n", failed ? "FAIL" : "PASS");
+out:
+	if (domain)
+		fi_close(&domain->fid);
+	if (fabric)
+		fi_close(&fabric->fid);
+	fi_freeinfo(info);
+	if (ret == TEST_SKIP)
+		return TEST_SKIP;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
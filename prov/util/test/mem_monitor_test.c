@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2026 The libfabric contributors. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks that the memhooks and userfaultfd monitors report memory that
+ * is unmapped, released with madvise or moved with mremap, and only
+ * for the subscribed pages.  A monitor that is not available on this
+ * system is skipped; the test is skipped if neither is.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <ofi.h>
+#include <ofi_mr.h>
+
+#define TEST_SKIP	77
+#define EVENT_WAIT_MS	1000
+
+static size_t page_size;
+static int failed;
+
+#define check(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+			failed = 1;				\
+		}						\
+	} while (0)
+
+/* userfaultfd events are delivered by the monitor thread */
+static struct ofi_subscription *
+wait_event(struct ofi_notification_queue *nq, int wait_ms)
+{
+	struct ofi_subscription *subscription;
+	uint64_t end = fi_gettime_ms() + wait_ms;
+
+	do {
+		subscription = ofi_monitor_get_event(nq);
+		if (subscription)
+			return subscription;
+		sched_yield();
+	} while (fi_gettime_ms() < end);
+
+	return NULL;
+}
+
+static char *map_pages(size_t cnt)
+{
+	char *buf;
+
+	buf = mmap(NULL, cnt * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	memset(buf, 0xa5, cnt * page_size);
+	return buf;
+}
+
+static void test_munmap(struct ofi_notification_queue *nq)
+{
+	struct ofi_subscription sub;
+	char *buf;
+	int ret;
+
+	buf = map_pages(4);
+	check(buf, "mmap failed");
+	if (!buf)
+		return;
+
+	ret = ofi_monitor_subscribe(nq, buf + page_size, page_size, &sub);
+	check(!ret, "subscribe failed: %d", ret);
+	if (ret)
+		goto out;
+
+	munmap(buf, page_size);
+	check(!wait_event(nq, 100), "event for an unsubscribed page");
+
+	munmap(buf + page_size, page_size);
+	check(wait_event(nq, EVENT_WAIT_MS) == &sub, "no unmap event");
+	ofi_monitor_unsubscribe(&sub);
+out:
+	munmap(buf, 4 * page_size);
+}
+
+static void test_madvise(struct ofi_notification_queue *nq)
+{
+	struct ofi_subscription sub;
+	char *buf;
+	int ret;
+
+	buf = map_pages(2);
+	check(buf, "mmap failed");
+	if (!buf)
+		return;
+
+	ret = ofi_monitor_subscribe(nq, buf, 2 * page_size, &sub);
+	check(!ret, "subscribe failed: %d", ret);
+	if (ret)
+		goto out;
+
+	madvise(buf + page_size, page_size, MADV_DONTNEED);
+	check(wait_event(nq, EVENT_WAIT_MS) == &sub, "no madvise event");
+
+	/* released pages read back as zero, as without a monitor */
+	check(buf[page_size] == 0, "released page not zeroed");
+	check(buf[0] == (char) 0xa5, "kept page changed");
+	ofi_monitor_unsubscribe(&sub);
+out:
+	munmap(buf, 2 * page_size);
+}
+
+static void test_mremap(struct ofi_notification_queue *nq)
+{
+	struct ofi_subscription sub;
+	char *buf, *target, *moved;
+	int ret;
+
+	buf = map_pages(2);
+	target = map_pages(2);
+	check(buf && target, "mmap failed");
+	if (!buf || !target)
+		goto out;
+
+	ret = ofi_monitor_subscribe(nq, buf, 2 * page_size, &sub);
+	check(!ret, "subscribe failed: %d", ret);
+	if (ret)
+		goto out;
+
+	moved = mremap(buf, 2 * page_size, 2 * page_size,
+		       MREMAP_MAYMOVE | MREMAP_FIXED, target);
+	check(moved == target, "mremap failed");
+	check(wait_event(nq, EVENT_WAIT_MS) == &sub, "no remap event");
+	ofi_monitor_unsubscribe(&sub);
+	if (moved == target)
+		buf = NULL;
+out:
+	if (buf)
+		munmap(buf, 2 * page_size);
+	if (target)
+		munmap(target, 2 * page_size);
+}
+
+static int run(const char *name, struct ofi_mem_monitor *monitor)
+{
+	struct ofi_notification_queue nq;
+	int ret;
+
+	if (!monitor) {
+		printf("%s: not available, skipped\n", name);
+		return 0;
+	}
+
+	ret = ofi_monitor_add_queue(monitor, &nq);
+	if (ret) {
+		printf("%s: unable to start (%s), skipped\n", name,
+		       fi_strerror(-ret));
+		return 0;
+	}
+
+	failed = 0;
+	test_munmap(&nq);
+	test_madvise(&nq);
+	test_mremap(&nq);
+	ofi_monitor_del_queue(&nq);
+
+	printf("%s: %s\n", name, failed ? "FAIL" : "PASS");
+	return failed ? -1 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct fi_info *info = NULL;
+	int ret, tested = 0, errors = 0;
+
+	/* memhooks is only set up when requested */
+	setenv("FI_MR_CACHE_MONITOR", "memhooks", 1);
+	(void) fi_getinfo(fi_version(), NULL, NULL, 0, NULL, &info);
+	fi_freeinfo(info);
+
+	page_size = ofi_sysconf(_SC_PAGESIZE);
+
+	ret = run("memhooks", memhooks_monitor);
+	tested += ret > 0;
+	errors += ret < 0;
+
+	ret = run("userfaultfd", uffd_monitor);
+	tested += ret > 0;
+	errors += ret < 0;
+
+	if (errors)
+		return EXIT_FAILURE;
+	return tested ? EXIT_SUCCESS : TEST_SKIP;
+}
@@ -77,6 +77,8 @@ struct fi_provider core_prov = {
 struct ofi_common_locks common_locks = {
 	.ini_lock = PTHREAD_MUTEX_INITIALIZER,
 	.util_fabric_lock = PTHREAD_MUTEX_INITIALIZER,
+	.util_buf_bg_lock = PTHREAD_MUTEX_INITIALIZER,
+	.monitor_lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
 int fi_poll_fd(int fd, int timeout)
@@ -973,7 +975,7 @@ void ofi_insert_loopback_addr(struct fi_provider *prov, struct slist *addr_list)
 		return;
 
 	addr_entry->ipaddr.sin.sin_family = AF_INET;
-	addr_entry->ipaddr.sin.sin_addr.s_addr = INADDR_LOOPBACK;
+	addr_entry->ipaddr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 	ofi_straddr_log(prov, FI_LOG_INFO, FI_LOG_CORE,
 			"available addr: ", &addr_entry->ipaddr);
 
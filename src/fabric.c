@@ -448,6 +448,7 @@ void fi_ini(void)
 	ofi_pmem_init();
 	ofi_perf_init();
 	ofi_hook_init();
+	ofi_monitors_init();
 
 	fi_param_define(NULL, "provider", FI_PARAM_STRING,
 			"Only use specified provider (default: all available)");
@@ -456,6 +457,18 @@ void fi_ini(void)
 			" (default: no). Setting this to yes could improve"
 			" performance at the expense of making fork() potentially"
 			" unsafe");
+	fi_param_define(NULL, "buf_pool_bg_grow", FI_PARAM_BOOL,
+			"Allow providers to allocate and register the next"
+			" region of their internal buffer pools in a background"
+			" thread (default: no)");
+	fi_param_define(NULL, "mr_cache_max_count", FI_PARAM_SIZE_T,
+			"Maximum number of memory registrations cached by"
+			" providers that use the common registration path."
+			" 0 disables caching (default: 0)");
+	fi_param_define(NULL, "mr_cache_max_size", FI_PARAM_SIZE_T,
+			"Maximum total size of the memory registrations cached"
+			" by providers that use the common registration path"
+			" (default: no limit)");
 	fi_param_define(NULL, "universe_size", FI_PARAM_SIZE_T,
 			"Defines the maximum number of processes that will be"
 			" used by distribute OFI application. The provider uses"
@@ -538,6 +551,8 @@ FI_DESTRUCTOR(fi_fini(void))
 	}
 
 	ofi_free_filter(&prov_filter);
+	util_buf_bg_cleanup();
+	ofi_monitors_cleanup();
 	fi_log_fini();
 	fi_param_fini();
 	ofi_osd_fini();
@@ -202,6 +202,8 @@ static BOOL CALLBACK ofi_init_once_cb(PINIT_ONCE once, void* data, void** ctx)
 
 	InitializeCriticalSection(&locks->ini_lock);
 	InitializeCriticalSection(&locks->util_fabric_lock);
+	InitializeCriticalSection(&locks->util_buf_bg_lock);
+	InitializeCriticalSection(&locks->monitor_lock);
 
 	return TRUE;
 }